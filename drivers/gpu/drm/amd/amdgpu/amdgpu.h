@@ -122,6 +122,7 @@ extern int amdgpu_disp_priority;
 extern int amdgpu_hw_i2c;
 extern int amdgpu_pcie_gen2;
 extern int amdgpu_msi;
+extern int amdgpu_ih_budget;
 extern int amdgpu_dpm;
 extern int amdgpu_fw_load_type;
 extern int amdgpu_aspm;
@@ -183,6 +184,8 @@ extern int amdgpu_cik_support;
 #define AMDGPU_FENCE_JIFFIES_TIMEOUT		(HZ / 2)
 /* AMDGPU_IB_POOL_SIZE must be a power of 2 */
 #define AMDGPU_IB_POOL_SIZE			16
+/* number of independent IB suballocation arenas, selected by CPU */
+#define AMDGPU_IB_POOL_ARENAS			4
 #define AMDGPU_DEBUGFS_MAX_COMPONENTS		32
 #define AMDGPUFB_CONN_LIMIT			4
 #define AMDGPU_BIOS_NUM_SCRATCH			16
@@ -361,6 +364,12 @@ struct amdgpu_sa_manager {
 	void			*cpu_ptr;
 	uint32_t		domain;
 	uint32_t		align;
+
+	/* statistics, protected by wq.lock */
+	uint64_t		num_allocs;
+	uint64_t		num_waits;
+	uint64_t		wait_ns;
+	uint64_t		max_wait_ns;
 };
 
 /* sub-allocation buffer */
@@ -518,7 +527,48 @@ void amdgpu_device_wb_free(struct amdgpu_device *adev, u32 wb);
 /*
  * Benchmarking
  */
+#define AMDGPU_BENCHMARK_MAX_RESULTS	64
+
+enum amdgpu_benchmark_engine {
+	AMDGPU_BENCHMARK_ENGINE_DMA,	/* buffer_funcs ring (SDMA) */
+	AMDGPU_BENCHMARK_ENGINE_CPU,	/* CPU through kernel mappings */
+	AMDGPU_BENCHMARK_ENGINE_SW,	/* CPU on system memory, no GPU */
+};
+
+struct amdgpu_benchmark_params {
+	int				test;
+	enum amdgpu_benchmark_engine	engine;
+	unsigned			iterations;
+	unsigned			depth;
+	unsigned			size;	/* 0: use the test's sizes */
+};
+
+struct amdgpu_benchmark_result {
+	const char			*kind;
+	enum amdgpu_benchmark_engine	engine;
+	unsigned			sdomain;
+	unsigned			ddomain;
+	unsigned			size;
+	unsigned			iterations;
+	unsigned			depth;
+	u64				total_ns;
+	u64				p50_ns;
+	u64				p90_ns;
+	u64				p99_ns;
+	u64				max_ns;
+};
+
+struct amdgpu_benchmark {
+	struct mutex			run_lock;	/* serializes runs */
+	struct mutex			lock;		/* protects results */
+	unsigned			num_results;
+	struct amdgpu_benchmark_result	results[AMDGPU_BENCHMARK_MAX_RESULTS];
+};
+
 void amdgpu_benchmark(struct amdgpu_device *adev, int test_number);
+int amdgpu_benchmark_run(struct amdgpu_device *adev,
+			 const struct amdgpu_benchmark_params *params);
+int amdgpu_debugfs_benchmark_init(struct amdgpu_device *adev);
 
 
 /*
@@ -909,7 +959,10 @@ struct amdgpu_device {
 	unsigned			num_rings;
 	struct amdgpu_ring		*rings[AMDGPU_MAX_RINGS];
 	bool				ib_pool_ready;
-	struct amdgpu_sa_manager	ring_tmp_bo;
+	struct amdgpu_sa_manager	ring_tmp_bo[AMDGPU_IB_POOL_ARENAS];
+
+	/* results of the last debugfs triggered benchmark run */
+	struct amdgpu_benchmark		benchmark;
 
 	/* interrupts */
 	struct amdgpu_irq		irq;
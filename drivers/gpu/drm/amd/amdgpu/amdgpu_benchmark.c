@@ -22,146 +22,336 @@
  * Authors: Jerome Glisse
  */
 
+#include <linux/debugfs.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
+
 #include <drm/amdgpu_drm.h>
 #include "amdgpu.h"
 
 #define AMDGPU_BENCHMARK_ITERATIONS 1024
 #define AMDGPU_BENCHMARK_COMMON_MODES_N 17
+#define AMDGPU_BENCHMARK_MAX_DEPTH 64
+#define AMDGPU_BENCHMARK_NUM_TESTS 10
+
+struct amdgpu_benchmark_bo {
+	struct amdgpu_bo	*bo;
+	uint64_t		addr;
+	void			*ptr;
+};
+
+static const char *amdgpu_benchmark_engine_name(enum amdgpu_benchmark_engine engine)
+{
+	switch (engine) {
+	case AMDGPU_BENCHMARK_ENGINE_DMA:
+		return "dma";
+	case AMDGPU_BENCHMARK_ENGINE_CPU:
+		return "cpu";
+	case AMDGPU_BENCHMARK_ENGINE_SW:
+		return "sw";
+	}
+	return "unknown";
+}
+
+static const char *amdgpu_benchmark_domain_name(unsigned domain)
+{
+	switch (domain) {
+	case AMDGPU_GEM_DOMAIN_CPU:
+		return "system";
+	case AMDGPU_GEM_DOMAIN_GTT:
+		return "gtt";
+	case AMDGPU_GEM_DOMAIN_VRAM:
+		return "vram";
+	}
+	return "none";
+}
 
-static int amdgpu_benchmark_do_move(struct amdgpu_device *adev, unsigned size,
-				    uint64_t saddr, uint64_t daddr, int n)
+static int amdgpu_benchmark_cmp_u64(const void *a, const void *b)
 {
-	unsigned long start_jiffies;
-	unsigned long end_jiffies;
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Submit @depth operations back to back and wait for the last one, so that
+ * each sample measures the latency of a batch of @depth queued operations.
+ */
+static int amdgpu_benchmark_dma_batch(struct amdgpu_device *adev,
+				      struct amdgpu_benchmark_bo *sobj,
+				      struct amdgpu_benchmark_bo *dobj,
+				      unsigned size, unsigned depth)
+{
+	struct amdgpu_ring *ring = adev->mman.buffer_funcs_ring;
 	struct dma_fence *fence = NULL;
-	int i, r;
+	int i, r = 0;
 
-	start_jiffies = jiffies;
-	for (i = 0; i < n; i++) {
-		struct amdgpu_ring *ring = adev->mman.buffer_funcs_ring;
-		r = amdgpu_copy_buffer(ring, saddr, daddr, size, NULL, &fence,
-				       false, false);
-		if (r)
-			goto exit_do_move;
-		r = dma_fence_wait(fence, false);
-		if (r)
-			goto exit_do_move;
+	for (i = 0; i < depth; i++) {
 		dma_fence_put(fence);
+		fence = NULL;
+		if (sobj)
+			r = amdgpu_copy_buffer(ring, sobj->addr, dobj->addr,
+					       size, NULL, &fence, false,
+					       false);
+		else
+			r = amdgpu_fill_buffer(dobj->bo, 0, NULL, &fence);
+		if (r)
+			goto out;
 	}
-	end_jiffies = jiffies;
-	r = jiffies_to_msecs(end_jiffies - start_jiffies);
+	r = dma_fence_wait(fence, false);
 
-exit_do_move:
-	if (fence)
-		dma_fence_put(fence);
+out:
+	dma_fence_put(fence);
 	return r;
 }
 
+static void amdgpu_benchmark_cpu_batch(struct amdgpu_benchmark_bo *sobj,
+				       struct amdgpu_benchmark_bo *dobj,
+				       unsigned size, unsigned depth)
+{
+	int i;
+
+	for (i = 0; i < depth; i++) {
+		if (sobj)
+			memcpy(dobj->ptr, sobj->ptr, size);
+		else
+			memset(dobj->ptr, 0, size);
+	}
+	mb();
+}
+
+static int amdgpu_benchmark_do_move(struct amdgpu_device *adev,
+				    struct amdgpu_benchmark_bo *sobj,
+				    struct amdgpu_benchmark_bo *dobj,
+				    unsigned size,
+				    struct amdgpu_benchmark_result *res)
+{
+	unsigned n = DIV_ROUND_UP(res->iterations, res->depth);
+	u64 start, end, *samples;
+	int i, r = 0;
+
+	samples = kmalloc_array(n, sizeof(*samples), GFP_KERNEL);
+	if (!samples)
+		return -ENOMEM;
+
+	start = ktime_get_ns();
+	for (i = 0; i < n; i++) {
+		u64 t = ktime_get_ns();
+
+		if (res->engine != AMDGPU_BENCHMARK_ENGINE_DMA) {
+			amdgpu_benchmark_cpu_batch(sobj, dobj, size,
+						   res->depth);
+		} else {
+			r = amdgpu_benchmark_dma_batch(adev, sobj, dobj, size,
+						       res->depth);
+			if (r)
+				goto out;
+		}
+		samples[i] = ktime_get_ns() - t;
+	}
+	end = ktime_get_ns();
+
+	sort(samples, n, sizeof(*samples), amdgpu_benchmark_cmp_u64, NULL);
+	res->iterations = n * res->depth;
+	res->total_ns = end - start;
+	res->p50_ns = samples[n / 2];
+	res->p90_ns = samples[(n * 90) / 100];
+	res->p99_ns = samples[(n * 99) / 100];
+	res->max_ns = samples[n - 1];
+
+out:
+	kfree(samples);
+	return r;
+}
 
-static void amdgpu_benchmark_log_results(int n, unsigned size,
-					 unsigned int time,
-					 unsigned sdomain, unsigned ddomain,
-					 char *kind)
+static void amdgpu_benchmark_log_results(const struct amdgpu_benchmark_result *res)
 {
-	unsigned int throughput = (n * (size >> 10)) / time;
-	DRM_INFO("amdgpu: %s %u bo moves of %u kB from"
-		 " %d to %d in %u ms, throughput: %u Mb/s or %u MB/s\n",
-		 kind, n, size >> 10, sdomain, ddomain, time,
-		 throughput * 8, throughput);
+	u64 throughput = 0;
+
+	if (res->total_ns)
+		throughput = div64_u64((u64)res->iterations * res->size *
+				       (NSEC_PER_SEC / 1024),
+				       res->total_ns) >> 10;
+	DRM_INFO("amdgpu: %s %s %u ops of %u kB from"
+		 " %d to %d (depth %u) in %llu us, throughput: %llu MB/s,"
+		 " latency p50 %llu us p99 %llu us\n",
+		 amdgpu_benchmark_engine_name(res->engine), res->kind,
+		 res->iterations, res->size >> 10, res->sdomain, res->ddomain,
+		 res->depth, div_u64(res->total_ns, NSEC_PER_USEC), throughput,
+		 div_u64(res->p50_ns, NSEC_PER_USEC),
+		 div_u64(res->p99_ns, NSEC_PER_USEC));
 }
 
-static void amdgpu_benchmark_move(struct amdgpu_device *adev, unsigned size,
-				  unsigned sdomain, unsigned ddomain)
+static int amdgpu_benchmark_bo_create(struct amdgpu_device *adev,
+				      unsigned size, unsigned domain,
+				      bool cpu_access,
+				      struct amdgpu_benchmark_bo *obj)
 {
-	struct amdgpu_bo *dobj = NULL;
-	struct amdgpu_bo *sobj = NULL;
 	struct amdgpu_bo_param bp;
-	uint64_t saddr, daddr;
-	int r, n;
-	int time;
+	int r;
 
 	memset(&bp, 0, sizeof(bp));
 	bp.size = size;
 	bp.byte_align = PAGE_SIZE;
-	bp.domain = sdomain;
-	bp.flags = 0;
+	bp.domain = domain;
+	bp.flags = cpu_access ? AMDGPU_GEM_CREATE_CPU_ACCESS_REQUIRED : 0;
 	bp.type = ttm_bo_type_kernel;
 	bp.resv = NULL;
-	n = AMDGPU_BENCHMARK_ITERATIONS;
-	r = amdgpu_bo_create(adev, &bp, &sobj);
-	if (r) {
-		goto out_cleanup;
-	}
-	r = amdgpu_bo_reserve(sobj, false);
+	r = amdgpu_bo_create(adev, &bp, &obj->bo);
+	if (r)
+		return r;
+	r = amdgpu_bo_reserve(obj->bo, false);
 	if (unlikely(r != 0))
-		goto out_cleanup;
-	r = amdgpu_bo_pin(sobj, sdomain);
+		return r;
+	r = amdgpu_bo_pin(obj->bo, domain);
 	if (r) {
-		amdgpu_bo_unreserve(sobj);
-		goto out_cleanup;
+		amdgpu_bo_unreserve(obj->bo);
+		return r;
 	}
-	r = amdgpu_ttm_alloc_gart(&sobj->tbo);
-	amdgpu_bo_unreserve(sobj);
-	if (r) {
-		goto out_cleanup;
+	r = amdgpu_ttm_alloc_gart(&obj->bo->tbo);
+	if (!r && cpu_access)
+		r = amdgpu_bo_kmap(obj->bo, &obj->ptr);
+	amdgpu_bo_unreserve(obj->bo);
+	if (r)
+		return r;
+	obj->addr = amdgpu_bo_gpu_offset(obj->bo);
+	return 0;
+}
+
+/*
+ * The software backend only touches system memory, so the harness can be
+ * exercised on a device whose GPU never came up.
+ */
+static int amdgpu_benchmark_sw_create(unsigned size,
+				      struct amdgpu_benchmark_bo *obj)
+{
+	obj->ptr = kvmalloc(size, GFP_KERNEL);
+	if (!obj->ptr)
+		return -ENOMEM;
+	return 0;
+}
+
+static void amdgpu_benchmark_bo_destroy(struct amdgpu_benchmark_bo *obj)
+{
+	int r;
+
+	if (!obj->bo) {
+		kvfree(obj->ptr);
+		return;
 	}
-	saddr = amdgpu_bo_gpu_offset(sobj);
-	bp.domain = ddomain;
-	r = amdgpu_bo_create(adev, &bp, &dobj);
-	if (r) {
-		goto out_cleanup;
+
+	r = amdgpu_bo_reserve(obj->bo, true);
+	if (likely(r == 0)) {
+		if (obj->ptr)
+			amdgpu_bo_kunmap(obj->bo);
+		amdgpu_bo_unpin(obj->bo);
+		amdgpu_bo_unreserve(obj->bo);
 	}
-	r = amdgpu_bo_reserve(dobj, false);
-	if (unlikely(r != 0))
-		goto out_cleanup;
-	r = amdgpu_bo_pin(dobj, ddomain);
-	if (r) {
-		amdgpu_bo_unreserve(sobj);
-		goto out_cleanup;
+	amdgpu_bo_unref(&obj->bo);
+}
+
+static void amdgpu_benchmark_record(struct amdgpu_device *adev,
+				    const struct amdgpu_benchmark_result *res)
+{
+	struct amdgpu_benchmark *bench = &adev->benchmark;
+
+	mutex_lock(&bench->lock);
+	if (bench->num_results < AMDGPU_BENCHMARK_MAX_RESULTS)
+		bench->results[bench->num_results++] = *res;
+	mutex_unlock(&bench->lock);
+}
+
+static int amdgpu_benchmark_obj_create(struct amdgpu_device *adev,
+				       unsigned size, unsigned domain,
+				       enum amdgpu_benchmark_engine engine,
+				       struct amdgpu_benchmark_bo *obj)
+{
+	switch (engine) {
+	case AMDGPU_BENCHMARK_ENGINE_DMA:
+		return amdgpu_benchmark_bo_create(adev, size, domain, false,
+						  obj);
+	case AMDGPU_BENCHMARK_ENGINE_CPU:
+		/*
+		 * This engine measures CPU access to GTT and VRAM, so it
+		 * needs pinned and mapped BOs, but never the ring.
+		 */
+		return amdgpu_benchmark_bo_create(adev, size, domain, true,
+						  obj);
+	case AMDGPU_BENCHMARK_ENGINE_SW:
+		return amdgpu_benchmark_sw_create(size, obj);
 	}
-	r = amdgpu_ttm_alloc_gart(&dobj->tbo);
-	amdgpu_bo_unreserve(dobj);
-	if (r) {
-		goto out_cleanup;
+	return -EINVAL;
+}
+
+/*
+ * Move (or fill, when @sdomain is 0) a buffer of @size bytes using the
+ * engine selected in @params and log the results.
+ */
+static int amdgpu_benchmark_move(struct amdgpu_device *adev, unsigned size,
+				 unsigned sdomain, unsigned ddomain,
+				 const struct amdgpu_benchmark_params *params)
+{
+	bool dma = params->engine == AMDGPU_BENCHMARK_ENGINE_DMA;
+	struct amdgpu_benchmark_bo sobj = {}, dobj = {};
+	struct amdgpu_benchmark_result res = {};
+	int r;
+
+	if (dma && !adev->mman.buffer_funcs)
+		return -ENODEV;
+
+	if (params->engine == AMDGPU_BENCHMARK_ENGINE_SW) {
+		if (sdomain)
+			sdomain = AMDGPU_GEM_DOMAIN_CPU;
+		ddomain = AMDGPU_GEM_DOMAIN_CPU;
 	}
-	daddr = amdgpu_bo_gpu_offset(dobj);
 
-	if (adev->mman.buffer_funcs) {
-		time = amdgpu_benchmark_do_move(adev, size, saddr, daddr, n);
-		if (time < 0)
+	res.kind = sdomain ? "copy" : "fill";
+	res.engine = params->engine;
+	res.sdomain = sdomain;
+	res.ddomain = ddomain;
+	res.size = size;
+	res.iterations = params->iterations;
+	res.depth = dma ? params->depth : 1;
+
+	if (sdomain) {
+		r = amdgpu_benchmark_obj_create(adev, size, sdomain,
+						params->engine, &sobj);
+		if (r)
 			goto out_cleanup;
-		if (time > 0)
-			amdgpu_benchmark_log_results(n, size, time,
-						     sdomain, ddomain, "dma");
 	}
+	r = amdgpu_benchmark_obj_create(adev, size, ddomain, params->engine,
+					&dobj);
+	if (r)
+		goto out_cleanup;
+
+	r = amdgpu_benchmark_do_move(adev, sdomain ? &sobj : NULL, &dobj,
+				     size, &res);
+	if (r)
+		goto out_cleanup;
+
+	amdgpu_benchmark_log_results(&res);
+	amdgpu_benchmark_record(adev, &res);
 
 out_cleanup:
 	/* Check error value now. The value can be overwritten when clean up.*/
 	if (r) {
-		DRM_ERROR("Error while benchmarking BO move.\n");
+		DRM_ERROR("Error while benchmarking BO move of %u bytes (%d).\n",
+			  size, r);
 	}
 
-	if (sobj) {
-		r = amdgpu_bo_reserve(sobj, true);
-		if (likely(r == 0)) {
-			amdgpu_bo_unpin(sobj);
-			amdgpu_bo_unreserve(sobj);
-		}
-		amdgpu_bo_unref(&sobj);
-	}
-	if (dobj) {
-		r = amdgpu_bo_reserve(dobj, true);
-		if (likely(r == 0)) {
-			amdgpu_bo_unpin(dobj);
-			amdgpu_bo_unreserve(dobj);
-		}
-		amdgpu_bo_unref(&dobj);
-	}
+	amdgpu_benchmark_bo_destroy(&sobj);
+	amdgpu_benchmark_bo_destroy(&dobj);
+	return r;
 }
 
-void amdgpu_benchmark(struct amdgpu_device *adev, int test_number)
+/*
+ * A failing size is logged and skipped so that the rest of the sweep still
+ * runs; the first error is returned once the test is done.
+ */
+static int amdgpu_benchmark_test(struct amdgpu_device *adev,
+				 const struct amdgpu_benchmark_params *params)
 {
-	int i;
+	int i, r, ret = 0;
 	static const int common_modes[AMDGPU_BENCHMARK_COMMON_MODES_N] = {
 		640 * 480 * 4,
 		720 * 480 * 4,
@@ -181,64 +371,241 @@ void amdgpu_benchmark(struct amdgpu_device *adev, int test_number)
 		1920 * 1080 * 4,
 		1920 * 1200 * 4
 	};
+	static const struct {
+		unsigned sdomain;
+		unsigned ddomain;
+	} dirs[] = {
+		[1] = { AMDGPU_GEM_DOMAIN_GTT, AMDGPU_GEM_DOMAIN_VRAM },
+		[2] = { AMDGPU_GEM_DOMAIN_VRAM, AMDGPU_GEM_DOMAIN_VRAM },
+		[3] = { AMDGPU_GEM_DOMAIN_GTT, AMDGPU_GEM_DOMAIN_VRAM },
+		[4] = { AMDGPU_GEM_DOMAIN_VRAM, AMDGPU_GEM_DOMAIN_GTT },
+		[5] = { AMDGPU_GEM_DOMAIN_VRAM, AMDGPU_GEM_DOMAIN_VRAM },
+		[6] = { AMDGPU_GEM_DOMAIN_GTT, AMDGPU_GEM_DOMAIN_VRAM },
+		[7] = { AMDGPU_GEM_DOMAIN_VRAM, AMDGPU_GEM_DOMAIN_GTT },
+		[8] = { AMDGPU_GEM_DOMAIN_VRAM, AMDGPU_GEM_DOMAIN_VRAM },
+		[9] = { 0, AMDGPU_GEM_DOMAIN_VRAM },
+		[10] = { 0, AMDGPU_GEM_DOMAIN_GTT },
+	};
+	unsigned sdomain = dirs[params->test].sdomain;
+	unsigned ddomain = dirs[params->test].ddomain;
+	unsigned size = params->size;
 
-	switch (test_number) {
+	switch (params->test) {
 	case 1:
-		/* simple test, VRAM to GTT and GTT to VRAM */
-		amdgpu_benchmark_move(adev, 1024*1024, AMDGPU_GEM_DOMAIN_GTT,
-				      AMDGPU_GEM_DOMAIN_VRAM);
-		amdgpu_benchmark_move(adev, 1024*1024, AMDGPU_GEM_DOMAIN_VRAM,
-				      AMDGPU_GEM_DOMAIN_GTT);
-		break;
+		/* simple test, GTT to VRAM and VRAM to GTT */
+		if (!size)
+			size = 1024 * 1024;
+		ret = amdgpu_benchmark_move(adev, size, sdomain, ddomain,
+					    params);
+		r = amdgpu_benchmark_move(adev, size, ddomain, sdomain,
+					  params);
+		return ret ? ret : r;
 	case 2:
 		/* simple test, VRAM to VRAM */
-		amdgpu_benchmark_move(adev, 1024*1024, AMDGPU_GEM_DOMAIN_VRAM,
-				      AMDGPU_GEM_DOMAIN_VRAM);
-		break;
+		if (!size)
+			size = 1024 * 1024;
+		return amdgpu_benchmark_move(adev, size, sdomain, ddomain,
+					     params);
 	case 3:
 		/* GTT to VRAM, buffer size sweep, powers of 2 */
-		for (i = 1; i <= 16384; i <<= 1)
-			amdgpu_benchmark_move(adev, i * AMDGPU_GPU_PAGE_SIZE,
-					      AMDGPU_GEM_DOMAIN_GTT,
-					      AMDGPU_GEM_DOMAIN_VRAM);
-		break;
 	case 4:
 		/* VRAM to GTT, buffer size sweep, powers of 2 */
-		for (i = 1; i <= 16384; i <<= 1)
-			amdgpu_benchmark_move(adev, i * AMDGPU_GPU_PAGE_SIZE,
-					      AMDGPU_GEM_DOMAIN_VRAM,
-					      AMDGPU_GEM_DOMAIN_GTT);
-		break;
 	case 5:
 		/* VRAM to VRAM, buffer size sweep, powers of 2 */
-		for (i = 1; i <= 16384; i <<= 1)
-			amdgpu_benchmark_move(adev, i * AMDGPU_GPU_PAGE_SIZE,
-					      AMDGPU_GEM_DOMAIN_VRAM,
-					      AMDGPU_GEM_DOMAIN_VRAM);
-		break;
+	case 9:
+		/* VRAM fill, buffer size sweep, powers of 2 */
+	case 10:
+		/* GTT fill, buffer size sweep, powers of 2 */
+		if (size)
+			return amdgpu_benchmark_move(adev, size, sdomain,
+						     ddomain, params);
+		for (i = 1; i <= 16384; i <<= 1) {
+			r = amdgpu_benchmark_move(adev,
+						  i * AMDGPU_GPU_PAGE_SIZE,
+						  sdomain, ddomain, params);
+			if (r && !ret)
+				ret = r;
+		}
+		return ret;
 	case 6:
 		/* GTT to VRAM, buffer size sweep, common modes */
-		for (i = 0; i < AMDGPU_BENCHMARK_COMMON_MODES_N; i++)
-			amdgpu_benchmark_move(adev, common_modes[i],
-					      AMDGPU_GEM_DOMAIN_GTT,
-					      AMDGPU_GEM_DOMAIN_VRAM);
-		break;
 	case 7:
 		/* VRAM to GTT, buffer size sweep, common modes */
-		for (i = 0; i < AMDGPU_BENCHMARK_COMMON_MODES_N; i++)
-			amdgpu_benchmark_move(adev, common_modes[i],
-					      AMDGPU_GEM_DOMAIN_VRAM,
-					      AMDGPU_GEM_DOMAIN_GTT);
-		break;
 	case 8:
 		/* VRAM to VRAM, buffer size sweep, common modes */
-		for (i = 0; i < AMDGPU_BENCHMARK_COMMON_MODES_N; i++)
-			amdgpu_benchmark_move(adev, common_modes[i],
-					      AMDGPU_GEM_DOMAIN_VRAM,
-					      AMDGPU_GEM_DOMAIN_VRAM);
-		break;
+		if (size)
+			return amdgpu_benchmark_move(adev, size, sdomain,
+						     ddomain, params);
+		for (i = 0; i < AMDGPU_BENCHMARK_COMMON_MODES_N; i++) {
+			r = amdgpu_benchmark_move(adev, common_modes[i],
+						  sdomain, ddomain, params);
+			if (r && !ret)
+				ret = r;
+		}
+		return ret;
+	}
+	return -EINVAL;
+}
+
+/*
+ * Run one test, replacing the results of the previous run. Runs are
+ * serialized so that concurrent writers don't interleave their results.
+ */
+int amdgpu_benchmark_run(struct amdgpu_device *adev,
+			 const struct amdgpu_benchmark_params *params)
+{
+	struct amdgpu_benchmark *bench = &adev->benchmark;
+	int r;
 
-	default:
+	if (params->test < 1 || params->test > AMDGPU_BENCHMARK_NUM_TESTS ||
+	    !params->iterations || !params->depth ||
+	    params->depth > AMDGPU_BENCHMARK_MAX_DEPTH) {
 		DRM_ERROR("Unknown benchmark\n");
+		return -EINVAL;
 	}
+
+	if (mutex_lock_interruptible(&bench->run_lock))
+		return -EINTR;
+
+	mutex_lock(&bench->lock);
+	bench->num_results = 0;
+	mutex_unlock(&bench->lock);
+
+	r = amdgpu_benchmark_test(adev, params);
+
+	mutex_unlock(&bench->run_lock);
+	return r;
+}
+
+void amdgpu_benchmark(struct amdgpu_device *adev, int test_number)
+{
+	struct amdgpu_benchmark_params params = {
+		.test = test_number,
+		.engine = AMDGPU_BENCHMARK_ENGINE_DMA,
+		.iterations = AMDGPU_BENCHMARK_ITERATIONS,
+		.depth = 1,
+		.size = 0,
+	};
+
+	amdgpu_benchmark_run(adev, &params);
+}
+
+/*
+ * Debugfs interface
+ *
+ * Writing "<test> [dma|cpu|sw] [iterations] [depth] [size]" to
+ * amdgpu_benchmark runs a benchmark; reading it returns the results
+ * collected by the last run as JSON. "sw" runs the same sequence on
+ * system memory without touching the GPU.
+ */
+#if defined(CONFIG_DEBUG_FS)
+
+static int amdgpu_debugfs_benchmark_show(struct seq_file *m, void *unused)
+{
+	struct amdgpu_device *adev = m->private;
+	struct amdgpu_benchmark *bench = &adev->benchmark;
+	unsigned i;
+
+	mutex_lock(&bench->lock);
+	seq_printf(m, "[");
+	for (i = 0; i < bench->num_results; i++) {
+		const struct amdgpu_benchmark_result *res = &bench->results[i];
+		u64 mbps = 0;
+
+		if (res->total_ns)
+			mbps = div64_u64((u64)res->iterations * res->size *
+					 (NSEC_PER_SEC / 1024),
+					 res->total_ns) >> 10;
+		seq_printf(m, "%s\n  {\"engine\": \"%s\", \"kind\": \"%s\", "
+			   "\"src\": \"%s\", \"dst\": \"%s\", \"size\": %u, "
+			   "\"iterations\": %u, \"depth\": %u, "
+			   "\"total_ns\": %llu, \"mbps\": %llu, "
+			   "\"p50_ns\": %llu, \"p90_ns\": %llu, "
+			   "\"p99_ns\": %llu, \"max_ns\": %llu}",
+			   i ? "," : "",
+			   amdgpu_benchmark_engine_name(res->engine),
+			   res->kind,
+			   amdgpu_benchmark_domain_name(res->sdomain),
+			   amdgpu_benchmark_domain_name(res->ddomain),
+			   res->size, res->iterations, res->depth,
+			   res->total_ns, mbps, res->p50_ns, res->p90_ns,
+			   res->p99_ns, res->max_ns);
+	}
+	seq_printf(m, "\n]\n");
+	mutex_unlock(&bench->lock);
+
+	return 0;
+}
+
+static int amdgpu_debugfs_benchmark_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, amdgpu_debugfs_benchmark_show, inode->i_private);
+}
+
+static ssize_t amdgpu_debugfs_benchmark_write(struct file *f,
+					      const char __user *buf,
+					      size_t size, loff_t *pos)
+{
+	struct amdgpu_device *adev = file_inode(f)->i_private;
+	struct amdgpu_benchmark_params params = {
+		.engine = AMDGPU_BENCHMARK_ENGINE_DMA,
+		.iterations = AMDGPU_BENCHMARK_ITERATIONS,
+		.depth = 1,
+		.size = 0,
+	};
+	char kbuf[64], engine[8] = "dma";
+	int r;
+
+	if (size >= sizeof(kbuf))
+		return -EINVAL;
+	if (copy_from_user(kbuf, buf, size))
+		return -EFAULT;
+	kbuf[size] = '\0';
+
+	r = sscanf(kbuf, "%d %7s %u %u %u", &params.test, engine,
+		   &params.iterations, &params.depth, &params.size);
+	if (r < 1)
+		return -EINVAL;
+
+	if (!strcmp(engine, "cpu"))
+		params.engine = AMDGPU_BENCHMARK_ENGINE_CPU;
+	else if (!strcmp(engine, "sw"))
+		params.engine = AMDGPU_BENCHMARK_ENGINE_SW;
+	else if (strcmp(engine, "dma"))
+		return -EINVAL;
+
+	if (params.engine == AMDGPU_BENCHMARK_ENGINE_DMA &&
+	    !adev->accel_working)
+		return -ENODEV;
+
+	r = amdgpu_benchmark_run(adev, &params);
+	if (r)
+		return r;
+
+	return size;
+}
+
+static const struct file_operations amdgpu_debugfs_benchmark_fops = {
+	.owner = THIS_MODULE,
+	.open = amdgpu_debugfs_benchmark_open,
+	.read = seq_read,
+	.write = amdgpu_debugfs_benchmark_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+#endif
+
+int amdgpu_debugfs_benchmark_init(struct amdgpu_device *adev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	struct dentry *ent;
+
+	ent = debugfs_create_file("amdgpu_benchmark", 0600,
+				  adev->ddev->primary->debugfs_root, adev,
+				  &amdgpu_debugfs_benchmark_fops);
+	if (!ent)
+		return -EIO;
+#endif
+	return 0;
 }
@@ -2640,6 +2640,8 @@ int amdgpu_device_init(struct amdgpu_device *adev,
 	mutex_init(&adev->gfx.gpu_clock_mutex);
 	mutex_init(&adev->srbm_mutex);
 	mutex_init(&adev->gfx.pipe_reserve_mutex);
+	mutex_init(&adev->benchmark.run_lock);
+	mutex_init(&adev->benchmark.lock);
 	mutex_init(&adev->gfx.gfx_off_mutex);
 	mutex_init(&adev->grbm_idx_mutex);
 	mutex_init(&adev->mn_lock);
@@ -2889,6 +2891,10 @@ fence_driver_init:
 	if (r)
 		DRM_ERROR("registering firmware debugfs failed (%d).\n", r);
 
+	r = amdgpu_debugfs_benchmark_init(adev);
+	if (r)
+		DRM_ERROR("registering benchmark debugfs failed (%d).\n", r);
+
 #if defined(CONFIG_DEBUG_FS)
 	r = amdgpu_debugfs_init(adev);
 	if (r)
@@ -254,17 +254,17 @@ static void amdgpu_dma_buf_map_detach(struct dma_buf *dma_buf,
 	struct amdgpu_device *adev = amdgpu_ttm_adev(bo->tbo.bdev);
 	int ret = 0;
 
+	/* Tear down the cached mappings while the pages are still pinned */
+	drm_gem_map_detach(dma_buf, attach);
+
 	ret = amdgpu_bo_reserve(bo, true);
 	if (unlikely(ret != 0))
-		goto error;
+		return;
 
 	amdgpu_bo_unpin(bo);
 	if (attach->dev->driver != adev->dev->driver && bo->prime_shared_count)
 		bo->prime_shared_count--;
 	amdgpu_bo_unreserve(bo);
-
-error:
-	drm_gem_map_detach(dma_buf, attach);
 }
 
 /**
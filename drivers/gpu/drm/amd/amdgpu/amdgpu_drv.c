@@ -107,6 +107,7 @@ int amdgpu_disp_priority = 0;
 int amdgpu_hw_i2c = 0;
 int amdgpu_pcie_gen2 = -1;
 int amdgpu_msi = -1;
+int amdgpu_ih_budget = 256;
 char amdgpu_lockup_timeout[AMDGPU_MAX_TIMEOUT_PARAM_LENTH];
 int amdgpu_dpm = -1;
 int amdgpu_fw_load_type = -1;
@@ -250,6 +251,14 @@ module_param_named(pcie_gen2, amdgpu_pcie_gen2, int, 0444);
 MODULE_PARM_DESC(msi, "MSI support (1 = enable, 0 = disable, -1 = auto)");
 module_param_named(msi, amdgpu_msi, int, 0444);
 
+/**
+ * DOC: ih_budget (int)
+ * Maximum number of IH ring entries processed in interrupt context before the
+ * rest is deferred to a work item. The default is 256, 0 means unlimited.
+ */
+MODULE_PARM_DESC(ih_budget, "IH entries processed per interrupt (0 = unlimited)");
+module_param_named(ih_budget, amdgpu_ih_budget, int, 0600);
+
 /**
  * DOC: lockup_timeout (string)
  * Set GPU scheduler timeout value in ms.
@@ -50,6 +50,23 @@
  */
 static int amdgpu_debugfs_sa_init(struct amdgpu_device *adev);
 
+/*
+ * The IB pool is split into several independent suballocators, each with
+ * its own lock and fence lists.  Submitters pick an arena based on the CPU
+ * they run on so that concurrent submissions don't serialize on a single
+ * lock.  The CPU is only a hint, so a preemptible caller reads it with
+ * raw_smp_processor_id().  An IB remembers its manager, so it is freed back
+ * to the arena it came from even if the submitter migrated in between.
+ *
+ * Every arena is as large as the old single pool, because the largest IB
+ * must still fit in one of them; the pinned GTT used by the pool therefore
+ * grows by AMDGPU_IB_POOL_ARENAS.
+ */
+static struct amdgpu_sa_manager *amdgpu_ib_pool_arena(struct amdgpu_device *adev)
+{
+	return &adev->ring_tmp_bo[raw_smp_processor_id() % AMDGPU_IB_POOL_ARENAS];
+}
+
 /**
  * amdgpu_ib_get - request an IB (Indirect Buffer)
  *
@@ -67,7 +84,7 @@ int amdgpu_ib_get(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 	int r;
 
 	if (size) {
-		r = amdgpu_sa_bo_new(&adev->ring_tmp_bo,
+		r = amdgpu_sa_bo_new(amdgpu_ib_pool_arena(adev),
 				      &ib->sa_bo, size, 256);
 		if (r) {
 			dev_err(adev->dev, "failed to get a new IB (%d)\n", r);
@@ -281,17 +298,22 @@ int amdgpu_ib_schedule(struct amdgpu_ring *ring, unsigned num_ibs,
  */
 int amdgpu_ib_pool_init(struct amdgpu_device *adev)
 {
-	int r;
+	int i, r;
 
 	if (adev->ib_pool_ready) {
 		return 0;
 	}
-	r = amdgpu_sa_bo_manager_init(adev, &adev->ring_tmp_bo,
-				      AMDGPU_IB_POOL_SIZE*64*1024,
-				      AMDGPU_GPU_PAGE_SIZE,
-				      AMDGPU_GEM_DOMAIN_GTT);
-	if (r) {
-		return r;
+	for (i = 0; i < AMDGPU_IB_POOL_ARENAS; i++) {
+		r = amdgpu_sa_bo_manager_init(adev, &adev->ring_tmp_bo[i],
+					      AMDGPU_IB_POOL_SIZE*64*1024,
+					      AMDGPU_GPU_PAGE_SIZE,
+					      AMDGPU_GEM_DOMAIN_GTT);
+		if (r) {
+			while (--i >= 0)
+				amdgpu_sa_bo_manager_fini(adev,
+							  &adev->ring_tmp_bo[i]);
+			return r;
+		}
 	}
 
 	adev->ib_pool_ready = true;
@@ -311,8 +333,11 @@ int amdgpu_ib_pool_init(struct amdgpu_device *adev)
  */
 void amdgpu_ib_pool_fini(struct amdgpu_device *adev)
 {
+	int i;
+
 	if (adev->ib_pool_ready) {
-		amdgpu_sa_bo_manager_fini(adev, &adev->ring_tmp_bo);
+		for (i = 0; i < AMDGPU_IB_POOL_ARENAS; i++)
+			amdgpu_sa_bo_manager_fini(adev, &adev->ring_tmp_bo[i]);
 		adev->ib_pool_ready = false;
 	}
 }
@@ -408,8 +433,12 @@ static int amdgpu_debugfs_sa_info(struct seq_file *m, void *data)
 	struct drm_info_node *node = (struct drm_info_node *) m->private;
 	struct drm_device *dev = node->minor->dev;
 	struct amdgpu_device *adev = dev->dev_private;
+	int i;
 
-	amdgpu_sa_bo_dump_debug_info(&adev->ring_tmp_bo, m);
+	for (i = 0; i < AMDGPU_IB_POOL_ARENAS; i++) {
+		seq_printf(m, "arena %d:\n", i);
+		amdgpu_sa_bo_dump_debug_info(&adev->ring_tmp_bo[i], m);
+	}
 
 	return 0;
 
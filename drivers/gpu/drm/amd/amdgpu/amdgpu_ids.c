@@ -192,6 +192,11 @@ bool amdgpu_vmid_had_gpu_reset(struct amdgpu_device *adev,
  *
  * Try to find an idle VMID, if none is idle add a fence to wait to the sync
  * object. Returns -ENOMEM when we are out of memory.
+ *
+ * Among the idle VMIDs one last owned by @vm is preferred, then one not owned
+ * by anybody, and only then the least recently used one. This keeps VMIDs
+ * with the VMs that last used them and avoids needless flushes when there
+ * are more active VMs than VMIDs.
  */
 static int amdgpu_vmid_grab_idle(struct amdgpu_vm *vm,
 				 struct amdgpu_ring *ring,
@@ -201,6 +206,7 @@ static int amdgpu_vmid_grab_idle(struct amdgpu_vm *vm,
 	struct amdgpu_device *adev = ring->adev;
 	unsigned vmhub = ring->funcs->vmhub;
 	struct amdgpu_vmid_mgr *id_mgr = &adev->vm_manager.id_mgr[vmhub];
+	struct amdgpu_vmid *id, *lru = NULL, *unowned = NULL;
 	struct dma_fence **fences;
 	unsigned i;
 	int r;
@@ -214,15 +220,33 @@ static int amdgpu_vmid_grab_idle(struct amdgpu_vm *vm,
 
 	/* Check if we have an idle VMID */
 	i = 0;
-	list_for_each_entry((*idle), &id_mgr->ids_lru, list) {
-		fences[i] = amdgpu_sync_peek_fence(&(*idle)->active, ring);
-		if (!fences[i])
+	*idle = NULL;
+	list_for_each_entry(id, &id_mgr->ids_lru, list) {
+		struct dma_fence *f = amdgpu_sync_peek_fence(&id->active, ring);
+
+		if (f) {
+			fences[i++] = f;
+			continue;
+		}
+		if (id->owner == vm->entity.fence_context) {
+			*idle = id;
 			break;
-		++i;
+		}
+		if (!id->owner && !unowned)
+			unowned = id;
+		if (!lru)
+			lru = id;
 	}
 
+	if (*idle)
+		id_mgr->num_affinity++;
+	else if (unowned)
+		*idle = unowned;
+	else
+		*idle = lru;
+
 	/* If we can't find a idle VMID to use, wait till one becomes available */
-	if (&(*idle)->list == &id_mgr->ids_lru) {
+	if (!*idle) {
 		u64 fence_context = adev->vm_manager.fence_context + ring->idx;
 		unsigned seqno = ++adev->vm_manager.seqno[ring->idx];
 		struct dma_fence_array *array;
@@ -410,11 +434,15 @@ int amdgpu_vmid_grab(struct amdgpu_vm *vm, struct amdgpu_ring *ring,
 	struct amdgpu_device *adev = ring->adev;
 	unsigned vmhub = ring->funcs->vmhub;
 	struct amdgpu_vmid_mgr *id_mgr = &adev->vm_manager.id_mgr[vmhub];
+	struct amdgpu_vmid_stats *stats = &vm->vmid_stats[vmhub];
 	struct amdgpu_vmid *idle = NULL;
 	struct amdgpu_vmid *id = NULL;
+	struct amdgpu_vmid *prev;
 	int r = 0;
 
 	mutex_lock(&id_mgr->lock);
+	id_mgr->num_grabs++;
+	stats->grabs++;
 	r = amdgpu_vmid_grab_idle(vm, ring, sync, &idle);
 	if (r || !idle)
 		goto error;
@@ -443,6 +471,19 @@ int amdgpu_vmid_grab(struct amdgpu_vm *vm, struct amdgpu_ring *ring,
 			dma_fence_put(id->flushed_updates);
 			id->flushed_updates = dma_fence_get(updates);
 			job->vm_needs_flush = true;
+
+			if (id->owner && id->owner != vm->entity.fence_context)
+				id_mgr->num_steals++;
+
+			/* Only lost if another VM took over our previous ID */
+			prev = stats->last_vmid ?
+				&id_mgr->ids[stats->last_vmid - 1] : NULL;
+			if (prev && prev->owner != vm->entity.fence_context)
+				stats->lost++;
+			stats->assigns++;
+		} else {
+			id_mgr->num_reuses++;
+			stats->reuses++;
 		}
 
 		list_move_tail(&id->list, &id_mgr->ids_lru);
@@ -450,6 +491,7 @@ int amdgpu_vmid_grab(struct amdgpu_vm *vm, struct amdgpu_ring *ring,
 
 	id->pd_gpu_addr = job->vm_pd_addr;
 	id->owner = vm->entity.fence_context;
+	stats->last_vmid = id - id_mgr->ids + 1;
 
 	if (job->vm_needs_flush) {
 		dma_fence_put(id->last_flush);
@@ -556,6 +598,83 @@ void amdgpu_vmid_reset_all(struct amdgpu_device *adev)
 	}
 }
 
+/*
+ * Debugfs info
+ */
+#if defined(CONFIG_DEBUG_FS)
+
+static int amdgpu_debugfs_vmid_info(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *)m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct amdgpu_device *adev = dev->dev_private;
+	struct drm_file *file;
+	unsigned i;
+	int r;
+
+	for (i = 0; i < AMDGPU_MAX_VMHUBS; ++i) {
+		struct amdgpu_vmid_mgr *id_mgr = &adev->vm_manager.id_mgr[i];
+
+		if (!id_mgr->num_ids)
+			continue;
+
+		mutex_lock(&id_mgr->lock);
+		seq_printf(m, "vmhub %u: %u ids, grabs %llu reuses %llu "
+			   "affinity %llu steals %llu\n", i, id_mgr->num_ids,
+			   id_mgr->num_grabs, id_mgr->num_reuses,
+			   id_mgr->num_affinity, id_mgr->num_steals);
+		mutex_unlock(&id_mgr->lock);
+	}
+
+	r = mutex_lock_interruptible(&dev->filelist_mutex);
+	if (r)
+		return r;
+
+	list_for_each_entry(file, &dev->filelist, lhead) {
+		struct amdgpu_fpriv *fpriv = file->driver_priv;
+
+		if (!fpriv)
+			continue;
+
+		for (i = 0; i < AMDGPU_MAX_VMHUBS; ++i) {
+			struct amdgpu_vmid_mgr *id_mgr =
+				&adev->vm_manager.id_mgr[i];
+			struct amdgpu_vmid_stats *stats =
+				&fpriv->vm.vmid_stats[i];
+
+			if (!id_mgr->num_ids || !stats->grabs)
+				continue;
+
+			mutex_lock(&id_mgr->lock);
+			seq_printf(m, "pid %8d pasid %u vmhub %u: grabs %llu "
+				   "reuses %llu assigns %llu lost %llu\n",
+				   pid_nr(file->pid), fpriv->vm.pasid, i,
+				   stats->grabs, stats->reuses, stats->assigns,
+				   stats->lost);
+			mutex_unlock(&id_mgr->lock);
+		}
+	}
+
+	mutex_unlock(&dev->filelist_mutex);
+	return 0;
+}
+
+static const struct drm_info_list amdgpu_debugfs_vmid_list[] = {
+	{"amdgpu_vmid_info", &amdgpu_debugfs_vmid_info, 0, NULL},
+};
+
+#endif
+
+int amdgpu_debugfs_vmid_init(struct amdgpu_device *adev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	return amdgpu_debugfs_add_files(adev, amdgpu_debugfs_vmid_list,
+					ARRAY_SIZE(amdgpu_debugfs_vmid_list));
+#else
+	return 0;
+#endif
+}
+
 /**
  * amdgpu_vmid_mgr_init - init the VMID manager
  *
@@ -582,6 +701,9 @@ void amdgpu_vmid_mgr_init(struct amdgpu_device *adev)
 			list_add_tail(&id_mgr->ids[j].list, &id_mgr->ids_lru);
 		}
 	}
+
+	if (amdgpu_debugfs_vmid_init(adev))
+		DRM_ERROR("registering vmid debugfs failed.\n");
 }
 
 /**
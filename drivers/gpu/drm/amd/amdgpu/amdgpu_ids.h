@@ -68,6 +68,22 @@ struct amdgpu_vmid_mgr {
 	struct list_head	ids_lru;
 	struct amdgpu_vmid	ids[AMDGPU_NUM_VMID];
 	atomic_t		reserved_vmid_num;
+
+	/* statistics, protected by lock */
+	uint64_t		num_grabs;
+	uint64_t		num_reuses;
+	uint64_t		num_affinity;
+	uint64_t		num_steals;
+};
+
+/* per VM and VMHUB VMID statistics, protected by the id_mgr lock */
+struct amdgpu_vmid_stats {
+	uint64_t		grabs;
+	uint64_t		reuses;
+	uint64_t		assigns;
+	uint64_t		lost;
+	/* index + 1 of the VMID last assigned, 0 if none */
+	unsigned		last_vmid;
 };
 
 int amdgpu_pasid_alloc(unsigned int bits);
@@ -92,5 +108,6 @@ void amdgpu_vmid_reset_all(struct amdgpu_device *adev);
 
 void amdgpu_vmid_mgr_init(struct amdgpu_device *adev);
 void amdgpu_vmid_mgr_fini(struct amdgpu_device *adev);
+int amdgpu_debugfs_vmid_init(struct amdgpu_device *adev);
 
 #endif
@@ -137,15 +137,24 @@ void amdgpu_ih_ring_fini(struct amdgpu_device *adev, struct amdgpu_ih_ring *ih)
  *
  * @adev: amdgpu_device pointer
  * @ih: ih ring to process
+ * @budget: maximum number of entries to process, 0 for no limit
+ * @pending: set when the budget ran out with entries left on the ring
  *
  * Interrupt hander (VI), walk the IH ring.
+ * If *@pending is set on return the caller is expected to continue from
+ * process context; it is cleared whenever this pass did not process the
+ * ring, so a disabled ring or one being shut down is never requeued.
  * Returns irq process return code.
  */
-int amdgpu_ih_process(struct amdgpu_device *adev, struct amdgpu_ih_ring *ih)
+int amdgpu_ih_process(struct amdgpu_device *adev, struct amdgpu_ih_ring *ih,
+		      unsigned budget, bool *pending)
 {
-	unsigned int count = AMDGPU_IH_MAX_NUM_IVS;
+	unsigned int count = 0;
+	u64 start, delta;
 	u32 wptr;
 
+	*pending = false;
+
 	if (!ih->enabled || adev->shutdown)
 		return IRQ_NONE;
 
@@ -159,16 +168,39 @@ restart_ih:
 	/* BSD: Too verbose, disable */
 	/* DRM_DEBUG("%s: rptr %d, wptr %d\n", __func__, ih->rptr, wptr); */
 
+	start = ktime_get_ns();
+
 	/* Order reading of wptr vs. reading of IH ring data */
 	rmb();
 
-	while (ih->rptr != wptr && --count) {
+	while (ih->rptr != wptr) {
+		if (budget && count >= budget) {
+			*pending = true;
+			ih->stat_deferred++;
+			break;
+		}
 		amdgpu_irq_dispatch(adev, ih);
 		ih->rptr &= ih->ptr_mask;
+
+		/* Give the hardware room long before the pass ends */
+		if (!(++count % AMDGPU_IH_MAX_NUM_IVS))
+			amdgpu_ih_set_rptr(adev, ih);
 	}
 
 	amdgpu_ih_set_rptr(adev, ih);
+
+	delta = ktime_get_ns() - start;
+	ih->stat_passes++;
+	ih->stat_entries += count;
+	ih->stat_time_ns += delta;
+	if (count > ih->stat_max_entries)
+		ih->stat_max_entries = count;
+	if (delta > ih->stat_max_time_ns)
+		ih->stat_max_time_ns = delta;
+
 	atomic_set(&ih->lock, 0);
+	if (*pending)
+		return IRQ_HANDLED;
 
 	/* make sure wptr hasn't changed while processing */
 	wptr = amdgpu_ih_get_wptr(adev, ih);
@@ -178,3 +210,51 @@ restart_ih:
 	return IRQ_HANDLED;
 }
 
+/*
+ * Debugfs info
+ */
+#if defined(CONFIG_DEBUG_FS)
+
+static void amdgpu_debugfs_ih_ring_stats(struct seq_file *m, const char *name,
+					 struct amdgpu_ih_ring *ih)
+{
+	if (!ih->ring_size)
+		return;
+
+	seq_printf(m, "%s: passes %llu entries %llu (max %u per pass) "
+		   "deferred %llu time %llu us (max %llu us per pass)\n",
+		   name, ih->stat_passes, ih->stat_entries,
+		   ih->stat_max_entries, ih->stat_deferred,
+		   div_u64(ih->stat_time_ns, NSEC_PER_USEC),
+		   div_u64(ih->stat_max_time_ns, NSEC_PER_USEC));
+}
+
+static int amdgpu_debugfs_ih_stats(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct amdgpu_device *adev = dev->dev_private;
+
+	seq_printf(m, "budget %d\n", amdgpu_ih_budget);
+	amdgpu_debugfs_ih_ring_stats(m, "ih", &adev->irq.ih);
+	amdgpu_debugfs_ih_ring_stats(m, "ih1", &adev->irq.ih1);
+	amdgpu_debugfs_ih_ring_stats(m, "ih2", &adev->irq.ih2);
+	return 0;
+}
+
+static const struct drm_info_list amdgpu_debugfs_ih_list[] = {
+	{"amdgpu_ih_stats", &amdgpu_debugfs_ih_stats, 0, NULL},
+};
+
+#endif
+
+int amdgpu_debugfs_ih_init(struct amdgpu_device *adev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	return amdgpu_debugfs_add_files(adev, amdgpu_debugfs_ih_list,
+					ARRAY_SIZE(amdgpu_debugfs_ih_list));
+#else
+	return 0;
+#endif
+}
+
@@ -24,7 +24,7 @@
 #ifndef __AMDGPU_IH_H__
 #define __AMDGPU_IH_H__
 
-/* Maximum number of IVs processed at once */
+/* Number of IVs processed between rptr updates */
 #define AMDGPU_IH_MAX_NUM_IVS	32
 
 struct amdgpu_device;
@@ -53,6 +53,14 @@ struct amdgpu_ih_ring {
 	bool                    enabled;
 	unsigned		rptr;
 	atomic_t		lock;
+
+	/* statistics, updated by the owner of lock */
+	u64			stat_passes;
+	u64			stat_entries;
+	u64			stat_deferred;
+	u64			stat_time_ns;
+	u32			stat_max_entries;
+	u64			stat_max_time_ns;
 };
 
 /* provided by the ih block */
@@ -72,6 +80,8 @@ struct amdgpu_ih_funcs {
 int amdgpu_ih_ring_init(struct amdgpu_device *adev, struct amdgpu_ih_ring *ih,
 			unsigned ring_size, bool use_bus_addr);
 void amdgpu_ih_ring_fini(struct amdgpu_device *adev, struct amdgpu_ih_ring *ih);
-int amdgpu_ih_process(struct amdgpu_device *adev, struct amdgpu_ih_ring *ih);
+int amdgpu_ih_process(struct amdgpu_device *adev, struct amdgpu_ih_ring *ih,
+		      unsigned budget, bool *pending);
+int amdgpu_debugfs_ih_init(struct amdgpu_device *adev);
 
 #endif
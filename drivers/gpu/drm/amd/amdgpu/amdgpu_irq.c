@@ -153,13 +153,38 @@ irqreturn_t amdgpu_irq_handler(int irq, void *arg)
 	struct drm_device *dev = (struct drm_device *) arg;
 	struct amdgpu_device *adev = dev->dev_private;
 	irqreturn_t ret;
+	bool pending;
 
-	ret = amdgpu_ih_process(adev, &adev->irq.ih);
+	ret = amdgpu_ih_process(adev, &adev->irq.ih, amdgpu_ih_budget,
+				&pending);
 	if (ret == IRQ_HANDLED)
 		pm_runtime_mark_last_busy(dev->dev);
+	if (pending)
+		queue_work(system_highpri_wq, &adev->irq.ih_work);
 	return ret;
 }
 
+/**
+ * amdgpu_irq_handle_ih - continue processing for IH0
+ *
+ * @work: work structure in struct amdgpu_irq
+ *
+ * Drain what is left on IH ring 0 after the interrupt handler ran out of
+ * budget, in bounded steps so other work gets a chance to run in between.
+ * IH0 carries the fence interrupts, so unlike IH1/IH2 it is continued from
+ * the high priority workqueue.
+ */
+static void amdgpu_irq_handle_ih(struct work_struct *work)
+{
+	struct amdgpu_device *adev = container_of(work, struct amdgpu_device,
+						  irq.ih_work);
+	bool pending;
+
+	amdgpu_ih_process(adev, &adev->irq.ih, amdgpu_ih_budget, &pending);
+	if (pending)
+		queue_work(system_highpri_wq, &adev->irq.ih_work);
+}
+
 /**
  * amdgpu_irq_handle_ih1 - kick of processing for IH1
  *
@@ -171,8 +196,11 @@ static void amdgpu_irq_handle_ih1(struct work_struct *work)
 {
 	struct amdgpu_device *adev = container_of(work, struct amdgpu_device,
 						  irq.ih1_work);
+	bool pending;
 
-	amdgpu_ih_process(adev, &adev->irq.ih1);
+	amdgpu_ih_process(adev, &adev->irq.ih1, amdgpu_ih_budget, &pending);
+	if (pending)
+		schedule_work(&adev->irq.ih1_work);
 }
 
 /**
@@ -186,8 +214,11 @@ static void amdgpu_irq_handle_ih2(struct work_struct *work)
 {
 	struct amdgpu_device *adev = container_of(work, struct amdgpu_device,
 						  irq.ih2_work);
+	bool pending;
 
-	amdgpu_ih_process(adev, &adev->irq.ih2);
+	amdgpu_ih_process(adev, &adev->irq.ih2, amdgpu_ih_budget, &pending);
+	if (pending)
+		schedule_work(&adev->irq.ih2_work);
 }
 
 /**
@@ -254,9 +285,14 @@ int amdgpu_irq_init(struct amdgpu_device *adev)
 				amdgpu_hotplug_work_func);
 	}
 
+	INIT_WORK(&adev->irq.ih_work, amdgpu_irq_handle_ih);
 	INIT_WORK(&adev->irq.ih1_work, amdgpu_irq_handle_ih1);
 	INIT_WORK(&adev->irq.ih2_work, amdgpu_irq_handle_ih2);
 
+	r = amdgpu_debugfs_ih_init(adev);
+	if (r)
+		DRM_ERROR("registering ih debugfs failed (%d).\n", r);
+
 	adev->irq.installed = true;
 	r = drm_irq_install(adev->ddev, adev->ddev->pdev->irq);
 	if (r) {
@@ -287,6 +323,9 @@ void amdgpu_irq_fini(struct amdgpu_device *adev)
 	if (adev->irq.installed) {
 		drm_irq_uninstall(adev->ddev);
 		adev->irq.installed = false;
+		cancel_work_sync(&adev->irq.ih_work);
+		cancel_work_sync(&adev->irq.ih1_work);
+		cancel_work_sync(&adev->irq.ih2_work);
 		if (adev->irq.msi_enabled)
 			pci_disable_msi(adev->pdev);
 		if (!amdgpu_device_has_dc_support(adev))
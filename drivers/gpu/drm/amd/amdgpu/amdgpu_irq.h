@@ -90,7 +90,7 @@ struct amdgpu_irq {
 	/* interrupt rings */
 	struct amdgpu_ih_ring		ih, ih1, ih2;
 	const struct amdgpu_ih_funcs    *ih_funcs;
-	struct work_struct		ih1_work, ih2_work;
+	struct work_struct		ih_work, ih1_work, ih2_work;
 	struct amdgpu_irq_src		self_irq;
 
 	/* gen irq stuff */
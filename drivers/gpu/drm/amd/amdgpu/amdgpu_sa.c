@@ -59,6 +59,10 @@ int amdgpu_sa_bo_manager_init(struct amdgpu_device *adev,
 	sa_manager->domain = domain;
 	sa_manager->align = align;
 	sa_manager->hole = &sa_manager->olist;
+	sa_manager->num_allocs = 0;
+	sa_manager->num_waits = 0;
+	sa_manager->wait_ns = 0;
+	sa_manager->max_wait_ns = 0;
 	INIT_LIST_HEAD(&sa_manager->olist);
 	for (i = 0; i < AMDGPU_SA_NUM_FENCE_LISTS; ++i)
 		INIT_LIST_HEAD(&sa_manager->flist[i]);
@@ -272,6 +276,21 @@ static bool amdgpu_sa_bo_next_hole(struct amdgpu_sa_manager *sa_manager,
 	return false;
 }
 
+static void amdgpu_sa_bo_account_wait(struct amdgpu_sa_manager *sa_manager,
+				      u64 start)
+{
+	u64 delta;
+
+	if (!start)
+		return;
+
+	delta = ktime_get_ns() - start;
+	sa_manager->num_waits++;
+	sa_manager->wait_ns += delta;
+	if (delta > sa_manager->max_wait_ns)
+		sa_manager->max_wait_ns = delta;
+}
+
 int amdgpu_sa_bo_new(struct amdgpu_sa_manager *sa_manager,
 		     struct amdgpu_sa_bo **sa_bo,
 		     unsigned size, unsigned align)
@@ -281,6 +300,7 @@ int amdgpu_sa_bo_new(struct amdgpu_sa_manager *sa_manager,
 	unsigned count;
 	int i, r;
 	signed long t;
+	u64 wait_start = 0;
 
 	if (WARN_ON_ONCE(align > sa_manager->align))
 		return -EINVAL;
@@ -306,6 +326,9 @@ int amdgpu_sa_bo_new(struct amdgpu_sa_manager *sa_manager,
 
 			if (amdgpu_sa_bo_try_alloc(sa_manager, *sa_bo,
 						   size, align)) {
+				sa_manager->num_allocs++;
+				amdgpu_sa_bo_account_wait(sa_manager,
+							  wait_start);
 				spin_unlock(&sa_manager->wq.lock);
 				return 0;
 			}
@@ -313,6 +336,9 @@ int amdgpu_sa_bo_new(struct amdgpu_sa_manager *sa_manager,
 			/* see if we can skip over some allocations */
 		} while (amdgpu_sa_bo_next_hole(sa_manager, fences, tries));
 
+		if (!wait_start)
+			wait_start = ktime_get_ns();
+
 		for (i = 0, count = 0; i < AMDGPU_SA_NUM_FENCE_LISTS; ++i)
 			if (fences[i])
 				fences[count++] = dma_fence_get(fences[i]);
@@ -337,6 +363,7 @@ int amdgpu_sa_bo_new(struct amdgpu_sa_manager *sa_manager,
 
 	} while (!r);
 
+	amdgpu_sa_bo_account_wait(sa_manager, wait_start);
 	spin_unlock(&sa_manager->wq.lock);
 	kfree(*sa_bo);
 	*sa_bo = NULL;
@@ -393,6 +420,10 @@ void amdgpu_sa_bo_dump_debug_info(struct amdgpu_sa_manager *sa_manager,
 
 		seq_printf(m, "\n");
 	}
+	seq_printf(m, "allocs %llu waits %llu wait time %llu us (max %llu us)\n",
+		   sa_manager->num_allocs, sa_manager->num_waits,
+		   div_u64(sa_manager->wait_ns, NSEC_PER_USEC),
+		   div_u64(sa_manager->max_wait_ns, NSEC_PER_USEC));
 	spin_unlock(&sa_manager->wq.lock);
 }
 #endif
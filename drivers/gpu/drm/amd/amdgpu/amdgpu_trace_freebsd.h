@@ -2,16 +2,27 @@
 #define _AMDGPU_TRACE_FREEBSD_H_
 
 #include <drm/drmP.h>
+#include <drm/drm_trace_ring_freebsd.h>
 #include "amdgpu.h"
 
+#define	AMDGPU_TRACE_EVENTS(E)						\
+	E(amdgpu_iv,		"client %u src %u ring %u vmid %u")	\
+	E(amdgpu_cs_ioctl,	"job %p")				\
+	E(amdgpu_sched_run_job,	"job %p")				\
+	E(amdgpu_ib_pipe_sync,	"job %p fence %p")
+DRM_TRACE_DECLARE(amdgpu, AMDGPU_TRACE_EVENTS);
+
 static inline void
 trace_amdgpu_iv(u_long ih __unused, struct amdgpu_iv_entry *iv){
 	CTR1(KTR_DRM, "amdgpu_iv %p", iv);
+	DRM_TRACE(amdgpu, amdgpu_iv,
+	    iv->client_id, iv->src_id, iv->ring_id, iv->vmid);
 }
 
 static inline void
 trace_amdgpu_cs_ioctl(struct amdgpu_job *job){
 	CTR1(KTR_DRM, "amdgpu_cs_ioctl %p", job);
+	DRM_TRACE(amdgpu, amdgpu_cs_ioctl, DRM_TRACE_PTR(job), 0, 0, 0);
 }
 
 static inline void
@@ -22,6 +33,7 @@ trace_amdgpu_cs(struct amdgpu_cs_parser *parser, int i){
 static inline void
 trace_amdgpu_sched_run_job(struct amdgpu_job *job){
 	CTR1(KTR_DRM, "amdgpu_sched_run_job %p", job);
+	DRM_TRACE(amdgpu, amdgpu_sched_run_job, DRM_TRACE_PTR(job), 0, 0, 0);
 }
 
 static inline void
@@ -130,6 +142,8 @@ trace_amdgpu_ttm_tt_unpopulate(struct amdgpu_device *adev, uint64_t dma_address,
 static inline void
 trace_amdgpu_ib_pipe_sync(struct amdgpu_job *job, struct dma_fence *fence){
 	CTR2(KTR_DRM, "amdgpu_ib_pipe_sync %p, fence %p", job, fence);
+	DRM_TRACE(amdgpu, amdgpu_ib_pipe_sync, DRM_TRACE_PTR(job),
+	    DRM_TRACE_PTR(fence), 0, 0);
 }
 
 #define trace_amdgpu_mm_rreg(dev, reg, ret)	\
@@ -27,3 +27,7 @@
 
 #define CREATE_TRACE_POINTS
 #include "amdgpu_trace.h"
+
+#ifdef __FreeBSD__
+DRM_TRACE_DEFINE(amdgpu, AMDGPU_TRACE_EVENTS);
+#endif
@@ -265,6 +265,14 @@ int drm_debugfs_init(struct drm_minor *minor, int minor_id,
 		}
 	}
 
+	if (drm_core_check_feature(dev, DRIVER_SYNCOBJ)) {
+		ret = drm_syncobj_debugfs_init(minor);
+		if (ret) {
+			DRM_ERROR("Failed to create syncobj debugfs file\n");
+			return ret;
+		}
+	}
+
 	if (dev->driver->debugfs_init) {
 		ret = dev->driver->debugfs_init(minor);
 		if (ret) {
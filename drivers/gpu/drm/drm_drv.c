@@ -816,6 +816,7 @@ void drm_dev_fini(struct drm_device *dev)
 	drm_minor_free(dev, DRM_MINOR_RENDER);
 
 #ifdef __FreeBSD__
+	kfree(dev->ioctl_stats);
 #if IS_ENABLED(CONFIG_DRM_LEGACY)
 	spin_lock_destroy(&dev->buf_lock);
 	spin_lock_destroy(&dev->event_lock);
@@ -1088,6 +1089,9 @@ void drm_dev_unregister(struct drm_device *dev)
 	remove_compat_control_link(dev);
 	drm_minor_unregister(dev, DRM_MINOR_PRIMARY);
 	drm_minor_unregister(dev, DRM_MINOR_RENDER);
+
+	if (drm_core_check_feature(dev, DRIVER_GEM))
+		drm_gem_flush_deferred_puts();
 }
 EXPORT_SYMBOL(drm_dev_unregister);
 
@@ -1176,6 +1180,7 @@ static void drm_core_exit(void)
 	unregister_chrdev(DRM_MAJOR, "drm");
 	debugfs_remove(drm_debugfs_root);
 	drm_sysfs_destroy();
+	drm_gem_put_exit();
 	idr_destroy(&drm_minors_idr);
 	drm_connector_ida_destroy();
 }
@@ -1187,6 +1192,10 @@ static int __init drm_core_init(void)
 	drm_connector_ida_init();
 	idr_init(&drm_minors_idr);
 
+	ret = drm_gem_put_init();
+	if (ret < 0)
+		goto error;
+
 	ret = drm_sysfs_init();
 	if (ret < 0) {
 		DRM_ERROR("Cannot create DRM class: %d\n", ret);
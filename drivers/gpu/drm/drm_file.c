@@ -139,9 +139,10 @@ struct drm_file *drm_file_alloc(struct drm_minor *minor)
 	mutex_init(&file->fbs_lock);
 	INIT_LIST_HEAD(&file->blobs);
 	INIT_LIST_HEAD(&file->pending_event_list);
+	init_llist_head(&file->event_llist);
 	INIT_LIST_HEAD(&file->event_list);
 	init_waitqueue_head(&file->event_wait);
-	file->event_space = 4096; /* set aside 4k for event buffer */
+	atomic_set(&file->event_space, 4096); /* set aside 4k for event buffer */
 
 	mutex_init(&file->event_read_lock);
 
@@ -188,13 +189,17 @@ static void drm_events_release(struct drm_file *file_priv)
 		e->file_priv = NULL;
 	}
 
-	/* Remove unconsumed events */
+	spin_unlock_irqrestore(&dev->event_lock, flags);
+
+	/* Remove unconsumed events, nothing can be sent to us any more */
+	llist_for_each_entry_safe(e, et, llist_del_all(&file_priv->event_llist),
+				  node)
+		kfree(e);
+
 	list_for_each_entry_safe(e, et, &file_priv->event_list, link) {
 		list_del(&e->link);
 		kfree(e);
 	}
-
-	spin_unlock_irqrestore(&dev->event_lock, flags);
 }
 
 /**
@@ -258,6 +263,7 @@ void drm_file_free(struct drm_file *file)
 	drm_prime_destroy_file_private(&file->prime);
 
 	WARN_ON(!list_empty(&file->event_list));
+	WARN_ON(!llist_empty(&file->event_llist));
 
 	put_pid(file->pid);
 	kfree(file);
@@ -461,6 +467,105 @@ int drm_release(struct inode *inode, struct file *filp)
 }
 EXPORT_SYMBOL(drm_release);
 
+static bool drm_events_pending(struct drm_file *file_priv)
+{
+	return !list_empty(&file_priv->event_list) ||
+	       !llist_empty(&file_priv->event_llist);
+}
+
+/*
+ * Move everything sent since the last call over to @event_list, restoring
+ * the order it was sent in. Returns true if any event was moved.
+ */
+static bool drm_events_fetch(struct drm_file *file_priv)
+{
+	struct drm_pending_event *e, *et;
+	LIST_HEAD(sent);
+
+	/* @event_llist is newest first, adding at the head reverses it */
+	llist_for_each_entry_safe(e, et,
+				  llist_del_all(&file_priv->event_llist), node)
+		list_add(&e->link, &sent);
+
+	if (list_empty(&sent))
+		return false;
+
+	list_splice_tail(&sent, &file_priv->event_list);
+	return true;
+}
+
+static void drm_events_free(struct drm_file *file_priv, struct list_head *list)
+{
+	struct drm_pending_event *e, *et;
+
+	list_for_each_entry_safe(e, et, list, link) {
+		atomic_add(e->event->length, &file_priv->event_space);
+		kfree(e);
+	}
+	INIT_LIST_HEAD(list);
+}
+
+/*
+ * Copy as many whole events as fit in @count to userspace. Small events are
+ * staged on the stack so that a burst of them costs a single copy_to_user().
+ * Anything not copied stays at the head of @event_list.
+ */
+static ssize_t drm_events_copy(struct drm_file *file_priv,
+			       char __user *buffer, size_t count)
+{
+	struct drm_pending_event *e, *et;
+	LIST_HEAD(staged);
+	char bounce[256];
+	size_t fill = 0;
+	ssize_t ret = 0;
+
+	lockdep_assert_held(&file_priv->event_read_lock);
+
+	do {
+		list_for_each_entry_safe(e, et, &file_priv->event_list, link) {
+			unsigned length = e->event->length;
+
+			if (length > count - ret - fill)
+				goto flush;
+
+			if (fill + length > sizeof(bounce) && fill) {
+				if (copy_to_user(buffer + ret, bounce, fill))
+					goto fault;
+				ret += fill;
+				fill = 0;
+				drm_events_free(file_priv, &staged);
+			}
+
+			if (length > sizeof(bounce)) {
+				if (copy_to_user(buffer + ret, e->event, length))
+					goto fault;
+				ret += length;
+				list_del(&e->link);
+				atomic_add(length, &file_priv->event_space);
+				kfree(e);
+				continue;
+			}
+
+			memcpy(bounce + fill, e->event, length);
+			fill += length;
+			list_move_tail(&e->link, &staged);
+		}
+	} while (drm_events_fetch(file_priv));
+
+flush:
+	if (fill) {
+		if (copy_to_user(buffer + ret, bounce, fill))
+			goto fault;
+		ret += fill;
+		drm_events_free(file_priv, &staged);
+	}
+	return ret;
+
+fault:
+	list_splice(&staged, &file_priv->event_list);
+	return ret ?: -EFAULT;
+}
+
 /**
  * drm_read - read method for DRM file
  * @filp: file pointer
@@ -491,7 +596,6 @@ ssize_t drm_read(struct file *filp, char __user *buffer,
 		 size_t count, loff_t *offset)
 {
 	struct drm_file *file_priv = filp->private_data;
-	struct drm_device *dev = file_priv->minor->dev;
 	ssize_t ret;
 
 	if (!access_ok(buffer, count))
@@ -502,55 +606,22 @@ ssize_t drm_read(struct file *filp, char __user *buffer,
 		return ret;
 
 	for (;;) {
-		struct drm_pending_event *e = NULL;
-
-		spin_lock_irq(&dev->event_lock);
-		if (!list_empty(&file_priv->event_list)) {
-			e = list_first_entry(&file_priv->event_list,
-					struct drm_pending_event, link);
-			file_priv->event_space += e->event->length;
-			list_del(&e->link);
-		}
-		spin_unlock_irq(&dev->event_lock);
-
-		if (e == NULL) {
-			if (ret)
-				break;
-
-			if (filp->f_flags & O_NONBLOCK) {
-				ret = -EAGAIN;
-				break;
-			}
-
-			mutex_unlock(&file_priv->event_read_lock);
-			ret = wait_event_interruptible(file_priv->event_wait,
-						       !list_empty(&file_priv->event_list));
-			if (ret >= 0)
-				ret = mutex_lock_interruptible(&file_priv->event_read_lock);
-			if (ret)
-				return ret;
-		} else {
-			unsigned length = e->event->length;
-
-			if (length > count - ret) {
-put_back_event:
-				spin_lock_irq(&dev->event_lock);
-				file_priv->event_space -= length;
-				list_add(&e->link, &file_priv->event_list);
-				spin_unlock_irq(&dev->event_lock);
-				wake_up_interruptible(&file_priv->event_wait);
-				break;
-			}
+		ret = drm_events_copy(file_priv, buffer, count);
+		if (ret || !list_empty(&file_priv->event_list))
+			break;
 
-			if (copy_to_user(buffer + ret, e->event, length)) {
-				if (ret == 0)
-					ret = -EFAULT;
-				goto put_back_event;
-			}
-
-			ret += length;
-			kfree(e);
+		if (filp->f_flags & O_NONBLOCK) {
+			ret = -EAGAIN;
+			break;
 		}
+
+		mutex_unlock(&file_priv->event_read_lock);
+		ret = wait_event_interruptible(file_priv->event_wait,
+					       drm_events_pending(file_priv));
+		if (ret >= 0)
+			ret = mutex_lock_interruptible(&file_priv->event_read_lock);
+		if (ret)
+			return ret;
 	}
 	mutex_unlock(&file_priv->event_read_lock);
 
@@ -581,7 +652,7 @@ __poll_t drm_poll(struct file *filp, struct poll_table_struct *wait)
 
 	poll_wait(filp, &file_priv->event_wait, wait);
 
-	if (!list_empty(&file_priv->event_list))
+	if (drm_events_pending(file_priv))
 #ifdef __linux__
 		mask |= EPOLLIN | EPOLLRDNORM;
 #elif defined(__FreeBSD__)
@@ -621,10 +692,10 @@ int drm_event_reserve_init_locked(struct drm_device *dev,
 				  struct drm_pending_event *p,
 				  struct drm_event *e)
 {
-	if (file_priv->event_space < e->length)
+	if (atomic_read(&file_priv->event_space) < e->length)
 		return -ENOMEM;
 
-	file_priv->event_space -= e->length;
+	atomic_sub(e->length, &file_priv->event_space);
 
 	p->event = e;
 	list_add(&p->pending_link, &file_priv->pending_event_list);
@@ -689,7 +760,7 @@ void drm_event_cancel_free(struct drm_device *dev,
 	unsigned long flags;
 	spin_lock_irqsave(&dev->event_lock, flags);
 	if (p->file_priv) {
-		p->file_priv->event_space += p->event->length;
+		atomic_add(p->event->length, &p->file_priv->event_space);
 		list_del(&p->pending_link);
 	}
 	spin_unlock_irqrestore(&dev->event_lock, flags);
@@ -736,8 +807,7 @@ void drm_send_event_locked(struct drm_device *dev, struct drm_pending_event *e)
 	}
 
 	list_del(&e->pending_link);
-	list_add_tail(&e->link,
-		      &e->file_priv->event_list);
+	llist_add(&e->node, &e->file_priv->event_llist);
 	wake_up_interruptible(&e->file_priv->event_wait);
 }
 EXPORT_SYMBOL(drm_send_event_locked);
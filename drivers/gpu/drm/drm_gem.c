@@ -38,6 +38,8 @@
 #include <linux/dma-buf.h>
 #include <linux/mem_encrypt.h>
 #include <linux/pagevec.h>
+#include <linux/rcupdate.h>
+#include <linux/workqueue.h>
 
 #include <drm/drm.h>
 #include <drm/drm_device.h>
@@ -267,6 +269,65 @@ drm_gem_object_release_handle(int id, void *ptr, void *data)
 	return 0;
 }
 
+/*
+ * Handle lookups run under RCU only, so an object unpublished from
+ * &drm_file.object_idr must stay alive until every lookup that may have
+ * seen it is done. Object memory is not RCU-freed, so kref_get_unless_zero()
+ * alone is not enough: the extra reference is dropped after a grace period,
+ * from process context since the final put may sleep. Closing the file and
+ * unregistering the device wait for these, see drm_gem_flush_deferred_puts().
+ */
+struct drm_gem_deferred_put {
+	struct rcu_head rcu;
+	struct work_struct work;
+	struct drm_gem_object *obj;
+	struct drm_file *filp;
+};
+
+static struct workqueue_struct *drm_gem_put_wq;
+
+static void drm_gem_deferred_put_work(struct work_struct *work)
+{
+	struct drm_gem_deferred_put *put =
+		container_of(work, typeof(*put), work);
+
+	drm_gem_object_put_unlocked(put->obj);
+	atomic_dec(&put->filp->gem_deferred_puts);
+	kfree(put);
+}
+
+static void drm_gem_deferred_put_rcu(struct rcu_head *rcu)
+{
+	struct drm_gem_deferred_put *put =
+		container_of(rcu, typeof(*put), rcu);
+
+	INIT_WORK(&put->work, drm_gem_deferred_put_work);
+	queue_work(drm_gem_put_wq, &put->work);
+}
+
+/* Wait for every reference drop queued by drm_gem_handle_delete() */
+void drm_gem_flush_deferred_puts(void)
+{
+	rcu_barrier();
+	flush_workqueue(drm_gem_put_wq);
+}
+
+int drm_gem_put_init(void)
+{
+	drm_gem_put_wq = alloc_workqueue("drm_gem_put", 0, 0);
+	if (!drm_gem_put_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void drm_gem_put_exit(void)
+{
+	if (!drm_gem_put_wq)
+		return;
+	drm_gem_flush_deferred_puts();
+	destroy_workqueue(drm_gem_put_wq);
+}
+
 /**
  * drm_gem_handle_delete - deletes the given file-private handle
  * @filp: drm file-private structure to use for the handle look up
@@ -279,6 +340,7 @@ drm_gem_object_release_handle(int id, void *ptr, void *data)
 int
 drm_gem_handle_delete(struct drm_file *filp, u32 handle)
 {
+	struct drm_gem_deferred_put *put;
 	struct drm_gem_object *obj;
 
 	spin_lock(&filp->table_lock);
@@ -289,9 +351,23 @@ drm_gem_handle_delete(struct drm_file *filp, u32 handle)
 	if (IS_ERR_OR_NULL(obj))
 		return -EINVAL;
 
+	/* Keep obj alive for concurrent lockless lookups, see objects_lookup() */
+	put = kmalloc(sizeof(*put), GFP_KERNEL);
+	if (put) {
+		drm_gem_object_get(obj);
+		put->obj = obj;
+		put->filp = filp;
+		atomic_inc(&filp->gem_deferred_puts);
+	} else {
+		synchronize_rcu();
+	}
+
 	/* Release driver's reference and decrement refcount. */
 	drm_gem_object_release_handle(handle, obj, filp);
 
+	if (put)
+		call_rcu(&put->rcu, drm_gem_deferred_put_rcu);
+
 	/* And finally make the handle available for future allocations. */
 	spin_lock(&filp->table_lock);
 	idr_remove(&filp->object_idr, handle);
@@ -427,6 +503,8 @@ err_remove:
 	spin_lock(&file_priv->table_lock);
 	idr_remove(&file_priv->object_idr, handle);
 	spin_unlock(&file_priv->table_lock);
+	/* The handle was visible to lockless lookups, let them finish */
+	synchronize_rcu();
 err_unref:
 	drm_gem_object_handle_put_unlocked(obj);
 	return ret;
@@ -659,25 +737,28 @@ void drm_gem_put_pages(struct drm_gem_object *obj, struct page **pages,
 EXPORT_SYMBOL(drm_gem_put_pages);
 #endif
 
+/*
+ * Resolve count handles in one pass without taking &drm_file.table_lock.
+ * A deleted handle keeps its object alive for a grace period (see
+ * drm_gem_handle_delete()), so whatever idr_find() returns is safe to
+ * reference; a zero refcount means we lost the race against the last put.
+ */
 static int objects_lookup(struct drm_file *filp, u32 *handle, int count,
 			  struct drm_gem_object **objs)
 {
 	int i, ret = 0;
 	struct drm_gem_object *obj;
 
-	spin_lock(&filp->table_lock);
-
+	rcu_read_lock();
 	for (i = 0; i < count; i++) {
-		/* Check if we currently have a reference on the object */
 		obj = idr_find(&filp->object_idr, handle[i]);
-		if (!obj) {
+		if (!obj || !kref_get_unless_zero(&obj->refcount)) {
 			ret = -ENOENT;
 			break;
 		}
-		drm_gem_object_get(obj);
 		objs[i] = obj;
 	}
-	spin_unlock(&filp->table_lock);
+	rcu_read_unlock();
 
 	return ret;
 }
@@ -716,11 +797,11 @@ int drm_gem_objects_lookup(struct drm_file *filp, void __user *bo_handles,
 	if (!objs)
 		return -ENOMEM;
 
+	*objs_out = objs;
+
 	handles = kvmalloc_array(count, sizeof(u32), GFP_KERNEL);
-	if (!handles) {
-		ret = -ENOMEM;
-		goto out;
-	}
+	if (!handles)
+		return -ENOMEM;
 
 	if (copy_from_user(handles, bo_handles, count * sizeof(u32))) {
 		ret = -EFAULT;
@@ -729,12 +810,9 @@ int drm_gem_objects_lookup(struct drm_file *filp, void __user *bo_handles,
 	}
 
 	ret = objects_lookup(filp, handles, count, objs);
-	*objs_out = objs;
-
 out:
 	kvfree(handles);
 	return ret;
-
 }
 EXPORT_SYMBOL(drm_gem_objects_lookup);
 
@@ -949,6 +1027,10 @@ drm_gem_release(struct drm_device *dev, struct drm_file *file_private)
 	idr_for_each(&file_private->object_idr,
 		     &drm_gem_object_release_handle, file_private);
 	idr_destroy(&file_private->object_idr);
+
+	/* Objects closed through GEM_CLOSE are gone once the file is */
+	if (atomic_read(&file_private->gem_deferred_puts))
+		drm_gem_flush_deferred_puts();
 }
 
 /**
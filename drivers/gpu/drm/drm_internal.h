@@ -55,6 +55,27 @@ int drm_irq_by_busid(struct drm_device *dev, void *data,
 void drm_pci_agp_destroy(struct drm_device *dev);
 int drm_pci_set_busid(struct drm_device *dev, struct drm_master *master);
 
+/* drm_ioctl.c */
+#ifdef __FreeBSD__
+/* Latency buckets, bucket n counts calls of [2^(n-1), 2^n) us */
+#define DRM_IOCTL_HIST_BUCKETS	16
+
+struct drm_ioctl_stat {
+	atomic64_t calls;
+	atomic64_t total_ns;
+	atomic64_t hist[DRM_IOCTL_HIST_BUCKETS];
+};
+
+struct drm_ioctl_stats {
+	bool enabled;
+	unsigned int count;
+	struct drm_ioctl_stat stat[];
+};
+
+int drm_ioctl_stats_enable(struct drm_device *dev, bool enable);
+const char *drm_ioctl_stats_name(struct drm_device *dev, unsigned int idx);
+#endif
+
 /* drm_prime.c */
 int drm_prime_handle_to_fd_ioctl(struct drm_device *dev, void *data,
 				 struct drm_file *file_priv);
@@ -134,6 +155,9 @@ int drm_gem_open_ioctl(struct drm_device *dev, void *data,
 		       struct drm_file *file_priv);
 void drm_gem_open(struct drm_device *dev, struct drm_file *file_private);
 void drm_gem_release(struct drm_device *dev, struct drm_file *file_private);
+int drm_gem_put_init(void);
+void drm_gem_put_exit(void);
+void drm_gem_flush_deferred_puts(void);
 void drm_gem_print_info(struct drm_printer *p, unsigned int indent,
 			const struct drm_gem_object *obj);
 
@@ -223,6 +247,7 @@ int drm_syncobj_timeline_signal_ioctl(struct drm_device *dev, void *data,
 				      struct drm_file *file_private);
 int drm_syncobj_query_ioctl(struct drm_device *dev, void *data,
 			    struct drm_file *file_private);
+int drm_syncobj_debugfs_init(struct drm_minor *minor);
 
 /* drm_framebuffer.c */
 void drm_framebuffer_print_info(struct drm_printer *p, unsigned int indent,
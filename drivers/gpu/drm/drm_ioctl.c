@@ -738,6 +738,58 @@ static const struct drm_ioctl_desc drm_ioctls[] = {
 
 #define DRM_CORE_IOCTL_COUNT	ARRAY_SIZE( drm_ioctls )
 
+#ifdef __FreeBSD__
+/*
+ * Optional per-ioctl call counts and latency histograms, switched on and
+ * reported through hw.dri.N.ioctl_stats. Slots below DRM_CORE_IOCTL_COUNT are
+ * core ioctls, the driver's ioctls follow. The table is only freed with the
+ * device so ioctls in flight never see it go away. Concurrent enables race
+ * to install it, the loser frees its copy.
+ */
+int drm_ioctl_stats_enable(struct drm_device *dev, bool enable)
+{
+	struct drm_ioctl_stats *stats, *old;
+	unsigned int count;
+
+	stats = smp_load_acquire(&dev->ioctl_stats);
+	if (!stats && enable) {
+		count = DRM_CORE_IOCTL_COUNT + dev->driver->num_ioctls;
+		stats = kzalloc(struct_size(stats, stat, count), GFP_KERNEL);
+		if (!stats)
+			return -ENOMEM;
+		stats->count = count;
+		old = cmpxchg(&dev->ioctl_stats, NULL, stats);
+		if (old) {
+			kfree(stats);
+			stats = old;
+		}
+	}
+	if (stats)
+		WRITE_ONCE(stats->enabled, enable);
+	return 0;
+}
+
+const char *drm_ioctl_stats_name(struct drm_device *dev, unsigned int idx)
+{
+	if (idx < DRM_CORE_IOCTL_COUNT)
+		return drm_ioctls[idx].name;
+	return dev->driver->ioctls[idx - DRM_CORE_IOCTL_COUNT].name;
+}
+
+static void drm_ioctl_stats_account(struct drm_ioctl_stats *stats,
+				    unsigned int idx, u64 ns)
+{
+	struct drm_ioctl_stat *stat = &stats->stat[idx];
+	unsigned int bucket;
+
+	bucket = min_t(unsigned int, fls64(div_u64(ns, NSEC_PER_USEC)),
+		       DRM_IOCTL_HIST_BUCKETS - 1);
+	atomic64_inc(&stat->calls);
+	atomic64_add(ns, &stat->total_ns);
+	atomic64_inc(&stat->hist[bucket]);
+}
+#endif
+
 /**
  * DOC: driver specific ioctls
  *
@@ -839,6 +891,11 @@ long drm_ioctl(struct file *filp,
 	char *kdata = NULL;
 	unsigned int in_size, out_size, drv_size, ksize;
 	bool is_driver_ioctl;
+#ifdef __FreeBSD__
+	struct drm_ioctl_stats *stats;
+	unsigned int stat_idx;
+	u64 start = 0;
+#endif
 
 	dev = file_priv->minor->dev;
 
@@ -862,12 +919,18 @@ long drm_ioctl(struct file *filp,
 			goto err_i1;
 		index = array_index_nospec(index, dev->driver->num_ioctls);
 		ioctl = &dev->driver->ioctls[index];
+#ifdef __FreeBSD__
+		stat_idx = DRM_CORE_IOCTL_COUNT + index;
+#endif
 	} else {
 		/* core ioctl */
 		if (nr >= DRM_CORE_IOCTL_COUNT)
 			goto err_i1;
 		nr = array_index_nospec(nr, DRM_CORE_IOCTL_COUNT);
 		ioctl = &drm_ioctls[nr];
+#ifdef __FreeBSD__
+		stat_idx = nr;
+#endif
 	}
 
 	drv_size = _IOC_SIZE(ioctl->cmd);
@@ -892,6 +955,11 @@ long drm_ioctl(struct file *filp,
 		goto err_i1;
 	}
 
+	/*
+	 * Nearly every ioctl argument fits the stack buffer: across the uapi
+	 * headers only GET_STATS (248 bytes) and AMDGPU_GEM_METADATA (288)
+	 * are larger, atomic, execbuffer2 and CS are 64 bytes or less.
+	 */
 	if (ksize <= sizeof(stack_kdata)) {
 		kdata = stack_kdata;
 	} else {
@@ -910,7 +978,19 @@ long drm_ioctl(struct file *filp,
 	if (ksize > in_size)
 		memset(kdata + in_size, 0, ksize - in_size);
 
+#ifdef __FreeBSD__
+	stats = smp_load_acquire(&dev->ioctl_stats);
+	if (unlikely(stats && READ_ONCE(stats->enabled)))
+		start = ktime_get_ns();
+	else
+		stats = NULL;
+#endif
 	retcode = drm_ioctl_kernel(filp, func, kdata, ioctl->flags);
+#ifdef __FreeBSD__
+	if (unlikely(stats))
+		drm_ioctl_stats_account(stats, stat_idx,
+					ktime_get_ns() - start);
+#endif
 	if (copy_to_user((void __user *)arg, kdata, out_size) != 0)
 		retcode = -EFAULT;
 
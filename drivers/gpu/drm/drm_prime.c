@@ -34,7 +34,8 @@
 
 #include <linux/export.h>
 #include <linux/dma-buf.h>
-#include <linux/rbtree.h>
+#include <linux/hashtable.h>
+#include <linux/kref.h>
 
 #include <drm/drm.h>
 #include <drm/drm_drv.h>
@@ -86,6 +87,11 @@
  * retain a weak reference, which is cleaned up when the corresponding object is
  * released.
  *
+ * Both caches are hash tables which are looked up under RCU first, so passing
+ * a buffer that is already known to a file back and forth takes no lock at
+ * all. Cache entries, and the &dma_buf reference they hold, are only released
+ * a grace period after they were unhashed.
+ *
  * Self-importing: If userspace is using PRIME as a replacement for flink then
  * it will get a fd->handle request for a GEM object that it created.  Drivers
  * should detect this situation and return back the underlying object from the
@@ -97,15 +103,19 @@ struct drm_prime_member {
 	struct dma_buf *dma_buf;
 	uint32_t handle;
 
-	struct rb_node dmabuf_rb;
-	struct rb_node handle_rb;
+	struct hlist_node dmabuf_hash;
+	struct hlist_node handle_hash;
+
+	/* Users of the member's dma_buf reference: the hash tables plus any
+	 * lockless lookup that is taking a reference of its own */
+	struct kref ref;
+	struct rcu_head rcu;
 };
 
 static int drm_prime_add_buf_handle(struct drm_prime_file_private *prime_fpriv,
 				    struct dma_buf *dma_buf, uint32_t handle)
 {
 	struct drm_prime_member *member;
-	struct rb_node **p, *rb;
 
 	member = kmalloc(sizeof(*member), GFP_KERNEL);
 	if (!member)
@@ -114,79 +124,86 @@ static int drm_prime_add_buf_handle(struct drm_prime_file_private *prime_fpriv,
 	get_dma_buf(dma_buf);
 	member->dma_buf = dma_buf;
 	member->handle = handle;
+	kref_init(&member->ref);
 
-	rb = NULL;
-	p = &prime_fpriv->dmabufs.rb_node;
-	while (*p) {
-		struct drm_prime_member *pos;
-
-		rb = *p;
-		pos = rb_entry(rb, struct drm_prime_member, dmabuf_rb);
-		if (dma_buf > pos->dma_buf)
-			p = &rb->rb_right;
-		else
-			p = &rb->rb_left;
-	}
-	rb_link_node(&member->dmabuf_rb, rb, p);
-	rb_insert_color(&member->dmabuf_rb, &prime_fpriv->dmabufs);
-
-	rb = NULL;
-	p = &prime_fpriv->handles.rb_node;
-	while (*p) {
-		struct drm_prime_member *pos;
-
-		rb = *p;
-		pos = rb_entry(rb, struct drm_prime_member, handle_rb);
-		if (handle > pos->handle)
-			p = &rb->rb_right;
-		else
-			p = &rb->rb_left;
-	}
-	rb_link_node(&member->handle_rb, rb, p);
-	rb_insert_color(&member->handle_rb, &prime_fpriv->handles);
+	hash_add_rcu(prime_fpriv->dmabufs, &member->dmabuf_hash,
+		     (unsigned long)dma_buf);
+	hash_add_rcu(prime_fpriv->handles, &member->handle_hash, handle);
 
 	return 0;
 }
 
-static struct dma_buf *drm_prime_lookup_buf_by_handle(struct drm_prime_file_private *prime_fpriv,
-						      uint32_t handle)
+static void drm_prime_member_release(struct kref *ref)
 {
-	struct rb_node *rb;
+	struct drm_prime_member *member =
+		container_of(ref, typeof(*member), ref);
 
-	rb = prime_fpriv->handles.rb_node;
-	while (rb) {
-		struct drm_prime_member *member;
+	dma_buf_put(member->dma_buf);
+	kfree_rcu(member, rcu);
+}
+
+/*
+ * The lookups below must be called with either prime_fpriv->lock or the RCU
+ * read lock held. Members are freed after a grace period, but their dma_buf
+ * reference is dropped as soon as they are removed; see
+ * drm_prime_get_buf_by_handle() for taking a reference without the lock.
+ */
+static struct drm_prime_member *drm_prime_lookup_member(struct drm_prime_file_private *prime_fpriv,
+							uint32_t handle)
+{
+	struct drm_prime_member *member;
 
-		member = rb_entry(rb, struct drm_prime_member, handle_rb);
+	hash_for_each_possible_rcu(prime_fpriv->handles, member,
+				   handle_hash, handle) {
 		if (member->handle == handle)
-			return member->dma_buf;
-		else if (member->handle < handle)
-			rb = rb->rb_right;
-		else
-			rb = rb->rb_left;
+			return member;
 	}
 
 	return NULL;
 }
 
+static struct dma_buf *drm_prime_lookup_buf_by_handle(struct drm_prime_file_private *prime_fpriv,
+						      uint32_t handle)
+{
+	struct drm_prime_member *member;
+
+	member = drm_prime_lookup_member(prime_fpriv, handle);
+	return member ? member->dma_buf : NULL;
+}
+
+/* Lockless lookup returning a new reference to the handle's dma_buf */
+static struct dma_buf *drm_prime_get_buf_by_handle(struct drm_prime_file_private *prime_fpriv,
+						   uint32_t handle)
+{
+	struct drm_prime_member *member;
+	struct dma_buf *dma_buf;
+
+	rcu_read_lock();
+	member = drm_prime_lookup_member(prime_fpriv, handle);
+	if (member && !kref_get_unless_zero(&member->ref))
+		member = NULL;
+	rcu_read_unlock();
+	if (!member)
+		return NULL;
+
+	dma_buf = member->dma_buf;
+	get_dma_buf(dma_buf);
+	kref_put(&member->ref, drm_prime_member_release);
+
+	return dma_buf;
+}
+
 static int drm_prime_lookup_buf_handle(struct drm_prime_file_private *prime_fpriv,
 				       struct dma_buf *dma_buf,
 				       uint32_t *handle)
 {
-	struct rb_node *rb;
-
-	rb = prime_fpriv->dmabufs.rb_node;
-	while (rb) {
-		struct drm_prime_member *member;
+	struct drm_prime_member *member;
 
-		member = rb_entry(rb, struct drm_prime_member, dmabuf_rb);
+	hash_for_each_possible_rcu(prime_fpriv->dmabufs, member,
+				   dmabuf_hash, (unsigned long)dma_buf) {
 		if (member->dma_buf == dma_buf) {
 			*handle = member->handle;
 			return 0;
-		} else if (member->dma_buf < dma_buf) {
-			rb = rb->rb_right;
-		} else {
-			rb = rb->rb_left;
 		}
 	}
 
@@ -196,24 +213,16 @@ static int drm_prime_lookup_buf_handle(struct drm_prime_file_private *prime_fpri
 void drm_prime_remove_buf_handle_locked(struct drm_prime_file_private *prime_fpriv,
 					struct dma_buf *dma_buf)
 {
-	struct rb_node *rb;
-
-	rb = prime_fpriv->dmabufs.rb_node;
-	while (rb) {
-		struct drm_prime_member *member;
+	struct drm_prime_member *member;
 
-		member = rb_entry(rb, struct drm_prime_member, dmabuf_rb);
+	hash_for_each_possible(prime_fpriv->dmabufs, member,
+			       dmabuf_hash, (unsigned long)dma_buf) {
 		if (member->dma_buf == dma_buf) {
-			rb_erase(&member->handle_rb, &prime_fpriv->handles);
-			rb_erase(&member->dmabuf_rb, &prime_fpriv->dmabufs);
+			hash_del_rcu(&member->handle_hash);
+			hash_del_rcu(&member->dmabuf_hash);
 
-			dma_buf_put(dma_buf);
-			kfree(member);
+			kref_put(&member->ref, drm_prime_member_release);
 			return;
-		} else if (member->dma_buf < dma_buf) {
-			rb = rb->rb_right;
-		} else {
-			rb = rb->rb_left;
 		}
 	}
 }
@@ -221,8 +230,8 @@ void drm_prime_remove_buf_handle_locked(struct drm_prime_file_private *prime_fpr
 void drm_prime_init_file_private(struct drm_prime_file_private *prime_fpriv)
 {
 	mutex_init(&prime_fpriv->lock);
-	prime_fpriv->dmabufs = RB_ROOT;
-	prime_fpriv->handles = RB_ROOT;
+	hash_init(prime_fpriv->dmabufs);
+	hash_init(prime_fpriv->handles);
 }
 
 void drm_prime_destroy_file_private(struct drm_prime_file_private *prime_fpriv)
@@ -232,7 +241,7 @@ void drm_prime_destroy_file_private(struct drm_prime_file_private *prime_fpriv)
 #endif
 
 	/* by now drm_gem_release should've made sure the list is empty */
-	WARN_ON(!RB_EMPTY_ROOT(&prime_fpriv->dmabufs));
+	WARN_ON(!hash_empty(prime_fpriv->dmabufs));
 }
 
 /**
@@ -310,6 +319,15 @@ int drm_gem_prime_fd_to_handle(struct drm_device *dev,
 	if (IS_ERR(dma_buf))
 		return PTR_ERR(dma_buf);
 
+	/* Fast path, this file already has a handle for the buffer */
+	rcu_read_lock();
+	ret = drm_prime_lookup_buf_handle(&file_priv->prime, dma_buf, handle);
+	rcu_read_unlock();
+	if (ret == 0) {
+		dma_buf_put(dma_buf);
+		return 0;
+	}
+
 	mutex_lock(&file_priv->prime.lock);
 
 	ret = drm_prime_lookup_buf_handle(&file_priv->prime,
@@ -438,6 +456,18 @@ int drm_gem_prime_handle_to_fd(struct drm_device *dev,
 	int ret = 0;
 	struct dma_buf *dmabuf;
 
+	/* Fast path, the handle was exported or imported before */
+	dmabuf = drm_prime_get_buf_by_handle(&file_priv->prime, handle);
+	if (dmabuf) {
+		ret = dma_buf_fd(dmabuf, flags);
+		if (ret < 0) {
+			dma_buf_put(dmabuf);
+			return ret;
+		}
+		*prime_fd = ret;
+		return 0;
+	}
+
 	mutex_lock(&file_priv->prime.lock);
 	obj = drm_gem_object_lookup(file_priv, handle);
 	if (!obj)  {
@@ -552,7 +582,9 @@ int drm_prime_handle_to_fd_ioctl(struct drm_device *dev, void *data,
  * Optional pinning of buffers is handled at dma-buf attach and detach time in
  * drm_gem_map_attach() and drm_gem_map_detach(). Backing storage itself is
  * handled by drm_gem_map_dma_buf() and drm_gem_unmap_dma_buf(), which relies on
- * &drm_gem_object_funcs.get_sg_table.
+ * &drm_gem_object_funcs.get_sg_table. Since the attachment keeps the buffer
+ * pinned, the mapping is built once per attachment and direction and only
+ * torn down on detach.
  *
  * For kernel-internal access there's drm_gem_dmabuf_vmap() and
  * drm_gem_dmabuf_vunmap(). Userspace mmap support is provided by
@@ -575,6 +607,30 @@ int drm_prime_handle_to_fd_ioctl(struct drm_device *dev, void *data,
  * option for sharing lots of buffers for rendering.
  */
 
+/*
+ * Mappings cached per attachment and DMA direction, see drm_gem_map_dma_buf().
+ * The lock serializes filling the cache, importers may map concurrently.
+ */
+struct drm_prime_attachment {
+	struct mutex lock;
+	struct sg_table *sgt[DMA_NONE];
+};
+
+static void drm_gem_unmap_sgt(struct dma_buf_attachment *attach,
+			      struct sg_table *sgt,
+			      enum dma_data_direction dir)
+{
+	dma_unmap_sg_attrs(attach->dev, sgt->sgl, sgt->nents, dir,
+#ifdef __linux__
+		// linuxkpi's dma_attrs is old and incompatible
+			   DMA_ATTR_SKIP_CPU_SYNC);
+#elif defined(__FreeBSD__)
+			   NULL);
+#endif
+	sg_free_table(sgt);
+	kfree(sgt);
+}
+
 /**
  * drm_gem_map_attach - dma_buf attach implementation for GEM
  * @dma_buf: buffer to attach device to
@@ -589,9 +645,24 @@ int drm_prime_handle_to_fd_ioctl(struct drm_device *dev, void *data,
 int drm_gem_map_attach(struct dma_buf *dma_buf,
 		       struct dma_buf_attachment *attach)
 {
+	struct drm_prime_attachment *prime_attach;
 	struct drm_gem_object *obj = dma_buf->priv;
+	int ret;
+
+	prime_attach = kzalloc(sizeof(*prime_attach), GFP_KERNEL);
+	if (!prime_attach)
+		return -ENOMEM;
+	mutex_init(&prime_attach->lock);
 
-	return drm_gem_pin(obj);
+	ret = drm_gem_pin(obj);
+	if (ret) {
+		mutex_destroy(&prime_attach->lock);
+		kfree(prime_attach);
+		return ret;
+	}
+
+	attach->priv = prime_attach;
+	return 0;
 }
 EXPORT_SYMBOL(drm_gem_map_attach);
 
@@ -601,13 +672,27 @@ EXPORT_SYMBOL(drm_gem_map_attach);
  * @attach: attachment to be detached
  *
  * Calls &drm_gem_object_funcs.pin for device specific handling.  Cleans up
- * &dma_buf_attachment from drm_gem_map_attach(). This can be used as the
+ * &dma_buf_attachment from drm_gem_map_attach(), including the mappings
+ * cached by drm_gem_map_dma_buf(). This can be used as the
  * &dma_buf_ops.detach callback.
  */
 void drm_gem_map_detach(struct dma_buf *dma_buf,
 			struct dma_buf_attachment *attach)
 {
+	struct drm_prime_attachment *prime_attach = attach->priv;
 	struct drm_gem_object *obj = dma_buf->priv;
+	int dir;
+
+	if (prime_attach) {
+		for (dir = 0; dir < DMA_NONE; dir++) {
+			if (prime_attach->sgt[dir])
+				drm_gem_unmap_sgt(attach, prime_attach->sgt[dir],
+						  dir);
+		}
+		mutex_destroy(&prime_attach->lock);
+		kfree(prime_attach);
+		attach->priv = NULL;
+	}
 
 	drm_gem_unpin(obj);
 }
@@ -622,22 +707,36 @@ EXPORT_SYMBOL(drm_gem_map_detach);
  * can be used as the &dma_buf_ops.map_dma_buf callback. Should be used together
  * with drm_gem_unmap_dma_buf().
  *
+ * For attachments set up by drm_gem_map_attach() the mapping is cached per
+ * direction and handed out again on the next call, until drm_gem_map_detach().
+ *
  * Returns:sg_table containing the scatterlist to be returned; returns ERR_PTR
  * on error. May return -EINTR if it is interrupted by a signal.
  */
 struct sg_table *drm_gem_map_dma_buf(struct dma_buf_attachment *attach,
 				     enum dma_data_direction dir)
 {
+	struct drm_prime_attachment *prime_attach = attach->priv;
 	struct drm_gem_object *obj = attach->dmabuf->priv;
 	struct sg_table *sgt;
 
 	if (WARN_ON(dir == DMA_NONE))
 		return ERR_PTR(-EINVAL);
 
+	if (prime_attach) {
+		mutex_lock(&prime_attach->lock);
+		if (prime_attach->sgt[dir]) {
+			sgt = prime_attach->sgt[dir];
+			goto out;
+		}
+	}
+
 	if (obj->funcs)
 		sgt = obj->funcs->get_sg_table(obj);
 	else
 		sgt = obj->dev->driver->gem_prime_get_sg_table(obj);
+	if (IS_ERR(sgt))
+		goto out;
 
 	if (!dma_map_sg_attrs(attach->dev, sgt->sgl, sgt->nents, dir,
 #ifdef __linux__
@@ -649,8 +748,15 @@ struct sg_table *drm_gem_map_dma_buf(struct dma_buf_attachment *attach,
 		sg_free_table(sgt);
 		kfree(sgt);
 		sgt = ERR_PTR(-ENOMEM);
+		goto out;
 	}
 
+	if (prime_attach)
+		prime_attach->sgt[dir] = sgt;
+
+out:
+	if (prime_attach)
+		mutex_unlock(&prime_attach->lock);
 	return sgt;
 }
 EXPORT_SYMBOL(drm_gem_map_dma_buf);
@@ -661,24 +767,28 @@ EXPORT_SYMBOL(drm_gem_map_dma_buf);
  * @sgt: scatterlist info of the buffer to unmap
  * @dir: direction of DMA transfer
  *
- * This can be used as the &dma_buf_ops.unmap_dma_buf callback.
+ * This can be used as the &dma_buf_ops.unmap_dma_buf callback. Mappings cached
+ * by drm_gem_map_dma_buf() are left in place for the next map.
  */
 void drm_gem_unmap_dma_buf(struct dma_buf_attachment *attach,
 			   struct sg_table *sgt,
 			   enum dma_data_direction dir)
 {
+	struct drm_prime_attachment *prime_attach = attach->priv;
+	bool cached;
+
 	if (!sgt)
 		return;
 
-	dma_unmap_sg_attrs(attach->dev, sgt->sgl, sgt->nents, dir,
-#ifdef __linux__
-		// linuxkpi's dma_attrs is old and incompatible
-			   DMA_ATTR_SKIP_CPU_SYNC);
-#elif defined(__FreeBSD__)
-			   NULL);
-#endif
-	sg_free_table(sgt);
-	kfree(sgt);
+	if (prime_attach && dir < DMA_NONE) {
+		mutex_lock(&prime_attach->lock);
+		cached = prime_attach->sgt[dir] == sgt;
+		mutex_unlock(&prime_attach->lock);
+		if (cached)
+			return;
+	}
+
+	drm_gem_unmap_sgt(attach, sgt, dir);
 }
 EXPORT_SYMBOL(drm_gem_unmap_dma_buf);
 
@@ -806,6 +916,23 @@ static const struct dma_buf_ops drm_gem_prime_dmabuf_ops =  {
 	.vunmap = drm_gem_dmabuf_vunmap,
 };
 
+/* Largest page aligned length that fits a scatterlist segment */
+#define DRM_PRIME_MAX_SEG_PAGES (UINT_MAX >> PAGE_SHIFT)
+
+/* End of the run of physically contiguous pages starting at @i */
+static unsigned int drm_prime_pages_run(struct page **pages, unsigned int i,
+					unsigned int nr_pages)
+{
+	unsigned int j;
+
+	for (j = i + 1; j < nr_pages; j++) {
+		if (page_to_pfn(pages[j]) != page_to_pfn(pages[j - 1]) + 1 ||
+		    j - i == DRM_PRIME_MAX_SEG_PAGES)
+			break;
+	}
+	return j;
+}
+
 /**
  * drm_prime_pages_to_sg - converts a page array into an sg list
  * @pages: pointer to the array of page pointers to convert
@@ -813,13 +940,16 @@ static const struct dma_buf_ops drm_gem_prime_dmabuf_ops =  {
  *
  * This helper creates an sg table object from a set of pages
  * the driver is responsible for mapping the pages into the
- * importers address space for use with dma_buf itself.
+ * importers address space for use with dma_buf itself. Physically contiguous
+ * pages are coalesced into a single segment.
  *
  * This is useful for implementing &drm_gem_object_funcs.get_sg_table.
  */
 struct sg_table *drm_prime_pages_to_sg(struct page **pages, unsigned int nr_pages)
 {
 	struct sg_table *sg = NULL;
+	struct scatterlist *sgl;
+	unsigned int i, j, nents;
 	int ret;
 
 	sg = kmalloc(sizeof(struct sg_table), GFP_KERNEL);
@@ -828,11 +958,19 @@ struct sg_table *drm_prime_pages_to_sg(struct page **pages, unsigned int nr_page
 		goto out;
 	}
 
-	ret = sg_alloc_table_from_pages(sg, pages, nr_pages, 0,
-				nr_pages << PAGE_SHIFT, GFP_KERNEL);
+	/* One segment per run of physically contiguous pages */
+	for (i = 0, nents = 0; i < nr_pages; i = j, nents++)
+		j = drm_prime_pages_run(pages, i, nr_pages);
+
+	ret = sg_alloc_table(sg, nents, GFP_KERNEL);
 	if (ret)
 		goto out;
 
+	for (i = 0, sgl = sg->sgl; i < nr_pages; i = j, sgl = sg_next(sgl)) {
+		j = drm_prime_pages_run(pages, i, nr_pages);
+		sg_set_page(sgl, pages[i], (j - i) << PAGE_SHIFT, 0);
+	}
+
 	return sg;
 out:
 	kfree(sg);
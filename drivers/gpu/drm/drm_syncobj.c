@@ -130,6 +130,7 @@
 #include <linux/uaccess.h>
 
 #include <drm/drm.h>
+#include <drm/drm_debugfs.h>
 #include <drm/drm_drv.h>
 #include <drm/drm_file.h>
 #include <drm/drm_gem.h>
@@ -138,14 +139,33 @@
 
 #include "drm_internal.h"
 
+/*
+ * Shared by all entries of one drm_syncobj_array_wait_timeout() call, so
+ * the waiter only looks at the entries whose state actually changed.
+ */
+struct syncobj_wait_bitmap {
+	unsigned long *signaled;	/* fence signaled or available */
+	unsigned long *submitted;	/* fence attached, callback not armed */
+};
+
 struct syncobj_wait_entry {
 	struct list_head node;
 	struct task_struct *task;
 	struct dma_fence *fence;
 	struct dma_fence_cb fence_cb;
 	u64    point;
+	struct syncobj_wait_bitmap *bitmap;
+	u32    index;
 };
 
+static void syncobj_wait_mark(struct syncobj_wait_entry *wait,
+			      unsigned long *bits)
+{
+	/* Publish wait->fence before the waiter sees the bit */
+	smp_mb__before_atomic();
+	set_bit(wait->index, bits);
+}
+
 static void syncobj_wait_syncobj_func(struct drm_syncobj *syncobj,
 				      struct syncobj_wait_entry *wait);
 
@@ -175,6 +195,150 @@ struct drm_syncobj *drm_syncobj_find(struct drm_file *file_private,
 }
 EXPORT_SYMBOL(drm_syncobj_find);
 
+/*
+ * Timeline point index.
+ *
+ * Resolving a timeline point walks the fence chain from its head, which is
+ * linear in the number of points that have not signaled yet.  The index keeps
+ * references to an ordered, sparse subset of the chain nodes so a lookup can
+ * start its walk close to the point it is after: every stride-th point is
+ * recorded and the stride doubles whenever the array fills up.  Points whose
+ * own fence signaled are retired from the front as new points are added.
+ *
+ * The index is only touched under &drm_syncobj.lock.
+ */
+#define DRM_SYNCOBJ_INDEX_SIZE 128
+
+struct drm_syncobj_index {
+	unsigned int count;
+	unsigned int stride;
+	unsigned int skipped;
+	struct dma_fence *points[DRM_SYNCOBJ_INDEX_SIZE];
+};
+
+static struct {
+	atomic64_t added;
+	atomic64_t retired;
+	atomic64_t lookups;
+} drm_syncobj_stats;
+
+static void drm_syncobj_index_reset(struct drm_syncobj_index *index)
+{
+	while (index->count)
+		dma_fence_put(index->points[--index->count]);
+	index->stride = 1;
+	index->skipped = 0;
+}
+
+static void drm_syncobj_index_add(struct drm_syncobj_index *index,
+				  struct dma_fence *fence)
+{
+	unsigned int i;
+
+	/* Unordered points start a new context, older points don't apply */
+	if (index->count &&
+	    index->points[index->count - 1]->context != fence->context)
+		drm_syncobj_index_reset(index);
+
+	if (++index->skipped < index->stride)
+		return;
+	index->skipped = 0;
+
+	if (index->count == DRM_SYNCOBJ_INDEX_SIZE) {
+		/* Keep every other point and record half as many from now on */
+		for (i = 0; i < index->count / 2; i++) {
+			dma_fence_put(index->points[2 * i]);
+			index->points[i] = index->points[2 * i + 1];
+		}
+		index->count /= 2;
+		index->stride *= 2;
+	}
+	index->points[index->count++] = dma_fence_get(fence);
+}
+
+/*
+ * Drop the indexed points whose fence signaled and return the oldest one
+ * left, or NULL if none are.
+ */
+static struct dma_fence *drm_syncobj_index_retire(struct drm_syncobj_index *index)
+{
+	struct dma_fence_chain *chain;
+	unsigned int n;
+
+	for (n = 0; n < index->count; n++) {
+		chain = to_dma_fence_chain(index->points[n]);
+		if (!dma_fence_is_signaled(chain->fence))
+			break;
+		dma_fence_put(index->points[n]);
+	}
+	if (!n)
+		return index->count ? index->points[0] : NULL;
+
+	atomic64_add(n, &drm_syncobj_stats.retired);
+	index->count -= n;
+	memmove(index->points, index->points + n,
+		index->count * sizeof(index->points[0]));
+	if (!index->count) {
+		drm_syncobj_index_reset(index);
+		return NULL;
+	}
+	return index->points[0];
+}
+
+/* The closest indexed point at or after @point, @head if there is none */
+static struct dma_fence *drm_syncobj_index_find(struct drm_syncobj_index *index,
+						struct dma_fence *head,
+						u64 point)
+{
+	unsigned int lo = 0, hi = index->count, mid;
+
+	if (!point || !hi || index->points[hi - 1]->context != head->context)
+		return head;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (index->points[mid]->seqno < point)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < index->count ? index->points[lo] : head;
+}
+
+/*
+ * Returns a reference to the fence to start the chain walk for @point from.
+ * Must be called with &drm_syncobj.lock held.
+ */
+static struct dma_fence *
+drm_syncobj_fence_get_point_locked(struct drm_syncobj *syncobj, u64 point)
+{
+	struct dma_fence *fence;
+
+	fence = rcu_dereference_protected(syncobj->fence,
+					  lockdep_is_held(&syncobj->lock));
+	if (fence && syncobj->index)
+		fence = drm_syncobj_index_find(syncobj->index, fence, point);
+	return dma_fence_get(fence);
+}
+
+/* Like drm_syncobj_fence_get(), but for resolving @point */
+static struct dma_fence *
+drm_syncobj_fence_get_point(struct drm_syncobj *syncobj, u64 point)
+{
+	struct dma_fence *fence;
+
+	/* Binary syncobjs never get an index, keep their lookup lockless */
+	if (!READ_ONCE(syncobj->index))
+		return drm_syncobj_fence_get(syncobj);
+
+	atomic64_inc(&drm_syncobj_stats.lookups);
+	spin_lock(&syncobj->lock);
+	fence = drm_syncobj_fence_get_point_locked(syncobj, point);
+	spin_unlock(&syncobj->lock);
+
+	return fence;
+}
+
 static void drm_syncobj_fence_add_wait(struct drm_syncobj *syncobj,
 				       struct syncobj_wait_entry *wait)
 {
@@ -188,7 +352,7 @@ static void drm_syncobj_fence_add_wait(struct drm_syncobj *syncobj,
 	 * have the lock, try one more time just to be sure we don't add a
 	 * callback when a fence has already been set.
 	 */
-	fence = dma_fence_get(rcu_dereference_protected(syncobj->fence, 1));
+	fence = drm_syncobj_fence_get_point_locked(syncobj, wait->point);
 	if (!fence || dma_fence_chain_find_seqno(&fence, wait->point)) {
 		dma_fence_put(fence);
 		list_add_tail(&wait->node, &syncobj->cb_list);
@@ -197,6 +361,8 @@ static void drm_syncobj_fence_add_wait(struct drm_syncobj *syncobj,
 	} else {
 		wait->fence = fence;
 	}
+	if (wait->fence && wait->bitmap)
+		syncobj_wait_mark(wait, wait->bitmap->submitted);
 	spin_unlock(&syncobj->lock);
 }
 
@@ -226,7 +392,15 @@ void drm_syncobj_add_point(struct drm_syncobj *syncobj,
 			   uint64_t point)
 {
 	struct syncobj_wait_entry *cur, *tmp;
-	struct dma_fence *prev;
+	struct drm_syncobj_index *index = NULL;
+	struct dma_fence *prev, *oldest = NULL;
+
+	/* Callers may hold locks reclaim depends on, the index is optional */
+	if (!READ_ONCE(syncobj->index)) {
+		index = kzalloc(sizeof(*index), GFP_NOWAIT | __GFP_NOWARN);
+		if (index)
+			index->stride = 1;
+	}
 
 	dma_fence_get(fence);
 
@@ -239,12 +413,34 @@ void drm_syncobj_add_point(struct drm_syncobj *syncobj,
 	dma_fence_chain_init(chain, prev, fence, point);
 	rcu_assign_pointer(syncobj->fence, &chain->base);
 
+	if (!syncobj->index) {
+		syncobj->index = index;
+		index = NULL;
+	}
+	if (syncobj->index) {
+		drm_syncobj_index_add(syncobj->index, &chain->base);
+		oldest = drm_syncobj_index_retire(syncobj->index);
+		oldest = dma_fence_get(oldest ?: &chain->base);
+	}
+	atomic64_inc(&drm_syncobj_stats.added);
+
 	list_for_each_entry_safe(cur, tmp, &syncobj->cb_list, node)
 		syncobj_wait_syncobj_func(syncobj, cur);
 	spin_unlock(&syncobj->lock);
 
-	/* Walk the chain once to trigger garbage collection */
-	dma_fence_chain_for_each(fence, prev);
+	kfree(index);
+
+	if (!syncobj->index) {
+		/* Walk the chain once to trigger garbage collection */
+		dma_fence_chain_for_each(fence, prev);
+	} else {
+		/*
+		 * Points newer than the oldest pending indexed one haven't
+		 * signaled yet for the most part; a single step from there
+		 * collapses the signaled prefix without walking them all.
+		 */
+		dma_fence_put(dma_fence_chain_walk(oldest));
+	}
 	dma_fence_put(prev);
 }
 EXPORT_SYMBOL(drm_syncobj_add_point);
@@ -270,6 +466,8 @@ void drm_syncobj_replace_fence(struct drm_syncobj *syncobj,
 	old_fence = rcu_dereference_protected(syncobj->fence,
 					      lockdep_is_held(&syncobj->lock));
 	rcu_assign_pointer(syncobj->fence, fence);
+	if (syncobj->index)
+		drm_syncobj_index_reset(syncobj->index);
 
 	if (fence != old_fence) {
 		list_for_each_entry_safe(cur, tmp, &syncobj->cb_list, node)
@@ -325,7 +523,7 @@ int drm_syncobj_find_fence(struct drm_file *file_private,
 	if (!syncobj)
 		return -ENOENT;
 
-	*fence = drm_syncobj_fence_get(syncobj);
+	*fence = drm_syncobj_fence_get_point(syncobj, point);
 	drm_syncobj_put(syncobj);
 
 	if (*fence) {
@@ -386,6 +584,7 @@ void drm_syncobj_free(struct kref *kref)
 						   struct drm_syncobj,
 						   refcount);
 	drm_syncobj_replace_fence(syncobj, NULL);
+	kfree(syncobj->index);
 	kfree(syncobj);
 }
 EXPORT_SYMBOL(drm_syncobj_free);
@@ -845,6 +1044,8 @@ static void syncobj_wait_fence_func(struct dma_fence *fence,
 	struct syncobj_wait_entry *wait =
 		container_of(cb, struct syncobj_wait_entry, fence_cb);
 
+	if (wait->bitmap)
+		syncobj_wait_mark(wait, wait->bitmap->signaled);
 	wake_up_process(wait->task);
 }
 
@@ -854,9 +1055,7 @@ static void syncobj_wait_syncobj_func(struct drm_syncobj *syncobj,
 	struct dma_fence *fence;
 
 	/* This happens inside the syncobj lock */
-	fence = rcu_dereference_protected(syncobj->fence,
-					  lockdep_is_held(&syncobj->lock));
-	dma_fence_get(fence);
+	fence = drm_syncobj_fence_get_point_locked(syncobj, wait->point);
 	if (!fence || dma_fence_chain_find_seqno(&fence, wait->point)) {
 		dma_fence_put(fence);
 		return;
@@ -866,10 +1065,46 @@ static void syncobj_wait_syncobj_func(struct drm_syncobj *syncobj,
 		wait->fence = fence;
 	}
 
+	if (wait->bitmap)
+		syncobj_wait_mark(wait, wait->bitmap->submitted);
 	wake_up_process(wait->task);
 	list_del_init(&wait->node);
 }
 
+/* Arm the fence callback of an entry, marking it if it already signaled */
+static void syncobj_wait_arm(struct syncobj_wait_entry *entry, uint32_t flags)
+{
+	if (test_bit(entry->index, entry->bitmap->signaled) ||
+	    entry->fence_cb.func)
+		return;
+
+	if ((flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE) ||
+	    dma_fence_is_signaled(entry->fence) ||
+	    dma_fence_add_callback(entry->fence, &entry->fence_cb,
+				   syncobj_wait_fence_func))
+		set_bit(entry->index, entry->bitmap->signaled);
+}
+
+static bool syncobj_wait_done(struct syncobj_wait_bitmap *bitmap,
+			      uint32_t count, uint32_t flags, uint32_t *idx)
+{
+	unsigned long i;
+
+	if (flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_ALL) {
+		if (find_first_zero_bit(bitmap->signaled, count) < count)
+			return false;
+		i = 0;
+	} else {
+		i = find_first_bit(bitmap->signaled, count);
+		if (i >= count)
+			return false;
+	}
+
+	if (idx)
+		*idx = i;
+	return true;
+}
+
 static signed long drm_syncobj_array_wait_timeout(struct drm_syncobj **syncobjs,
 						  void __user *user_points,
 						  uint32_t count,
@@ -877,10 +1112,11 @@ static signed long drm_syncobj_array_wait_timeout(struct drm_syncobj **syncobjs,
 						  signed long timeout,
 						  uint32_t *idx)
 {
+	struct syncobj_wait_bitmap bitmap;
 	struct syncobj_wait_entry *entries;
-	struct dma_fence *fence;
+	unsigned long *bits;
 	uint64_t *points;
-	uint32_t signaled_count, i;
+	uint32_t i;
 
 	points = kmalloc_array(count, sizeof(*points), GFP_KERNEL);
 	if (points == NULL)
@@ -895,23 +1131,32 @@ static signed long drm_syncobj_array_wait_timeout(struct drm_syncobj **syncobjs,
 		goto err_free_points;
 	}
 
+	bits = kcalloc(2 * BITS_TO_LONGS(count), sizeof(*bits), GFP_KERNEL);
+	if (!bits) {
+		timeout = -ENOMEM;
+		goto err_free_points;
+	}
+	bitmap.signaled = bits;
+	bitmap.submitted = bits + BITS_TO_LONGS(count);
+
 	entries = kcalloc(count, sizeof(*entries), GFP_KERNEL);
 	if (!entries) {
 		timeout = -ENOMEM;
-		goto err_free_points;
+		goto err_free_bits;
 	}
 	/* Walk the list of sync objects and initialize entries.  We do
 	 * this up-front so that we can properly return -EINVAL if there is
 	 * a syncobj with a missing fence and then never have the chance of
 	 * returning -EINVAL again.
 	 */
-	signaled_count = 0;
 	for (i = 0; i < count; ++i) {
 		struct dma_fence *fence;
 
 		entries[i].task = current;
 		entries[i].point = points[i];
-		fence = drm_syncobj_fence_get(syncobjs[i]);
+		entries[i].bitmap = &bitmap;
+		entries[i].index = i;
+		fence = drm_syncobj_fence_get_point(syncobjs[i], points[i]);
 		if (!fence || dma_fence_chain_find_seqno(&fence, points[i])) {
 			dma_fence_put(fence);
 			if (flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT) {
@@ -928,24 +1173,22 @@ static signed long drm_syncobj_array_wait_timeout(struct drm_syncobj **syncobjs,
 			entries[i].fence = dma_fence_get_stub();
 
 		if ((flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE) ||
-		    dma_fence_is_signaled(entries[i].fence)) {
-			if (signaled_count == 0 && idx)
-				*idx = i;
-			signaled_count++;
-		}
+		    dma_fence_is_signaled(entries[i].fence))
+			set_bit(i, bitmap.signaled);
 	}
 
-	if (signaled_count == count ||
-	    (signaled_count > 0 &&
-	     !(flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_ALL)))
+	if (syncobj_wait_done(&bitmap, count, flags, idx))
 		goto cleanup_entries;
 
-	/* There's a very annoying laxness in the dma_fence API here, in
-	 * that backends are not required to automatically report when a
-	 * fence is signaled prior to fence->ops->enable_signaling() being
-	 * called.  So here if we fail to match signaled_count, we need to
-	 * fallthough and try a 0 timeout wait!
+	/*
+	 * From here on the callbacks keep the bitmaps up to date: fences
+	 * known now are armed once, later ones show up in bitmap.submitted,
+	 * and each wake only costs a bitmap scan.
 	 */
+	for (i = 0; i < count; ++i) {
+		if (entries[i].fence)
+			syncobj_wait_arm(&entries[i], flags);
+	}
 
 	if (flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT) {
 		for (i = 0; i < count; ++i)
@@ -955,34 +1198,28 @@ static signed long drm_syncobj_array_wait_timeout(struct drm_syncobj **syncobjs,
 	do {
 		set_current_state(TASK_INTERRUPTIBLE);
 
-		signaled_count = 0;
-		for (i = 0; i < count; ++i) {
-			fence = entries[i].fence;
-			if (!fence)
-				continue;
-
-			if ((flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE) ||
-			    dma_fence_is_signaled(fence) ||
-			    (!entries[i].fence_cb.func &&
-			     dma_fence_add_callback(fence,
-						    &entries[i].fence_cb,
-						    syncobj_wait_fence_func))) {
-				/* The fence has been signaled */
-				if (flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_ALL) {
-					signaled_count++;
-				} else {
-					if (idx)
-						*idx = i;
-					goto done_waiting;
-				}
-			}
+		for_each_set_bit(i, bitmap.submitted, count) {
+			if (test_and_clear_bit(i, bitmap.submitted))
+				syncobj_wait_arm(&entries[i], flags);
 		}
 
-		if (signaled_count == count)
+		if (syncobj_wait_done(&bitmap, count, flags, idx))
 			goto done_waiting;
 
 		if (timeout == 0) {
-			timeout = -ETIME;
+			/* There's a very annoying laxness in the dma_fence
+			 * API here, in that backends are not required to
+			 * automatically report when a fence is signaled prior
+			 * to fence->ops->enable_signaling() being called.  So
+			 * before giving up, poll every armed fence once.
+			 */
+			for (i = 0; i < count; ++i) {
+				if (entries[i].fence_cb.func &&
+				    dma_fence_is_signaled(entries[i].fence))
+					set_bit(i, bitmap.signaled);
+			}
+			if (!syncobj_wait_done(&bitmap, count, flags, idx))
+				timeout = -ETIME;
 			goto done_waiting;
 		}
 
@@ -1007,6 +1244,8 @@ cleanup_entries:
 	}
 	kfree(entries);
 
+err_free_bits:
+	kfree(bits);
 err_free_points:
 	kfree(points);
 
@@ -1342,6 +1581,24 @@ out:
 	return ret;
 }
 
+/* The oldest node of the chain that shares @fence's context */
+static struct dma_fence *drm_syncobj_chain_tail(struct dma_fence *fence)
+{
+	struct dma_fence *iter, *last = NULL;
+
+	dma_fence_chain_for_each(iter, fence) {
+		if (iter->context != fence->context) {
+			dma_fence_put(iter);
+			/* It is most likely that timeline has
+			 * unorder points. */
+			break;
+		}
+		dma_fence_put(last);
+		last = dma_fence_get(iter);
+	}
+	return last;
+}
+
 int drm_syncobj_query_ioctl(struct drm_device *dev, void *data,
 			    struct drm_file *file_private)
 {
@@ -1372,20 +1629,19 @@ int drm_syncobj_query_ioctl(struct drm_device *dev, void *data,
 		struct dma_fence *fence;
 		uint64_t point;
 
-		fence = drm_syncobj_fence_get(syncobjs[i]);
+		/* Start from the oldest pending point the index knows of */
+		fence = drm_syncobj_fence_get_point(syncobjs[i], 1);
 		chain = to_dma_fence_chain(fence);
 		if (chain) {
-			struct dma_fence *iter, *last_signaled = NULL;
-
-			dma_fence_chain_for_each(iter, fence) {
-				if (iter->context != fence->context) {
-					dma_fence_put(iter);
-					/* It is most likely that timeline has
-					 * unorder points. */
-					break;
-				}
+			struct dma_fence *last_signaled;
+
+			last_signaled = drm_syncobj_chain_tail(fence);
+			if (dma_fence_is_signaled(last_signaled)) {
+				/* Later points may have signaled as well */
 				dma_fence_put(last_signaled);
-				last_signaled = dma_fence_get(iter);
+				dma_fence_put(fence);
+				fence = drm_syncobj_fence_get(syncobjs[i]);
+				last_signaled = drm_syncobj_chain_tail(fence);
 			}
 			point = dma_fence_is_signaled(last_signaled) ?
 				last_signaled->seqno :
@@ -1403,3 +1659,80 @@ int drm_syncobj_query_ioctl(struct drm_device *dev, void *data,
 
 	return ret;
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int drm_syncobj_info(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct drm_printer p = drm_seq_file_printer(m);
+	struct drm_syncobj *syncobj;
+	struct dma_fence *fence, *iter;
+	unsigned int depth, count, stride;
+	struct drm_file *file;
+	int id;
+
+	drm_printf(&p, "points added %lld, retired from index %lld, indexed lookups %lld\n",
+		   (long long)atomic64_read(&drm_syncobj_stats.added),
+		   (long long)atomic64_read(&drm_syncobj_stats.retired),
+		   (long long)atomic64_read(&drm_syncobj_stats.lookups));
+	drm_printf(&p, "%5s %8s %20s %8s %7s %6s\n",
+		   "pid", "handle", "point", "depth", "indexed", "stride");
+
+	mutex_lock(&dev->filelist_mutex);
+	list_for_each_entry_reverse(file, &dev->filelist, lhead) {
+		/*
+		 * A chain can be millions of points deep, so only take a
+		 * reference under the table lock and walk without it.
+		 */
+		for (id = 0; ; id++) {
+			spin_lock(&file->syncobj_table_lock);
+			syncobj = idr_get_next(&file->syncobj_idr, &id);
+			if (syncobj)
+				drm_syncobj_get(syncobj);
+			spin_unlock(&file->syncobj_table_lock);
+			if (!syncobj)
+				break;
+
+			fence = drm_syncobj_fence_get(syncobj);
+			if (!to_dma_fence_chain(fence)) {
+				dma_fence_put(fence);
+				drm_syncobj_put(syncobj);
+				continue;
+			}
+
+			/* Walking also collapses what signaled meanwhile */
+			depth = 0;
+			dma_fence_chain_for_each(iter, fence)
+				depth++;
+
+			spin_lock(&syncobj->lock);
+			count = syncobj->index ? syncobj->index->count : 0;
+			stride = syncobj->index ? syncobj->index->stride : 0;
+			spin_unlock(&syncobj->lock);
+
+			drm_printf(&p, "%5d %8d %20llu %8u %7u %6u\n",
+				   pid_vnr(file->pid), id,
+				   (unsigned long long)fence->seqno,
+				   depth, count, stride);
+			dma_fence_put(fence);
+			drm_syncobj_put(syncobj);
+			cond_resched();
+		}
+	}
+	mutex_unlock(&dev->filelist_mutex);
+
+	return 0;
+}
+
+static const struct drm_info_list drm_syncobj_debugfs_list[] = {
+	{ "syncobjs", drm_syncobj_info, 0 },
+};
+
+int drm_syncobj_debugfs_init(struct drm_minor *minor)
+{
+	return drm_debugfs_create_files(drm_syncobj_debugfs_list,
+				ARRAY_SIZE(drm_syncobj_debugfs_list),
+				minor->debugfs_root, minor);
+}
+#endif
@@ -31,6 +31,7 @@ __FBSDID("$FreeBSD$");
 
 #include <drm/drmP.h>
 #include <uapi/drm/drm.h>
+#include "drm_internal.h"
 #include "drm_legacy.h"
 
 #include <sys/sysctl.h>
@@ -45,10 +46,14 @@ SYSCTL_DECL(_hw_drm);
 
 extern int drm_vblank_offdelay;
 extern unsigned int drm_timestamp_precision;
+extern int drm_vblank_adaptive_offdelay;
+extern int drm_vblank_extrapolate;
 
 static int	   drm_name_info DRM_SYSCTL_HANDLER_ARGS;
 static int	   drm_clients_info DRM_SYSCTL_HANDLER_ARGS;
 static int	   drm_vblank_info DRM_SYSCTL_HANDLER_ARGS;
+static int	   drm_ioctls_info DRM_SYSCTL_HANDLER_ARGS;
+static int	   drm_ioctl_stats_sysctl DRM_SYSCTL_HANDLER_ARGS;
 
 struct drm_sysctl_list {
 	const char *name;
@@ -57,6 +62,7 @@ struct drm_sysctl_list {
 	{"name",    drm_name_info},
 	{"clients", drm_clients_info},
 	{"vblank",    drm_vblank_info},
+	{"ioctls",  drm_ioctls_info},
 };
 #define DRM_SYSCTL_ENTRIES (sizeof(drm_sysctl_list)/sizeof(drm_sysctl_list[0]))
 
@@ -123,6 +129,14 @@ drm_sysctl_init(struct drm_device *dev)
 			return (-ENOMEM);
 		}
 	}
+	oid = SYSCTL_ADD_PROC(&info->ctx, SYSCTL_CHILDREN(top), OID_AUTO,
+	    "ioctl_stats", CTLTYPE_INT | CTLFLAG_RW, dev, 0,
+	    drm_ioctl_stats_sysctl, "I",
+	    "Collect per-ioctl call counts and latencies, see ioctls");
+	if (!oid) {
+		drm_sysctl_cleanup(dev);
+		return (-ENOMEM);
+	}
 	SYSCTL_ADD_INT(&info->ctx, SYSCTL_CHILDREN(drioid), OID_AUTO, "debug",
 	    CTLFLAG_RW, &drm_debug, sizeof(drm_debug),
 		       "Enable debugging output");
@@ -141,6 +155,15 @@ drm_sysctl_init(struct drm_device *dev)
 	    "timestamp_precision", CTLFLAG_RW, &drm_timestamp_precision,
 	    sizeof(drm_timestamp_precision),
 	    "");
+	SYSCTL_ADD_INT(&info->ctx, SYSCTL_CHILDREN(drioid), OID_AUTO,
+	    "vblank_adaptive_offdelay", CTLFLAG_RW,
+	    &drm_vblank_adaptive_offdelay,
+	    sizeof(drm_vblank_adaptive_offdelay),
+	    "");
+	SYSCTL_ADD_INT(&info->ctx, SYSCTL_CHILDREN(drioid), OID_AUTO,
+	    "vblank_extrapolate", CTLFLAG_RW, &drm_vblank_extrapolate,
+	    sizeof(drm_vblank_extrapolate),
+	    "");
 
 	return (0);
 }
@@ -166,6 +189,13 @@ drm_add_busid_modesetting(struct drm_device *dev, struct sysctl_ctx_list *ctx,
 	device_t bsddev;
 	int domain, bus, slot, func;
 
+	if (dev->pdev == NULL) {
+		/* Virtual devices have no PCI location */
+		snprintf(dev->busid_str, sizeof(dev->busid_str),
+		    "platform:%s", dev->driver->name);
+		goto out;
+	}
+
 	bsddev = dev->dev->bsddev;
 	domain = pci_get_domain(bsddev);
 	bus    = pci_get_bus(bsddev);
@@ -174,6 +204,7 @@ drm_add_busid_modesetting(struct drm_device *dev, struct sysctl_ctx_list *ctx,
 
 	snprintf(dev->busid_str, sizeof(dev->busid_str),
 	    "pci:%04x:%02x:%02x.%d", domain, bus, slot, func);
+out:
 	oid = SYSCTL_ADD_STRING(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "busid",
 	    CTLFLAG_RD, dev->busid_str, 0, NULL);
 	if (oid == NULL)
@@ -280,16 +311,22 @@ static int drm_vblank_info DRM_SYSCTL_HANDLER_ARGS
 	int i;
 
 	mutex_lock(&dev->struct_mutex);
-	DRM_SYSCTL_PRINT("\ncrtc ref count    last     enabled inmodeset\n");
+	DRM_SYSCTL_PRINT("\ncrtc ref count    last     enabled inmodeset"
+	    " enables  disables extrap   offdelay\n");
 	if (dev->vblank == NULL)
 		goto done;
 	for (i = 0 ; i < dev->num_crtcs ; i++) {
-		DRM_SYSCTL_PRINT("  %02d  %02d %08d %08d %02d      %02d\n",
+		DRM_SYSCTL_PRINT("  %02d  %02d %08d %08d %02d      %02d       "
+		    " %08lu %08lu %08lu %u\n",
 		    i, dev->vblank[i].refcount.counter,
 		    dev->vblank[i].count,
 		    dev->vblank[i].last,
 		    dev->vblank[i].enabled,
-		    dev->vblank[i].inmodeset);
+		    dev->vblank[i].inmodeset,
+		    dev->vblank[i].enable_count,
+		    dev->vblank[i].disable_count,
+		    atomic_long_read(&dev->vblank[i].extrapolated_count),
+		    dev->vblank[i].offdelay_ms);
 	}
 done:
 	mutex_unlock(&dev->struct_mutex);
@@ -297,3 +334,60 @@ done:
 	SYSCTL_OUT(req, "", -1);
 	return retcode;
 }
+
+static int drm_ioctl_stats_sysctl DRM_SYSCTL_HANDLER_ARGS
+{
+	struct drm_device *dev = arg1;
+	struct drm_ioctl_stats *stats;
+	int error, val;
+
+	stats = atomic_load_acq_ptr((volatile uintptr_t *)&dev->ioctl_stats);
+	val = stats != NULL && READ_ONCE(stats->enabled);
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+
+	return (-drm_ioctl_stats_enable(dev, val != 0));
+}
+
+/*
+ * One line per ioctl that was called while statistics were enabled: call
+ * count, average latency and the latency histogram.  Column n > 0 of the
+ * histogram counts calls of [2^(n-1), 2^n) microseconds, column 0 those
+ * under a microsecond and the last one everything slower.
+ */
+static int drm_ioctls_info DRM_SYSCTL_HANDLER_ARGS
+{
+	struct drm_device *dev = arg1;
+	struct drm_ioctl_stats *stats;
+	struct drm_ioctl_stat *stat;
+	char buf[128];
+	uint64_t calls;
+	int retcode;
+	unsigned int i, j;
+
+	retcode = 0;
+	stats = atomic_load_acq_ptr((volatile uintptr_t *)&dev->ioctl_stats);
+	if (stats == NULL)
+		goto done;
+
+	DRM_SYSCTL_PRINT("\n%-32s %10s %10s histogram\n",
+	    "ioctl", "calls", "avg_us");
+	for (i = 0; i < stats->count; i++) {
+		stat = &stats->stat[i];
+		calls = atomic64_read(&stat->calls);
+		if (calls == 0)
+			continue;
+		DRM_SYSCTL_PRINT("%-32s %10ju %10ju",
+		    drm_ioctl_stats_name(dev, i), (uintmax_t)calls,
+		    (uintmax_t)(atomic64_read(&stat->total_ns) / calls / 1000));
+		for (j = 0; j < DRM_IOCTL_HIST_BUCKETS; j++)
+			DRM_SYSCTL_PRINT(" %ju",
+			    (uintmax_t)atomic64_read(&stat->hist[j]));
+		DRM_SYSCTL_PRINT("\n");
+	}
+done:
+	if (retcode == 0)
+		retcode = SYSCTL_OUT(req, "", 1);
+	return retcode;
+}
@@ -2,7 +2,13 @@
 #define _DRM_TRACE_FREEBSD_H_
 
 #include <drm/drmP.h>
+#include <drm/drm_trace_ring_freebsd.h>
 
+#define	DRM_TRACE_EVENTS(E)						\
+	E(drm_vblank_event,		"crtc %d seq %u")		\
+	E(drm_vblank_event_queued,	"file %p crtc %d seq %u")	\
+	E(drm_vblank_event_delivered,	"file %p crtc %d seq %u")
+DRM_TRACE_DECLARE(drm, DRM_TRACE_EVENTS);
 
 /* TRACE_EVENT(drm_vblank_event, */
 /* TP_PROTO(int crtc, unsigned int seq), */
@@ -10,6 +16,7 @@ static inline void
 trace_drm_vblank_event(int crtc, unsigned int seq)
 {
 	CTR2(KTR_DRM, "drm_vblank_event crtc %d, seq %u", crtc, seq);
+	DRM_TRACE(drm, drm_vblank_event, crtc, seq, 0, 0);
 }
 
 /* TRACE_EVENT(drm_vblank_event_queued, */
@@ -18,6 +25,7 @@ static inline void
 trace_drm_vblank_event_queued(struct drm_file *file, int crtc, unsigned int seq)
 {
 	CTR3(KTR_DRM, "drm_vblank_event_queued crtc %d, seq %u", file, crtc, seq);
+	DRM_TRACE(drm, drm_vblank_event_queued, DRM_TRACE_PTR(file), crtc, seq, 0);
 }
 
 /* TRACE_EVENT(drm_vblank_event_delivered, */
@@ -26,6 +34,7 @@ static inline void
 trace_drm_vblank_event_delivered(struct drm_file *file, int crtc, unsigned int seq)
 {
 	CTR3(KTR_DRM, "drm_vblank_event_delivered drm_file %p, crtc %d, seq %u", file, crtc, seq);
+	DRM_TRACE(drm, drm_vblank_event_delivered, DRM_TRACE_PTR(file), crtc, seq, 0);
 }
 
 #endif
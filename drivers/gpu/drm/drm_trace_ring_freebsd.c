@@ -0,0 +1,279 @@
+/*-
+ * Per-CPU binary trace ring for the DRM trace_*() stubs.
+ *
+ * Writers only ever touch the ring of the CPU they run on and do so inside
+ * a critical section, so appending a record is a plain store followed by a
+ * release of the new head.  The single reader (serialised by
+ * drm_trace_lock) never blocks writers: if it falls behind by more than a
+ * ring, the oldest records are overwritten and accounted in
+ * hw.dri.trace.lost.
+ */
+
+#include <sys/cdefs.h>
+__FBSDID("$FreeBSD$");
+
+#include <drm/drmP.h>
+
+#include <sys/priv.h>
+#include <sys/sbuf.h>
+#include <sys/sx.h>
+#include <sys/sysctl.h>
+
+#include "drm_trace_freebsd.h"
+
+/* Records drained per SYSCTL_OUT() */
+#define	DRM_TRACE_CHUNK		64
+
+static struct drm_trace_ring *drm_trace_rings[MAXCPU];
+static TAILQ_HEAD(, drm_trace_provider) drm_trace_providers =
+    TAILQ_HEAD_INITIALIZER(drm_trace_providers);
+static uint64_t drm_trace_lost;
+static int drm_trace_ring_size = 4096;
+
+static struct sx drm_trace_lock;
+SX_SYSINIT(drm_trace_lock, &drm_trace_lock, "drm trace");
+
+SYSCTL_DECL(_hw_dri);
+static SYSCTL_NODE(_hw_dri, OID_AUTO, trace, CTLFLAG_RW, 0,
+    "DRM trace ring");
+SYSCTL_INT(_hw_dri_trace, OID_AUTO, ring_size, CTLFLAG_RDTUN,
+    &drm_trace_ring_size, 0, "Records per CPU, rounded up to a power of two");
+SYSCTL_INT(_hw_dri_trace, OID_AUTO, record_size, CTLFLAG_RD,
+    SYSCTL_NULL_INT_PTR, sizeof(struct drm_trace_record),
+    "Size of a record in hw.dri.trace.data");
+SYSCTL_U64(_hw_dri_trace, OID_AUTO, lost, CTLFLAG_RD,
+    &drm_trace_lost, 0, "Records overwritten before they were read");
+
+DRM_TRACE_DEFINE(drm, DRM_TRACE_EVENTS);
+
+static void
+drm_trace_alloc_rings(void)
+{
+	struct drm_trace_ring *ring;
+	uint64_t n;
+	int cpu;
+
+	sx_assert(&drm_trace_lock, SA_XLOCKED);
+
+	n = 1ul << flsl(MAX(drm_trace_ring_size, 64) - 1);
+	CPU_FOREACH(cpu) {
+		if (drm_trace_rings[cpu] != NULL)
+			continue;
+		ring = malloc(sizeof(*ring) + n * sizeof(ring->rec[0]),
+		    DRM_MEM_DRIVER, M_WAITOK | M_ZERO);
+		ring->mask = n - 1;
+		atomic_store_rel_ptr((volatile uintptr_t *)&drm_trace_rings[cpu],
+		    (uintptr_t)ring);
+	}
+}
+
+static void
+drm_trace_free_rings(void *arg __unused)
+{
+	int cpu;
+
+	CPU_FOREACH(cpu) {
+		free(drm_trace_rings[cpu], DRM_MEM_DRIVER);
+		drm_trace_rings[cpu] = NULL;
+	}
+}
+SYSUNINIT(drm_trace_rings, SI_SUB_DRIVERS, SI_ORDER_ANY,
+    drm_trace_free_rings, NULL);
+
+void
+drm_trace_emit(const struct drm_trace_event *ev,
+    uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3)
+{
+	struct drm_trace_ring *ring;
+
+	critical_enter();
+	ring = (struct drm_trace_ring *)atomic_load_acq_ptr(
+	    (volatile uintptr_t *)&drm_trace_rings[curcpu]);
+	if (__predict_true(ring != NULL))
+		drm_trace_ring_put(ring, sbinuptime(), ev->id, curcpu,
+		    curthread->td_tid, a0, a1, a2, a3);
+	critical_exit();
+}
+
+static int
+drm_trace_data_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_trace_record *buf;
+	struct drm_trace_ring *ring;
+	size_t pending;
+	int cpu, error, max, n, skip;
+
+	if (req->newptr != NULL)
+		return (EPERM);
+	/* Records carry kernel pointers */
+	error = priv_check(req->td, PRIV_DRIVER);
+	if (error != 0)
+		return (error);
+
+	sx_xlock(&drm_trace_lock);
+	if (req->oldptr == NULL) {
+		/* Size estimate, with room for what arrives meanwhile */
+		pending = 0;
+		CPU_FOREACH(cpu) {
+			ring = drm_trace_rings[cpu];
+			if (ring != NULL)
+				pending += MIN(ring->head - ring->tail,
+				    ring->mask + 1);
+		}
+		error = SYSCTL_OUT(req, NULL,
+		    (pending + DRM_TRACE_CHUNK) * sizeof(*buf));
+		sx_xunlock(&drm_trace_lock);
+		return (error);
+	}
+
+	buf = malloc(DRM_TRACE_CHUNK * sizeof(*buf), DRM_MEM_DRIVER, M_WAITOK);
+	error = 0;
+	CPU_FOREACH(cpu) {
+		ring = drm_trace_rings[cpu];
+		if (ring == NULL)
+			continue;
+		while (error == 0) {
+			/* Stop short of the caller's buffer, not with ENOMEM */
+			max = MIN(DRM_TRACE_CHUNK,
+			    (req->oldlen - req->oldidx) / sizeof(*buf));
+			if (max == 0)
+				break;
+			n = drm_trace_ring_read(ring, buf, max, &skip,
+			    &drm_trace_lost);
+			if (n == 0 && skip == 0)
+				break;
+			error = SYSCTL_OUT(req, buf + skip, n * sizeof(*buf));
+		}
+	}
+	free(buf, DRM_MEM_DRIVER);
+	sx_xunlock(&drm_trace_lock);
+
+	return (error);
+}
+SYSCTL_PROC(_hw_dri_trace, OID_AUTO, data,
+    CTLTYPE_OPAQUE | CTLFLAG_RD | CTLFLAG_MPSAFE, NULL, 0,
+    drm_trace_data_sysctl, "S,drm_trace_record",
+    "Drain the trace rings, see scripts/drmtrace.c");
+
+static int
+drm_trace_events_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_trace_provider *prov;
+	struct drm_trace_event *ev;
+	struct sbuf *sb;
+	int error, i;
+
+	sb = sbuf_new_for_sysctl(NULL, NULL, 256, req);
+	if (sb == NULL)
+		return (ENOMEM);
+
+	sx_slock(&drm_trace_lock);
+	TAILQ_FOREACH(prov, &drm_trace_providers, link) {
+		for (i = 0; i < prov->nevents; i++) {
+			ev = &prov->events[i];
+			sbuf_printf(sb, "%u %s %s %s\n",
+			    ev->id, prov->name, ev->name, ev->fmt);
+		}
+	}
+	sx_sunlock(&drm_trace_lock);
+
+	error = sbuf_finish(sb);
+	sbuf_delete(sb);
+	return (error);
+}
+SYSCTL_PROC(_hw_dri_trace, OID_AUTO, events,
+    CTLTYPE_STRING | CTLFLAG_RD | CTLFLAG_MPSAFE, NULL, 0,
+    drm_trace_events_sysctl, "A", "id provider event format");
+
+static int
+drm_trace_enable_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_trace_event *ev = arg1;
+	int error, val;
+
+	val = ev->enabled;
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+
+	sx_xlock(&drm_trace_lock);
+	if (val != 0)
+		drm_trace_alloc_rings();
+	atomic_thread_fence_rel();
+	ev->enabled = val != 0;
+	sx_xunlock(&drm_trace_lock);
+
+	return (0);
+}
+
+/*
+ * Find the lowest run of ids no registered provider uses.  Providers are
+ * kept sorted by id, so a driver that is unloaded and loaded again gets
+ * its ids back rather than new ones, and ids do not run out over reloads.
+ * Records it left in the rings are decoded with the events registered
+ * when they are drained.
+ */
+static struct drm_trace_provider *
+drm_trace_alloc_ids(struct drm_trace_provider *prov)
+{
+	struct drm_trace_provider *next;
+	int first;
+
+	sx_assert(&drm_trace_lock, SA_XLOCKED);
+
+	first = 0;
+	TAILQ_FOREACH(next, &drm_trace_providers, link) {
+		if (next->first_id - first >= prov->nevents)
+			break;
+		first = next->first_id + next->nevents;
+	}
+	KASSERT(first + prov->nevents <= UINT16_MAX + 1,
+	    ("drm trace: out of event ids for %s", prov->name));
+	prov->first_id = first;
+
+	return (next);
+}
+
+void
+drm_trace_register(struct drm_trace_provider *prov)
+{
+	struct drm_trace_provider *next;
+	struct drm_trace_event *ev;
+	struct sysctl_oid *node;
+	int i;
+
+	sx_xlock(&drm_trace_lock);
+	next = drm_trace_alloc_ids(prov);
+	sysctl_ctx_init(&prov->ctx);
+	node = SYSCTL_ADD_NODE(&prov->ctx, SYSCTL_STATIC_CHILDREN(_hw_dri_trace),
+	    OID_AUTO, prov->name, CTLFLAG_RW, NULL, NULL);
+	for (i = 0; i < prov->nevents; i++) {
+		ev = &prov->events[i];
+		ev->id = prov->first_id + i;
+		if (node == NULL)
+			continue;
+		SYSCTL_ADD_PROC(&prov->ctx, SYSCTL_CHILDREN(node), OID_AUTO,
+		    ev->name, CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE,
+		    ev, 0, drm_trace_enable_sysctl, "I", ev->fmt);
+	}
+	if (next != NULL)
+		TAILQ_INSERT_BEFORE(next, prov, link);
+	else
+		TAILQ_INSERT_TAIL(&drm_trace_providers, prov, link);
+	sx_xunlock(&drm_trace_lock);
+}
+
+void
+drm_trace_unregister(struct drm_trace_provider *prov)
+{
+	int i;
+
+	/* Drop the knobs first, their handler takes drm_trace_lock */
+	sysctl_ctx_free(&prov->ctx);
+
+	sx_xlock(&drm_trace_lock);
+	for (i = 0; i < prov->nevents; i++)
+		prov->events[i].enabled = false;
+	TAILQ_REMOVE(&drm_trace_providers, prov, link);
+	sx_xunlock(&drm_trace_lock);
+}
@@ -0,0 +1,98 @@
+#ifndef _DRM_TRACE_RING_FREEBSD_H_
+#define _DRM_TRACE_RING_FREEBSD_H_
+
+/*
+ * Binary trace ring backing the FreeBSD trace_*() stubs.
+ *
+ * Each driver lists its events once:
+ *
+ *	#define FOO_TRACE_EVENTS(E)					\
+ *		E(foo_submit, "ctx %u seqno %u")			\
+ *		E(foo_retire, "ctx %u seqno %u")
+ *	DRM_TRACE_DECLARE(foo, FOO_TRACE_EVENTS);
+ *
+ * instantiates the table in exactly one file with DRM_TRACE_DEFINE() and
+ * emits records with DRM_TRACE(foo, foo_submit, ctx, seqno, 0, 0).  Every
+ * event gets an hw.dri.trace.<driver>.<event> enable knob; while it is off
+ * the tracepoint costs a single load and branch.  Records are appended to a
+ * per-CPU ring without locks and drained through hw.dri.trace.data, see
+ * scripts/drmtrace.c for a decoder.
+ */
+
+#include <sys/param.h>
+#include <sys/queue.h>
+#include <sys/sysctl.h>
+#include <machine/atomic.h>
+
+#include "drm_trace_ringbuf_freebsd.h"
+
+struct drm_trace_event {
+	const char	*name;
+	const char	*fmt;
+	bool		enabled;
+	uint16_t	id;
+};
+
+struct drm_trace_provider {
+	const char		*name;
+	struct drm_trace_event	*events;
+	int			nevents;
+	uint16_t		first_id;
+	struct sysctl_ctx_list	ctx;
+	TAILQ_ENTRY(drm_trace_provider) link;
+};
+
+void	drm_trace_register(struct drm_trace_provider *prov);
+void	drm_trace_unregister(struct drm_trace_provider *prov);
+void	drm_trace_emit(const struct drm_trace_event *ev,
+	    uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3);
+
+#define	DRM_TRACE_ID(name)		__drm_trace_id_##name
+#define	__DRM_TRACE_ENUM(name, fmt)	DRM_TRACE_ID(name),
+#define	__DRM_TRACE_INIT(name, fmt)	[DRM_TRACE_ID(name)] = { #name, fmt },
+
+#define	DRM_TRACE_DECLARE(prov, list)					\
+	enum { list(__DRM_TRACE_ENUM) };				\
+	extern struct drm_trace_event prov##_trace_events[]
+
+#define	DRM_TRACE_DEFINE(prov, list)					\
+	struct drm_trace_event prov##_trace_events[] = {		\
+		list(__DRM_TRACE_INIT)					\
+	};								\
+	static struct drm_trace_provider prov##_trace_prov = {		\
+		.name = #prov,						\
+		.events = prov##_trace_events,				\
+		.nevents = nitems(prov##_trace_events),			\
+	};								\
+	static void							\
+	prov##_trace_sysinit(void *arg __unused)			\
+	{								\
+		drm_trace_register(&prov##_trace_prov);			\
+	}								\
+	static void							\
+	prov##_trace_sysuninit(void *arg __unused)			\
+	{								\
+		drm_trace_unregister(&prov##_trace_prov);		\
+	}								\
+	SYSINIT(prov##_trace, SI_SUB_DRIVERS, SI_ORDER_FIRST,		\
+	    prov##_trace_sysinit, NULL);				\
+	SYSUNINIT(prov##_trace, SI_SUB_DRIVERS, SI_ORDER_FIRST,		\
+	    prov##_trace_sysuninit, NULL)
+
+/*
+ * Arguments are stored as 64-bit words.  Integers are widened as is, so
+ * 64-bit values such as fence contexts survive on 32-bit platforms;
+ * pointers have to be passed through DRM_TRACE_PTR().
+ */
+#define	DRM_TRACE_PTR(p)	((uintptr_t)(p))
+
+#define	DRM_TRACE(prov, name, a0, a1, a2, a3) do {			\
+	const struct drm_trace_event *__ev =				\
+	    &prov##_trace_events[DRM_TRACE_ID(name)];			\
+									\
+	if (__predict_false(__ev->enabled))				\
+		drm_trace_emit(__ev, (uint64_t)(a0), (uint64_t)(a1),	\
+		    (uint64_t)(a2), (uint64_t)(a3));			\
+} while (0)
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _DRM_TRACE_RINGBUF_FREEBSD_H_
+#define _DRM_TRACE_RINGBUF_FREEBSD_H_
+
+/*
+ * Record layout and lockless ring of the DRM trace ring.
+ *
+ * This is kept free of kernel includes so that scripts/drmtrace.c decodes
+ * the very same records and can run the ring itself.  The includer provides
+ * the <stdint.h> types, MIN(), atomic_load_acq_64(), atomic_store_rel_64()
+ * and atomic_thread_fence_acq().
+ */
+
+#define	DRM_TRACE_NARGS		4
+
+/* On-ring record, as hw.dri.trace.data returns it */
+struct drm_trace_record {
+	uint64_t	ts;		/* sbinuptime() */
+	uint16_t	id;		/* see hw.dri.trace.events */
+	uint16_t	cpu;
+	uint32_t	tid;
+	uint64_t	arg[DRM_TRACE_NARGS];
+};
+
+struct drm_trace_ring {
+	volatile uint64_t	head;	/* written by the owning CPU only */
+	uint64_t		tail;	/* reader, under drm_trace_lock */
+	uint64_t		mask;
+	struct drm_trace_record	rec[];
+};
+
+/*
+ * Append a record.  Only the CPU owning the ring writes to it, inside a
+ * critical section, so this is a plain store followed by a release of the
+ * new head.
+ */
+static inline void
+drm_trace_ring_put(struct drm_trace_ring *ring, uint64_t ts, uint16_t id,
+    uint16_t cpu, uint32_t tid,
+    uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3)
+{
+	struct drm_trace_record *rec;
+	uint64_t head;
+
+	head = ring->head;
+	rec = &ring->rec[head & ring->mask];
+	rec->ts = ts;
+	rec->id = id;
+	rec->cpu = cpu;
+	rec->tid = tid;
+	rec->arg[0] = a0;
+	rec->arg[1] = a1;
+	rec->arg[2] = a2;
+	rec->arg[3] = a3;
+	atomic_store_rel_64(&ring->head, head + 1);
+}
+
+/*
+ * Copy up to max records out of the ring.  Returns the number of valid
+ * records, which start at buf[*skip]: anything the writer lapped while
+ * we were copying is dropped and added to *lost.
+ */
+static inline int
+drm_trace_ring_read(struct drm_trace_ring *ring, struct drm_trace_record *buf,
+    int max, int *skip, uint64_t *lost)
+{
+	uint64_t head, size, tail;
+	int i, n;
+
+	size = ring->mask + 1;
+	head = atomic_load_acq_64(&ring->head);
+	tail = ring->tail;
+	if (head - tail > size) {
+		*lost += head - tail - size;
+		tail = head - size;
+	}
+
+	n = MIN(head - tail, max);
+	for (i = 0; i < n; i++)
+		buf[i] = ring->rec[(tail + i) & ring->mask];
+	ring->tail = tail + n;
+
+	/* A slot is torn once the writer has started on its next lap */
+	atomic_thread_fence_acq();
+	head = atomic_load_acq_64(&ring->head);
+	*skip = 0;
+	if (head >= tail + size)
+		*skip = MIN(n, head - size - tail + 1);
+	*lost += *skip;
+
+	return (n - *skip);
+}
+
+#endif
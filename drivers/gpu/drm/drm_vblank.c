@@ -71,6 +71,13 @@
  * &drm_driver.max_vblank_count. In that case the vblank core only disables the
  * vblanks after a timer has expired, which can be configured through the
  * ``vblankoffdelay`` module parameter.
+ *
+ * Drivers that can disable immediately still get a short per-CRTC off-delay
+ * when clients keep re-enabling the interrupt right after it went off, which
+ * is learned from the enable/disable pattern and relaxed again once the CRTC
+ * goes quiet (``vblank_adaptive_offdelay``). With ``vblank_extrapolate`` set,
+ * pure counter queries on a CRTC whose interrupt is off are answered from the
+ * driver's scanout position based timestamps instead of enabling it.
  */
 
 /* Retry timestamp calculation up to 3 times to satisfy
@@ -83,6 +90,13 @@
  */
 #define DRM_REDUNDANT_VBLIRQ_THRESH_NS 1000000
 
+/* Bounds of the per-CRTC off-delay learned in drm_vblank_adapt_offdelay(),
+ * and the gap between disable and re-enable considered churn.
+ */
+#define DRM_VBLANK_ADAPT_MIN_MS 50
+#define DRM_VBLANK_ADAPT_MAX_MS 1000
+#define DRM_VBLANK_CHURN_MS 250
+
 static bool
 drm_get_last_vbltimestamp(struct drm_device *dev, unsigned int pipe,
 			  ktime_t *tvblank, bool in_vblank_irq);
@@ -97,10 +111,28 @@ unsigned int drm_timestamp_precision = 20;  /* Default to 20 usecs. */
 int drm_vblank_offdelay = 5000;    /* Default to 5000 msecs. */
 #endif
 
+/*
+ * Extrapolated counts round down, so jitter in the scanout timestamps can
+ * make a query right after a vblank still report the previous frame, i.e.
+ * be one behind what enabling the interrupt would report. They never run
+ * ahead and never go backwards.
+ */
+#ifdef __linux__
+static int drm_vblank_adaptive_offdelay = 1;
+static int drm_vblank_extrapolate;
+#elif defined(__FreeBSD__)
+int drm_vblank_adaptive_offdelay = 1;
+int drm_vblank_extrapolate;
+#endif
+
 module_param_named(vblankoffdelay, drm_vblank_offdelay, int, 0600);
 module_param_named(timestamp_precision_usec, drm_timestamp_precision, int, 0600);
+module_param_named(vblank_adaptive_offdelay, drm_vblank_adaptive_offdelay, int, 0600);
+module_param_named(vblank_extrapolate, drm_vblank_extrapolate, int, 0600);
 MODULE_PARM_DESC(vblankoffdelay, "Delay until vblank irq auto-disable [msecs] (0: never disable, <0: disable immediately)");
 MODULE_PARM_DESC(timestamp_precision_usec, "Max. error on timestamps [usecs]");
+MODULE_PARM_DESC(vblank_adaptive_offdelay, "Delay immediate vblank irq disable on CRTCs that keep re-enabling it");
+MODULE_PARM_DESC(vblank_extrapolate, "Answer vblank count queries from scanout timestamps without enabling the irq (may lag by one frame)");
 
 static void store_vblank(struct drm_device *dev, unsigned int pipe,
 			 u32 vblank_count_inc,
@@ -395,6 +427,8 @@ void drm_vblank_disable_and_save(struct drm_device *dev, unsigned int pipe)
 	drm_update_vblank_count(dev, pipe, false);
 	__disable_vblank(dev, pipe);
 	vblank->enabled = false;
+	vblank->disabled_at = ktime_get();
+	vblank->disable_count++;
 
 out:
 	spin_unlock_irqrestore(&dev->vblank_time_lock, irqflags);
@@ -967,6 +1001,44 @@ static int __enable_vblank(struct drm_device *dev, unsigned int pipe)
 	return dev->driver->enable_vblank(dev, pipe);
 }
 
+/*
+ * Re-enabling the interrupt shortly after it was disabled means the clients
+ * of this CRTC poll faster than the off-delay, so double the delay; a long
+ * quiet spell halves it again until the default behaviour is back.
+ */
+static void drm_vblank_adapt_offdelay(struct drm_vblank_crtc *vblank)
+{
+	unsigned int delay = vblank->offdelay_ms;
+	unsigned int max_delay;
+	s64 idle_ms;
+
+	assert_spin_locked(&vblank->dev->vbl_lock);
+
+	/* Only immediate disable churns, the timer already provides hysteresis */
+	if (!drm_vblank_adaptive_offdelay || drm_vblank_offdelay <= 0 ||
+	    !vblank->dev->vblank_disable_immediate) {
+		WRITE_ONCE(vblank->offdelay_ms, 0);
+		return;
+	}
+
+	if (!vblank->disable_count)
+		return;
+
+	max_delay = min_t(unsigned int, drm_vblank_offdelay,
+			  DRM_VBLANK_ADAPT_MAX_MS);
+	idle_ms = ktime_ms_delta(ktime_get(), vblank->disabled_at);
+	if (idle_ms < DRM_VBLANK_CHURN_MS)
+		delay = clamp_t(unsigned int, delay * 2,
+				DRM_VBLANK_ADAPT_MIN_MS, max_delay);
+	else if (idle_ms > 4 * max_t(s64, delay, DRM_VBLANK_CHURN_MS))
+		delay = delay / 2 < DRM_VBLANK_ADAPT_MIN_MS ? 0 : delay / 2;
+
+	if (delay != vblank->offdelay_ms)
+		DRM_DEBUG("crtc %u vblank off-delay %u ms\n",
+			  vblank->pipe, delay);
+	WRITE_ONCE(vblank->offdelay_ms, delay);
+}
+
 static int drm_vblank_enable(struct drm_device *dev, unsigned int pipe)
 {
 	struct drm_vblank_crtc *vblank = &dev->vblank[pipe];
@@ -996,6 +1068,8 @@ static int drm_vblank_enable(struct drm_device *dev, unsigned int pipe)
 			 * to drm_update_vblank_count().
 			 */
 			WRITE_ONCE(vblank->enabled, true);
+			vblank->enable_count++;
+			drm_vblank_adapt_offdelay(vblank);
 		}
 	}
 
@@ -1050,6 +1124,7 @@ EXPORT_SYMBOL(drm_crtc_vblank_get);
 static void drm_vblank_put(struct drm_device *dev, unsigned int pipe)
 {
 	struct drm_vblank_crtc *vblank = &dev->vblank[pipe];
+	unsigned int offdelay_ms;
 
 	if (WARN_ON(pipe >= dev->num_crtcs))
 		return;
@@ -1059,10 +1134,14 @@ static void drm_vblank_put(struct drm_device *dev, unsigned int pipe)
 
 	/* Last user schedules interrupt disable */
 	if (atomic_dec_and_test(&vblank->refcount)) {
+		offdelay_ms = READ_ONCE(vblank->offdelay_ms);
 		if (drm_vblank_offdelay == 0)
 			return;
 		else if (drm_vblank_offdelay < 0)
 			vblank_disable_fn(&vblank->disable_timer);
+		else if (offdelay_ms)
+			mod_timer(&vblank->disable_timer,
+				  jiffies + msecs_to_jiffies(offdelay_ms));
 		else if (!dev->vblank_disable_immediate)
 			mod_timer(&vblank->disable_timer,
 				  jiffies + ((drm_vblank_offdelay * HZ)/1000));
@@ -1541,6 +1620,56 @@ err_put:
 	return ret;
 }
 
+/*
+ * Extrapolate the counter of a CRTC whose interrupt is off from the count and
+ * timestamp saved when it was disabled, using a fresh scanout position based
+ * timestamp. Only precise timestamps are trusted, otherwise the caller has to
+ * enable the interrupt as usual.
+ *
+ * The frame count is rounded down so that it never gets ahead of what
+ * drm_update_vblank_count() computes once the interrupt is back on, and it
+ * is clamped to the last value handed out so that it never goes backwards.
+ */
+static bool drm_vblank_extrapolate_count(struct drm_device *dev,
+					 unsigned int pipe, u64 *count,
+					 ktime_t *vblanktime)
+{
+	struct drm_vblank_crtc *vblank = &dev->vblank[pipe];
+	int framedur_ns = vblank->framedur_ns;
+	ktime_t t_vblank, t_saved;
+	s64 diff_ns;
+	u64 saved, seq, last, old;
+
+	if (!drm_vblank_extrapolate || !dev->driver->get_vblank_timestamp ||
+	    READ_ONCE(vblank->enabled) || READ_ONCE(vblank->inmodeset) ||
+	    framedur_ns <= 0)
+		return false;
+
+	if (!drm_get_last_vbltimestamp(dev, pipe, &t_vblank, false))
+		return false;
+
+	saved = drm_vblank_count_and_time(dev, pipe, &t_saved);
+	diff_ns = ktime_to_ns(ktime_sub(t_vblank, t_saved));
+	if (diff_ns < 0)
+		return false;
+
+	seq = saved + div_u64(diff_ns, framedur_ns);
+
+	last = atomic64_read(&vblank->last_extrapolated);
+	while (seq > last) {
+		old = atomic64_cmpxchg(&vblank->last_extrapolated, last, seq);
+		if (old == last)
+			break;
+		last = old;
+	}
+
+	*count = max(seq, last);
+	*vblanktime = t_vblank;
+	atomic_long_inc(&vblank->extrapolated_count);
+
+	return true;
+}
+
 static bool drm_wait_vblank_is_query(union drm_wait_vblank *vblwait)
 {
 	if (vblwait->request.sequence)
@@ -1585,6 +1714,25 @@ static void drm_wait_vblank_reply(struct drm_device *dev, unsigned int pipe,
 	reply->tval_usec = ts.tv_nsec / 1000;
 }
 
+static bool drm_wait_vblank_extrapolate(struct drm_device *dev,
+					unsigned int pipe,
+					struct drm_wait_vblank_reply *reply)
+{
+	struct timespec64 ts;
+	ktime_t now;
+	u64 seq;
+
+	if (!drm_vblank_extrapolate_count(dev, pipe, &seq, &now))
+		return false;
+
+	ts = ktime_to_timespec64(now);
+	reply->sequence = seq;
+	reply->tval_sec = (u32)ts.tv_sec;
+	reply->tval_usec = ts.tv_nsec / 1000;
+
+	return true;
+}
+
 int drm_wait_vblank_ioctl(struct drm_device *dev, void *data,
 			  struct drm_file *file_priv)
 {
@@ -1649,6 +1797,11 @@ int drm_wait_vblank_ioctl(struct drm_device *dev, void *data,
 		return 0;
 	}
 
+	/* Otherwise try to answer them without enabling the interrupt */
+	if (drm_wait_vblank_is_query(vblwait) &&
+	    drm_wait_vblank_extrapolate(dev, pipe, &vblwait->reply))
+		return 0;
+
 	ret = drm_vblank_get(dev, pipe);
 	if (ret) {
 		DRM_DEBUG("crtc %d failed to acquire vblank counter, %d\n", pipe, ret);
@@ -1802,6 +1955,7 @@ bool drm_handle_vblank(struct drm_device *dev, unsigned int pipe)
 	 */
 	disable_irq = (dev->vblank_disable_immediate &&
 		       drm_vblank_offdelay > 0 &&
+		       !READ_ONCE(vblank->offdelay_ms) &&
 		       !atomic_read(&vblank->refcount));
 
 	drm_handle_vblank_events(dev, pipe);
@@ -1849,7 +2003,8 @@ int drm_crtc_get_sequence_ioctl(struct drm_device *dev, void *data,
 	int pipe;
 	struct drm_crtc_get_sequence *get_seq = data;
 	ktime_t now;
-	bool vblank_enabled;
+	bool vblank_enabled, extrapolated;
+	u64 seq;
 	int ret;
 
 	if (!drm_core_check_feature(dev, DRIVER_MODESET))
@@ -1866,8 +2021,10 @@ int drm_crtc_get_sequence_ioctl(struct drm_device *dev, void *data,
 
 	vblank = &dev->vblank[pipe];
 	vblank_enabled = dev->vblank_disable_immediate && READ_ONCE(vblank->enabled);
+	extrapolated = !vblank_enabled &&
+		drm_vblank_extrapolate_count(dev, pipe, &seq, &now);
 
-	if (!vblank_enabled) {
+	if (!vblank_enabled && !extrapolated) {
 		ret = drm_crtc_vblank_get(crtc);
 		if (ret) {
 			DRM_DEBUG("crtc %d failed to acquire vblank counter, %d\n", pipe, ret);
@@ -1880,9 +2037,11 @@ int drm_crtc_get_sequence_ioctl(struct drm_device *dev, void *data,
 	else
 		get_seq->active = crtc->enabled;
 	drm_modeset_unlock(&crtc->mutex);
-	get_seq->sequence = drm_vblank_count_and_time(dev, pipe, &now);
+	if (!extrapolated)
+		seq = drm_vblank_count_and_time(dev, pipe, &now);
+	get_seq->sequence = seq;
 	get_seq->sequence_ns = ktime_to_ns(now);
-	if (!vblank_enabled)
+	if (!vblank_enabled && !extrapolated)
 		drm_crtc_vblank_put(crtc);
 	return 0;
 }
@@ -105,6 +105,8 @@ static void lut_close(struct i915_gem_context *ctx)
 
 	lockdep_assert_held(&ctx->mutex);
 
+	ctx->lut_gen++;
+
 	rcu_read_lock();
 	radix_tree_for_each_slot(slot, &ctx->handles_vma, &iter, 0) {
 		struct i915_vma *vma = rcu_dereference_raw(*slot);
@@ -311,11 +313,23 @@ static struct i915_gem_engines *default_engines(struct i915_gem_context *ctx)
 	return e;
 }
 
+static void busy_fold(atomic64_t *to, atomic64_t *from)
+{
+	int class;
+
+	for (class = 0; class <= MAX_ENGINE_CLASS; class++)
+		atomic64_add(atomic64_xchg(&from[class], 0), &to[class]);
+}
+
 static void i915_gem_context_free(struct i915_gem_context *ctx)
 {
 	lockdep_assert_held(&ctx->i915->drm.struct_mutex);
 	GEM_BUG_ON(!i915_gem_context_is_closed(ctx));
 
+	/* Time run after the client closed the context */
+	if (IS_ERR(ctx->file_priv))
+		busy_fold(ctx->i915->contexts.closed_busy, ctx->busy);
+
 	release_hw_id(ctx);
 	if (ctx->vm)
 		i915_vm_put(ctx->vm);
@@ -324,6 +338,7 @@ static void i915_gem_context_free(struct i915_gem_context *ctx)
 	mutex_destroy(&ctx->engines_mutex);
 
 	kfree(ctx->jump_whitelist);
+	kvfree(ctx->exec_cache.entries);
 
 	if (ctx->timeline)
 		intel_timeline_put(ctx->timeline);
@@ -388,6 +403,8 @@ static void context_close(struct i915_gem_context *ctx)
 	mutex_lock(&ctx->mutex);
 
 	i915_gem_context_set_closed(ctx);
+	if (!IS_ERR_OR_NULL(ctx->file_priv))
+		busy_fold(ctx->file_priv->busy, ctx->busy);
 	ctx->file_priv = ERR_PTR(-EBADF);
 
 	/*
@@ -767,6 +784,8 @@ void i915_gem_context_close(struct drm_file *file)
 	idr_for_each(&file_priv->vm_idr, vm_idr_cleanup, NULL);
 	idr_destroy(&file_priv->vm_idr);
 	mutex_destroy(&file_priv->vm_idr_lock);
+
+	busy_fold(file_priv->dev_priv->contexts.closed_busy, file_priv->busy);
 }
 
 int i915_gem_vm_create_ioctl(struct drm_device *dev, void *data,
@@ -197,6 +197,36 @@ struct i915_gem_context {
 	 */
 	struct radix_tree_root handles_vma;
 
+	/**
+	 * lut_gen: Bumped under @mutex whenever an entry is removed from
+	 * @handles_vma, invalidating @exec_cache.
+	 */
+	unsigned long lut_gen;
+
+	/**
+	 * exec_cache: The handle to vma table of the last execbuffer on this
+	 * context, used to skip the @handles_vma lookups when userspace
+	 * resubmits the same object list. Guarded by @mutex.
+	 */
+	struct i915_exec_cache {
+		struct i915_exec_cache_entry {
+			u32 handle;
+			struct i915_vma *vma;
+		} *entries;
+		unsigned int count;
+		unsigned int size;
+		unsigned long gen;
+
+		u64 hits;
+		u64 misses;
+	} exec_cache;
+
+	/**
+	 * busy: Nanoseconds this context kept each class of engine busy,
+	 * accumulated without locks whenever it is switched out.
+	 */
+	atomic64_t busy[MAX_ENGINE_CLASS + 1];
+
 	/** jump_whitelist: Bit array for tracking cmds during cmdparsing
 	 *  Guarded by struct_mutex
 	 */
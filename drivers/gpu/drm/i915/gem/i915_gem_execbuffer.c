@@ -748,11 +748,49 @@ static int eb_select_context(struct i915_execbuffer *eb)
 	return 0;
 }
 
+static void eb_update_exec_cache(struct i915_execbuffer *eb, bool hit)
+{
+	struct i915_gem_context *ctx = eb->gem_context;
+	struct i915_exec_cache *cache = &ctx->exec_cache;
+	unsigned int i;
+
+	lockdep_assert_held(&ctx->mutex);
+
+	if (hit) {
+		cache->hits++;
+		return;
+	}
+	cache->misses++;
+
+	if (eb->buffer_count > cache->size) {
+		struct i915_exec_cache_entry *entries;
+
+		entries = kvmalloc_array(eb->buffer_count, sizeof(*entries),
+					 GFP_KERNEL | __GFP_NOWARN);
+		if (!entries) {
+			cache->count = 0;
+			return;
+		}
+
+		kvfree(cache->entries);
+		cache->entries = entries;
+		cache->size = eb->buffer_count;
+	}
+
+	for (i = 0; i < eb->buffer_count; i++) {
+		cache->entries[i].handle = eb->exec[i].handle;
+		cache->entries[i].vma = eb->vma[i];
+	}
+	cache->count = eb->buffer_count;
+	cache->gen = ctx->lut_gen;
+}
+
 static int eb_lookup_vmas(struct i915_execbuffer *eb)
 {
 	struct radix_tree_root *handles_vma = &eb->gem_context->handles_vma;
+	struct i915_exec_cache *cache = &eb->gem_context->exec_cache;
 	struct drm_i915_gem_object *obj;
-	unsigned int i, batch;
+	unsigned int i, batch, cached;
 	int err;
 
 	if (unlikely(i915_gem_context_is_banned(eb->gem_context)))
@@ -769,11 +807,27 @@ static int eb_lookup_vmas(struct i915_execbuffer *eb)
 		goto err_ctx;
 	}
 
+	/*
+	 * The vma of the last execbuffer stay valid for as long as their
+	 * handles_vma entries do, which lut_gen tracks.
+	 */
+	cached = 0;
+	if (cache->gen == eb->gem_context->lut_gen)
+		cached = min(cache->count, eb->buffer_count);
+
 	for (i = 0; i < eb->buffer_count; i++) {
 		u32 handle = eb->exec[i].handle;
 		struct i915_lut_handle *lut;
 		struct i915_vma *vma;
 
+		if (i < cached) {
+			if (likely(cache->entries[i].handle == handle)) {
+				vma = cache->entries[i].vma;
+				goto add_vma;
+			}
+			cached = i;
+		}
+
 		vma = radix_tree_lookup(handles_vma, handle);
 		if (likely(vma))
 			goto add_vma;
@@ -823,6 +877,8 @@ add_vma:
 			   eb_vma_misplaced(&eb->exec[i], vma, eb->flags[i]));
 	}
 
+	eb_update_exec_cache(eb, cached == eb->buffer_count &&
+			     cache->count == eb->buffer_count);
 	mutex_unlock(&eb->gem_context->mutex);
 
 	eb->args->flags |= __EXEC_VALIDATED;
@@ -8,6 +8,7 @@
 #define __INTEL_CONTEXT_TYPES__
 
 #include <linux/kref.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/types.h>
@@ -59,6 +60,8 @@ struct intel_context {
 	u32 *lrc_reg_state;
 	u64 lrc_desc;
 
+	ktime_t busy_start; /* when scheduled in to the HW, 0 while out */
+
 	unsigned int active_count; /* protected by timeline->mutex */
 
 	atomic_t pin_count;
@@ -54,9 +54,8 @@
 #define I915_MAX_SLICES	3
 #define I915_MAX_SUBSLICES 8
 
-#define I915_CMD_HASH_ORDER 9
-
 struct dma_fence;
+struct drm_i915_cmd_lookup;
 struct drm_i915_gem_object;
 struct drm_i915_reg_table;
 struct i915_gem_context;
@@ -491,9 +490,9 @@ struct intel_engine_cs {
 
 	/*
 	 * Table of commands the command parser needs to know about
-	 * for this engine.
+	 * for this engine, directly indexed by command opcode.
 	 */
-	DECLARE_HASHTABLE(cmd_hash, I915_CMD_HASH_ORDER);
+	struct drm_i915_cmd_lookup *cmd_lookup;
 
 	/*
 	 * Table of registers allowed in commands that read/write registers.
@@ -132,6 +132,7 @@
  *
  */
 #include <linux/interrupt.h>
+#include <linux/seq_file.h>
 
 #include "gem/i915_gem_context.h"
 
@@ -573,6 +574,8 @@ __execlists_schedule_in(struct i915_request *rq)
 	execlists_context_status_change(rq, INTEL_CONTEXT_SCHEDULE_IN);
 	intel_engine_context_in(engine);
 
+	WRITE_ONCE(ce->busy_start, ktime_get());
+
 	return engine;
 }
 
@@ -612,6 +615,13 @@ __execlists_schedule_out(struct i915_request *rq,
 {
 	struct intel_context * const ce = rq->hw_context;
 
+	/* Charge the time since schedule-in to the owning client context */
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), ce->busy_start)),
+		     &rq->gem_context->busy[engine->class]);
+	/* Pairs with the reader in i915_client_busy() */
+	smp_wmb();
+	WRITE_ONCE(ce->busy_start, 0);
+
 	intel_engine_context_out(engine);
 	execlists_context_status_change(rq, INTEL_CONTEXT_SCHEDULE_OUT);
 	intel_gt_pm_put(engine->gt);
@@ -4027,6 +4037,132 @@ void intel_lr_context_reset(struct intel_engine_cs *engine,
 	__execlists_update_reg_state(ce, engine);
 }
 
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Switch rq->hw_context in and out of rq->engine, staying in for about @us,
+ * and check what was charged to rq->gem_context: the whole run to the
+ * engine's class, nothing to the others, and busy_start set only while in.
+ */
+static bool busy_selftest_run(struct seq_file *m, struct i915_request *rq,
+			      unsigned long us)
+{
+	struct intel_engine_cs *engine = rq->engine;
+	struct intel_context *ce = rq->hw_context;
+	atomic64_t *busy = rq->gem_context->busy;
+	u64 before[MAX_ENGINE_CLASS + 1];
+	ktime_t start, end, in, out;
+	s64 charged, elapsed;
+	bool ok = true;
+	int class;
+
+	for (class = 0; class <= MAX_ENGINE_CLASS; class++)
+		before[class] = atomic64_read(&busy[class]);
+
+	start = ktime_get();
+	__execlists_schedule_in(rq);
+	in = READ_ONCE(ce->busy_start);
+	usleep_range(us, 2 * us);
+	__execlists_schedule_out(rq, engine);
+	out = READ_ONCE(ce->busy_start);
+	end = ktime_get();
+
+	charged = atomic64_read(&busy[engine->class]) - before[engine->class];
+	elapsed = ktime_to_ns(ktime_sub(end, start));
+
+	if (!in || ktime_before(in, start) || out) {
+		seq_printf(m, "FAIL %s: busy_start %lld after schedule-in, %lld after schedule-out\n",
+			   engine->name, ktime_to_ns(in), ktime_to_ns(out));
+		ok = false;
+	}
+	if (charged < us * NSEC_PER_USEC || charged > elapsed) {
+		seq_printf(m, "FAIL %s: %lu us run charged %lld ns, %lld ns elapsed\n",
+			   engine->name, us, charged, elapsed);
+		ok = false;
+	}
+	for (class = 0; class <= MAX_ENGINE_CLASS; class++) {
+		if (class != engine->class &&
+		    atomic64_read(&busy[class]) != before[class]) {
+			seq_printf(m, "FAIL %s: charged to class %d\n",
+				   engine->name, class);
+			ok = false;
+		}
+	}
+
+	if (ok)
+		seq_printf(m, "ok %s: %lu us run charged %lld ns, %lld ns elapsed\n",
+			   engine->name, us, charged, elapsed);
+	return ok;
+}
+
+/**
+ * intel_execlists_busy_selftest - check the per-client busy time accounting
+ * @i915: i915 device
+ * @m: seq_file for the results
+ *
+ * Runs a private context through __execlists_schedule_in() and
+ * __execlists_schedule_out() on the first engine of every class, without
+ * submitting anything to the hardware. The time is charged to a zeroed
+ * GEM context that no client sees, so the counters of i915_client_busy are
+ * left alone.
+ *
+ * Returns 0 if every check passed, -EINVAL if one failed.
+ */
+int intel_execlists_busy_selftest(struct drm_i915_private *i915,
+				  struct seq_file *m)
+{
+	struct intel_engine_cs *engine;
+	struct i915_gem_context *ctx;
+	struct i915_request *rq;
+	unsigned long classes = 0;
+	bool ok = true;
+	int ret = 0;
+
+	if (!HAS_EXECLISTS(i915)) {
+		seq_puts(m, "skipped: no execlists submission\n");
+		return 0;
+	}
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	rq = kzalloc(sizeof(*rq), GFP_KERNEL);
+	if (!ctx || !rq) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for_each_uabi_engine(engine, i915) {
+		struct intel_context *ce;
+
+		if (classes & BIT(engine->class))
+			continue;
+		classes |= BIT(engine->class);
+
+		ce = intel_context_create(i915->kernel_context, engine);
+		if (IS_ERR(ce)) {
+			ret = PTR_ERR(ce);
+			goto out;
+		}
+
+		rq->engine = engine;
+		rq->hw_context = ce;
+		rq->gem_context = ctx;
+
+		/* A second run must add to the first */
+		ok &= busy_selftest_run(m, rq, 1000);
+		ok &= busy_selftest_run(m, rq, 100);
+
+		intel_context_put(ce);
+	}
+
+	seq_puts(m, ok ? "passed\n" : "FAILED\n");
+	if (!ok)
+		ret = -EINVAL;
+out:
+	kfree(rq);
+	kfree(ctx);
+	return ret;
+}
+#endif
+
 #if IS_ENABLED(CONFIG_DRM_I915_SELFTEST)
 #include "selftest_lrc.c"
 #endif
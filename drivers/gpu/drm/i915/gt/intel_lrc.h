@@ -33,6 +33,7 @@ struct i915_gem_context;
 struct i915_request;
 struct intel_context;
 struct intel_engine_cs;
+struct seq_file;
 
 /* Execlists regs */
 #define RING_ELSP(base)				_MMIO((base) + 0x230)
@@ -131,4 +132,9 @@ int intel_virtual_engine_attach_bond(struct intel_engine_cs *engine,
 				     const struct intel_engine_cs *master,
 				     const struct intel_engine_cs *sibling);
 
+#ifdef CONFIG_DEBUG_FS
+int intel_execlists_busy_selftest(struct drm_i915_private *i915,
+				  struct seq_file *m);
+#endif
+
 #endif /* _INTEL_LRC_H_ */
@@ -29,6 +29,7 @@
 
 #include "i915_drv.h"
 #include "i915_memcpy.h"
+#include "i915_cmd_tables.h"
 
 /**
  * DOC: batch buffer command parser
@@ -87,468 +88,6 @@
  * mechanism.
  */
 
-/*
- * A command that requires special handling by the command parser.
- */
-struct drm_i915_cmd_descriptor {
-	/*
-	 * Flags describing how the command parser processes the command.
-	 *
-	 * CMD_DESC_FIXED: The command has a fixed length if this is set,
-	 *                 a length mask if not set
-	 * CMD_DESC_SKIP: The command is allowed but does not follow the
-	 *                standard length encoding for the opcode range in
-	 *                which it falls
-	 * CMD_DESC_REJECT: The command is never allowed
-	 * CMD_DESC_REGISTER: The command should be checked against the
-	 *                    register whitelist for the appropriate ring
-	 */
-	u32 flags;
-#define CMD_DESC_FIXED    (1<<0)
-#define CMD_DESC_SKIP     (1<<1)
-#define CMD_DESC_REJECT   (1<<2)
-#define CMD_DESC_REGISTER (1<<3)
-#define CMD_DESC_BITMASK  (1<<4)
-
-	/*
-	 * The command's unique identification bits and the bitmask to get them.
-	 * This isn't strictly the opcode field as defined in the spec and may
-	 * also include type, subtype, and/or subop fields.
-	 */
-	struct {
-		u32 value;
-		u32 mask;
-	} cmd;
-
-	/*
-	 * The command's length. The command is either fixed length (i.e. does
-	 * not include a length field) or has a length field mask. The flag
-	 * CMD_DESC_FIXED indicates a fixed length. Otherwise, the command has
-	 * a length mask. All command entries in a command table must include
-	 * length information.
-	 */
-	union {
-		u32 fixed;
-		u32 mask;
-	} length;
-
-	/*
-	 * Describes where to find a register address in the command to check
-	 * against the ring's register whitelist. Only valid if flags has the
-	 * CMD_DESC_REGISTER bit set.
-	 *
-	 * A non-zero step value implies that the command may access multiple
-	 * registers in sequence (e.g. LRI), in that case step gives the
-	 * distance in dwords between individual offset fields.
-	 */
-	struct {
-		u32 offset;
-		u32 mask;
-		u32 step;
-	} reg;
-
-#define MAX_CMD_DESC_BITMASKS 3
-	/*
-	 * Describes command checks where a particular dword is masked and
-	 * compared against an expected value. If the command does not match
-	 * the expected value, the parser rejects it. Only valid if flags has
-	 * the CMD_DESC_BITMASK bit set. Only entries where mask is non-zero
-	 * are valid.
-	 *
-	 * If the check specifies a non-zero condition_mask then the parser
-	 * only performs the check when the bits specified by condition_mask
-	 * are non-zero.
-	 */
-	struct {
-		u32 offset;
-		u32 mask;
-		u32 expected;
-		u32 condition_offset;
-		u32 condition_mask;
-	} bits[MAX_CMD_DESC_BITMASKS];
-};
-
-/*
- * A table of commands requiring special handling by the command parser.
- *
- * Each engine has an array of tables. Each table consists of an array of
- * command descriptors, which must be sorted with command opcodes in
- * ascending order.
- */
-struct drm_i915_cmd_table {
-	const struct drm_i915_cmd_descriptor *table;
-	int count;
-};
-
-#define STD_MI_OPCODE_SHIFT  (32 - 9)
-#define STD_3D_OPCODE_SHIFT  (32 - 16)
-#define STD_2D_OPCODE_SHIFT  (32 - 10)
-#define STD_MFX_OPCODE_SHIFT (32 - 16)
-#define MIN_OPCODE_SHIFT 16
-
-#define CMD(op, opm, f, lm, fl, ...)				\
-	{							\
-		.flags = (fl) | ((f) ? CMD_DESC_FIXED : 0),	\
-		.cmd = { (op & ~0u << (opm)), ~0u << (opm) },	\
-		.length = { (lm) },				\
-		__VA_ARGS__					\
-	}
-
-/* Convenience macros to compress the tables */
-#define SMI STD_MI_OPCODE_SHIFT
-#define S3D STD_3D_OPCODE_SHIFT
-#define S2D STD_2D_OPCODE_SHIFT
-#define SMFX STD_MFX_OPCODE_SHIFT
-#define F true
-#define S CMD_DESC_SKIP
-#define R CMD_DESC_REJECT
-#define W CMD_DESC_REGISTER
-#define B CMD_DESC_BITMASK
-
-/*            Command                          Mask   Fixed Len   Action
-	      ---------------------------------------------------------- */
-static const struct drm_i915_cmd_descriptor gen7_common_cmds[] = {
-	CMD(  MI_NOOP,                          SMI,    F,  1,      S  ),
-	CMD(  MI_USER_INTERRUPT,                SMI,    F,  1,      R  ),
-	CMD(  MI_WAIT_FOR_EVENT,                SMI,    F,  1,      R  ),
-	CMD(  MI_ARB_CHECK,                     SMI,    F,  1,      S  ),
-	CMD(  MI_REPORT_HEAD,                   SMI,    F,  1,      S  ),
-	CMD(  MI_SUSPEND_FLUSH,                 SMI,    F,  1,      S  ),
-	CMD(  MI_SEMAPHORE_MBOX,                SMI,   !F,  0xFF,   R  ),
-	CMD(  MI_STORE_DWORD_INDEX,             SMI,   !F,  0xFF,   R  ),
-	CMD(  MI_LOAD_REGISTER_IMM(1),          SMI,   !F,  0xFF,   W,
-	      .reg = { .offset = 1, .mask = 0x007FFFFC, .step = 2 }    ),
-	CMD(  MI_STORE_REGISTER_MEM,            SMI,    F,  3,     W | B,
-	      .reg = { .offset = 1, .mask = 0x007FFFFC },
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_GLOBAL_GTT,
-			.expected = 0,
-	      }},						       ),
-	CMD(  MI_LOAD_REGISTER_MEM,             SMI,    F,  3,     W | B,
-	      .reg = { .offset = 1, .mask = 0x007FFFFC },
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_GLOBAL_GTT,
-			.expected = 0,
-	      }},						       ),
-	/*
-	 * MI_BATCH_BUFFER_START requires some special handling. It's not
-	 * really a 'skip' action but it doesn't seem like it's worth adding
-	 * a new action. See i915_parse_cmds().
-	 */
-	CMD(  MI_BATCH_BUFFER_START,            SMI,   !F,  0xFF,   S  ),
-};
-
-static const struct drm_i915_cmd_descriptor gen7_render_cmds[] = {
-	CMD(  MI_FLUSH,                         SMI,    F,  1,      S  ),
-	CMD(  MI_ARB_ON_OFF,                    SMI,    F,  1,      R  ),
-	CMD(  MI_PREDICATE,                     SMI,    F,  1,      S  ),
-	CMD(  MI_TOPOLOGY_FILTER,               SMI,    F,  1,      S  ),
-	CMD(  MI_SET_APPID,                     SMI,    F,  1,      S  ),
-	CMD(  MI_DISPLAY_FLIP,                  SMI,   !F,  0xFF,   R  ),
-	CMD(  MI_SET_CONTEXT,                   SMI,   !F,  0xFF,   R  ),
-	CMD(  MI_URB_CLEAR,                     SMI,   !F,  0xFF,   S  ),
-	CMD(  MI_STORE_DWORD_IMM,               SMI,   !F,  0x3F,   B,
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_GLOBAL_GTT,
-			.expected = 0,
-	      }},						       ),
-	CMD(  MI_UPDATE_GTT,                    SMI,   !F,  0xFF,   R  ),
-	CMD(  MI_CLFLUSH,                       SMI,   !F,  0x3FF,  B,
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_GLOBAL_GTT,
-			.expected = 0,
-	      }},						       ),
-	CMD(  MI_REPORT_PERF_COUNT,             SMI,   !F,  0x3F,   B,
-	      .bits = {{
-			.offset = 1,
-			.mask = MI_REPORT_PERF_COUNT_GGTT,
-			.expected = 0,
-	      }},						       ),
-	CMD(  MI_CONDITIONAL_BATCH_BUFFER_END,  SMI,   !F,  0xFF,   B,
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_GLOBAL_GTT,
-			.expected = 0,
-	      }},						       ),
-	CMD(  GFX_OP_3DSTATE_VF_STATISTICS,     S3D,    F,  1,      S  ),
-	CMD(  PIPELINE_SELECT,                  S3D,    F,  1,      S  ),
-	CMD(  MEDIA_VFE_STATE,			S3D,   !F,  0xFFFF, B,
-	      .bits = {{
-			.offset = 2,
-			.mask = MEDIA_VFE_STATE_MMIO_ACCESS_MASK,
-			.expected = 0,
-	      }},						       ),
-	CMD(  GPGPU_OBJECT,                     S3D,   !F,  0xFF,   S  ),
-	CMD(  GPGPU_WALKER,                     S3D,   !F,  0xFF,   S  ),
-	CMD(  GFX_OP_3DSTATE_SO_DECL_LIST,      S3D,   !F,  0x1FF,  S  ),
-	CMD(  GFX_OP_PIPE_CONTROL(5),           S3D,   !F,  0xFF,   B,
-	      .bits = {{
-			.offset = 1,
-			.mask = (PIPE_CONTROL_MMIO_WRITE | PIPE_CONTROL_NOTIFY),
-			.expected = 0,
-	      },
-	      {
-			.offset = 1,
-		        .mask = (PIPE_CONTROL_GLOBAL_GTT_IVB |
-				 PIPE_CONTROL_STORE_DATA_INDEX),
-			.expected = 0,
-			.condition_offset = 1,
-			.condition_mask = PIPE_CONTROL_POST_SYNC_OP_MASK,
-	      }},						       ),
-};
-
-static const struct drm_i915_cmd_descriptor hsw_render_cmds[] = {
-	CMD(  MI_SET_PREDICATE,                 SMI,    F,  1,      S  ),
-	CMD(  MI_RS_CONTROL,                    SMI,    F,  1,      S  ),
-	CMD(  MI_URB_ATOMIC_ALLOC,              SMI,    F,  1,      S  ),
-	CMD(  MI_SET_APPID,                     SMI,    F,  1,      S  ),
-	CMD(  MI_RS_CONTEXT,                    SMI,    F,  1,      S  ),
-	CMD(  MI_LOAD_SCAN_LINES_INCL,          SMI,   !F,  0x3F,   R  ),
-	CMD(  MI_LOAD_SCAN_LINES_EXCL,          SMI,   !F,  0x3F,   R  ),
-	CMD(  MI_LOAD_REGISTER_REG,             SMI,   !F,  0xFF,   W,
-	      .reg = { .offset = 1, .mask = 0x007FFFFC, .step = 1 }    ),
-	CMD(  MI_RS_STORE_DATA_IMM,             SMI,   !F,  0xFF,   S  ),
-	CMD(  MI_LOAD_URB_MEM,                  SMI,   !F,  0xFF,   S  ),
-	CMD(  MI_STORE_URB_MEM,                 SMI,   !F,  0xFF,   S  ),
-	CMD(  GFX_OP_3DSTATE_DX9_CONSTANTF_VS,  S3D,   !F,  0x7FF,  S  ),
-	CMD(  GFX_OP_3DSTATE_DX9_CONSTANTF_PS,  S3D,   !F,  0x7FF,  S  ),
-
-	CMD(  GFX_OP_3DSTATE_BINDING_TABLE_EDIT_VS,  S3D,   !F,  0x1FF,  S  ),
-	CMD(  GFX_OP_3DSTATE_BINDING_TABLE_EDIT_GS,  S3D,   !F,  0x1FF,  S  ),
-	CMD(  GFX_OP_3DSTATE_BINDING_TABLE_EDIT_HS,  S3D,   !F,  0x1FF,  S  ),
-	CMD(  GFX_OP_3DSTATE_BINDING_TABLE_EDIT_DS,  S3D,   !F,  0x1FF,  S  ),
-	CMD(  GFX_OP_3DSTATE_BINDING_TABLE_EDIT_PS,  S3D,   !F,  0x1FF,  S  ),
-};
-
-static const struct drm_i915_cmd_descriptor gen7_video_cmds[] = {
-	CMD(  MI_ARB_ON_OFF,                    SMI,    F,  1,      R  ),
-	CMD(  MI_SET_APPID,                     SMI,    F,  1,      S  ),
-	CMD(  MI_STORE_DWORD_IMM,               SMI,   !F,  0xFF,   B,
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_GLOBAL_GTT,
-			.expected = 0,
-	      }},						       ),
-	CMD(  MI_UPDATE_GTT,                    SMI,   !F,  0x3F,   R  ),
-	CMD(  MI_FLUSH_DW,                      SMI,   !F,  0x3F,   B,
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_FLUSH_DW_NOTIFY,
-			.expected = 0,
-	      },
-	      {
-			.offset = 1,
-			.mask = MI_FLUSH_DW_USE_GTT,
-			.expected = 0,
-			.condition_offset = 0,
-			.condition_mask = MI_FLUSH_DW_OP_MASK,
-	      },
-	      {
-			.offset = 0,
-			.mask = MI_FLUSH_DW_STORE_INDEX,
-			.expected = 0,
-			.condition_offset = 0,
-			.condition_mask = MI_FLUSH_DW_OP_MASK,
-	      }},						       ),
-	CMD(  MI_CONDITIONAL_BATCH_BUFFER_END,  SMI,   !F,  0xFF,   B,
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_GLOBAL_GTT,
-			.expected = 0,
-	      }},						       ),
-	/*
-	 * MFX_WAIT doesn't fit the way we handle length for most commands.
-	 * It has a length field but it uses a non-standard length bias.
-	 * It is always 1 dword though, so just treat it as fixed length.
-	 */
-	CMD(  MFX_WAIT,                         SMFX,   F,  1,      S  ),
-};
-
-static const struct drm_i915_cmd_descriptor gen7_vecs_cmds[] = {
-	CMD(  MI_ARB_ON_OFF,                    SMI,    F,  1,      R  ),
-	CMD(  MI_SET_APPID,                     SMI,    F,  1,      S  ),
-	CMD(  MI_STORE_DWORD_IMM,               SMI,   !F,  0xFF,   B,
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_GLOBAL_GTT,
-			.expected = 0,
-	      }},						       ),
-	CMD(  MI_UPDATE_GTT,                    SMI,   !F,  0x3F,   R  ),
-	CMD(  MI_FLUSH_DW,                      SMI,   !F,  0x3F,   B,
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_FLUSH_DW_NOTIFY,
-			.expected = 0,
-	      },
-	      {
-			.offset = 1,
-			.mask = MI_FLUSH_DW_USE_GTT,
-			.expected = 0,
-			.condition_offset = 0,
-			.condition_mask = MI_FLUSH_DW_OP_MASK,
-	      },
-	      {
-			.offset = 0,
-			.mask = MI_FLUSH_DW_STORE_INDEX,
-			.expected = 0,
-			.condition_offset = 0,
-			.condition_mask = MI_FLUSH_DW_OP_MASK,
-	      }},						       ),
-	CMD(  MI_CONDITIONAL_BATCH_BUFFER_END,  SMI,   !F,  0xFF,   B,
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_GLOBAL_GTT,
-			.expected = 0,
-	      }},						       ),
-};
-
-static const struct drm_i915_cmd_descriptor gen7_blt_cmds[] = {
-	CMD(  MI_DISPLAY_FLIP,                  SMI,   !F,  0xFF,   R  ),
-	CMD(  MI_STORE_DWORD_IMM,               SMI,   !F,  0x3FF,  B,
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_GLOBAL_GTT,
-			.expected = 0,
-	      }},						       ),
-	CMD(  MI_UPDATE_GTT,                    SMI,   !F,  0x3F,   R  ),
-	CMD(  MI_FLUSH_DW,                      SMI,   !F,  0x3F,   B,
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_FLUSH_DW_NOTIFY,
-			.expected = 0,
-	      },
-	      {
-			.offset = 1,
-			.mask = MI_FLUSH_DW_USE_GTT,
-			.expected = 0,
-			.condition_offset = 0,
-			.condition_mask = MI_FLUSH_DW_OP_MASK,
-	      },
-	      {
-			.offset = 0,
-			.mask = MI_FLUSH_DW_STORE_INDEX,
-			.expected = 0,
-			.condition_offset = 0,
-			.condition_mask = MI_FLUSH_DW_OP_MASK,
-	      }},						       ),
-	CMD(  COLOR_BLT,                        S2D,   !F,  0x3F,   S  ),
-	CMD(  SRC_COPY_BLT,                     S2D,   !F,  0x3F,   S  ),
-};
-
-static const struct drm_i915_cmd_descriptor hsw_blt_cmds[] = {
-	CMD(  MI_LOAD_SCAN_LINES_INCL,          SMI,   !F,  0x3F,   R  ),
-	CMD(  MI_LOAD_SCAN_LINES_EXCL,          SMI,   !F,  0x3F,   R  ),
-};
-
-/*
- * For Gen9 we can still rely on the h/w to enforce cmd security, and only
- * need to re-enforce the register access checks. We therefore only need to
- * teach the cmdparser how to find the end of each command, and identify
- * register accesses. The table doesn't need to reject any commands, and so
- * the only commands listed here are:
- *   1) Those that touch registers
- *   2) Those that do not have the default 8-bit length
- *
- * Note that the default MI length mask chosen for this table is 0xFF, not
- * the 0x3F used on older devices. This is because the vast majority of MI
- * cmds on Gen9 use a standard 8-bit Length field.
- * All the Gen9 blitter instructions are standard 0xFF length mask, and
- * none allow access to non-general registers, so in fact no BLT cmds are
- * included in the table at all.
- *
- */
-static const struct drm_i915_cmd_descriptor gen9_blt_cmds[] = {
-	CMD(  MI_NOOP,                          SMI,    F,  1,      S  ),
-	CMD(  MI_USER_INTERRUPT,                SMI,    F,  1,      S  ),
-	CMD(  MI_WAIT_FOR_EVENT,                SMI,    F,  1,      S  ),
-	CMD(  MI_FLUSH,                         SMI,    F,  1,      S  ),
-	CMD(  MI_ARB_CHECK,                     SMI,    F,  1,      S  ),
-	CMD(  MI_REPORT_HEAD,                   SMI,    F,  1,      S  ),
-	CMD(  MI_ARB_ON_OFF,                    SMI,    F,  1,      S  ),
-	CMD(  MI_SUSPEND_FLUSH,                 SMI,    F,  1,      S  ),
-	CMD(  MI_LOAD_SCAN_LINES_INCL,          SMI,   !F,  0x3F,   S  ),
-	CMD(  MI_LOAD_SCAN_LINES_EXCL,          SMI,   !F,  0x3F,   S  ),
-	CMD(  MI_STORE_DWORD_IMM,               SMI,   !F,  0x3FF,  S  ),
-	CMD(  MI_LOAD_REGISTER_IMM(1),          SMI,   !F,  0xFF,   W,
-	      .reg = { .offset = 1, .mask = 0x007FFFFC, .step = 2 }    ),
-	CMD(  MI_UPDATE_GTT,                    SMI,   !F,  0x3FF,  S  ),
-	CMD(  MI_STORE_REGISTER_MEM_GEN8,       SMI,    F,  4,      W,
-	      .reg = { .offset = 1, .mask = 0x007FFFFC }               ),
-	CMD(  MI_FLUSH_DW,                      SMI,   !F,  0x3F,   S  ),
-	CMD(  MI_LOAD_REGISTER_MEM_GEN8,        SMI,    F,  4,      W,
-	      .reg = { .offset = 1, .mask = 0x007FFFFC }               ),
-	CMD(  MI_LOAD_REGISTER_REG,             SMI,    !F,  0xFF,  W,
-	      .reg = { .offset = 1, .mask = 0x007FFFFC, .step = 1 }    ),
-
-	/*
-	 * We allow BB_START but apply further checks. We just sanitize the
-	 * basic fields here.
-	 */
-#define MI_BB_START_OPERAND_MASK   GENMASK(SMI-1, 0)
-#define MI_BB_START_OPERAND_EXPECT (MI_BATCH_PPGTT_HSW | 1)
-	CMD(  MI_BATCH_BUFFER_START_GEN8,       SMI,    !F,  0xFF,  B,
-	      .bits = {{
-			.offset = 0,
-			.mask = MI_BB_START_OPERAND_MASK,
-			.expected = MI_BB_START_OPERAND_EXPECT,
-	      }},						       ),
-};
-
-static const struct drm_i915_cmd_descriptor noop_desc =
-	CMD(MI_NOOP, SMI, F, 1, S);
-
-#undef CMD
-#undef SMI
-#undef S3D
-#undef S2D
-#undef SMFX
-#undef F
-#undef S
-#undef R
-#undef W
-#undef B
-
-static const struct drm_i915_cmd_table gen7_render_cmd_table[] = {
-	{ gen7_common_cmds, ARRAY_SIZE(gen7_common_cmds) },
-	{ gen7_render_cmds, ARRAY_SIZE(gen7_render_cmds) },
-};
-
-static const struct drm_i915_cmd_table hsw_render_ring_cmd_table[] = {
-	{ gen7_common_cmds, ARRAY_SIZE(gen7_common_cmds) },
-	{ gen7_render_cmds, ARRAY_SIZE(gen7_render_cmds) },
-	{ hsw_render_cmds, ARRAY_SIZE(hsw_render_cmds) },
-};
-
-static const struct drm_i915_cmd_table gen7_video_cmd_table[] = {
-	{ gen7_common_cmds, ARRAY_SIZE(gen7_common_cmds) },
-	{ gen7_video_cmds, ARRAY_SIZE(gen7_video_cmds) },
-};
-
-static const struct drm_i915_cmd_table hsw_vebox_cmd_table[] = {
-	{ gen7_common_cmds, ARRAY_SIZE(gen7_common_cmds) },
-	{ gen7_vecs_cmds, ARRAY_SIZE(gen7_vecs_cmds) },
-};
-
-static const struct drm_i915_cmd_table gen7_blt_cmd_table[] = {
-	{ gen7_common_cmds, ARRAY_SIZE(gen7_common_cmds) },
-	{ gen7_blt_cmds, ARRAY_SIZE(gen7_blt_cmds) },
-};
-
-static const struct drm_i915_cmd_table hsw_blt_ring_cmd_table[] = {
-	{ gen7_common_cmds, ARRAY_SIZE(gen7_common_cmds) },
-	{ gen7_blt_cmds, ARRAY_SIZE(gen7_blt_cmds) },
-	{ hsw_blt_cmds, ARRAY_SIZE(hsw_blt_cmds) },
-};
-
-static const struct drm_i915_cmd_table gen9_blt_cmd_table[] = {
-	{ gen9_blt_cmds, ARRAY_SIZE(gen9_blt_cmds) },
-};
-
-
 /*
  * Register whitelists, sorted by increasing register offset.
  */
@@ -716,71 +255,6 @@ static const struct drm_i915_reg_table gen9_blt_reg_tables[] = {
 	{ gen9_blt_regs, ARRAY_SIZE(gen9_blt_regs) },
 };
 
-static u32 gen7_render_get_cmd_length_mask(u32 cmd_header)
-{
-	u32 client = cmd_header >> INSTR_CLIENT_SHIFT;
-	u32 subclient =
-		(cmd_header & INSTR_SUBCLIENT_MASK) >> INSTR_SUBCLIENT_SHIFT;
-
-	if (client == INSTR_MI_CLIENT)
-		return 0x3F;
-	else if (client == INSTR_RC_CLIENT) {
-		if (subclient == INSTR_MEDIA_SUBCLIENT)
-			return 0xFFFF;
-		else
-			return 0xFF;
-	}
-
-	DRM_DEBUG_DRIVER("CMD: Abnormal rcs cmd length! 0x%08X\n", cmd_header);
-	return 0;
-}
-
-static u32 gen7_bsd_get_cmd_length_mask(u32 cmd_header)
-{
-	u32 client = cmd_header >> INSTR_CLIENT_SHIFT;
-	u32 subclient =
-		(cmd_header & INSTR_SUBCLIENT_MASK) >> INSTR_SUBCLIENT_SHIFT;
-	u32 op = (cmd_header & INSTR_26_TO_24_MASK) >> INSTR_26_TO_24_SHIFT;
-
-	if (client == INSTR_MI_CLIENT)
-		return 0x3F;
-	else if (client == INSTR_RC_CLIENT) {
-		if (subclient == INSTR_MEDIA_SUBCLIENT) {
-			if (op == 6)
-				return 0xFFFF;
-			else
-				return 0xFFF;
-		} else
-			return 0xFF;
-	}
-
-	DRM_DEBUG_DRIVER("CMD: Abnormal bsd cmd length! 0x%08X\n", cmd_header);
-	return 0;
-}
-
-static u32 gen7_blt_get_cmd_length_mask(u32 cmd_header)
-{
-	u32 client = cmd_header >> INSTR_CLIENT_SHIFT;
-
-	if (client == INSTR_MI_CLIENT)
-		return 0x3F;
-	else if (client == INSTR_BC_CLIENT)
-		return 0xFF;
-
-	DRM_DEBUG_DRIVER("CMD: Abnormal blt cmd length! 0x%08X\n", cmd_header);
-	return 0;
-}
-
-static u32 gen9_blt_get_cmd_length_mask(u32 cmd_header)
-{
-	u32 client = cmd_header >> INSTR_CLIENT_SHIFT;
-
-	if (client == INSTR_MI_CLIENT || client == INSTR_BC_CLIENT)
-		return 0xFF;
-
-	DRM_DEBUG_DRIVER("CMD: Abnormal blt cmd length! 0x%08X\n", cmd_header);
-	return 0;
-}
 
 static bool validate_cmds_sorted(const struct intel_engine_cs *engine,
 				 const struct drm_i915_cmd_table *cmd_tables,
@@ -856,73 +330,42 @@ static bool validate_regs_sorted(struct intel_engine_cs *engine)
 	return true;
 }
 
-struct cmd_node {
-	const struct drm_i915_cmd_descriptor *desc;
-	struct hlist_node node;
-};
-
-/*
- * Different command ranges have different numbers of bits for the opcode. For
- * example, MI commands use bits 31:23 while 3D commands use bits 31:16. The
- * problem is that, for example, MI commands use bits 22:16 for other fields
- * such as GGTT vs PPGTT bits. If we include those bits in the mask then when
- * we mask a command from a batch it could hash to the wrong bucket due to
- * non-opcode bits being set. But if we don't include those bits, some 3D
- * commands may hash to the same bucket due to not including opcode bits that
- * make the command unique. For now, we will risk hashing to the same bucket.
- */
-static inline u32 cmd_header_key(u32 x)
-{
-	switch (x >> INSTR_CLIENT_SHIFT) {
-	default:
-	case INSTR_MI_CLIENT:
-		return x >> STD_MI_OPCODE_SHIFT;
-	case INSTR_RC_CLIENT:
-		return x >> STD_3D_OPCODE_SHIFT;
-	case INSTR_BC_CLIENT:
-		return x >> STD_2D_OPCODE_SHIFT;
-	}
-}
-
-static int init_hash_table(struct intel_engine_cs *engine,
+static int init_cmd_lookup(struct intel_engine_cs *engine,
 			   const struct drm_i915_cmd_table *cmd_tables,
 			   int cmd_table_count)
 {
-	int i, j;
+	struct drm_i915_cmd_lookup *lookup;
+	int total;
 
-	hash_init(engine->cmd_hash);
+	lookup = kvzalloc(sizeof(*lookup), GFP_KERNEL);
+	if (!lookup)
+		return -ENOMEM;
 
-	for (i = 0; i < cmd_table_count; i++) {
-		const struct drm_i915_cmd_table *table = &cmd_tables[i];
+	total = count_cmd_lookup(lookup, cmd_tables, cmd_table_count);
+	if (total < 0) {
+		kvfree(lookup);
+		return total;
+	}
 
-		for (j = 0; j < table->count; j++) {
-			const struct drm_i915_cmd_descriptor *desc =
-				&table->table[j];
-			struct cmd_node *desc_node =
-				kmalloc(sizeof(*desc_node), GFP_KERNEL);
+	engine->cmd_lookup = kvmalloc(struct_size(lookup, descs, total),
+				      GFP_KERNEL);
+	if (!engine->cmd_lookup) {
+		kvfree(lookup);
+		return -ENOMEM;
+	}
 
-			if (!desc_node)
-				return -ENOMEM;
+	memcpy(engine->cmd_lookup->slot, lookup->slot, sizeof(lookup->slot));
+	kvfree(lookup);
 
-			desc_node->desc = desc;
-			hash_add(engine->cmd_hash, &desc_node->node,
-				 cmd_header_key(desc->cmd.value));
-		}
-	}
+	fill_cmd_lookup(engine->cmd_lookup, cmd_tables, cmd_table_count);
 
 	return 0;
 }
 
-static void fini_hash_table(struct intel_engine_cs *engine)
+static void fini_cmd_lookup(struct intel_engine_cs *engine)
 {
-	struct hlist_node *tmp;
-	struct cmd_node *desc_node;
-	int i;
-
-	hash_for_each_safe(engine->cmd_hash, i, tmp, desc_node, node) {
-		hash_del(&desc_node->node);
-		kfree(desc_node);
-	}
+	kvfree(engine->cmd_lookup);
+	engine->cmd_lookup = NULL;
 }
 
 /**
@@ -1019,10 +462,10 @@ void intel_engine_init_cmd_parser(struct intel_engine_cs *engine)
 		return;
 	}
 
-	ret = init_hash_table(engine, cmd_tables, cmd_table_count);
+	ret = init_cmd_lookup(engine, cmd_tables, cmd_table_count);
 	if (ret) {
 		DRM_ERROR("%s: initialised failed!\n", engine->name);
-		fini_hash_table(engine);
+		fini_cmd_lookup(engine);
 		return;
 	}
 
@@ -1041,23 +484,14 @@ void intel_engine_cleanup_cmd_parser(struct intel_engine_cs *engine)
 	if (!intel_engine_using_cmd_parser(engine))
 		return;
 
-	fini_hash_table(engine);
+	fini_cmd_lookup(engine);
 }
 
 static const struct drm_i915_cmd_descriptor*
 find_cmd_in_table(struct intel_engine_cs *engine,
 		  u32 cmd_header)
 {
-	struct cmd_node *desc_node;
-
-	hash_for_each_possible(engine->cmd_hash, desc_node, node,
-			       cmd_header_key(cmd_header)) {
-		const struct drm_i915_cmd_descriptor *desc = desc_node->desc;
-		if (((cmd_header ^ desc->cmd.value) & desc->cmd.mask) == 0)
-			return desc;
-	}
-
-	return NULL;
+	return lookup_cmd(engine->cmd_lookup, cmd_header);
 }
 
 /*
@@ -1124,85 +558,6 @@ find_reg(const struct intel_engine_cs *engine, u32 addr)
 	return reg;
 }
 
-/* Returns a vmap'd pointer to dst_obj, which the caller must unmap */
-static u32 *copy_batch(struct drm_i915_gem_object *dst_obj,
-		       struct drm_i915_gem_object *src_obj,
-		       u32 batch_start_offset,
-		       u32 batch_len,
-		       bool *needs_clflush_after)
-{
-	unsigned int src_needs_clflush;
-	unsigned int dst_needs_clflush;
-	void *dst, *src;
-	int ret;
-
-	ret = i915_gem_object_prepare_write(dst_obj, &dst_needs_clflush);
-	if (ret)
-		return ERR_PTR(ret);
-
-	dst = i915_gem_object_pin_map(dst_obj, I915_MAP_FORCE_WB);
-	i915_gem_object_finish_access(dst_obj);
-	if (IS_ERR(dst))
-		return dst;
-
-	ret = i915_gem_object_prepare_read(src_obj, &src_needs_clflush);
-	if (ret) {
-		i915_gem_object_unpin_map(dst_obj);
-		return ERR_PTR(ret);
-	}
-
-	src = ERR_PTR(-ENODEV);
-	if (src_needs_clflush &&
-	    i915_can_memcpy_from_wc(NULL, batch_start_offset, 0)) {
-		src = i915_gem_object_pin_map(src_obj, I915_MAP_WC);
-		if (!IS_ERR(src)) {
-			i915_memcpy_from_wc(dst,
-					    src + batch_start_offset,
-					    ALIGN(batch_len, 16));
-			i915_gem_object_unpin_map(src_obj);
-		}
-	}
-	if (IS_ERR(src)) {
-		void *ptr;
-		int offset, n;
-
-		offset = offset_in_page(batch_start_offset);
-
-		/* We can avoid clflushing partial cachelines before the write
-		 * if we only every write full cache-lines. Since we know that
-		 * both the source and destination are in multiples of
-		 * PAGE_SIZE, we can simply round up to the next cacheline.
-		 * We don't care about copying too much here as we only
-		 * validate up to the end of the batch.
-		 */
-		if (dst_needs_clflush & CLFLUSH_BEFORE)
-			batch_len = roundup(batch_len,
-					    boot_cpu_data.x86_clflush_size);
-
-		ptr = dst;
-		for (n = batch_start_offset >> PAGE_SHIFT; batch_len; n++) {
-			int len = min_t(int, batch_len, PAGE_SIZE - offset);
-
-			src = kmap_atomic(i915_gem_object_get_page(src_obj, n));
-			if (src_needs_clflush)
-				drm_clflush_virt_range(src + offset, len);
-			memcpy(ptr, src + offset, len);
-			kunmap_atomic(src);
-
-			ptr += len;
-			batch_len -= len;
-			offset = 0;
-		}
-	}
-
-	i915_gem_object_finish_access(src_obj);
-
-	/* dst_obj is returned with vmap pinned */
-	*needs_clflush_after = dst_needs_clflush & CLFLUSH_AFTER;
-
-	return dst;
-}
-
 static bool check_cmd(const struct intel_engine_cs *engine,
 		      const struct drm_i915_cmd_descriptor *desc,
 		      const u32 *cmd, u32 length)
@@ -1402,67 +757,51 @@ again:
 
 #define LENGTH_BIAS 2
 
-/**
- * i915_parse_cmds() - parse a submitted batch buffer for privilege violations
- * @ctx: the context in which the batch is to execute
- * @engine: the engine on which the batch is to execute
- * @batch_obj: the batch buffer in question
- * @batch_start: Canonical base address of batch
- * @batch_start_offset: byte offset in the batch at which execution starts
- * @batch_len: length of the commands in batch_obj
- * @shadow_batch_obj: copy of the batch buffer in question
- * @shadow_batch_start: Canonical base address of shadow_batch_obj
- *
- * Parses the specified batch buffer looking for privilege violations as
- * described in the overview.
- *
- * Return: non-zero if the parser finds violations or otherwise fails; -EACCES
- * if the batch appears legal but should use hardware parsing
+/*
+ * Parser state carried across the chunks of a batch. The batch is validated
+ * while it is being copied into the shadow object, so that each command is
+ * checked while its cachelines are still hot from the copy, rather than in a
+ * second full pass over the shadow afterwards.
  */
+struct cmd_parser {
+	struct i915_gem_context *ctx;
+	struct intel_engine_cs *engine;
+	struct drm_i915_cmd_descriptor default_desc;
+	const struct drm_i915_cmd_descriptor *desc;
+	u32 *cmd;
+	u32 *batch_end;
+	u32 offset;
+	u32 batch_len;
+	u64 batch_start;
+	u64 shadow_batch_start;
+	bool done;
+};
 
-int intel_engine_cmd_parser(struct i915_gem_context *ctx,
-			    struct intel_engine_cs *engine,
-			    struct drm_i915_gem_object *batch_obj,
-			    u64 batch_start,
-			    u32 batch_start_offset,
-			    u32 batch_len,
-			    struct drm_i915_gem_object *shadow_batch_obj,
-			    u64 shadow_batch_start)
+/*
+ * Validate the commands of the shadow batch up to @avail, the end of the
+ * part copied so far. A command straddling @avail is left for the next call.
+ * Sets p->done once the batch is terminated by BBE or a valid BB_START.
+ */
+static int parse_cmds(struct cmd_parser *p, const u32 *avail)
 {
-	u32 *cmd, *batch_end, offset = 0;
-	struct drm_i915_cmd_descriptor default_desc = noop_desc;
-	const struct drm_i915_cmd_descriptor *desc = &default_desc;
-	bool needs_clflush_after = false;
+	const struct drm_i915_cmd_descriptor *desc = p->desc;
+	u32 *cmd = p->cmd;
 	int ret = 0;
 
-	cmd = copy_batch(shadow_batch_obj, batch_obj,
-			 batch_start_offset, batch_len,
-			 &needs_clflush_after);
-	if (IS_ERR(cmd)) {
-		DRM_DEBUG_DRIVER("CMD: Failed to copy batch\n");
-		return PTR_ERR(cmd);
-	}
-
-	init_whitelist(ctx, batch_len);
-
-	/*
-	 * We use the batch length as size because the shadow object is as
-	 * large or larger and copy_batch() will write MI_NOPs to the extra
-	 * space. Parsing should be faster in some cases this way.
-	 */
-	batch_end = cmd + (batch_len / sizeof(*batch_end));
-	do {
+	while (cmd < avail) {
 		u32 length;
 
-		if (*cmd == MI_BATCH_BUFFER_END)
+		if (*cmd == MI_BATCH_BUFFER_END) {
+			p->done = true;
 			break;
+		}
 
-		desc = find_cmd(engine, *cmd, desc, &default_desc);
+		desc = find_cmd(p->engine, *cmd, desc, &p->default_desc);
 		if (!desc) {
 			DRM_DEBUG_DRIVER("CMD: Unrecognized command: 0x%08X\n",
 					 *cmd);
 			ret = -EINVAL;
-			goto err;
+			break;
 		}
 
 		if (desc->flags & CMD_DESC_FIXED)
@@ -1470,51 +809,208 @@ int intel_engine_cmd_parser(struct i915_gem_context *ctx,
 		else
 			length = ((*cmd & desc->length.mask) + LENGTH_BIAS);
 
-		if ((batch_end - cmd) < length) {
+		if ((p->batch_end - cmd) < length) {
 			DRM_DEBUG_DRIVER("CMD: Command length exceeds batch length: 0x%08X length=%u batchlen=%td\n",
 					 *cmd,
 					 length,
-					 batch_end - cmd);
+					 p->batch_end - cmd);
 			ret = -EINVAL;
-			goto err;
+			break;
 		}
 
-		if (!check_cmd(engine, desc, cmd, length)) {
+		/* The tail of this command has not been copied yet */
+		if ((avail - cmd) < length)
+			break;
+
+		if (!check_cmd(p->engine, desc, cmd, length)) {
 			ret = -EACCES;
-			goto err;
+			break;
 		}
 
 		if (desc->cmd.value == MI_BATCH_BUFFER_START) {
-			ret = check_bbstart(ctx, cmd, offset, length,
-					    batch_len, batch_start,
-					    shadow_batch_start);
-
-			if (ret)
-				goto err;
+			ret = check_bbstart(p->ctx, cmd, p->offset, length,
+					    p->batch_len, p->batch_start,
+					    p->shadow_batch_start);
+			if (!ret)
+				p->done = true;
 			break;
 		}
 
-		if (ctx->jump_whitelist_cmds > offset)
-			set_bit(offset, ctx->jump_whitelist);
+		if (p->ctx->jump_whitelist_cmds > p->offset)
+			set_bit(p->offset, p->ctx->jump_whitelist);
 
 		cmd += length;
-		offset += length;
-		if  (cmd >= batch_end) {
+		p->offset += length;
+		if  (cmd >= p->batch_end) {
 			DRM_DEBUG_DRIVER("CMD: Got to the end of the buffer w/o a BBE cmd!\n");
 			ret = -EINVAL;
-			goto err;
+			break;
+		}
+	}
+
+	p->cmd = cmd;
+	p->desc = desc;
+	return ret;
+}
+
+/*
+ * Copy the batch into dst_obj a chunk at a time, parsing each chunk as soon
+ * as it lands. Copying stops once the batch is terminated: nothing past the
+ * BBE or BB_START can be executed from the shadow, and any jump target has
+ * already been copied and parsed.
+ */
+static int copy_and_parse_batch(struct cmd_parser *p,
+				struct drm_i915_gem_object *dst_obj,
+				struct drm_i915_gem_object *src_obj,
+				u32 batch_start_offset,
+				u32 batch_len)
+{
+	unsigned int src_needs_clflush;
+	unsigned int dst_needs_clflush;
+	void *dst, *src;
+	int ret;
+
+	ret = i915_gem_object_prepare_write(dst_obj, &dst_needs_clflush);
+	if (ret)
+		goto err_copy;
+
+	dst = i915_gem_object_pin_map(dst_obj, I915_MAP_FORCE_WB);
+	i915_gem_object_finish_access(dst_obj);
+	if (IS_ERR(dst)) {
+		ret = PTR_ERR(dst);
+		goto err_copy;
+	}
+
+	ret = i915_gem_object_prepare_read(src_obj, &src_needs_clflush);
+	if (ret) {
+		i915_gem_object_unpin_map(dst_obj);
+		goto err_copy;
+	}
+
+	/*
+	 * We use the batch length as size because the shadow object is as
+	 * large or larger and the copy below will write MI_NOPs to the extra
+	 * space. Parsing should be faster in some cases this way.
+	 */
+	p->cmd = dst;
+	p->batch_end = p->cmd + (batch_len / sizeof(*p->batch_end));
+
+	src = ERR_PTR(-ENODEV);
+	if (src_needs_clflush &&
+	    i915_can_memcpy_from_wc(NULL, batch_start_offset, 0)) {
+		src = i915_gem_object_pin_map(src_obj, I915_MAP_WC);
+		if (!IS_ERR(src)) {
+			u32 len = ALIGN(batch_len, 16);
+			u32 pos, n;
+
+			for (pos = 0; pos < len && !p->done && !ret; pos += n) {
+				n = min_t(u32, len - pos, PAGE_SIZE);
+				i915_memcpy_from_wc(dst + pos,
+						    src + batch_start_offset + pos,
+						    n);
+				ret = parse_cmds(p, (u32 *)dst +
+						 (pos + n) / sizeof(u32));
+			}
+			i915_gem_object_unpin_map(src_obj);
 		}
-	} while (1);
+	}
+	if (IS_ERR(src)) {
+		void *ptr;
+		int offset, n;
+
+		offset = offset_in_page(batch_start_offset);
 
-	if (needs_clflush_after) {
-		void *ptr = page_mask_bits(shadow_batch_obj->mm.mapping);
+		/* We can avoid clflushing partial cachelines before the write
+		 * if we only every write full cache-lines. Since we know that
+		 * both the source and destination are in multiples of
+		 * PAGE_SIZE, we can simply round up to the next cacheline.
+		 * We don't care about copying too much here as we only
+		 * validate up to the end of the batch.
+		 */
+		if (dst_needs_clflush & CLFLUSH_BEFORE)
+			batch_len = roundup(batch_len,
+					    boot_cpu_data.x86_clflush_size);
 
-		drm_clflush_virt_range(ptr, (void *)(cmd + 1) - ptr);
+		ptr = dst;
+		for (n = batch_start_offset >> PAGE_SHIFT;
+		     batch_len && !p->done && !ret;
+		     n++) {
+			int len = min_t(int, batch_len, PAGE_SIZE - offset);
+
+			src = kmap_atomic(i915_gem_object_get_page(src_obj, n));
+			if (src_needs_clflush)
+				drm_clflush_virt_range(src + offset, len);
+			memcpy(ptr, src + offset, len);
+			kunmap_atomic(src);
+
+			ptr += len;
+			batch_len -= len;
+			offset = 0;
+
+			ret = parse_cmds(p, (u32 *)dst +
+					 (ptr - dst) / sizeof(u32));
+		}
 	}
 
-err:
-	i915_gem_object_unpin_map(shadow_batch_obj);
+	i915_gem_object_finish_access(src_obj);
+
+	/* Every exit from parse_cmds() over the whole batch sets done or ret */
+	if (!ret && GEM_WARN_ON(!p->done))
+		ret = -EINVAL;
+
+	if (!ret && (dst_needs_clflush & CLFLUSH_AFTER))
+		drm_clflush_virt_range(dst, (void *)(p->cmd + 1) - dst);
+
+	i915_gem_object_unpin_map(dst_obj);
 	return ret;
+
+err_copy:
+	DRM_DEBUG_DRIVER("CMD: Failed to copy batch\n");
+	return ret;
+}
+
+/**
+ * i915_parse_cmds() - parse a submitted batch buffer for privilege violations
+ * @ctx: the context in which the batch is to execute
+ * @engine: the engine on which the batch is to execute
+ * @batch_obj: the batch buffer in question
+ * @batch_start: Canonical base address of batch
+ * @batch_start_offset: byte offset in the batch at which execution starts
+ * @batch_len: length of the commands in batch_obj
+ * @shadow_batch_obj: copy of the batch buffer in question
+ * @shadow_batch_start: Canonical base address of shadow_batch_obj
+ *
+ * Copies the batch into the shadow object and parses it for privilege
+ * violations as described in the overview, in a single pass over the batch.
+ *
+ * Return: non-zero if the parser finds violations or otherwise fails; -EACCES
+ * if the batch appears legal but should use hardware parsing
+ */
+
+int intel_engine_cmd_parser(struct i915_gem_context *ctx,
+			    struct intel_engine_cs *engine,
+			    struct drm_i915_gem_object *batch_obj,
+			    u64 batch_start,
+			    u32 batch_start_offset,
+			    u32 batch_len,
+			    struct drm_i915_gem_object *shadow_batch_obj,
+			    u64 shadow_batch_start)
+{
+	struct cmd_parser p = {
+		.ctx = ctx,
+		.engine = engine,
+		.default_desc = noop_desc,
+		.batch_len = batch_len,
+		.batch_start = batch_start,
+		.shadow_batch_start = shadow_batch_start,
+	};
+
+	p.desc = &p.default_desc;
+
+	init_whitelist(ctx, batch_len);
+
+	return copy_and_parse_batch(&p, shadow_batch_obj, batch_obj,
+				    batch_start_offset, batch_len);
 }
 
 /**
@@ -766,6 +766,13 @@ static const struct file_operations i915_error_state_fops = {
 	.llseek = default_llseek,
 	.release = gpu_state_release,
 };
+
+static int i915_error_capture_bench(struct seq_file *m, void *data)
+{
+	struct drm_printer p = drm_seq_file_printer(m);
+
+	return i915_gpu_error_benchmark(&p);
+}
 #endif
 
 static int i915_frequency_info(struct seq_file *m, void *unused)
@@ -1599,6 +1606,9 @@ static int i915_context_status(struct seq_file *m, void *unused)
 		seq_putc(m, ctx->remap_slice ? 'R' : 'r');
 		seq_putc(m, '\n');
 
+		seq_printf(m, "execbuf cache: %llu hits, %llu misses\n",
+			   ctx->exec_cache.hits, ctx->exec_cache.misses);
+
 		for_each_gem_engine(ce,
 				    i915_gem_context_lock_engines(ctx), it) {
 			intel_context_lock_pinned(ce);
@@ -1621,6 +1631,178 @@ static int i915_context_status(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static const char * const client_busy_names[] = {
+	[RENDER_CLASS] = "render",
+	[VIDEO_DECODE_CLASS] = "video",
+	[VIDEO_ENHANCEMENT_CLASS] = "video-enhance",
+	[COPY_ENGINE_CLASS] = "copy",
+};
+
+/* Time the engines of one class have been running ctx so far, up to now */
+static u64 client_busy_active(struct i915_gem_engines *e, int class,
+			      ktime_t now)
+{
+	unsigned int n;
+	ktime_t start;
+	u64 active = 0;
+
+	for (n = 0; n < e->num_engines; n++) {
+		struct intel_context *ce = e->engines[n];
+
+		if (!ce || ce->engine->class != class)
+			continue;
+
+		start = READ_ONCE(ce->busy_start);
+		if (start && ktime_before(start, now))
+			active += ktime_to_ns(ktime_sub(now, start));
+	}
+
+	return active;
+}
+
+/*
+ * Add the busy time of ctx, including the run in progress. A context
+ * switched out meanwhile has already charged its time before clearing
+ * busy_start (see __execlists_schedule_out()), so retry rather than count
+ * that run twice or not at all.
+ */
+static void client_busy_add(u64 *busy, struct i915_gem_context *ctx)
+{
+	struct i915_gem_engines *e = i915_gem_context_lock_engines(ctx);
+	ktime_t now = ktime_get();
+	u64 active, total;
+	int class;
+
+	for (class = 0; class < ARRAY_SIZE(client_busy_names); class++) {
+		do {
+			active = client_busy_active(e, class, now);
+			smp_rmb();
+			total = atomic64_read(&ctx->busy[class]);
+			smp_rmb();
+		} while (active != client_busy_active(e, class, now));
+
+		busy[class] += total + active;
+	}
+
+	i915_gem_context_unlock_engines(ctx);
+}
+
+static void client_busy_add_closed(u64 *busy, atomic64_t *closed)
+{
+	int class;
+
+	for (class = 0; class < ARRAY_SIZE(client_busy_names); class++)
+		busy[class] += atomic64_read(&closed[class]);
+}
+
+/*
+ * A context closing moves its run in progress from its client's row to
+ * "<closed>"; never let a row go backwards because of that. The part of
+ * that run the client's row had already shown stays in it, and the whole
+ * run is charged to "<closed>" at schedule-out, so that part is counted in
+ * both rows.
+ */
+static void client_busy_monotonic(u64 *busy, u64 *shown)
+{
+	int class;
+
+	for (class = 0; class < ARRAY_SIZE(client_busy_names); class++) {
+		if (busy[class] < shown[class])
+			busy[class] = shown[class];
+		shown[class] = busy[class];
+	}
+}
+
+static void client_busy_print(struct seq_file *m,
+			      const char *comm, int pid, const u64 *busy)
+{
+	int class;
+
+	seq_printf(m, "%20s %5d", comm, pid);
+	for (class = 0; class < ARRAY_SIZE(client_busy_names); class++)
+		seq_printf(m, " %14llu", busy[class]);
+	seq_putc(m, '\n');
+}
+
+/*
+ * Engine busy time per client, in nanoseconds per engine class. Each row
+ * only ever grows. A context closed while on the hardware is counted twice
+ * for the time its client's row had already shown of the run in progress,
+ * once there and once in "<closed>"; see client_busy_monotonic().
+ */
+static int i915_client_busy(struct seq_file *m, void *unused)
+{
+	struct drm_i915_private *dev_priv = node_to_i915(m->private);
+	struct drm_device *dev = &dev_priv->drm;
+	u64 busy[ARRAY_SIZE(client_busy_names)];
+	struct i915_gem_context *ctx;
+	struct drm_file *file;
+	int class, ret;
+
+	seq_printf(m, "%20s %5s", "command", "pid");
+	for (class = 0; class < ARRAY_SIZE(client_busy_names); class++)
+		seq_printf(m, " %14s", client_busy_names[class]);
+	seq_puts(m, " (busy ns)\n");
+
+	ret = mutex_lock_interruptible(&dev->filelist_mutex);
+	if (ret)
+		return ret;
+
+	ret = mutex_lock_interruptible(&dev->struct_mutex);
+	if (ret)
+		goto out_filelist;
+
+	/* Oldest first, as in drm_clients_info() */
+	list_for_each_entry_reverse(file, &dev->filelist, lhead) {
+		struct drm_i915_file_private *file_priv = file->driver_priv;
+		struct task_struct *task;
+
+		memset(busy, 0, sizeof(busy));
+		client_busy_add_closed(busy, file_priv->busy);
+		list_for_each_entry(ctx, &dev_priv->contexts.list, link) {
+			if (ctx->file_priv == file_priv)
+				client_busy_add(busy, ctx);
+		}
+		client_busy_monotonic(busy, file_priv->busy_shown);
+
+		rcu_read_lock(); /* locks pid_task()->comm */
+		task = pid_task(file->pid, PIDTYPE_PID);
+		client_busy_print(m, task ? task->comm : "<unknown>",
+				  pid_vnr(file->pid), busy);
+		rcu_read_unlock();
+	}
+
+	/*
+	 * Clients that are gone, and contexts outliving their file until
+	 * their last request retires
+	 */
+	memset(busy, 0, sizeof(busy));
+	client_busy_add_closed(busy, dev_priv->contexts.closed_busy);
+	list_for_each_entry(ctx, &dev_priv->contexts.list, link) {
+		if (IS_ERR(ctx->file_priv))
+			client_busy_add(busy, ctx);
+	}
+	client_busy_monotonic(busy, dev_priv->contexts.closed_busy_shown);
+	client_busy_print(m, "<closed>", 0, busy);
+
+	mutex_unlock(&dev->struct_mutex);
+out_filelist:
+	mutex_unlock(&dev->filelist_mutex);
+	return ret;
+}
+
+static int i915_client_busy_selftest(struct seq_file *m, void *unused)
+{
+	struct drm_i915_private *dev_priv = node_to_i915(m->private);
+	intel_wakeref_t wakeref;
+	int ret = 0;
+
+	with_intel_runtime_pm(&dev_priv->runtime_pm, wakeref)
+		ret = intel_execlists_busy_selftest(dev_priv, m);
+
+	return ret;
+}
+
 static const char *swizzle_string(unsigned swizzle)
 {
 	switch (swizzle) {
@@ -4313,6 +4495,8 @@ static const struct drm_info_list i915_debugfs_list[] = {
 	{"i915_vbt", i915_vbt, 0},
 	{"i915_gem_framebuffer", i915_gem_framebuffer_info, 0},
 	{"i915_context_status", i915_context_status, 0},
+	{"i915_client_busy", i915_client_busy, 0},
+	{"i915_client_busy_selftest", i915_client_busy_selftest, 0},
 	{"i915_forcewake_domains", i915_forcewake_domains, 0},
 	{"i915_swizzle_info", i915_swizzle_info, 0},
 	{"i915_llc", i915_llc, 0},
@@ -4332,6 +4516,9 @@ static const struct drm_info_list i915_debugfs_list[] = {
 	{"i915_sseu_status", i915_sseu_status, 0},
 	{"i915_drrs_status", i915_drrs_status, 0},
 	{"i915_rps_boost_info", i915_rps_boost_info, 0},
+#if IS_ENABLED(CONFIG_DRM_I915_CAPTURE_ERROR)
+	{"i915_error_capture_bench", i915_error_capture_bench, 0},
+#endif
 };
 #define I915_DEBUGFS_ENTRIES ARRAY_SIZE(i915_debugfs_list)
 
@@ -226,6 +226,14 @@ struct drm_i915_file_private {
 	/** ban_score: Accumulated score of all ctx bans and fast hangs. */
 	atomic_t ban_score;
 	unsigned long hang_timestamp;
+
+	/**
+	 * busy: Engine busy time of the client's contexts that have been
+	 * closed, folded in by context_close().
+	 */
+	atomic64_t busy[MAX_ENGINE_CLASS + 1];
+	/** busy_shown: Last totals reported, under struct_mutex. */
+	u64 busy_shown[MAX_ENGINE_CLASS + 1];
 };
 
 /* Interface history:
@@ -1072,6 +1080,20 @@ struct i915_perf_stream_ops {
 		    size_t count,
 		    size_t *offset);
 
+	/**
+	 * @mmap: Map the stream buffer read-only into the calling process in
+	 * response to `I915_PERF_IOCTL_OA_MMAP`, returning its address in
+	 * **addr**.
+	 */
+	int (*mmap)(struct i915_perf_stream *stream, u64 *addr);
+
+	/**
+	 * @ack: Release the data consumed through @mmap up to **head**, a
+	 * byte offset into the stream buffer, in response to
+	 * `I915_PERF_IOCTL_OA_ACK`.
+	 */
+	int (*ack)(struct i915_perf_stream *stream, u32 head);
+
 	/**
 	 * @destroy: Cleanup any stream specific resources.
 	 *
@@ -1216,6 +1238,13 @@ struct i915_perf_stream {
 		 * OA buffer data to userspace.
 		 */
 		u32 head;
+
+		/**
+		 * Page following the OA buffer in the same object, mapped
+		 * along with it when the stream is opened with
+		 * `DRM_I915_PERF_PROP_OA_MMAP`; %NULL for read() streams.
+		 */
+		struct drm_i915_perf_oa_mmap *mmap_ctrl;
 	} oa_buffer;
 };
 
@@ -1283,6 +1312,18 @@ struct i915_oa_ops {
 	 * generations.
 	 */
 	u32 (*oa_hw_tail_read)(struct i915_perf_stream *stream);
+
+	/**
+	 * @oa_hw_head_write: write the OA head pointer register
+	 */
+	void (*oa_hw_head_write)(struct i915_perf_stream *stream, u32 head);
+
+	/**
+	 * @oa_mmap_status: Check the OA unit status registers on behalf of an
+	 * mmapped stream, accounting lost reports in the shared page and
+	 * restarting the unit after a buffer overflow.
+	 */
+	void (*oa_mmap_status)(struct i915_perf_stream *stream);
 };
 
 struct intel_cdclk_state {
@@ -1563,6 +1604,13 @@ struct drm_i915_private {
 /* in Gen12 ID 0x7FF is reserved to indicate idle */
 #define GEN12_MAX_CONTEXT_HW_ID	(GEN11_MAX_CONTEXT_HW_ID - 1)
 		struct list_head hw_id_list;
+
+		/*
+		 * Engine busy time of clients that are gone and of contexts
+		 * freed after their file was closed, see i915_client_busy().
+		 */
+		atomic64_t closed_busy[MAX_ENGINE_CLASS + 1];
+		u64 closed_busy_shown[MAX_ENGINE_CLASS + 1];
 	} contexts;
 
 	u32 fdi_rx_config;
@@ -32,6 +32,7 @@
 #include <linux/pagevec.h>
 #include <linux/scatterlist.h>
 #include <linux/utsname.h>
+#include <linux/vmalloc.h>
 #include <linux/zlib.h>
 
 #include <drm/drm_print.h>
@@ -235,76 +236,152 @@ static void pool_free(struct pagevec *pv, void *addr)
 		__free_page(p);
 }
 
+static int snapshot_page(struct pagevec *pool,
+			 void *src,
+			 struct drm_i915_error_object *dst)
+{
+	void *ptr;
+
+	ptr = pool_alloc(pool, ALLOW_FAIL);
+	if (!ptr)
+		return -ENOMEM;
+
+	if (!i915_memcpy_from_wc(ptr, src, PAGE_SIZE))
+		memcpy(ptr, src, PAGE_SIZE);
+	dst->pages[dst->page_count++] = ptr;
+
+	return 0;
+}
+
 #ifdef CONFIG_DRM_I915_COMPRESS_ERROR
 
+/*
+ * While capturing, with the engines hung, we only snapshot the pages. Each
+ * object is then deflated by its own worker on system_unbound_wq once the
+ * capture is complete, so large contexts and batches are compressed in
+ * parallel and off the reset path. Readers wait for the workers to finish.
+ */
 struct compress {
+	struct pagevec pool;
+	struct drm_i915_error_object *deferred;
+	int level;
+};
+
+struct deflate {
 	struct pagevec pool;
 	struct z_stream_s zstream;
-	void *tmp;
 };
 
+static void compress_work(struct work_struct *work);
+
 static bool compress_init(struct compress *c)
 {
-	struct z_stream_s *zstream = &c->zstream;
-
 	if (pool_init(&c->pool, ALLOW_FAIL))
 		return false;
 
-	zstream->workspace =
-		kmalloc(zlib_deflate_workspacesize(MAX_WBITS, MAX_MEM_LEVEL),
-			ALLOW_FAIL);
-	if (!zstream->workspace) {
-		pool_fini(&c->pool);
-		return false;
-	}
-
-	c->tmp = NULL;
-	if (i915_has_memcpy_from_wc())
-		c->tmp = pool_alloc(&c->pool, ALLOW_FAIL);
+	c->deferred = NULL;
+	c->level = READ_ONCE(i915_modparams.error_compression);
 
 	return true;
 }
 
 static bool compress_start(struct compress *c)
 {
-	struct z_stream_s *zstream = &c->zstream;
-	void *workspace = zstream->workspace;
+	return true;
+}
 
-	memset(zstream, 0, sizeof(*zstream));
-	zstream->workspace = workspace;
+static int compress_page(struct compress *c,
+			 void *src,
+			 struct drm_i915_error_object *dst)
+{
+	return snapshot_page(&c->pool, src, dst);
+}
 
-	return zlib_deflateInit(zstream, Z_DEFAULT_COMPRESSION) == Z_OK;
+static int compress_flush(struct compress *c,
+			  struct drm_i915_error_object *dst)
+{
+	dst->compressed = false;
+	if (c->level <= 0 || !dst->page_count)
+		return 0;
+
+	dst->level = c->level == 1 ? Z_BEST_SPEED : Z_DEFAULT_COMPRESSION;
+	INIT_WORK(&dst->work, compress_work);
+	dst->next = c->deferred;
+	c->deferred = dst;
+
+	return 0;
+}
+
+static void compress_finish(struct compress *c)
+{
+}
+
+static void compress_fini(struct compress *c)
+{
+	pool_fini(&c->pool);
+}
+
+static void compress_submit(struct compress *c, struct i915_gpu_state *error)
+{
+	struct drm_i915_error_object *obj;
+
+	error->deferred = c->deferred;
+	for (obj = c->deferred; obj; obj = obj->next)
+		queue_work(system_unbound_wq, &obj->work);
 }
 
-static void *compress_next_page(struct compress *c,
-				struct drm_i915_error_object *dst)
+static void compress_wait(struct i915_gpu_state *error)
+{
+	struct drm_i915_error_object *obj;
+
+	for (obj = error->deferred; obj; obj = obj->next)
+		flush_work(&obj->work);
+}
+
+#define COMPRESS_LEVELS 3 /* i915.error_compression=0..2 */
+
+static void compress_set_level(struct compress *c, int level)
+{
+	c->level = level;
+}
+
+static void compress_run(struct compress *c)
+{
+	struct drm_i915_error_object *obj;
+
+	for (obj = c->deferred; obj; obj = obj->next)
+		queue_work(system_unbound_wq, &obj->work);
+	for (obj = c->deferred; obj; obj = obj->next)
+		flush_work(&obj->work);
+}
+
+static void *deflate_next_page(struct deflate *d,
+			       struct drm_i915_error_object *dst)
 {
 	void *page;
 
 	if (dst->page_count >= dst->num_pages)
 		return ERR_PTR(-ENOSPC);
 
-	page = pool_alloc(&c->pool, ALLOW_FAIL);
+	page = pool_alloc(&d->pool, ALLOW_FAIL);
 	if (!page)
 		return ERR_PTR(-ENOMEM);
 
 	return dst->pages[dst->page_count++] = page;
 }
 
-static int compress_page(struct compress *c,
-			 void *src,
-			 struct drm_i915_error_object *dst)
+static int deflate_page(struct deflate *d,
+			void *src,
+			struct drm_i915_error_object *dst)
 {
-	struct z_stream_s *zstream = &c->zstream;
+	struct z_stream_s *zstream = &d->zstream;
 
 	zstream->next_in = src;
-	if (c->tmp && i915_memcpy_from_wc(c->tmp, src, PAGE_SIZE))
-		zstream->next_in = c->tmp;
 	zstream->avail_in = PAGE_SIZE;
 
 	do {
 		if (zstream->avail_out == 0) {
-			zstream->next_out = compress_next_page(c, dst);
+			zstream->next_out = deflate_next_page(d, dst);
 			if (IS_ERR(zstream->next_out))
 				return PTR_ERR(zstream->next_out);
 
@@ -322,15 +399,15 @@ static int compress_page(struct compress *c,
 	return 0;
 }
 
-static int compress_flush(struct compress *c,
-			  struct drm_i915_error_object *dst)
+static int deflate_flush(struct deflate *d,
+			 struct drm_i915_error_object *dst)
 {
-	struct z_stream_s *zstream = &c->zstream;
+	struct z_stream_s *zstream = &d->zstream;
 
 	do {
 		switch (zlib_deflate(zstream, Z_FINISH)) {
 		case Z_OK: /* more space requested */
-			zstream->next_out = compress_next_page(c, dst);
+			zstream->next_out = deflate_next_page(d, dst);
 			if (IS_ERR(zstream->next_out))
 				return PTR_ERR(zstream->next_out);
 
@@ -351,22 +428,64 @@ end:
 	return 0;
 }
 
-static void compress_finish(struct compress *c)
+static void compress_work(struct work_struct *work)
 {
-	zlib_deflateEnd(&c->zstream);
-}
+	struct drm_i915_error_object *obj =
+		container_of(work, typeof(*obj), work);
+	const int count = obj->page_count;
+	struct deflate d;
+	u32 **raw;
+	int i, ret;
 
-static void compress_fini(struct compress *c)
-{
-	kfree(c->zstream.workspace);
-	if (c->tmp)
-		pool_free(&c->pool, c->tmp);
-	pool_fini(&c->pool);
+	raw = kmemdup(obj->pages, count * sizeof(*raw), ALLOW_FAIL);
+	if (!raw)
+		return;
+
+	if (pool_init(&d.pool, ALLOW_FAIL))
+		goto out_raw;
+
+	memset(&d.zstream, 0, sizeof(d.zstream));
+	d.zstream.workspace =
+		kvmalloc(zlib_deflate_workspacesize(MAX_WBITS, MAX_MEM_LEVEL),
+			 ALLOW_FAIL);
+	if (!d.zstream.workspace)
+		goto out_pool;
+
+	if (zlib_deflateInit(&d.zstream, obj->level) != Z_OK)
+		goto out_workspace;
+
+	obj->page_count = 0;
+	for (ret = 0, i = 0; !ret && i < count; i++)
+		ret = deflate_page(&d, raw[i], obj);
+	if (!ret)
+		ret = deflate_flush(&d, obj);
+	zlib_deflateEnd(&d.zstream);
+
+	if (ret) {
+		/* Keep the uncompressed snapshot */
+		while (obj->page_count--)
+			pool_free(&d.pool, obj->pages[obj->page_count]);
+		memcpy(obj->pages, raw, count * sizeof(*raw));
+		obj->page_count = count;
+		obj->unused = 0;
+	} else {
+		for (i = 0; i < count; i++)
+			free_page((unsigned long)raw[i]);
+		obj->compressed = true;
+	}
+
+out_workspace:
+	kvfree(d.zstream.workspace);
+out_pool:
+	pool_fini(&d.pool);
+out_raw:
+	kfree(raw);
 }
 
-static void err_compression_marker(struct drm_i915_error_state_buf *m)
+static void err_compression_marker(struct drm_i915_error_state_buf *m,
+				   const struct drm_i915_error_object *obj)
 {
-	err_puts(m, ":");
+	err_puts(m, obj->compressed ? ":" : "~");
 }
 
 #else
@@ -389,17 +508,7 @@ static int compress_page(struct compress *c,
 			 void *src,
 			 struct drm_i915_error_object *dst)
 {
-	void *ptr;
-
-	ptr = pool_alloc(&c->pool, ALLOW_FAIL);
-	if (!ptr)
-		return -ENOMEM;
-
-	if (!i915_memcpy_from_wc(ptr, src, PAGE_SIZE))
-		memcpy(ptr, src, PAGE_SIZE);
-	dst->pages[dst->page_count++] = ptr;
-
-	return 0;
+	return snapshot_page(&c->pool, src, dst);
 }
 
 static int compress_flush(struct compress *c,
@@ -417,7 +526,26 @@ static void compress_fini(struct compress *c)
 	pool_fini(&c->pool);
 }
 
-static void err_compression_marker(struct drm_i915_error_state_buf *m)
+static void compress_submit(struct compress *c, struct i915_gpu_state *error)
+{
+}
+
+static void compress_wait(struct i915_gpu_state *error)
+{
+}
+
+#define COMPRESS_LEVELS 1
+
+static void compress_set_level(struct compress *c, int level)
+{
+}
+
+static void compress_run(struct compress *c)
+{
+}
+
+static void err_compression_marker(struct drm_i915_error_state_buf *m,
+				   const struct drm_i915_error_object *obj)
 {
 	err_puts(m, "~");
 }
@@ -580,7 +708,7 @@ static void print_error_obj(struct drm_i915_error_state_buf *m,
 			   lower_32_bits(obj->gtt_offset));
 	}
 
-	err_compression_marker(m);
+	err_compression_marker(m, obj);
 	for (page = 0; page < obj->page_count; page++) {
 		int i, len;
 
@@ -806,6 +934,8 @@ static int err_print_to_sgl(struct i915_gpu_state *error)
 	if (READ_ONCE(error->sgl))
 		return 0;
 
+	compress_wait(error);
+
 	memset(&m, 0, sizeof(m));
 	m.i915 = error->i915;
 
@@ -931,6 +1061,8 @@ void __i915_gpu_state_free(struct kref *error_ref)
 		container_of(error_ref, typeof(*error), ref);
 	long i;
 
+	compress_wait(error);
+
 	while (error->engine) {
 		struct drm_i915_error_engine *ee = error->engine;
 
@@ -1020,6 +1152,94 @@ i915_error_object_create(struct drm_i915_private *i915,
 	return dst;
 }
 
+/*
+ * Capture a synthetic object of @num_pages from @src the way
+ * i915_error_object_create() does, then compress it with @level, and report
+ * how long the capture took (the part done with the engines hung) and how
+ * long the compression took afterwards.
+ */
+static int bench_error_object(struct drm_printer *p, void *src,
+			      int num_pages, int level)
+{
+	static const char * const names[] = { "none", "fast", "default" };
+	struct drm_i915_error_object *dst;
+	struct compress compress;
+	ktime_t start, captured, done;
+	int i, ret;
+
+	dst = kmalloc(sizeof(*dst) + DIV_ROUND_UP(10 * num_pages, 8) *
+		      sizeof(u32 *), GFP_KERNEL);
+	if (!dst)
+		return -ENOMEM;
+
+	if (!compress_init(&compress)) {
+		kfree(dst);
+		return -ENOMEM;
+	}
+	compress_set_level(&compress, level);
+
+	dst->gtt_offset = 0;
+	dst->gtt_size = (u64)num_pages << PAGE_SHIFT;
+	dst->num_pages = DIV_ROUND_UP(10 * num_pages, 8);
+	dst->page_count = 0;
+	dst->unused = 0;
+
+	start = ktime_get();
+	ret = compress_start(&compress) ? 0 : -ENOMEM;
+	for (i = 0; !ret && i < num_pages; i++)
+		ret = compress_page(&compress, src + i * PAGE_SIZE, dst);
+	if (!ret)
+		ret = compress_flush(&compress, dst);
+	compress_finish(&compress);
+	captured = ktime_get();
+
+	if (!ret)
+		compress_run(&compress);
+	done = ktime_get();
+
+	if (!ret)
+		drm_printf(p, "%-8s %5d pages: capture %7lld us, compress %7lld us, %5d pages stored\n",
+			   names[level], num_pages,
+			   ktime_us_delta(captured, start),
+			   ktime_us_delta(done, captured),
+			   dst->page_count);
+
+	compress_fini(&compress);
+	i915_error_object_free(dst);
+	return ret;
+}
+
+/**
+ * i915_gpu_error_benchmark - time error capture and compression
+ * @p: printer for the results
+ *
+ * Runs the error capture path over synthetic objects of increasing size for
+ * every supported i915.error_compression level.
+ */
+int i915_gpu_error_benchmark(struct drm_printer *p)
+{
+	static const int sizes[] = { 1, 16, 256, 1024 };
+	const int max_pages = sizes[ARRAY_SIZE(sizes) - 1];
+	int level, i, ret = 0;
+	u32 *src;
+
+	src = vmalloc(max_pages * PAGE_SIZE);
+	if (!src)
+		return -ENOMEM;
+
+	/* Mostly MI_NOOP padding with some noise, like a batch buffer */
+	for (i = 0; i < max_pages * PAGE_SIZE / sizeof(u32); i++)
+		src[i] = i % 8 ? 0 : i * 2654435761u;
+
+	for (level = 0; !ret && level < COMPRESS_LEVELS; level++) {
+		for (i = 0; !ret && i < ARRAY_SIZE(sizes); i++)
+			ret = bench_error_object(p, src, sizes[i], level);
+	}
+
+	vfree(src);
+	return ret;
+}
+
 /*
  * Generate a semi-unique error code. The code is not meant to have meaning, The
  * code's only purpose is to try to prevent false duplicated bug reports by
@@ -1723,6 +1943,7 @@ i915_capture_gpu_state(struct drm_i915_private *i915)
 	error->epoch = capture_find_epoch(error);
 
 	capture_finish(error);
+	compress_submit(&compress, error);
 	compress_fini(&compress);
 
 	return error;
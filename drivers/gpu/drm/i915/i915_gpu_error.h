@@ -11,6 +11,7 @@
 #include <linux/kref.h>
 #include <linux/ktime.h>
 #include <linux/sched.h>
+#include <linux/workqueue.h>
 
 #include <drm/drm_mm.h>
 
@@ -25,6 +26,7 @@
 #include "i915_scheduler.h"
 
 struct drm_i915_private;
+struct drm_printer;
 struct intel_overlay_error_state;
 struct intel_display_error_state;
 
@@ -130,6 +132,12 @@ struct i915_gpu_state {
 			int num_pages;
 			int page_count;
 			int unused;
+#ifdef CONFIG_DRM_I915_COMPRESS_ERROR
+			struct work_struct work;
+			struct drm_i915_error_object *next;
+			int level;
+			bool compressed;
+#endif
 			u32 *pages[0];
 		} *ringbuffer, *batchbuffer, *wa_batchbuffer, *ctx, *hws_page;
 
@@ -164,6 +172,11 @@ struct i915_gpu_state {
 	} *engine;
 
 	struct scatterlist *sgl, *fit;
+
+#ifdef CONFIG_DRM_I915_COMPRESS_ERROR
+	/* objects still being compressed by compress_work() */
+	struct drm_i915_error_object *deferred;
+#endif
 };
 
 struct i915_gpu_error {
@@ -224,6 +237,8 @@ struct i915_gpu_state *i915_first_error_state(struct drm_i915_private *i915);
 void i915_reset_error_state(struct drm_i915_private *i915);
 void i915_disable_error_state(struct drm_i915_private *i915, int err);
 
+int i915_gpu_error_benchmark(struct drm_printer *p);
+
 #else
 
 static inline void i915_capture_error_state(struct drm_i915_private *dev_priv,
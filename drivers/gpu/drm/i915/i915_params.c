@@ -89,6 +89,12 @@ i915_param_named(error_capture, bool, 0600,
 	"triaging and debugging hangs.");
 #endif
 
+#if IS_ENABLED(CONFIG_DRM_I915_COMPRESS_ERROR)
+i915_param_named(error_compression, int, 0600,
+	"Compression of the objects in the GPU error state "
+	"(0=none, 1=fast zlib, 2=default zlib [default])");
+#endif
+
 i915_param_named_unsafe(enable_hangcheck, bool, 0600,
 	"Periodically check GPU activity for detecting hangs. "
 	"WARNING: Disabling this can cause system wide hangs. "
@@ -192,6 +192,7 @@
  */
 
 #include <linux/anon_inodes.h>
+#include <linux/mman.h>
 #include <linux/sizes.h>
 #include <linux/uuid.h>
 
@@ -216,6 +217,11 @@
 #include "oa/i915_oa_cnl.h"
 #include "oa/i915_oa_icl.h"
 
+#ifdef __FreeBSD__
+#include <sys/resourcevar.h>	/* for lim_cur_proc */
+#define	resource linux_resource
+#endif
+
 /* HW requires this to be a power of two, between 128k and 16M, though driver
  * is currently generally designed assuming the largest 16M size is used such
  * that the overflow cases are unlikely in normal operation.
@@ -363,6 +369,7 @@ struct perf_open_properties {
 	int oa_format;
 	bool oa_periodic;
 	int oa_period_exponent;
+	bool oa_mmap;
 };
 
 static enum hrtimer_restart oa_poll_check_timer_cb(struct hrtimer *hrtimer);
@@ -430,6 +437,34 @@ static u32 gen7_oa_hw_tail_read(struct i915_perf_stream *stream)
 	return oastatus1 & GEN7_OASTATUS1_TAIL_MASK;
 }
 
+static void gen8_oa_hw_head_write(struct i915_perf_stream *stream, u32 head)
+{
+	struct drm_i915_private *dev_priv = stream->dev_priv;
+
+	I915_WRITE(GEN8_OAHEADPTR, head & GEN8_OAHEADPTR_MASK);
+}
+
+static void gen7_oa_hw_head_write(struct i915_perf_stream *stream, u32 head)
+{
+	struct drm_i915_private *dev_priv = stream->dev_priv;
+
+	I915_WRITE(GEN7_OASTATUS2,
+		   ((head & GEN7_OASTATUS2_HEAD_MASK) |
+		    GEN7_OASTATUS2_MEM_SELECT_GGTT));
+}
+
+/* Called with oa_buffer.ptr_lock held, whenever the OA buffer is reset */
+static void oa_mmap_reset(struct i915_perf_stream *stream)
+{
+	struct drm_i915_perf_oa_mmap *ctrl = stream->oa_buffer.mmap_ctrl;
+
+	if (!ctrl)
+		return;
+
+	WRITE_ONCE(ctrl->head, 0);
+	WRITE_ONCE(ctrl->tail, 0);
+}
+
 /**
  * oa_buffer_check_unlocked - check for data and update tail ptr state
  * @stream: i915 stream instance
@@ -541,6 +576,14 @@ static bool oa_buffer_check_unlocked(struct i915_perf_stream *stream)
 		}
 	}
 
+	/* Reports up to the aged tail are visible to mmapped readers too */
+	if (stream->oa_buffer.mmap_ctrl && aged_tail != INVALID_TAIL_PTR) {
+		u32 gtt_offset = i915_ggtt_offset(stream->oa_buffer.vma);
+
+		smp_store_release(&stream->oa_buffer.mmap_ctrl->tail,
+				  aged_tail - gtt_offset);
+	}
+
 	spin_unlock_irqrestore(&stream->oa_buffer.ptr_lock, flags);
 
 	return aged_tail == INVALID_TAIL_PTR ?
@@ -918,6 +961,41 @@ static int gen8_oa_read(struct i915_perf_stream *stream,
 	return gen8_append_oa_reports(stream, buf, count, offset);
 }
 
+/**
+ * gen8_oa_mmap_status - account OA status for an mmapped stream
+ * @stream: An i915-perf stream opened with `DRM_I915_PERF_PROP_OA_MMAP`
+ *
+ * The counterpart of the status records gen8_oa_read() appends, reported
+ * through the shared page instead.
+ */
+static void gen8_oa_mmap_status(struct i915_perf_stream *stream)
+{
+	struct drm_i915_private *dev_priv = stream->dev_priv;
+	struct drm_i915_perf_oa_mmap *ctrl = stream->oa_buffer.mmap_ctrl;
+	u32 oastatus;
+
+	oastatus = I915_READ(GEN8_OASTATUS);
+
+	/* See gen8_oa_read() for why an overflow forces a restart */
+	if (oastatus & GEN8_OASTATUS_OABUFFER_OVERFLOW) {
+		WRITE_ONCE(ctrl->buffer_lost, ctrl->buffer_lost + 1);
+
+		DRM_DEBUG("OA buffer overflow (exponent = %d): force restart\n",
+			  stream->period_exponent);
+
+		dev_priv->perf.ops.oa_disable(stream);
+		dev_priv->perf.ops.oa_enable(stream);
+
+		oastatus = I915_READ(GEN8_OASTATUS);
+	}
+
+	if (oastatus & GEN8_OASTATUS_REPORT_LOST) {
+		WRITE_ONCE(ctrl->report_lost, ctrl->report_lost + 1);
+		I915_WRITE(GEN8_OASTATUS,
+			   oastatus & ~GEN8_OASTATUS_REPORT_LOST);
+	}
+}
+
 /**
  * Copies all buffered OA reports into userspace read() buffer.
  * @stream: An i915-perf stream opened for OA metrics
@@ -1138,6 +1216,42 @@ static int gen7_oa_read(struct i915_perf_stream *stream,
 	return gen7_append_oa_reports(stream, buf, count, offset);
 }
 
+/**
+ * gen7_oa_mmap_status - account OA status for an mmapped stream
+ * @stream: An i915-perf stream opened with `DRM_I915_PERF_PROP_OA_MMAP`
+ *
+ * The counterpart of the status records gen7_oa_read() appends, reported
+ * through the shared page instead.
+ */
+static void gen7_oa_mmap_status(struct i915_perf_stream *stream)
+{
+	struct drm_i915_private *dev_priv = stream->dev_priv;
+	struct drm_i915_perf_oa_mmap *ctrl = stream->oa_buffer.mmap_ctrl;
+	u32 oastatus1;
+
+	oastatus1 = I915_READ(GEN7_OASTATUS1);
+	oastatus1 &= ~dev_priv->perf.gen7_latched_oastatus1;
+
+	/* See gen7_oa_read() for why an overflow forces a restart */
+	if (unlikely(oastatus1 & GEN7_OASTATUS1_OABUFFER_OVERFLOW)) {
+		WRITE_ONCE(ctrl->buffer_lost, ctrl->buffer_lost + 1);
+
+		DRM_DEBUG("OA buffer overflow (exponent = %d): force restart\n",
+			  stream->period_exponent);
+
+		dev_priv->perf.ops.oa_disable(stream);
+		dev_priv->perf.ops.oa_enable(stream);
+
+		oastatus1 = I915_READ(GEN7_OASTATUS1);
+	}
+
+	if (unlikely(oastatus1 & GEN7_OASTATUS1_REPORT_LOST)) {
+		WRITE_ONCE(ctrl->report_lost, ctrl->report_lost + 1);
+		dev_priv->perf.gen7_latched_oastatus1 |=
+			GEN7_OASTATUS1_REPORT_LOST;
+	}
+}
+
 /**
  * i915_oa_wait_unlocked - handles blocking IO until OA data available
  * @stream: An i915-perf stream opened for OA metrics
@@ -1198,6 +1312,10 @@ static int i915_oa_read(struct i915_perf_stream *stream,
 {
 	struct drm_i915_private *dev_priv = stream->dev_priv;
 
+	/* Reports of mmapped streams are only consumed in place */
+	if (stream->oa_buffer.mmap_ctrl)
+		return -EINVAL;
+
 	return dev_priv->perf.ops.read(stream, buf, count, offset);
 }
 
@@ -1357,6 +1475,7 @@ free_oa_buffer(struct i915_perf_stream *stream)
 	mutex_unlock(&i915->drm.struct_mutex);
 
 	stream->oa_buffer.vaddr = NULL;
+	stream->oa_buffer.mmap_ctrl = NULL;
 }
 
 static void i915_oa_stream_destroy(struct i915_perf_stream *stream)
@@ -1413,6 +1532,8 @@ static void gen7_init_oa_buffer(struct i915_perf_stream *stream)
 	stream->oa_buffer.tails[0].offset = INVALID_TAIL_PTR;
 	stream->oa_buffer.tails[1].offset = INVALID_TAIL_PTR;
 
+	oa_mmap_reset(stream);
+
 	spin_unlock_irqrestore(&stream->oa_buffer.ptr_lock, flags);
 
 	/* On Haswell we have to track which OASTATUS1 flags we've
@@ -1477,6 +1598,8 @@ static void gen8_init_oa_buffer(struct i915_perf_stream *stream)
 	 */
 	stream->oa_buffer.last_ctx_id = INVALID_CTX_ID;
 
+	oa_mmap_reset(stream);
+
 	spin_unlock_irqrestore(&stream->oa_buffer.ptr_lock, flags);
 
 	/*
@@ -1500,7 +1623,7 @@ static void gen8_init_oa_buffer(struct i915_perf_stream *stream)
 	stream->pollin = false;
 }
 
-static int alloc_oa_buffer(struct i915_perf_stream *stream)
+static int alloc_oa_buffer(struct i915_perf_stream *stream, bool mmap)
 {
 	struct drm_i915_gem_object *bo;
 	struct drm_i915_private *dev_priv = stream->dev_priv;
@@ -1517,7 +1640,9 @@ static int alloc_oa_buffer(struct i915_perf_stream *stream)
 	BUILD_BUG_ON_NOT_POWER_OF_2(OA_BUFFER_SIZE);
 	BUILD_BUG_ON(OA_BUFFER_SIZE < SZ_128K || OA_BUFFER_SIZE > SZ_16M);
 
-	bo = i915_gem_object_create_shmem(dev_priv, OA_BUFFER_SIZE);
+	/* Mmapped streams share their head/tail with userspace in an extra page */
+	bo = i915_gem_object_create_shmem(dev_priv, OA_BUFFER_SIZE +
+					  (mmap ? PAGE_SIZE : 0));
 	if (IS_ERR(bo)) {
 		DRM_ERROR("Failed to allocate OA buffer\n");
 		ret = PTR_ERR(bo);
@@ -1541,6 +1666,15 @@ static int alloc_oa_buffer(struct i915_perf_stream *stream)
 		goto err_unpin;
 	}
 
+	if (mmap) {
+		struct drm_i915_perf_oa_mmap *ctrl =
+			(void *)(stream->oa_buffer.vaddr + OA_BUFFER_SIZE);
+
+		ctrl->size = OA_BUFFER_SIZE;
+		ctrl->report_size = stream->oa_buffer.format_size;
+		stream->oa_buffer.mmap_ctrl = ctrl;
+	}
+
 	DRM_DEBUG_DRIVER("OA Buffer initialized, gtt offset = 0x%x, vaddr = %p\n",
 			 i915_ggtt_offset(stream->oa_buffer.vma),
 			 stream->oa_buffer.vaddr);
@@ -2135,6 +2269,141 @@ static void i915_oa_stream_disable(struct i915_perf_stream *stream)
 		hrtimer_cancel(&stream->poll_check_timer);
 }
 
+/**
+ * i915_oa_mmap - map the OA buffer and its shared page into the caller
+ * @stream: An i915-perf stream opened with `DRM_I915_PERF_PROP_OA_MMAP`
+ * @addr: (out) the user address of the mapping
+ *
+ * The backing store of the OA buffer is mapped read-only, so the mapping
+ * holds its own reference on it and outlives the stream if need be.
+ *
+ * Returns: zero on success or a negative error code
+ */
+static int i915_oa_mmap(struct i915_perf_stream *stream, u64 *addr)
+{
+	struct drm_i915_gem_object *obj = stream->oa_buffer.vma->obj;
+#ifdef __FreeBSD__
+	struct proc *p = curproc;
+	vm_offset_t uaddr = 0;
+	vm_object_t vmobj;
+	vm_map_t map;
+	int rv;
+#else
+	struct mm_struct *mm = current->mm;
+	struct vm_area_struct *vma;
+	unsigned long uaddr;
+#endif
+
+	if (!stream->oa_buffer.mmap_ctrl)
+		return -EINVAL;
+
+#ifdef __linux__
+	uaddr = vm_mmap(obj->base.filp, 0, obj->base.size,
+			PROT_READ, MAP_SHARED, 0);
+	if (IS_ERR_VALUE(uaddr))
+		return uaddr;
+
+	/* Don't let mprotect() make the kernel's buffer writable */
+	down_write(&mm->mmap_sem);
+	vma = find_vma(mm, uaddr);
+	if (vma && vma->vm_file == obj->base.filp && vma->vm_start == uaddr)
+		vma->vm_flags &= ~VM_MAYWRITE;
+	else
+		uaddr = -ENOMEM;
+	up_write(&mm->mmap_sem);
+	if (IS_ERR_VALUE(uaddr))
+		return uaddr;
+#elif defined(__FreeBSD__)
+	map = &p->p_vmspace->vm_map;
+	PROC_LOCK(p);
+	if (map->size + obj->base.size > lim_cur_proc(p, RLIMIT_VMEM)) {
+		PROC_UNLOCK(p);
+		return -ENOMEM;
+	}
+	PROC_UNLOCK(p);
+
+	vmobj = obj->base.filp->f_shmem;
+	vm_object_reference(vmobj);
+	rv = vm_map_find(map, vmobj, 0, &uaddr, obj->base.size, 0,
+	    VMFS_OPTIMAL_SPACE, VM_PROT_READ, VM_PROT_READ,
+	    MAP_INHERIT_SHARE);
+	if (rv != KERN_SUCCESS) {
+		vm_object_deallocate(vmobj);
+		return -vm_mmap_to_errno(rv);
+	}
+#endif
+
+	*addr = uaddr;
+	return 0;
+}
+
+/**
+ * i915_oa_ack - release mmapped OA reports up to a new head
+ * @stream: An i915-perf stream opened with `DRM_I915_PERF_PROP_OA_MMAP`
+ * @head: byte offset into the OA buffer of the first unconsumed report
+ *
+ * Moves the OA head pointer on behalf of userspace, which can't write the
+ * shared page, and then handles any pending OA status the way read() does.
+ * The released reports get their report ID zeroed like read() does, so
+ * that after the buffer wraps stale reports can still be told apart.
+ *
+ * Returns: zero on success or a negative error code
+ */
+static int i915_oa_ack(struct i915_perf_stream *stream, u32 head)
+{
+	struct drm_i915_private *dev_priv = stream->dev_priv;
+	struct drm_i915_perf_oa_mmap *ctrl = stream->oa_buffer.mmap_ctrl;
+	u32 gtt_offset = i915_ggtt_offset(stream->oa_buffer.vma);
+	int report_size = stream->oa_buffer.format_size;
+	u8 *oa_buf_base = stream->oa_buffer.vaddr;
+	unsigned long flags;
+	u32 old, tail, off;
+	int ret = 0;
+
+	if (!ctrl)
+		return -EINVAL;
+
+	if (!stream->enabled)
+		return -EIO;
+
+	if (head >= OA_BUFFER_SIZE || head % stream->oa_buffer.format_size)
+		return -EINVAL;
+
+	spin_lock_irqsave(&stream->oa_buffer.ptr_lock, flags);
+
+	old = stream->oa_buffer.head - gtt_offset;
+	tail = stream->oa_buffer.tails[stream->oa_buffer.aged_tail_idx].offset;
+
+	/* The new head may not move past the tail published to userspace */
+	if (head != old) {
+		if (tail == INVALID_TAIL_PTR ||
+		    OA_TAKEN(head, old) > OA_TAKEN(tail - gtt_offset, old)) {
+			ret = -EINVAL;
+		} else {
+			for (off = old; off != head;
+			     off = (off + report_size) & (OA_BUFFER_SIZE - 1))
+				*(u32 *)(oa_buf_base + off) = 0;
+
+			dev_priv->perf.ops.oa_hw_head_write(stream,
+							   head + gtt_offset);
+			stream->oa_buffer.head = head + gtt_offset;
+			WRITE_ONCE(ctrl->head, head);
+		}
+	}
+
+	spin_unlock_irqrestore(&stream->oa_buffer.ptr_lock, flags);
+
+	if (ret)
+		return ret;
+
+	dev_priv->perf.ops.oa_mmap_status(stream);
+
+	/* As with read(), back off until the next hrtimer callback */
+	stream->pollin = false;
+
+	return 0;
+}
+
 static const struct i915_perf_stream_ops i915_oa_stream_ops = {
 	.destroy = i915_oa_stream_destroy,
 	.enable = i915_oa_stream_enable,
@@ -2142,6 +2411,8 @@ static const struct i915_perf_stream_ops i915_oa_stream_ops = {
 	.wait_unlocked = i915_oa_wait_unlocked,
 	.poll_wait = i915_oa_poll_wait,
 	.read = i915_oa_read,
+	.mmap = i915_oa_mmap,
+	.ack = i915_oa_ack,
 };
 
 /**
@@ -2221,6 +2492,16 @@ static int i915_oa_stream_init(struct i915_perf_stream *stream,
 	if (stream->periodic)
 		stream->period_exponent = props->oa_period_exponent;
 
+	/*
+	 * Reports of other contexts are only filtered out by read(), so
+	 * mapping the OA buffer is reserved to system-wide streams, which
+	 * already require privileges.
+	 */
+	if (props->oa_mmap && stream->ctx) {
+		DRM_DEBUG("OA buffer mmap requires a system-wide stream\n");
+		return -EINVAL;
+	}
+
 	if (stream->ctx) {
 		ret = oa_get_render_ctx_id(stream);
 		if (ret) {
@@ -2250,7 +2531,7 @@ static int i915_oa_stream_init(struct i915_perf_stream *stream,
 	stream->wakeref = intel_runtime_pm_get(&dev_priv->runtime_pm);
 	intel_uncore_forcewake_get(&dev_priv->uncore, FORCEWAKE_ALL);
 
-	ret = alloc_oa_buffer(stream);
+	ret = alloc_oa_buffer(stream, props->oa_mmap);
 	if (ret)
 		goto err_oa_buf_alloc;
 
@@ -2580,11 +2861,42 @@ static long i915_perf_ioctl_locked(struct i915_perf_stream *stream,
 	case I915_PERF_IOCTL_DISABLE:
 		i915_perf_disable_locked(stream);
 		return 0;
+	case I915_PERF_IOCTL_OA_ACK:
+		if (!stream->ops->ack)
+			return -EINVAL;
+		return stream->ops->ack(stream, arg);
 	}
 
 	return -EINVAL;
 }
 
+/**
+ * i915_perf_mmap_unlocked - handle `I915_PERF_IOCTL_OA_MMAP` ioctl
+ * @stream: An i915 perf stream
+ * @arg: userspace pointer receiving the address of the mapping
+ *
+ * Mapping into the process takes mmap_sem, so unlike the other stream
+ * ioctls this is called without the &drm_i915_private->perf.lock mutex; the
+ * stream buffer can't go away while its file is in use.
+ *
+ * Returns: zero on success or a negative error code.
+ */
+static long i915_perf_mmap_unlocked(struct i915_perf_stream *stream,
+				    unsigned long arg)
+{
+	u64 addr;
+	int ret;
+
+	if (!stream->ops->mmap)
+		return -EINVAL;
+
+	ret = stream->ops->mmap(stream, &addr);
+	if (ret)
+		return ret;
+
+	return put_user(addr, (u64 __user *)arg);
+}
+
 /**
  * i915_perf_ioctl - support ioctl() usage with i915 perf stream FDs
  * @file: An i915 perf stream file
@@ -2604,6 +2916,20 @@ static long i915_perf_ioctl(struct file *file,
 	struct drm_i915_private *dev_priv = stream->dev_priv;
 	long ret;
 
+	/* Touch userspace memory before taking the perf lock */
+	switch (cmd) {
+	case I915_PERF_IOCTL_OA_MMAP:
+		return i915_perf_mmap_unlocked(stream, arg);
+	case I915_PERF_IOCTL_OA_ACK: {
+		u32 head;
+
+		if (get_user(head, (u32 __user *)arg))
+			return -EFAULT;
+		arg = head;
+		break;
+	}
+	}
+
 	mutex_lock(&dev_priv->perf.lock);
 	ret = i915_perf_ioctl_locked(stream, cmd, arg);
 	mutex_unlock(&dev_priv->perf.lock);
@@ -2671,8 +2997,8 @@ static const struct file_operations fops = {
 	.poll		= i915_perf_poll,
 	.read		= i915_perf_read,
 	.unlocked_ioctl	= i915_perf_ioctl,
-	/* Our ioctl have no arguments, so it's safe to use the same function
-	 * to handle 32bits compatibility.
+	/* Our ioctl arguments have the same layout for 32bits userspace, so
+	 * it's safe to use the same function to handle 32bits compatibility.
 	 */
 	.compat_ioctl   = i915_perf_ioctl,
 };
@@ -2949,6 +3275,9 @@ static int read_properties_unlocked(struct drm_i915_private *dev_priv,
 			props->oa_periodic = true;
 			props->oa_period_exponent = value;
 			break;
+		case DRM_I915_PERF_PROP_OA_MMAP:
+			props->oa_mmap = value != 0;
+			break;
 		case DRM_I915_PERF_PROP_MAX:
 			MISSING_CASE(id);
 			return -EINVAL;
@@ -3573,6 +3902,9 @@ void i915_perf_init(struct drm_i915_private *dev_priv)
 		dev_priv->perf.ops.read = gen7_oa_read;
 		dev_priv->perf.ops.oa_hw_tail_read =
 			gen7_oa_hw_tail_read;
+		dev_priv->perf.ops.oa_hw_head_write =
+			gen7_oa_hw_head_write;
+		dev_priv->perf.ops.oa_mmap_status = gen7_oa_mmap_status;
 
 		dev_priv->perf.oa_formats = hsw_oa_formats;
 	} else if (HAS_LOGICAL_RING_CONTEXTS(dev_priv)) {
@@ -3588,6 +3920,8 @@ void i915_perf_init(struct drm_i915_private *dev_priv)
 		dev_priv->perf.ops.oa_disable = gen8_oa_disable;
 		dev_priv->perf.ops.read = gen8_oa_read;
 		dev_priv->perf.ops.oa_hw_tail_read = gen8_oa_hw_tail_read;
+		dev_priv->perf.ops.oa_hw_head_write = gen8_oa_hw_head_write;
+		dev_priv->perf.ops.oa_mmap_status = gen8_oa_mmap_status;
 
 		if (IS_GEN_RANGE(dev_priv, 8, 9)) {
 			dev_priv->perf.ops.is_valid_b_counter_reg =
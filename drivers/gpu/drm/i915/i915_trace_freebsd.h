@@ -2,10 +2,28 @@
 #define _I915_TRACE_FREEBSD_H_
 
 #include <drm/drmP.h>
+#include <drm/drm_trace_ring_freebsd.h>
 #include "i915_drv.h"
 #include "intel_display_types.h"
 #include "gt/intel_engine.h"
 
+#define	I915_TRACE_EVENTS(E)						\
+	E(i915_request_queue,	"ctx %llu seqno %u engine %04x flags %x") \
+	E(i915_request_add,	"ctx %llu seqno %u engine %04x")	\
+	E(i915_request_submit,	"ctx %llu seqno %u engine %04x")	\
+	E(i915_request_execute,	"ctx %llu seqno %u engine %04x")	\
+	E(i915_request_in,	"ctx %llu seqno %u engine %04x port %u") \
+	E(i915_request_out,	"ctx %llu seqno %u engine %04x")	\
+	E(i915_request_retire,	"ctx %llu seqno %u engine %04x")	\
+	E(i915_request_wait_begin, "ctx %llu seqno %u engine %04x flags %x") \
+	E(i915_request_wait_end, "ctx %llu seqno %u engine %04x")
+DRM_TRACE_DECLARE(i915, I915_TRACE_EVENTS);
+
+/* Engine as class << 8 | instance, like the uabi engine map */
+#define	I915_TRACE_RQ(name, rq, extra)					\
+	DRM_TRACE(i915, name, (rq)->fence.context, (rq)->fence.seqno,	\
+	    (rq)->engine->uabi_class << 8 | (rq)->engine->instance, extra)
+
 static inline void
 trace_i915_flip_complete(int plane, struct drm_i915_gem_object *pending_flip_obj)
 {
@@ -175,18 +193,21 @@ trace_i915_context_free(void *ctx) {
 }
 
 static inline void
-trace_i915_request_wait_begin(void *req, uint32_t flags) {
+trace_i915_request_wait_begin(struct i915_request *req, uint32_t flags) {
 	CTR2(KTR_DRM, "request_wait_begin req %p flags %x", req, flags);
+	I915_TRACE_RQ(i915_request_wait_begin, req, flags);
 }
 
 static inline void
-trace_i915_request_wait_end(void *req) {
+trace_i915_request_wait_end(struct i915_request *req) {
 	CTR1(KTR_DRM, "request_wait_end req %p", req);
+	I915_TRACE_RQ(i915_request_wait_end, req, 0);
 }
 
 static inline void
-trace_i915_request_retire(void *req) {
+trace_i915_request_retire(struct i915_request *req) {
 	CTR1(KTR_DRM, "request_retire req %p", req);
+	I915_TRACE_RQ(i915_request_retire, req, 0);
 }
 
 static inline void
@@ -195,28 +216,33 @@ trace_i915_request_notify(void *req) {
 }
 
 static inline void
-trace_i915_request_execute(void *req) {
+trace_i915_request_execute(struct i915_request *req) {
 	CTR1(KTR_DRM, "request_execute req %p", req);
+	I915_TRACE_RQ(i915_request_execute, req, 0);
 }
 
 static inline void
-trace_i915_request_submit(void *req) {
+trace_i915_request_submit(struct i915_request *req) {
 	CTR1(KTR_DRM, "request_submit req %p", req);
+	I915_TRACE_RQ(i915_request_submit, req, 0);
 }
 
 static inline void
 trace_i915_request_queue(struct i915_request *req, uint32_t flags) {
 	CTR2(KTR_DRM, "request_queue req %p flags %x", req, flags);
+	I915_TRACE_RQ(i915_request_queue, req, flags);
 }
 
 static inline void
 trace_i915_request_in(struct i915_request *req, uint32_t flags) {
 	CTR2(KTR_DRM, "request_in req %p flags %x", req, flags);
+	I915_TRACE_RQ(i915_request_in, req, flags);
 }
 
 static inline void
 trace_i915_request_out(struct i915_request *req) {
 	CTR1(KTR_DRM, "request_out req %p", req);
+	I915_TRACE_RQ(i915_request_out, req, 0);
 }
 
 static inline void
@@ -262,9 +288,10 @@ trace_i915_pipe_update_end(void *crtc, u32 end_vbl_count, int scanline_end)
 }
 
 static inline void
-trace_i915_request_add(void *req)
+trace_i915_request_add(struct i915_request *req)
 {
 	CTR1(KTR_DRM, "request_add req %p", req);
+	I915_TRACE_RQ(i915_request_add, req, 0);
 }
 
 #define trace_i915_gem_ring_sync_to(to_req, from) \
@@ -12,3 +12,7 @@
 #define CREATE_TRACE_POINTS
 #include "i915_trace.h"
 #endif
+
+#ifdef __FreeBSD__
+DRM_TRACE_DEFINE(i915, I915_TRACE_EVENTS);
+#endif
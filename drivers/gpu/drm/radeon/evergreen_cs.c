@@ -31,6 +31,7 @@
 #include "evergreend.h"
 #include "evergreen_reg_safe.h"
 #include "cayman_reg_safe.h"
+#include "radeon_reg_range.h"
 
 #define MAX(a,b)                   (((a)>(b))?(a):(b))
 #define MIN(a,b)                   (((a)<(b))?(a):(b))
@@ -2306,13 +2307,12 @@ static int evergreen_packet3_check(struct radeon_cs_parser *p,
 			DRM_ERROR("bad PACKET3_SET_CONFIG_REG\n");
 			return -EINVAL;
 		}
-		for (reg = start_reg, idx++; reg <= end_reg; reg += 4, idx++) {
-			if (evergreen_is_safe_reg(p, reg))
-				continue;
-			r = evergreen_cs_handle_reg(p, reg, idx);
-			if (r)
-				return r;
-		}
+		r = radeon_cs_check_reg_range(p, track->reg_safe_bm,
+					      REG_SAFE_BM_SIZE, start_reg,
+					      end_reg, idx + 1,
+					      evergreen_cs_handle_reg);
+		if (r)
+			return r;
 		break;
 	case PACKET3_SET_CONTEXT_REG:
 		start_reg = (idx_value << 2) + PACKET3_SET_CONTEXT_REG_START;
@@ -2323,13 +2323,12 @@ static int evergreen_packet3_check(struct radeon_cs_parser *p,
 			DRM_ERROR("bad PACKET3_SET_CONTEXT_REG\n");
 			return -EINVAL;
 		}
-		for (reg = start_reg, idx++; reg <= end_reg; reg += 4, idx++) {
-			if (evergreen_is_safe_reg(p, reg))
-				continue;
-			r = evergreen_cs_handle_reg(p, reg, idx);
-			if (r)
-				return r;
-		}
+		r = radeon_cs_check_reg_range(p, track->reg_safe_bm,
+					      REG_SAFE_BM_SIZE, start_reg,
+					      end_reg, idx + 1,
+					      evergreen_cs_handle_reg);
+		if (r)
+			return r;
 		break;
 	case PACKET3_SET_RESOURCE:
 		if (pkt->count % 8) {
@@ -31,6 +31,7 @@
 #include "radeon_asic.h"
 #include "r600d.h"
 #include "r600_reg_safe.h"
+#include "radeon_reg_range.h"
 
 static int r600_nomm;
 extern void r600_cs_legacy_get_tiling_conf(struct drm_device *dev, u32 *npipes, u32 *nbanks, u32 *group_size);
@@ -1914,12 +1915,12 @@ static int r600_packet3_check(struct radeon_cs_parser *p,
 			DRM_ERROR("bad PACKET3_SET_CONFIG_REG\n");
 			return -EINVAL;
 		}
-		for (i = 0; i < pkt->count; i++) {
-			reg = start_reg + (4 * i);
-			r = r600_cs_check_reg(p, reg, idx+1+i);
-			if (r)
-				return r;
-		}
+		r = radeon_cs_check_reg_range(p, r600_reg_safe_bm,
+					      ARRAY_SIZE(r600_reg_safe_bm),
+					      start_reg, end_reg, idx + 1,
+					      r600_cs_check_reg);
+		if (r)
+			return r;
 		break;
 	case PACKET3_SET_CONTEXT_REG:
 		start_reg = (idx_value << 2) + PACKET3_SET_CONTEXT_REG_OFFSET;
@@ -1930,12 +1931,12 @@ static int r600_packet3_check(struct radeon_cs_parser *p,
 			DRM_ERROR("bad PACKET3_SET_CONTEXT_REG\n");
 			return -EINVAL;
 		}
-		for (i = 0; i < pkt->count; i++) {
-			reg = start_reg + (4 * i);
-			r = r600_cs_check_reg(p, reg, idx+1+i);
-			if (r)
-				return r;
-		}
+		r = radeon_cs_check_reg_range(p, r600_reg_safe_bm,
+					      ARRAY_SIZE(r600_reg_safe_bm),
+					      start_reg, end_reg, idx + 1,
+					      r600_cs_check_reg);
+		if (r)
+			return r;
 		break;
 	case PACKET3_SET_RESOURCE:
 		if (pkt->count % 7) {
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2010 Advanced Micro Devices, Inc.
+ * Copyright 2008 Red Hat Inc.
+ * Copyright 2009 Jerome Glisse.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __RADEON_REG_RANGE_H__
+#define __RADEON_REG_RANGE_H__
+
+/*
+ * Checking of SET_CONFIG_REG and SET_CONTEXT_REG runs against the
+ * mkregtable generated reg_safe_bm tables. This is kept free of kernel
+ * includes so that scripts/radeonregtest.c can replay command streams
+ * through it on the host. The includer provides the kernel types,
+ * GENMASK(), __ffs(), likely() and struct radeon_cs_parser.
+ */
+
+/**
+ * radeon_cs_check_reg_range() - check a run of consecutive registers
+ * @p: parser structure holding parsing context
+ * @bm: reg_safe_bm of the asic, a set bit marks a register to check
+ * @bm_size: number of words in @bm
+ * @start_reg: first register of the run
+ * @end_reg: last register of the run
+ * @idx: index into the cs buffer of the value for @start_reg
+ * @check: checker for a register whose bit is set, or which is beyond @bm
+ *
+ * Equivalent to calling @check for every register of the run that has its
+ * bit set in @bm, in ascending order, but walks @bm a 32 register word at a
+ * time so runs of safe registers cost a single test. Registers beyond @bm
+ * are all handed to @check, which is expected to reject them.
+ *
+ * Returns 0 if all registers passed, else the first error from @check.
+ */
+static inline int
+radeon_cs_check_reg_range(struct radeon_cs_parser *p, const unsigned *bm,
+			  u32 bm_size, u32 start_reg, u32 end_reg, u32 idx,
+			  int (*check)(struct radeon_cs_parser *p, u32 reg,
+				       u32 idx))
+{
+	u32 i, first, last, m;
+	int r;
+
+	if (start_reg > end_reg)
+		return 0;
+
+	first = (start_reg >> 2) & 31;
+	for (i = start_reg >> 7; i <= end_reg >> 7; i++, first = 0) {
+		last = i == end_reg >> 7 ? (end_reg >> 2) & 31 : 31;
+		m = GENMASK(last, first);
+		if (likely(i < bm_size))
+			m &= bm[i];
+
+		while (m) {
+			u32 bit = __ffs(m);
+
+			m &= m - 1;
+			r = check(p, (i << 7) | (bit << 2), idx + bit - first);
+			if (r)
+				return r;
+		}
+		idx += last - first + 1;
+	}
+
+	return 0;
+}
+
+#endif
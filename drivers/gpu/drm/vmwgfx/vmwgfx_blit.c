@@ -1,4 +1,4 @@
-// SPDX-License-Identifier: GPL-2.0 OR MIT
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
 /**************************************************************************
  *
  * Copyright 2017 VMware, Inc., Palo Alto, CA., USA
@@ -28,209 +28,44 @@
 
 #include "vmwgfx_drv.h"
 
-/*
- * Template that implements find_first_diff() for a generic
- * unsigned integer type. @size and return value are in bytes.
- */
-#define VMW_FIND_FIRST_DIFF(_type)			 \
-static size_t vmw_find_first_diff_ ## _type		 \
-	(const _type * dst, const _type * src, size_t size)\
-{							 \
-	size_t i;					 \
-							 \
-	for (i = 0; i < size; i += sizeof(_type)) {	 \
-		if (*dst++ != *src++)			 \
-			break;				 \
-	}						 \
-							 \
-	return i;					 \
-}
-
-
-/*
- * Template that implements find_last_diff() for a generic
- * unsigned integer type. Pointers point to the item following the
- * *end* of the area to be examined. @size and return value are in
- * bytes.
- */
-#define VMW_FIND_LAST_DIFF(_type)					\
-static ssize_t vmw_find_last_diff_ ## _type(				\
-	const _type * dst, const _type * src, size_t size)		\
-{									\
-	while (size) {							\
-		if (*--dst != *--src)					\
-			break;						\
-									\
-		size -= sizeof(_type);					\
-	}								\
-	return size;							\
-}
-
-
-/*
- * Instantiate find diff functions for relevant unsigned integer sizes,
- * assuming that wider integers are faster (including aligning) up to the
- * architecture native width, which is assumed to be 32 bit unless
- * CONFIG_64BIT is defined.
- */
-VMW_FIND_FIRST_DIFF(u8);
-VMW_FIND_LAST_DIFF(u8);
-
-VMW_FIND_FIRST_DIFF(u16);
-VMW_FIND_LAST_DIFF(u16);
-
-VMW_FIND_FIRST_DIFF(u32);
-VMW_FIND_LAST_DIFF(u32);
-
-#ifdef CONFIG_64BIT
-VMW_FIND_FIRST_DIFF(u64);
-VMW_FIND_LAST_DIFF(u64);
+#ifdef CONFIG_X86
+#include <asm/fpu/api.h>
+
+#ifdef __linux__
+static DEFINE_STATIC_KEY_FALSE(vmw_has_sse2);
+#define VMW_HAS_SSE2()	static_branch_likely(&vmw_has_sse2)
+#elif defined(__FreeBSD__)
+#include <x86/x86_var.h>
+static bool vmw_has_sse2 = false;
+#define VMW_HAS_SSE2()	likely(vmw_has_sse2)
+#define	asm		__asm
+#endif
 #endif
 
+#include "vmwgfx_blit_diff.h"
 
-/* We use size aligned copies. This computes (addr - align(addr)) */
-#define SPILL(_var, _type) ((unsigned long) _var & (sizeof(_type) - 1))
-
-
-/*
- * Template to compute find_first_diff() for a certain integer type
- * including a head copy for alignment, and adjustment of parameters
- * for tail find or increased resolution find using an unsigned integer find
- * of smaller width. If finding is complete, and resolution is sufficient,
- * the macro executes a return statement. Otherwise it falls through.
- */
-#define VMW_TRY_FIND_FIRST_DIFF(_type)					\
-do {									\
-	unsigned int spill = SPILL(dst, _type);				\
-	size_t diff_offs;						\
-									\
-	if (spill && spill == SPILL(src, _type) &&			\
-	    sizeof(_type) - spill <= size) {				\
-		spill = sizeof(_type) - spill;				\
-		diff_offs = vmw_find_first_diff_u8(dst, src, spill);	\
-		if (diff_offs < spill)					\
-			return round_down(offset + diff_offs, granularity); \
-									\
-		dst += spill;						\
-		src += spill;						\
-		size -= spill;						\
-		offset += spill;					\
-		spill = 0;						\
-	}								\
-	if (!spill && !SPILL(src, _type)) {				\
-		size_t to_copy = size &	 ~(sizeof(_type) - 1);		\
-									\
-		diff_offs = vmw_find_first_diff_ ## _type		\
-			((_type *) dst, (_type *) src, to_copy);	\
-		if (diff_offs >= size || granularity == sizeof(_type))	\
-			return (offset + diff_offs);			\
-									\
-		dst += diff_offs;					\
-		src += diff_offs;					\
-		size -= diff_offs;					\
-		offset += diff_offs;					\
-	}								\
-} while (0)								\
-
-
+#ifdef CONFIG_X86
 /**
- * vmw_find_first_diff - find the first difference between dst and src
+ * vmw_blit_init - Select the difference finding implementation
  *
- * @dst: The destination address
- * @src: The source address
- * @size: Number of bytes to compare
- * @granularity: The granularity needed for the return value in bytes.
- * return: The offset from find start where the first difference was
- * encountered in bytes. If no difference was found, the function returns
- * a value >= @size.
+ * Enables the SSE2 compare kernels if the CPU supports them. Must be
+ * called before the first vmw_diff_memcpy().
  */
-static size_t vmw_find_first_diff(const u8 *dst, const u8 *src, size_t size,
-				  size_t granularity)
+void vmw_blit_init(void)
 {
-	size_t offset = 0;
-
-	/*
-	 * Try finding with large integers if alignment allows, or we can
-	 * fix it. Fall through if we need better resolution or alignment
-	 * was bad.
-	 */
-#ifdef CONFIG_64BIT
-	VMW_TRY_FIND_FIRST_DIFF(u64);
+#ifdef __linux__
+	if (static_cpu_has(X86_FEATURE_XMM2))
+		static_branch_enable(&vmw_has_sse2);
+#elif defined(__FreeBSD__)
+	if (cpu_feature & CPUID_SSE2)
+		vmw_has_sse2 = true;
 #endif
-	VMW_TRY_FIND_FIRST_DIFF(u32);
-	VMW_TRY_FIND_FIRST_DIFF(u16);
-
-	return round_down(offset + vmw_find_first_diff_u8(dst, src, size),
-			  granularity);
 }
-
-
-/*
- * Template to compute find_last_diff() for a certain integer type
- * including a tail copy for alignment, and adjustment of parameters
- * for head find or increased resolution find using an unsigned integer find
- * of smaller width. If finding is complete, and resolution is sufficient,
- * the macro executes a return statement. Otherwise it falls through.
- */
-#define VMW_TRY_FIND_LAST_DIFF(_type)					\
-do {									\
-	unsigned int spill = SPILL(dst, _type);				\
-	ssize_t location;						\
-	ssize_t diff_offs;						\
-									\
-	if (spill && spill <= size && spill == SPILL(src, _type)) {	\
-		diff_offs = vmw_find_last_diff_u8(dst, src, spill);	\
-		if (diff_offs) {					\
-			location = size - spill + diff_offs - 1;	\
-			return round_down(location, granularity);	\
-		}							\
-									\
-		dst -= spill;						\
-		src -= spill;						\
-		size -= spill;						\
-		spill = 0;						\
-	}								\
-	if (!spill && !SPILL(src, _type)) {				\
-		size_t to_copy = round_down(size, sizeof(_type));	\
-									\
-		diff_offs = vmw_find_last_diff_ ## _type		\
-			((_type *) dst, (_type *) src, to_copy);	\
-		location = size - to_copy + diff_offs - sizeof(_type);	\
-		if (location < 0 || granularity == sizeof(_type))	\
-			return location;				\
-									\
-		dst -= to_copy - diff_offs;				\
-		src -= to_copy - diff_offs;				\
-		size -= to_copy - diff_offs;				\
-	}								\
-} while (0)
-
-
-/**
- * vmw_find_last_diff - find the last difference between dst and src
- *
- * @dst: The destination address
- * @src: The source address
- * @size: Number of bytes to compare
- * @granularity: The granularity needed for the return value in bytes.
- * return: The offset from find start where the last difference was
- * encountered in bytes, or a negative value if no difference was found.
- */
-static ssize_t vmw_find_last_diff(const u8 *dst, const u8 *src, size_t size,
-				  size_t granularity)
+#else
+void vmw_blit_init(void)
 {
-	dst += size;
-	src += size;
-
-#ifdef CONFIG_64BIT
-	VMW_TRY_FIND_LAST_DIFF(u64);
-#endif
-	VMW_TRY_FIND_LAST_DIFF(u32);
-	VMW_TRY_FIND_LAST_DIFF(u16);
-
-	return round_down(vmw_find_last_diff_u8(dst, src, size) - 1,
-			  granularity);
 }
+#endif
 
 
 /**
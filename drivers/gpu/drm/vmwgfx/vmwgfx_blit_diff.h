@@ -0,0 +1,378 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/**************************************************************************
+ *
+ * Copyright 2017 VMware, Inc., Palo Alto, CA., USA
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#ifndef _VMWGFX_BLIT_DIFF_H_
+#define _VMWGFX_BLIT_DIFF_H_
+
+/*
+ * Difference finding for vmw_diff_memcpy(). This is kept free of kernel
+ * includes so that scripts/vmwblittest.c can build it on the host and
+ * check the SSE2 kernels against the integer loops. The includer provides
+ * the kernel types and helpers, kernel_fpu_begin() / kernel_fpu_end() and,
+ * on x86, VMW_HAS_SSE2().
+ */
+
+/*
+ * Template that implements find_first_diff() for a generic
+ * unsigned integer type. @size and return value are in bytes.
+ */
+#define VMW_FIND_FIRST_DIFF(_type)			 \
+static size_t vmw_find_first_diff_ ## _type		 \
+	(const _type * dst, const _type * src, size_t size)\
+{							 \
+	size_t i;					 \
+							 \
+	for (i = 0; i < size; i += sizeof(_type)) {	 \
+		if (*dst++ != *src++)			 \
+			break;				 \
+	}						 \
+							 \
+	return i;					 \
+}
+
+
+/*
+ * Template that implements find_last_diff() for a generic
+ * unsigned integer type. Pointers point to the item following the
+ * *end* of the area to be examined. @size and return value are in
+ * bytes.
+ */
+#define VMW_FIND_LAST_DIFF(_type)					\
+static ssize_t vmw_find_last_diff_ ## _type(				\
+	const _type * dst, const _type * src, size_t size)		\
+{									\
+	while (size) {							\
+		if (*--dst != *--src)					\
+			break;						\
+									\
+		size -= sizeof(_type);					\
+	}								\
+	return size;							\
+}
+
+
+/*
+ * Instantiate find diff functions for relevant unsigned integer sizes,
+ * assuming that wider integers are faster (including aligning) up to the
+ * architecture native width, which is assumed to be 32 bit unless
+ * CONFIG_64BIT is defined.
+ */
+VMW_FIND_FIRST_DIFF(u8);
+VMW_FIND_LAST_DIFF(u8);
+
+VMW_FIND_FIRST_DIFF(u16);
+VMW_FIND_LAST_DIFF(u16);
+
+VMW_FIND_FIRST_DIFF(u32);
+VMW_FIND_LAST_DIFF(u32);
+
+#ifdef CONFIG_64BIT
+VMW_FIND_FIRST_DIFF(u64);
+VMW_FIND_LAST_DIFF(u64);
+#endif
+
+
+/* We use size aligned copies. This computes (addr - align(addr)) */
+#define SPILL(_var, _type) ((unsigned long) _var & (sizeof(_type) - 1))
+
+
+/*
+ * Template to compute find_first_diff() for a certain integer type
+ * including a head copy for alignment, and adjustment of parameters
+ * for tail find or increased resolution find using an unsigned integer find
+ * of smaller width. If finding is complete, and resolution is sufficient,
+ * the macro executes a return statement. Otherwise it falls through.
+ */
+#define VMW_TRY_FIND_FIRST_DIFF(_type)					\
+do {									\
+	unsigned int spill = SPILL(dst, _type);				\
+	size_t diff_offs;						\
+									\
+	if (spill && spill == SPILL(src, _type) &&			\
+	    sizeof(_type) - spill <= size) {				\
+		spill = sizeof(_type) - spill;				\
+		diff_offs = vmw_find_first_diff_u8(dst, src, spill);	\
+		if (diff_offs < spill)					\
+			return round_down(offset + diff_offs, granularity); \
+									\
+		dst += spill;						\
+		src += spill;						\
+		size -= spill;						\
+		offset += spill;					\
+		spill = 0;						\
+	}								\
+	if (!spill && !SPILL(src, _type)) {				\
+		size_t to_copy = size &	 ~(sizeof(_type) - 1);		\
+									\
+		diff_offs = vmw_find_first_diff_ ## _type		\
+			((_type *) dst, (_type *) src, to_copy);	\
+		if (diff_offs >= size || granularity == sizeof(_type))	\
+			return (offset + diff_offs);			\
+									\
+		dst += diff_offs;					\
+		src += diff_offs;					\
+		size -= diff_offs;					\
+		offset += diff_offs;					\
+	}								\
+} while (0)								\
+
+
+#ifdef CONFIG_X86
+/*
+ * Below this size the FPU state save / restore costs more than the
+ * wider compares win, so stay with the integer loops.
+ */
+#define VMW_SIMD_DIFF_MIN 256
+
+static inline bool vmw_use_sse2(size_t size)
+{
+	return size >= VMW_SIMD_DIFF_MIN && VMW_HAS_SSE2();
+}
+
+/*
+ * Compare 16 bytes at @dst and @src. Returns a mask with bit n set if
+ * byte n is equal, i.e. 0xffff if the blocks are identical.
+ */
+static inline unsigned int vmw_cmp16_sse2(const u8 *dst, const u8 *src)
+{
+	unsigned int mask;
+
+	asm("movdqu (%1), %%xmm0\n"
+	    "movdqu (%2), %%xmm1\n"
+	    "pcmpeqb %%xmm1, %%xmm0\n"
+	    "pmovmskb %%xmm0, %0\n"
+	    : "=r" (mask) : "r" (dst), "r" (src) : "memory");
+
+	return mask;
+}
+
+/*
+ * Compare 64 bytes at @dst and @src. Returns true if they are identical.
+ * Used to skip over unchanged data before narrowing down with
+ * vmw_cmp16_sse2().
+ */
+static inline bool vmw_same64_sse2(const u8 *dst, const u8 *src)
+{
+	unsigned int mask;
+
+	asm("movdqu (%1), %%xmm0\n"
+	    "movdqu 16(%1), %%xmm1\n"
+	    "movdqu 32(%1), %%xmm2\n"
+	    "movdqu 48(%1), %%xmm3\n"
+	    "movdqu (%2), %%xmm4\n"
+	    "movdqu 16(%2), %%xmm5\n"
+	    "movdqu 32(%2), %%xmm6\n"
+	    "movdqu 48(%2), %%xmm7\n"
+	    "pcmpeqb %%xmm4, %%xmm0\n"
+	    "pcmpeqb %%xmm5, %%xmm1\n"
+	    "pcmpeqb %%xmm6, %%xmm2\n"
+	    "pcmpeqb %%xmm7, %%xmm3\n"
+	    "pand %%xmm1, %%xmm0\n"
+	    "pand %%xmm3, %%xmm2\n"
+	    "pand %%xmm2, %%xmm0\n"
+	    "pmovmskb %%xmm0, %0\n"
+	    : "=r" (mask) : "r" (dst), "r" (src) : "memory");
+
+	return mask == 0xffff;
+}
+
+/*
+ * SSE2 version of find_first_diff(). Returns the byte offset of the first
+ * difference, or @size if the areas are identical.
+ */
+static size_t vmw_find_first_diff_sse2(const u8 *dst, const u8 *src,
+				       size_t size)
+{
+	unsigned int mask;
+	size_t i;
+
+	kernel_fpu_begin();
+	for (i = 0; i + 64 <= size && vmw_same64_sse2(dst + i, src + i);
+	     i += 64)
+		;
+	for (; i + 16 <= size; i += 16) {
+		mask = vmw_cmp16_sse2(dst + i, src + i);
+		if (mask != 0xffff) {
+			kernel_fpu_end();
+			return i + __ffs(~mask & 0xffff);
+		}
+	}
+	kernel_fpu_end();
+
+	return i + vmw_find_first_diff_u8(dst + i, src + i, size - i);
+}
+
+/*
+ * SSE2 version of find_last_diff(). Pointers point to the *start* of the
+ * area. Returns the byte offset of the last difference, or -1 if the areas
+ * are identical.
+ */
+static ssize_t vmw_find_last_diff_sse2(const u8 *dst, const u8 *src,
+				       size_t size)
+{
+	size_t tail = size & 15;
+	unsigned int mask;
+	ssize_t diff_offs;
+	size_t i;
+
+	diff_offs = vmw_find_last_diff_u8(dst + size, src + size, tail);
+	if (diff_offs)
+		return size - tail + diff_offs - 1;
+
+	kernel_fpu_begin();
+	for (i = size - tail;
+	     i >= 64 && vmw_same64_sse2(dst + i - 64, src + i - 64); i -= 64)
+		;
+	for (; i; i -= 16) {
+		mask = vmw_cmp16_sse2(dst + i - 16, src + i - 16);
+		if (mask != 0xffff) {
+			kernel_fpu_end();
+			return i - 16 + fls(~mask & 0xffff) - 1;
+		}
+	}
+	kernel_fpu_end();
+
+	return -1;
+}
+#endif
+
+/**
+ * vmw_find_first_diff - find the first difference between dst and src
+ *
+ * @dst: The destination address
+ * @src: The source address
+ * @size: Number of bytes to compare
+ * @granularity: The granularity needed for the return value in bytes.
+ * return: The offset from find start where the first difference was
+ * encountered in bytes. If no difference was found, the function returns
+ * a value >= @size.
+ */
+static size_t vmw_find_first_diff(const u8 *dst, const u8 *src, size_t size,
+				  size_t granularity)
+{
+	size_t offset = 0;
+
+#ifdef CONFIG_X86
+	if (vmw_use_sse2(size))
+		return round_down(vmw_find_first_diff_sse2(dst, src, size),
+				  granularity);
+#endif
+
+	/*
+	 * Try finding with large integers if alignment allows, or we can
+	 * fix it. Fall through if we need better resolution or alignment
+	 * was bad.
+	 */
+#ifdef CONFIG_64BIT
+	VMW_TRY_FIND_FIRST_DIFF(u64);
+#endif
+	VMW_TRY_FIND_FIRST_DIFF(u32);
+	VMW_TRY_FIND_FIRST_DIFF(u16);
+
+	return round_down(offset + vmw_find_first_diff_u8(dst, src, size),
+			  granularity);
+}
+
+
+/*
+ * Template to compute find_last_diff() for a certain integer type
+ * including a tail copy for alignment, and adjustment of parameters
+ * for head find or increased resolution find using an unsigned integer find
+ * of smaller width. If finding is complete, and resolution is sufficient,
+ * the macro executes a return statement. Otherwise it falls through.
+ */
+#define VMW_TRY_FIND_LAST_DIFF(_type)					\
+do {									\
+	unsigned int spill = SPILL(dst, _type);				\
+	ssize_t location;						\
+	ssize_t diff_offs;						\
+									\
+	if (spill && spill <= size && spill == SPILL(src, _type)) {	\
+		diff_offs = vmw_find_last_diff_u8(dst, src, spill);	\
+		if (diff_offs) {					\
+			location = size - spill + diff_offs - 1;	\
+			return round_down(location, granularity);	\
+		}							\
+									\
+		dst -= spill;						\
+		src -= spill;						\
+		size -= spill;						\
+		spill = 0;						\
+	}								\
+	if (!spill && !SPILL(src, _type)) {				\
+		size_t to_copy = round_down(size, sizeof(_type));	\
+									\
+		diff_offs = vmw_find_last_diff_ ## _type		\
+			((_type *) dst, (_type *) src, to_copy);	\
+		location = size - to_copy + diff_offs - sizeof(_type);	\
+		if (diff_offs && granularity == sizeof(_type))		\
+			return location;				\
+									\
+		dst -= to_copy - diff_offs;				\
+		src -= to_copy - diff_offs;				\
+		size -= to_copy - diff_offs;				\
+	}								\
+} while (0)
+
+
+/**
+ * vmw_find_last_diff - find the last difference between dst and src
+ *
+ * @dst: The destination address
+ * @src: The source address
+ * @size: Number of bytes to compare
+ * @granularity: The granularity needed for the return value in bytes.
+ * return: The offset from find start where the last difference was
+ * encountered in bytes, or a negative value if no difference was found.
+ */
+static ssize_t vmw_find_last_diff(const u8 *dst, const u8 *src, size_t size,
+				  size_t granularity)
+{
+#ifdef CONFIG_X86
+	if (vmw_use_sse2(size)) {
+		ssize_t location = vmw_find_last_diff_sse2(dst, src, size);
+
+		return location < 0 ? location :
+			round_down(location, granularity);
+	}
+#endif
+
+	dst += size;
+	src += size;
+
+#ifdef CONFIG_64BIT
+	VMW_TRY_FIND_LAST_DIFF(u64);
+#endif
+	VMW_TRY_FIND_LAST_DIFF(u32);
+	VMW_TRY_FIND_LAST_DIFF(u16);
+
+	return round_down(vmw_find_last_diff_u8(dst, src, size) - 1,
+			  granularity);
+}
+
+#endif
@@ -25,6 +25,8 @@
  *
  **************************************************************************/
 
+#include <linux/seq_file.h>
+
 #include <drm/ttm/ttm_bo_api.h>
 
 #include "vmwgfx_drv.h"
@@ -37,6 +39,9 @@
 #define VMW_CMDBUF_INLINE_SIZE \
 	(1024 - ALIGN(sizeof(SVGACBHeader), VMW_CMDBUF_INLINE_ALIGN))
 
+/* Upper bound of the batching latency budget, in microseconds. */
+#define VMW_CMDBUF_BATCH_MAX_US 10000
+
 /**
  * struct vmw_cmdbuf_context - Command buffer context queues
  *
@@ -102,6 +107,12 @@ struct vmw_cmdbuf_context {
  * false. Immutable.
  * @size: The size of the command buffer space. Immutable.
  * @num_contexts: Number of contexts actually enabled.
+ * @batch_timer: Timer bounding how long flushes of @cur may be held back.
+ * @batch_work: Work flushing @cur when @batch_timer expires.
+ * @cur_flushes: Number of flush requests held back in @cur. Protected by
+ * @cur_mutex.
+ * @stats: Submission statistics. The flush counters are protected by
+ * @cur_mutex, @stats.doorbells by @lock.
  */
 struct vmw_cmdbuf_man {
 	struct mutex cur_mutex;
@@ -130,6 +141,10 @@ struct vmw_cmdbuf_man {
 	dma_addr_t handle;
 	size_t size;
 	u32 num_contexts;
+	struct hrtimer batch_timer;
+	struct work_struct batch_work;
+	u32 cur_flushes;
+	struct vmw_cmdbuf_stats stats;
 };
 
 /**
@@ -300,6 +315,7 @@ static int vmw_cmdbuf_header_submit(struct vmw_cmdbuf_header *header)
 	struct vmw_cmdbuf_man *man = header->man;
 	u32 val;
 
+	man->stats.doorbells++;
 	val = upper_32_bits(header->handle);
 	vmw_write(man->dev_priv, SVGA_REG_COMMAND_HIGH, val);
 
@@ -667,6 +683,12 @@ static void __vmw_cmdbuf_cur_flush(struct vmw_cmdbuf_man *man)
 	if (!cur)
 		return;
 
+	if (man->cur_flushes) {
+		hrtimer_cancel(&man->batch_timer);
+		man->stats.coalesced += man->cur_flushes - 1;
+		man->cur_flushes = 0;
+	}
+
 	spin_lock(&man->lock);
 	if (man->cur_pos == 0) {
 		__vmw_cmdbuf_header_free(cur);
@@ -681,6 +703,76 @@ out_unlock:
 	man->cur_pos = 0;
 }
 
+/**
+ * __vmw_cmdbuf_cur_flush_batched - Handle a flush request for the current
+ * command buffer
+ *
+ * @man: The command buffer manager.
+ *
+ * With batching enabled, a flush of a small current command buffer is held
+ * back for at most vmw_cmdbuf_batch_us microseconds, so that commands
+ * committed in the meantime are submitted with the same register write.
+ * The buffer is flushed right away once it holds vmw_cmdbuf_batch_bytes.
+ * Call with @man->cur_mutex held.
+ */
+static void __vmw_cmdbuf_cur_flush_batched(struct vmw_cmdbuf_man *man)
+{
+	unsigned int batch_us = min_t(unsigned int,
+				      READ_ONCE(vmw_cmdbuf_batch_us),
+				      VMW_CMDBUF_BATCH_MAX_US);
+
+	lockdep_assert_held_once(&man->cur_mutex);
+
+	man->stats.flushes++;
+	if (!batch_us || !man->cur || man->cur_pos == 0 ||
+	    man->cur_pos >= READ_ONCE(vmw_cmdbuf_batch_bytes)) {
+		if (man->cur_flushes)
+			man->cur_flushes++;
+		__vmw_cmdbuf_cur_flush(man);
+		return;
+	}
+
+	if (man->cur_flushes++ == 0)
+		hrtimer_start(&man->batch_timer,
+			      ns_to_ktime((u64) batch_us * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+}
+
+/**
+ * vmw_cmdbuf_batch_timer_func - Batching latency budget expired
+ *
+ * @timer: The batch timer.
+ *
+ * Flushing needs @man->cur_mutex, so defer it to process context.
+ */
+static enum hrtimer_restart vmw_cmdbuf_batch_timer_func(struct hrtimer *timer)
+{
+	struct vmw_cmdbuf_man *man =
+		container_of(timer, struct vmw_cmdbuf_man, batch_timer);
+
+	schedule_work(&man->batch_work);
+
+	return HRTIMER_NORESTART;
+}
+
+/**
+ * vmw_cmdbuf_batch_work_func - Flush command buffers held back by batching
+ *
+ * @work: The work func closure argument.
+ */
+static void vmw_cmdbuf_batch_work_func(struct work_struct *work)
+{
+	struct vmw_cmdbuf_man *man =
+		container_of(work, struct vmw_cmdbuf_man, batch_work);
+
+	mutex_lock(&man->cur_mutex);
+	if (man->cur_flushes) {
+		man->stats.timer_flushes++;
+		__vmw_cmdbuf_cur_flush(man);
+	}
+	mutex_unlock(&man->cur_mutex);
+}
+
 /**
  * vmw_cmdbuf_cur_flush - Flush the current command buffer for small kernel
  * command submissions
@@ -1054,7 +1146,7 @@ static void vmw_cmdbuf_commit_cur(struct vmw_cmdbuf_man *man,
 	if (!size)
 		cur->cb_header->flags &= ~SVGA_CB_FLAG_DX_CONTEXT;
 	if (flush)
-		__vmw_cmdbuf_cur_flush(man);
+		__vmw_cmdbuf_cur_flush_batched(man);
 	vmw_cmdbuf_cur_unlock(man);
 }
 
@@ -1115,7 +1207,7 @@ void vmw_cmdbuf_commit(struct vmw_cmdbuf_man *man, size_t size,
 	if (!size)
 		header->cb_header->flags &= ~SVGA_CB_FLAG_DX_CONTEXT;
 	if (flush)
-		__vmw_cmdbuf_cur_flush(man);
+		__vmw_cmdbuf_cur_flush_batched(man);
 	vmw_cmdbuf_cur_unlock(man);
 }
 
@@ -1344,6 +1436,9 @@ struct vmw_cmdbuf_man *vmw_cmdbuf_man_create(struct vmw_private *dev_priv)
 	man->dev_priv = dev_priv;
 	man->max_hw_submitted = SVGA_CB_MAX_QUEUED_PER_CONTEXT - 1;
 	INIT_WORK(&man->work, &vmw_cmdbuf_work_func);
+	INIT_WORK(&man->batch_work, &vmw_cmdbuf_batch_work_func);
+	hrtimer_init(&man->batch_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	man->batch_timer.function = vmw_cmdbuf_batch_timer_func;
 	vmw_generic_waiter_add(dev_priv, SVGA_IRQFLAG_ERROR,
 			       &dev_priv->error_waiters);
 	ret = vmw_cmdbuf_startstop(man, 0, true);
@@ -1403,6 +1498,8 @@ void vmw_cmdbuf_man_destroy(struct vmw_cmdbuf_man *man)
 {
 	WARN_ON_ONCE(man->has_pool);
 	(void) vmw_cmdbuf_idle(man, false, 10*HZ);
+	hrtimer_cancel(&man->batch_timer);
+	(void) cancel_work_sync(&man->batch_work);
 
 	if (vmw_cmdbuf_startstop(man, 0, false))
 		DRM_ERROR("Failed stopping command buffer contexts.\n");
@@ -1417,3 +1514,226 @@ void vmw_cmdbuf_man_destroy(struct vmw_cmdbuf_man *man)
 	mutex_destroy(&man->error_mutex);
 	kfree(man);
 }
+
+/**
+ * vmw_cmdbuf_stats - Read the command buffer submission statistics
+ *
+ * @man: Pointer to a command buffer manager.
+ * @stats: Where to store the statistics.
+ */
+void vmw_cmdbuf_stats(struct vmw_cmdbuf_man *man,
+		      struct vmw_cmdbuf_stats *stats)
+{
+	mutex_lock(&man->cur_mutex);
+	spin_lock(&man->lock);
+	*stats = man->stats;
+	spin_unlock(&man->lock);
+	mutex_unlock(&man->cur_mutex);
+}
+
+#if defined(CONFIG_DEBUG_FS)
+/**
+ * vmw_cmdbuf_selftest_nops - Commit no-op commands to the current command
+ * buffer, each with a flush request
+ *
+ * @man: Pointer to a command buffer manager.
+ * @count: Number of commands.
+ *
+ * Returns 0 on success, negative error code on failure.
+ */
+static int vmw_cmdbuf_selftest_nops(struct vmw_cmdbuf_man *man,
+				    unsigned int count)
+{
+	SVGA3dCmdHeader *cmd;
+
+	while (count--) {
+		cmd = vmw_cmdbuf_reserve(man, sizeof(*cmd), SVGA3D_INVALID_ID,
+					 false, NULL);
+		if (IS_ERR(cmd))
+			return PTR_ERR(cmd);
+
+		cmd->id = SVGA_3D_CMD_NOP;
+		cmd->size = 0;
+		vmw_cmdbuf_commit(man, sizeof(*cmd), NULL, true);
+	}
+
+	return 0;
+}
+
+/**
+ * vmw_cmdbuf_selftest_check - Compare statistics deltas with the expected
+ * ones
+ *
+ * @m: Where to report.
+ * @name: Name of the case.
+ * @before: Statistics before the case ran.
+ * @after: Statistics after the case ran.
+ * @doorbells: Expected number of command buffers handed to the device.
+ * @coalesced: Expected number of flush requests merged into later ones.
+ * @timer_flushes: Expected number of flushes forced by the budget.
+ *
+ * Returns true if the deltas match.
+ */
+static bool vmw_cmdbuf_selftest_check(struct seq_file *m, const char *name,
+				      const struct vmw_cmdbuf_stats *before,
+				      const struct vmw_cmdbuf_stats *after,
+				      u64 doorbells, u64 coalesced,
+				      u64 timer_flushes)
+{
+	u64 d = after->doorbells - before->doorbells;
+	u64 c = after->coalesced - before->coalesced;
+	u64 t = after->timer_flushes - before->timer_flushes;
+	bool ok = d == doorbells && c == coalesced && t == timer_flushes;
+
+	seq_printf(m, "%-10s %s: doorbells %llu/%llu, coalesced %llu/%llu, timer flushes %llu/%llu\n",
+		   name, ok ? "ok  " : "FAIL", d, doorbells, c, coalesced,
+		   t, timer_flushes);
+
+	return ok;
+}
+
+/**
+ * vmw_cmdbuf_selftest_time - Time small committed and flushed commands
+ *
+ * @man: Pointer to a command buffer manager.
+ * @count: Number of commands.
+ * @ns: Where to store the average time per command, including the wait
+ * for the device to process them.
+ *
+ * Returns 0 on success, negative error code on failure.
+ */
+static int vmw_cmdbuf_selftest_time(struct vmw_cmdbuf_man *man,
+				    unsigned int count, u64 *ns)
+{
+	ktime_t start = ktime_get();
+	int ret;
+
+	ret = vmw_cmdbuf_selftest_nops(man, count);
+	if (!ret)
+		ret = vmw_cmdbuf_idle(man, false, 10*HZ);
+	*ns = div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)), count);
+
+	return ret;
+}
+
+/**
+ * vmw_cmdbuf_batch_selftest - Check and time the batching of small command
+ * buffer flushes
+ *
+ * @man: Pointer to a command buffer manager.
+ * @m: Where to report.
+ *
+ * Commits SVGA_3D_CMD_NOP commands with a flush request each, with batching
+ * off, held back until the budget expires, flushed when the byte threshold
+ * is reached and flushed explicitly, and checks the doorbells and flush
+ * counters against what each case must produce. Then the time per command
+ * is reported with batching off and on. The batching module parameters are
+ * changed while this runs and restored afterwards. Other command
+ * submissions in the meantime skew the counts, so run this on an otherwise
+ * idle device.
+ *
+ * Returns 0 if all cases passed, -EINVAL if one failed, or another negative
+ * error code if the commands could not be submitted.
+ */
+int vmw_cmdbuf_batch_selftest(struct vmw_cmdbuf_man *man, struct seq_file *m)
+{
+	unsigned int saved_us = READ_ONCE(vmw_cmdbuf_batch_us);
+	unsigned int saved_bytes = READ_ONCE(vmw_cmdbuf_batch_bytes);
+	const unsigned int budget_us = 2000;
+	struct vmw_cmdbuf_stats before, after;
+	u64 off_ns, on_ns, off_bells, on_bells;
+	bool ok = true;
+	int ret;
+
+	ret = vmw_cmdbuf_idle(man, true, 10*HZ);
+	if (ret)
+		goto out;
+
+	/* Batching off: every flush request rings the doorbell. */
+	WRITE_ONCE(vmw_cmdbuf_batch_us, 0);
+	vmw_cmdbuf_stats(man, &before);
+	ret = vmw_cmdbuf_selftest_nops(man, 8);
+	if (!ret)
+		ret = vmw_cmdbuf_idle(man, false, 10*HZ);
+	if (ret)
+		goto out;
+	vmw_cmdbuf_stats(man, &after);
+	ok &= vmw_cmdbuf_selftest_check(m, "off", &before, &after, 8, 0, 0);
+
+	/* Held back until the budget expires, then one doorbell. */
+	WRITE_ONCE(vmw_cmdbuf_batch_us, VMW_CMDBUF_BATCH_MAX_US);
+	WRITE_ONCE(vmw_cmdbuf_batch_bytes, UINT_MAX);
+	vmw_cmdbuf_stats(man, &before);
+	ret = vmw_cmdbuf_selftest_nops(man, 8);
+	if (ret)
+		goto out;
+	vmw_cmdbuf_stats(man, &after);
+	ok &= vmw_cmdbuf_selftest_check(m, "held", &before, &after, 0, 0, 0);
+	usleep_range(2 * VMW_CMDBUF_BATCH_MAX_US, 3 * VMW_CMDBUF_BATCH_MAX_US);
+	flush_work(&man->batch_work);
+	ret = vmw_cmdbuf_idle(man, false, 10*HZ);
+	if (ret)
+		goto out;
+	vmw_cmdbuf_stats(man, &after);
+	ok &= vmw_cmdbuf_selftest_check(m, "budget", &before, &after, 1, 7, 1);
+
+	/* The byte threshold flushes every 8 commands of 8 bytes. */
+	WRITE_ONCE(vmw_cmdbuf_batch_bytes, 8 * sizeof(SVGA3dCmdHeader));
+	vmw_cmdbuf_stats(man, &before);
+	ret = vmw_cmdbuf_selftest_nops(man, 16);
+	if (!ret)
+		ret = vmw_cmdbuf_idle(man, false, 10*HZ);
+	if (ret)
+		goto out;
+	vmw_cmdbuf_stats(man, &after);
+	ok &= vmw_cmdbuf_selftest_check(m, "bytes", &before, &after, 2, 14, 0);
+
+	/* An explicit flush submits what is held back and stops the timer. */
+	WRITE_ONCE(vmw_cmdbuf_batch_bytes, UINT_MAX);
+	vmw_cmdbuf_stats(man, &before);
+	ret = vmw_cmdbuf_selftest_nops(man, 4);
+	if (!ret)
+		ret = vmw_cmdbuf_cur_flush(man, false);
+	if (ret)
+		goto out;
+	usleep_range(VMW_CMDBUF_BATCH_MAX_US, 2 * VMW_CMDBUF_BATCH_MAX_US);
+	flush_work(&man->batch_work);
+	ret = vmw_cmdbuf_idle(man, false, 10*HZ);
+	if (ret)
+		goto out;
+	vmw_cmdbuf_stats(man, &after);
+	ok &= vmw_cmdbuf_selftest_check(m, "explicit", &before, &after,
+					1, 3, 0);
+
+	/* Time per command, and doorbells per 1024 commands. */
+	WRITE_ONCE(vmw_cmdbuf_batch_us, 0);
+	vmw_cmdbuf_stats(man, &before);
+	ret = vmw_cmdbuf_selftest_time(man, 1024, &off_ns);
+	if (ret)
+		goto out;
+	vmw_cmdbuf_stats(man, &after);
+	off_bells = after.doorbells - before.doorbells;
+
+	WRITE_ONCE(vmw_cmdbuf_batch_us, budget_us);
+	WRITE_ONCE(vmw_cmdbuf_batch_bytes, saved_bytes);
+	before = after;
+	ret = vmw_cmdbuf_selftest_time(man, 1024, &on_ns);
+	if (ret)
+		goto out;
+	vmw_cmdbuf_stats(man, &after);
+	on_bells = after.doorbells - before.doorbells;
+
+	seq_printf(m, "1024 commands, off: %llu ns each, %llu doorbells\n",
+		   off_ns, off_bells);
+	seq_printf(m, "1024 commands, %u us / %u bytes: %llu ns each, %llu doorbells\n",
+		   budget_us, saved_bytes, on_ns, on_bells);
+
+out:
+	WRITE_ONCE(vmw_cmdbuf_batch_us, saved_us);
+	WRITE_ONCE(vmw_cmdbuf_batch_bytes, saved_bytes);
+	if (ret)
+		seq_printf(m, "aborted: %d\n", ret);
+
+	return ret ? ret : ok ? 0 : -EINVAL;
+}
+#endif
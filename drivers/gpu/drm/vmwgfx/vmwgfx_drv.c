@@ -54,6 +54,7 @@
 #define VMWGFX_REPO "In Tree"
 
 #define VMWGFX_VALIDATION_MEM_GRAN (16*PAGE_SIZE)
+#define VMWGFX_VALIDATION_ARENA_PAGES 16
 
 #ifdef __FreeBSD__
 SYSCTL_NODE(_hw, OID_AUTO, vmwgfx,
@@ -261,6 +262,8 @@ static int vmw_restrict_iommu;
 static int vmw_force_coherent;
 static int vmw_restrict_dma_mask;
 static int vmw_assume_16bpp;
+unsigned int vmw_cmdbuf_batch_us;
+unsigned int vmw_cmdbuf_batch_bytes = 2048;
 
 static int vmw_probe(struct pci_dev *, const struct pci_device_id *);
 static int vmwgfx_pm_notifier(struct notifier_block *nb, unsigned long val,
@@ -278,6 +281,10 @@ MODULE_PARM_DESC(restrict_dma_mask, "Restrict DMA mask to 44 bits with IOMMU");
 module_param_named(restrict_dma_mask, vmw_restrict_dma_mask, int, 0600);
 MODULE_PARM_DESC(assume_16bpp, "Assume 16-bpp when filtering modes");
 module_param_named(assume_16bpp, vmw_assume_16bpp, int, 0600);
+MODULE_PARM_DESC(cmdbuf_batch_us, "Hold back small command buffer flushes for up to this many microseconds (0 = off, max 10000)");
+module_param_named(cmdbuf_batch_us, vmw_cmdbuf_batch_us, uint, 0600);
+MODULE_PARM_DESC(cmdbuf_batch_bytes, "Flush a held back command buffer once it holds this many bytes");
+module_param_named(cmdbuf_batch_bytes, vmw_cmdbuf_batch_bytes, uint, 0600);
 
 
 static void vmw_print_capabilities2(uint32_t capabilities2)
@@ -638,6 +645,8 @@ static int vmw_driver_load(struct drm_device *dev, unsigned long chipset)
 	mutex_init(&dev_priv->global_kms_state_mutex);
 	ttm_lock_init(&dev_priv->reservation_sem);
 	spin_lock_init(&dev_priv->resource_lock);
+	vmw_validation_arena_init(&dev_priv->ctx.val_arena,
+				  VMWGFX_VALIDATION_ARENA_PAGES);
 #ifdef __linux__
 	spin_lock_init(&dev_priv->hw_lock);
 #elif defined(__FreeBSD__)
@@ -978,8 +987,7 @@ static void vmw_driver_unload(struct drm_device *dev)
 
 	unregister_pm_notifier(&dev_priv->pm_nb);
 
-	if (dev_priv->ctx.res_ht_initialized)
-		drm_ht_remove(&dev_priv->ctx.res_ht);
+	vmw_validation_arena_fini(&dev_priv->ctx.val_arena);
 	vfree(dev_priv->ctx.cmd_bounce);
 	if (dev_priv->enable_fb) {
 		vmw_fb_off(dev_priv);
@@ -1383,6 +1391,85 @@ static const struct dev_pm_ops vmw_pm_ops = {
 	.resume = vmw_pm_resume,
 };
 
+#if defined(CONFIG_DEBUG_FS)
+static int vmw_validation_stats_show(struct seq_file *m, void *unused)
+{
+	struct drm_info_node *node = m->private;
+	struct vmw_private *dev_priv = vmw_priv(node->minor->dev);
+	struct vmw_validation_arena *arena = &dev_priv->ctx.val_arena;
+
+	mutex_lock(&dev_priv->cmdbuf_mutex);
+	spin_lock(&arena->lock);
+	seq_printf(m, "submissions: %llu\n", arena->num_submissions);
+	seq_printf(m, "cached pages: %u / %u\n", arena->num_pages,
+		   arena->max_pages);
+	seq_printf(m, "page allocs: %llu\n", arena->num_page_allocs);
+	seq_printf(m, "page reuses: %llu\n", arena->num_page_reuses);
+	spin_unlock(&arena->lock);
+	seq_printf(m, "dup table slots: %u\n",
+		   arena->dups.entries ? 1U << arena->dups.order : 0);
+	seq_printf(m, "dup lookups: %llu\n", arena->dups.num_lookups);
+	seq_printf(m, "dup hits: %llu\n", arena->dups.num_hits);
+	seq_printf(m, "dup resizes: %llu\n", arena->dups.num_resizes);
+	mutex_unlock(&dev_priv->cmdbuf_mutex);
+
+	return 0;
+}
+
+static int vmw_cmdbuf_stats_show(struct seq_file *m, void *unused)
+{
+	struct drm_info_node *node = m->private;
+	struct vmw_private *dev_priv = vmw_priv(node->minor->dev);
+	struct vmw_cmdbuf_stats stats;
+
+	if (!dev_priv->cman) {
+		seq_puts(m, "command buffers not in use\n");
+		return 0;
+	}
+
+	vmw_cmdbuf_stats(dev_priv->cman, &stats);
+	seq_printf(m, "batch budget: %u us, %u bytes\n",
+		   vmw_cmdbuf_batch_us, vmw_cmdbuf_batch_bytes);
+	seq_printf(m, "flush requests: %llu\n", stats.flushes);
+	seq_printf(m, "coalesced flushes: %llu\n", stats.coalesced);
+	seq_printf(m, "timer flushes: %llu\n", stats.timer_flushes);
+	seq_printf(m, "doorbells: %llu\n", stats.doorbells);
+	seq_printf(m, "register writes saved: %llu\n", 2 * stats.coalesced);
+
+	return 0;
+}
+
+static int vmw_cmdbuf_selftest_show(struct seq_file *m, void *unused)
+{
+	struct drm_info_node *node = m->private;
+	struct vmw_private *dev_priv = vmw_priv(node->minor->dev);
+	int ret;
+
+	if (!dev_priv->cman) {
+		seq_puts(m, "command buffers not in use\n");
+		return 0;
+	}
+
+	ret = vmw_cmdbuf_batch_selftest(dev_priv->cman, m);
+	seq_printf(m, "%s\n", ret ? "FAILED" : "passed");
+
+	return 0;
+}
+
+static const struct drm_info_list vmw_debugfs_list[] = {
+	{ "vmwgfx_validation", vmw_validation_stats_show, 0 },
+	{ "vmwgfx_cmdbuf", vmw_cmdbuf_stats_show, 0 },
+	{ "vmwgfx_cmdbuf_selftest", vmw_cmdbuf_selftest_show, 0 },
+};
+
+static int vmw_debugfs_init(struct drm_minor *minor)
+{
+	return drm_debugfs_create_files(vmw_debugfs_list,
+					ARRAY_SIZE(vmw_debugfs_list),
+					minor->debugfs_root, minor);
+}
+#endif
+
 static const struct file_operations vmwgfx_driver_fops = {
 	.owner = THIS_MODULE,
 	.open = drm_open,
@@ -1411,6 +1498,9 @@ static struct drm_driver driver = {
 	.master_drop = vmw_master_drop,
 	.open = vmw_driver_open,
 	.postclose = vmw_postclose,
+#if defined(CONFIG_DEBUG_FS)
+	.debugfs_init = vmw_debugfs_init,
+#endif
 
 	.dumb_create = vmw_dumb_create,
 	.dumb_map_offset = vmw_dumb_map_offset,
@@ -1450,6 +1540,8 @@ static int __init vmwgfx_init(void)
 	if (vgacon_text_force())
 		return -EINVAL;
 
+	vmw_blit_init();
+
 #ifdef __linux__
 	ret = pci_register_driver(&vmw_pci_driver);
 #elif defined(__FreeBSD__)
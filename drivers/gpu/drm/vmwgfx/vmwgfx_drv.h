@@ -345,7 +345,8 @@ struct vmw_ctx_validation_info;
 
 /**
  * struct vmw_sw_context - Command submission context
- * @res_ht: Pointer hash table used to find validation duplicates
+ * @val_arena: Validation memory and duplicate table cached across
+ * submissions
  * @kernel: Whether the command buffer originates from kernel code rather
  * than from user-space
  * @fp: If @kernel is false, points to the file of the client. Otherwise
@@ -375,8 +376,7 @@ struct vmw_ctx_validation_info;
  * @ctx: The validation context
  */
 struct vmw_sw_context{
-	struct drm_open_hash res_ht;
-	bool res_ht_initialized;
+	struct vmw_validation_arena val_arena;
 	bool kernel;
 	struct vmw_fpriv *fp;
 	uint32_t *cmd_bounce;
@@ -1278,6 +1278,25 @@ extern void vmw_cotable_add_resource(struct vmw_resource *ctx,
 struct vmw_cmdbuf_man;
 struct vmw_cmdbuf_header;
 
+/**
+ * struct vmw_cmdbuf_stats - Command buffer submission statistics
+ *
+ * @flushes: Flush requests for the current command buffer.
+ * @coalesced: Flush requests merged into a later submission.
+ * @timer_flushes: Submissions forced by the batching latency budget.
+ * @doorbells: Command buffers handed to the device. Each one costs two
+ * register writes.
+ */
+struct vmw_cmdbuf_stats {
+	u64 flushes;
+	u64 coalesced;
+	u64 timer_flushes;
+	u64 doorbells;
+};
+
+extern unsigned int vmw_cmdbuf_batch_us;
+extern unsigned int vmw_cmdbuf_batch_bytes;
+
 extern struct vmw_cmdbuf_man *
 vmw_cmdbuf_man_create(struct vmw_private *dev_priv);
 extern int vmw_cmdbuf_set_pool_size(struct vmw_cmdbuf_man *man,
@@ -1299,6 +1318,13 @@ extern void vmw_cmdbuf_header_free(struct vmw_cmdbuf_header *header);
 extern int vmw_cmdbuf_cur_flush(struct vmw_cmdbuf_man *man,
 				bool interruptible);
 extern void vmw_cmdbuf_irqthread(struct vmw_cmdbuf_man *man);
+extern void vmw_cmdbuf_stats(struct vmw_cmdbuf_man *man,
+			     struct vmw_cmdbuf_stats *stats);
+#if defined(CONFIG_DEBUG_FS)
+struct seq_file;
+extern int vmw_cmdbuf_batch_selftest(struct vmw_cmdbuf_man *man,
+				     struct seq_file *m);
+#endif
 
 /* CPU blit utilities - vmwgfx_blit.c */
 
@@ -1341,6 +1367,8 @@ void vmw_diff_memcpy(struct vmw_diff_cpy *diff, u8 *dest, const u8 *src,
 
 void vmw_memcpy(struct vmw_diff_cpy *diff, u8 *dest, const u8 *src, size_t n);
 
+void vmw_blit_init(void);
+
 int vmw_bo_cpu_blit(struct ttm_buffer_object *dst,
 		    u32 dst_offset, u32 dst_stride,
 		    struct ttm_buffer_object *src,
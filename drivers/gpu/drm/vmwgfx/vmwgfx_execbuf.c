@@ -33,8 +33,6 @@
 #include "vmwgfx_so.h"
 #include "vmwgfx_binding.h"
 
-#define VMW_RES_HT_ORDER 12
-
 /*
  * Helper macro to get dx_ctx_node if available otherwise print an error
  * message. This is for use in command verifier function where if dx_ctx_node
@@ -3642,7 +3640,7 @@ int vmw_execbuf_process(struct drm_file *file_priv,
 	int ret;
 	int32_t out_fence_fd = -1;
 	struct sync_file *sync_file = NULL;
-	DECLARE_VAL_CONTEXT(val_ctx, &sw_context->res_ht, 1);
+	DECLARE_VAL_CONTEXT(val_ctx, &sw_context->val_arena, 1);
 
 	vmw_validation_set_val_mem(&val_ctx, &dev_priv->vvm);
 
@@ -3710,14 +3708,6 @@ int vmw_execbuf_process(struct drm_file *file_priv,
 	if (sw_context->staged_bindings)
 		vmw_binding_state_reset(sw_context->staged_bindings);
 
-	if (!sw_context->res_ht_initialized) {
-		ret = drm_ht_create(&sw_context->res_ht, VMW_RES_HT_ORDER);
-		if (unlikely(ret != 0))
-			goto out_unlock;
-
-		sw_context->res_ht_initialized = true;
-	}
-
 	INIT_LIST_HEAD(&sw_context->staged_cmd_res);
 	sw_context->ctx = &val_ctx;
 	ret = vmw_execbuf_tie_context(dev_priv, sw_context, dx_context_handle);
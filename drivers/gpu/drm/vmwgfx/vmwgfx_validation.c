@@ -32,7 +32,6 @@
 /**
  * struct vmw_validation_bo_node - Buffer object validation metadata.
  * @base: Metadata used for TTM reservation- and validation.
- * @hash: A hash entry used for the duplicate detection hash table.
  * @as_mob: Validate as mob.
  * @cpu_blit: Validate for cpu blit access.
  *
@@ -41,7 +40,6 @@
  */
 struct vmw_validation_bo_node {
 	struct ttm_validate_buffer base;
-	struct drm_hash_item hash;
 	u32 as_mob : 1;
 	u32 cpu_blit : 1;
 };
@@ -49,7 +47,6 @@ struct vmw_validation_bo_node {
 /**
  * struct vmw_validation_res_node - Resource validation metadata.
  * @head: List head for the resource validation list.
- * @hash: A hash entry used for the duplicate detection hash table.
  * @res: Reference counted resource pointer.
  * @new_backup: Non ref-counted pointer to new backup buffer to be assigned
  * to a resource.
@@ -68,7 +65,6 @@ struct vmw_validation_bo_node {
  */
 struct vmw_validation_res_node {
 	struct list_head head;
-	struct drm_hash_item hash;
 	struct vmw_resource *res;
 	struct vmw_buffer_object *new_backup;
 	unsigned long new_backup_offset;
@@ -81,6 +77,89 @@ struct vmw_validation_res_node {
 	unsigned long private[0];
 };
 
+/**
+ * vmw_validation_get_page - Get a zeroed page for the validation context
+ * @ctx: The validation context
+ *
+ * Pages cached in the context's arena are handed out before falling back
+ * to the page allocator.
+ *
+ * Return: Pointer to the page on success. NULL on failure.
+ */
+static struct page *vmw_validation_get_page(struct vmw_validation_context *ctx)
+{
+	struct vmw_validation_arena *arena = ctx->arena;
+	struct page *page = NULL;
+
+	if (arena) {
+		spin_lock(&arena->lock);
+		if (arena->num_pages) {
+#ifdef __linux__
+			page = list_first_entry(&arena->page_list, struct page,
+						lru);
+			list_del(&page->lru);
+#elif defined(__FreeBSD__)
+			page = TAILQ_FIRST(&arena->bsd_pglist);
+			TAILQ_REMOVE(&arena->bsd_pglist, page, plinks.q);
+#endif
+			arena->num_pages--;
+			arena->num_page_reuses++;
+		}
+		spin_unlock(&arena->lock);
+		if (page)
+			return page;
+	}
+
+	page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if (page && arena) {
+		spin_lock(&arena->lock);
+		arena->num_page_allocs++;
+		spin_unlock(&arena->lock);
+	}
+
+	return page;
+}
+
+/**
+ * vmw_validation_put_page - Return a page to the context's arena
+ * @ctx: The validation context
+ * @page: The page, already removed from the context's page list
+ *
+ * The used part of the page is cleared so that the arena only holds
+ * zeroed pages.
+ *
+ * Return: true if the page was cached, false if the caller needs to free it.
+ */
+static bool vmw_validation_put_page(struct vmw_validation_context *ctx,
+				    struct page *page)
+{
+	struct vmw_validation_arena *arena = ctx->arena;
+	u8 *addr = page_address(page);
+	bool cached = false;
+
+	if (!arena || READ_ONCE(arena->num_pages) >= arena->max_pages)
+		return false;
+
+	if (addr == ctx->page_address)
+		memset(addr, 0, PAGE_SIZE - ctx->mem_size_left);
+	else
+		memset(addr, 0, PAGE_SIZE);
+
+	spin_lock(&arena->lock);
+	if (arena->num_pages < arena->max_pages) {
+#ifdef __linux__
+		list_add(&page->lru, &arena->page_list);
+#elif defined(__FreeBSD__)
+		TAILQ_INSERT_HEAD(&arena->bsd_pglist, page, plinks.q);
+#endif
+		arena->num_pages++;
+		cached = true;
+	}
+	spin_unlock(&arena->lock);
+
+	return cached;
+}
+
 /**
  * vmw_validation_mem_alloc - Allocate kernel memory from the validation
  * context based allocator
@@ -118,7 +197,7 @@ void *vmw_validation_mem_alloc(struct vmw_validation_context *ctx,
 			ctx->total_mem += ctx->vm->gran;
 		}
 
-		page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		page = vmw_validation_get_page(ctx);
 		if (!page)
 			return NULL;
 
@@ -146,23 +225,36 @@ void *vmw_validation_mem_alloc(struct vmw_validation_context *ctx,
  * @ctx: The validation context
  *
  * All memory previously allocated for this context using
- * vmw_validation_mem_alloc() is freed.
+ * vmw_validation_mem_alloc() is freed, or returned to the context's arena
+ * for reuse by the next validation context.
  */
 static void vmw_validation_mem_free(struct vmw_validation_context *ctx)
 {
 	struct page *entry, *next;
 
+	vmw_validation_drop_ht(ctx);
+
 #ifdef __linux__
 	list_for_each_entry_safe(entry, next, &ctx->page_list, lru) {
 		list_del_init(&entry->lru);
-		__free_page(entry);
+		if (!vmw_validation_put_page(ctx, entry))
+			__free_page(entry);
 	}
 #elif defined(__FreeBSD__)
 	TAILQ_FOREACH_SAFE(entry, &ctx->bsd_pglist, plinks.q, next) {
-		__free_page(entry);
+		TAILQ_REMOVE(&ctx->bsd_pglist, entry, plinks.q);
+		if (!vmw_validation_put_page(ctx, entry))
+			__free_page(entry);
 	}
 #endif
 
+	if (ctx->arena) {
+		spin_lock(&ctx->arena->lock);
+		ctx->arena->num_submissions++;
+		spin_unlock(&ctx->arena->lock);
+	}
+
+	ctx->page_address = NULL;
 	ctx->mem_size_left = 0;
 	if (ctx->vm && ctx->total_mem) {
 		ctx->vm->unreserve_mem(ctx->vm, ctx->total_mem);
@@ -189,11 +281,9 @@ vmw_validation_find_bo_dup(struct vmw_validation_context *ctx,
 	if (!ctx->merge_dups)
 		return NULL;
 
-	if (ctx->ht) {
-		struct drm_hash_item *hash;
-
-		if (!drm_ht_find_item(ctx->ht, (unsigned long) vbo, &hash))
-			bo_node = container_of(hash, typeof(*bo_node), hash);
+	if (ctx->dups) {
+		bo_node = vmw_validation_dup_find(&ctx->dups->dups,
+						  (unsigned long) vbo);
 	} else {
 		struct  vmw_validation_bo_node *entry;
 
@@ -226,11 +316,9 @@ vmw_validation_find_res_dup(struct vmw_validation_context *ctx,
 	if (!ctx->merge_dups)
 		return NULL;
 
-	if (ctx->ht) {
-		struct drm_hash_item *hash;
-
-		if (!drm_ht_find_item(ctx->ht, (unsigned long) res, &hash))
-			res_node = container_of(hash, typeof(*res_node), hash);
+	if (ctx->dups) {
+		res_node = vmw_validation_dup_find(&ctx->dups->dups,
+						   (unsigned long) res);
 	} else {
 		struct  vmw_validation_res_node *entry;
 
@@ -284,9 +372,10 @@ int vmw_validation_add_bo(struct vmw_validation_context *ctx,
 		if (!bo_node)
 			return -ENOMEM;
 
-		if (ctx->ht) {
-			bo_node->hash.key = (unsigned long) vbo;
-			ret = drm_ht_insert_item(ctx->ht, &bo_node->hash);
+		if (ctx->dups) {
+			ret = vmw_validation_dup_insert(&ctx->dups->dups,
+							(unsigned long) vbo,
+							bo_node);
 			if (ret) {
 				DRM_ERROR("Failed to initialize a buffer "
 					  "validation entry.\n");
@@ -339,9 +428,9 @@ int vmw_validation_add_resource(struct vmw_validation_context *ctx,
 		return -ENOMEM;
 	}
 
-	if (ctx->ht) {
-		node->hash.key = (unsigned long) res;
-		ret = drm_ht_insert_item(ctx->ht, &node->hash);
+	if (ctx->dups) {
+		ret = vmw_validation_dup_insert(&ctx->dups->dups,
+						(unsigned long) res, node);
 		if (ret) {
 			DRM_ERROR("Failed to initialize a resource validation "
 				  "entry.\n");
@@ -633,35 +722,25 @@ int vmw_validation_res_validate(struct vmw_validation_context *ctx, bool intr)
 }
 
 /**
- * vmw_validation_drop_ht - Reset the hash table used for duplicate finding
+ * vmw_validation_drop_ht - Reset the table used for duplicate finding
  * and unregister it from this validation context.
  * @ctx: The validation context.
  *
- * The hash table used for duplicate finding is an expensive resource and
- * may be protected by mutexes that may cause deadlocks during resource
- * unreferencing if held. After resource- and buffer object registering,
- * there is no longer any use for this hash table, so allow freeing it
- * either to shorten any mutex locking time, or before resources- and
- * buffer objects are freed during validation context cleanup.
+ * The duplicate table is shared with other validation contexts through the
+ * arena, and is protected by the lock serializing those. After resource- and
+ * buffer object registering, there is no longer any use for this table, so
+ * allow resetting it either to shorten any mutex locking time, or before
+ * resources- and buffer objects are freed during validation context cleanup.
+ * A table that has grown much larger than this submission needed is freed,
+ * so that it is sized to the next submission.
  */
 void vmw_validation_drop_ht(struct vmw_validation_context *ctx)
 {
-	struct vmw_validation_bo_node *entry;
-	struct vmw_validation_res_node *val;
-
-	if (!ctx->ht)
+	if (!ctx->dups)
 		return;
 
-	list_for_each_entry(entry, &ctx->bo_list, base.head)
-		(void) drm_ht_remove_item(ctx->ht, &entry->hash);
-
-	list_for_each_entry(val, &ctx->resource_list, head)
-		(void) drm_ht_remove_item(ctx->ht, &val->hash);
-
-	list_for_each_entry(val, &ctx->resource_ctx_list, head)
-		(void) drm_ht_remove_item(ctx->ht, &val->hash);
-
-	ctx->ht = NULL;
+	vmw_validation_dup_reset(&ctx->dups->dups);
+	ctx->dups = NULL;
 }
 
 /**
@@ -838,3 +917,47 @@ int vmw_validation_preload_res(struct vmw_validation_context *ctx,
 	ctx->mem_size_left += size;
 	return 0;
 }
+
+/**
+ * vmw_validation_arena_init - Initialize a validation arena
+ * @arena: The arena to initialize
+ * @max_pages: Maximum number of pages kept cached between submissions
+ */
+void vmw_validation_arena_init(struct vmw_validation_arena *arena,
+			       unsigned int max_pages)
+{
+	memset(arena, 0, sizeof(*arena));
+	spin_lock_init(&arena->lock);
+#ifdef __linux__
+	INIT_LIST_HEAD(&arena->page_list);
+#elif defined(__FreeBSD__)
+	TAILQ_INIT(&arena->bsd_pglist);
+#endif
+	arena->max_pages = max_pages;
+}
+
+/**
+ * vmw_validation_arena_fini - Free the memory cached by a validation arena
+ * @arena: The arena
+ *
+ * No validation context may be using the arena.
+ */
+void vmw_validation_arena_fini(struct vmw_validation_arena *arena)
+{
+	struct page *entry, *next;
+
+#ifdef __linux__
+	list_for_each_entry_safe(entry, next, &arena->page_list, lru) {
+		list_del_init(&entry->lru);
+		__free_page(entry);
+	}
+#elif defined(__FreeBSD__)
+	TAILQ_FOREACH_SAFE(entry, &arena->bsd_pglist, plinks.q, next) {
+		TAILQ_REMOVE(&arena->bsd_pglist, entry, plinks.q);
+		__free_page(entry);
+	}
+#endif
+	arena->num_pages = 0;
+
+	vmw_validation_dup_fini(&arena->dups);
+}
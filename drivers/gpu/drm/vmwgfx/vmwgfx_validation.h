@@ -28,11 +28,14 @@
 #ifndef _VMWGFX_VALIDATION_H_
 #define _VMWGFX_VALIDATION_H_
 
-#include <drm/drm_hashtab.h>
 #include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/spinlock.h>
 #include <linux/ww_mutex.h>
 #include <drm/ttm/ttm_execbuf_util.h>
 
+#include "vmwgfx_validation_dup.h"
+
 #define VMW_RES_DIRTY_NONE 0
 #define VMW_RES_DIRTY_SET BIT(0)
 #define VMW_RES_DIRTY_CLEAR BIT(1)
@@ -52,9 +55,42 @@ struct vmw_validation_mem {
 	size_t gran;
 };
 
+/**
+ * struct vmw_validation_arena - Validation memory and duplicate finding
+ * state cached across command submissions
+ * @lock: Protects the page cache and its counters
+ * @page_list: Pages available for the next validation context
+ * @num_pages: Number of pages in @page_list
+ * @max_pages: Maximum number of pages kept cached after a submission
+ * @dups: Table used to find resource- or buffer object duplicates
+ * @num_submissions: Number of validation contexts that used the arena
+ * @num_page_allocs: Number of pages allocated from the page allocator
+ * @num_page_reuses: Number of pages handed out from @page_list
+ *
+ * Validation memory may be released after the lock serializing the
+ * validation contexts has been dropped, so the page cache has its own
+ * lock. The duplicate table is only used under the serializing lock.
+ */
+struct vmw_validation_arena {
+	spinlock_t lock;
+#ifdef __linux__
+	struct list_head page_list;
+#elif defined(__FreeBSD__)
+	struct pglist bsd_pglist;
+#endif
+	unsigned int num_pages;
+	unsigned int max_pages;
+	struct vmw_validation_dup_table dups;
+	u64 num_submissions;
+	u64 num_page_allocs;
+	u64 num_page_reuses;
+};
+
 /**
  * struct vmw_validation_context - Per command submission validation context
- * @ht: Hash table used to find resource- or buffer object duplicates
+ * @arena: Memory cached across submissions, or NULL
+ * @dups: Arena whose duplicate table is used to find resource- or buffer
+ * object duplicates, or NULL
  * @resource_list: List head for resource validation metadata
  * @resource_ctx_list: List head for resource validation metadata for
  * resources that need to be validated before those in @resource_list
@@ -72,7 +108,8 @@ struct vmw_validation_mem {
  * @total_mem: Amount of reserved memory.
  */
 struct vmw_validation_context {
-	struct drm_open_hash *ht;
+	struct vmw_validation_arena *arena;
+	struct vmw_validation_arena *dups;
 	struct list_head resource_list;
 	struct list_head resource_ctx_list;
 	struct list_head bo_list;
@@ -99,17 +136,18 @@ struct vmw_fence_obj;
 /**
  * DECLARE_VAL_CONTEXT - Declare a validation context with initialization
  * @_name: The name of the variable
- * @_ht: The hash table used to find dups or NULL if none
+ * @_arena: The arena used for memory and to find dups or NULL if none
  * @_merge_dups: Whether to merge duplicate buffer object- or resource
- * entries. If set to true, ideally a hash table pointer should be supplied
+ * entries. If set to true, ideally an arena pointer should be supplied
  * as well unless the number of resources and buffer objects per validation
  * is known to be very small
  */
 #endif
 #ifdef __linux__
-#define DECLARE_VAL_CONTEXT(_name, _ht, _merge_dups)			\
+#define DECLARE_VAL_CONTEXT(_name, _arena, _merge_dups)		\
 	struct vmw_validation_context _name =				\
-	{ .ht = _ht,							\
+	{ .arena = _arena,						\
+	  .dups = _arena,						\
 	  .resource_list = LIST_HEAD_INIT((_name).resource_list),	\
 	  .resource_ctx_list = LIST_HEAD_INIT((_name).resource_ctx_list), \
 	  .bo_list = LIST_HEAD_INIT((_name).bo_list),			\
@@ -119,9 +157,10 @@ struct vmw_fence_obj;
 	  .mem_size_left = 0,						\
 	}
 #elif defined(__FreeBSD__)
-#define DECLARE_VAL_CONTEXT(_name, _ht, _merge_dups)			\
+#define DECLARE_VAL_CONTEXT(_name, _arena, _merge_dups)		\
 	struct vmw_validation_context _name;				\
-	(_name).ht = _ht;						\
+	(_name).arena = _arena;						\
+	(_name).dups = _arena;						\
 	(_name).res_mutex = NULL;					\
 	(_name).merge_dups = _merge_dups;				\
 	(_name).mem_size_left = 0;					\
@@ -161,16 +200,19 @@ vmw_validation_set_val_mem(struct vmw_validation_context *ctx,
 }
 
 /**
- * vmw_validation_set_ht - Register a hash table for duplicate finding
+ * vmw_validation_set_arena - Register an arena for memory allocation and
+ * duplicate finding
  * @ctx: The validation context
- * @ht: Pointer to a hash table to use for duplicate finding
- * This function is intended to be used if the hash table wasn't
+ * @arena: Pointer to the arena to use
+ * This function is intended to be used if the arena wasn't
  * available at validation context declaration time
  */
-static inline void vmw_validation_set_ht(struct vmw_validation_context *ctx,
-					 struct drm_open_hash *ht)
+static inline void
+vmw_validation_set_arena(struct vmw_validation_context *ctx,
+			 struct vmw_validation_arena *arena)
 {
-	ctx->ht = ht;
+	ctx->arena = arena;
+	ctx->dups = arena;
 }
 
 /**
@@ -286,4 +328,7 @@ int vmw_validation_preload_res(struct vmw_validation_context *ctx,
 			       unsigned int size);
 void vmw_validation_res_set_dirty(struct vmw_validation_context *ctx,
 				  void *val_private, u32 dirty);
+void vmw_validation_arena_init(struct vmw_validation_arena *arena,
+			       unsigned int max_pages);
+void vmw_validation_arena_fini(struct vmw_validation_arena *arena);
 #endif
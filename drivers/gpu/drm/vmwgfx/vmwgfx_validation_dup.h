@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+/**************************************************************************
+ *
+ * Copyright © 2018 VMware, Inc., Palo Alto, CA., USA
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#ifndef _VMWGFX_VALIDATION_DUP_H_
+#define _VMWGFX_VALIDATION_DUP_H_
+
+/*
+ * Duplicate finding table for the validation code. This is kept free of
+ * kernel includes so that scripts/vmwvaltest.c can build it on the host and
+ * time it against the drm_open_hash it replaced. The includer provides the
+ * kernel types, BITS_PER_LONG, kvcalloc(), kvfree() and memset().
+ */
+
+/* Smallest duplicate table, in log2 of the number of slots. */
+#define VMW_VALIDATION_DUP_MIN_ORDER 6
+
+/**
+ * struct vmw_validation_dup_entry - Duplicate finding table slot
+ * @key: The buffer object or resource address, 0 if the slot is free.
+ * @node: The validation metadata registered for @key.
+ */
+struct vmw_validation_dup_entry {
+	unsigned long key;
+	void *node;
+};
+
+/**
+ * struct vmw_validation_dup_table - Open-addressed table used to find
+ * resource- or buffer object duplicates
+ * @entries: The slots, or NULL if none are allocated
+ * @order: log2 of the number of slots in @entries
+ * @count: Number of used slots in @entries
+ * @num_lookups: Number of lookups
+ * @num_hits: Number of lookups finding an entry
+ * @num_resizes: Number of reallocations of @entries
+ */
+struct vmw_validation_dup_table {
+	struct vmw_validation_dup_entry *entries;
+	unsigned int order;
+	unsigned int count;
+	u64 num_lookups;
+	u64 num_hits;
+	u64 num_resizes;
+};
+
+/**
+ * vmw_validation_dup_hash - Hash a key to its home slot
+ * @key: The buffer object or resource address
+ * @order: log2 of the number of slots
+ *
+ * This is Linux' hash_long(). The LinuxKPI one hashes the key bytewise into
+ * 32 bits and then shifts by the long size, which leaves 0 for every key on
+ * 64-bit FreeBSD, so that all keys would probe from the first slot.
+ *
+ * Return: The home slot of @key.
+ */
+static inline unsigned int
+vmw_validation_dup_hash(unsigned long key, unsigned int order)
+{
+#if BITS_PER_LONG == 64
+	return (u64)key * 0x61C8864680B583EBull >> (64 - order);
+#else
+	return (u32)key * 0x61C88647U >> (32 - order);
+#endif
+}
+
+/**
+ * vmw_validation_dup_slot - Find the duplicate table slot of a key
+ * @dups: The duplicate table
+ * @key: The buffer object or resource address
+ *
+ * Return: The slot holding @key, or the free slot where it would be
+ * inserted.
+ */
+static inline struct vmw_validation_dup_entry *
+vmw_validation_dup_slot(struct vmw_validation_dup_table *dups,
+			unsigned long key)
+{
+	unsigned int mask = (1U << dups->order) - 1;
+	unsigned int i = vmw_validation_dup_hash(key, dups->order);
+
+	while (dups->entries[i].key && dups->entries[i].key != key)
+		i = (i + 1) & mask;
+
+	return &dups->entries[i];
+}
+
+/**
+ * vmw_validation_dup_find - Look up a key in the duplicate table
+ * @dups: The duplicate table
+ * @key: The buffer object or resource address
+ *
+ * Return: The validation metadata registered for @key, or NULL.
+ */
+static inline void *
+vmw_validation_dup_find(struct vmw_validation_dup_table *dups,
+			unsigned long key)
+{
+	struct vmw_validation_dup_entry *entry;
+
+	dups->num_lookups++;
+	if (!dups->count)
+		return NULL;
+
+	entry = vmw_validation_dup_slot(dups, key);
+	if (!entry->key)
+		return NULL;
+
+	dups->num_hits++;
+	return entry->node;
+}
+
+/**
+ * vmw_validation_dup_resize - Reallocate the duplicate table
+ * @dups: The duplicate table
+ * @order: log2 of the new number of slots
+ *
+ * Return: Zero on success, -ENOMEM on failure.
+ */
+static inline int
+vmw_validation_dup_resize(struct vmw_validation_dup_table *dups,
+			  unsigned int order)
+{
+	struct vmw_validation_dup_entry *old = dups->entries;
+	unsigned int old_size = old ? 1U << dups->order : 0;
+	unsigned int i;
+
+	dups->entries = kvcalloc(1U << order, sizeof(*dups->entries),
+				 GFP_KERNEL);
+	if (!dups->entries) {
+		dups->entries = old;
+		return -ENOMEM;
+	}
+
+	dups->order = order;
+	for (i = 0; i < old_size; ++i) {
+		if (old[i].key)
+			*vmw_validation_dup_slot(dups, old[i].key) = old[i];
+	}
+
+	kvfree(old);
+	dups->num_resizes++;
+
+	return 0;
+}
+
+/**
+ * vmw_validation_dup_insert - Register validation metadata for duplicate
+ * finding
+ * @dups: The duplicate table
+ * @key: The buffer object or resource address, not yet in the table
+ * @node: The validation metadata
+ *
+ * The table is kept at most half full, growing as the submission
+ * registers more buffer objects and resources.
+ *
+ * Return: Zero on success, -ENOMEM on failure.
+ */
+static inline int
+vmw_validation_dup_insert(struct vmw_validation_dup_table *dups,
+			  unsigned long key, void *node)
+{
+	struct vmw_validation_dup_entry *entry;
+	int ret;
+
+	if (!dups->entries || 2 * (dups->count + 1) > (1U << dups->order)) {
+		ret = vmw_validation_dup_resize(dups, dups->entries ?
+						dups->order + 1 :
+						VMW_VALIDATION_DUP_MIN_ORDER);
+		if (ret)
+			return ret;
+	}
+
+	entry = vmw_validation_dup_slot(dups, key);
+	entry->key = key;
+	entry->node = node;
+	dups->count++;
+
+	return 0;
+}
+
+/**
+ * vmw_validation_dup_reset - Empty the duplicate table
+ * @dups: The duplicate table
+ *
+ * A table that has grown much larger than the last submission needed is
+ * freed, so that it is sized to the next submission.
+ */
+static inline void
+vmw_validation_dup_reset(struct vmw_validation_dup_table *dups)
+{
+	unsigned int size;
+
+	if (!dups->entries)
+		return;
+
+	size = 1U << dups->order;
+	if (dups->order > VMW_VALIDATION_DUP_MIN_ORDER &&
+	    dups->count * 16 < size) {
+		kvfree(dups->entries);
+		dups->entries = NULL;
+		dups->order = 0;
+	} else if (dups->count) {
+		memset(dups->entries, 0, size * sizeof(*dups->entries));
+	}
+	dups->count = 0;
+}
+
+/**
+ * vmw_validation_dup_fini - Free the duplicate table
+ * @dups: The duplicate table
+ */
+static inline void
+vmw_validation_dup_fini(struct vmw_validation_dup_table *dups)
+{
+	kvfree(dups->entries);
+	dups->entries = NULL;
+	dups->order = 0;
+	dups->count = 0;
+}
+
+#endif
@@ -24,22 +24,176 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <linux/device.h>
 #include <linux/module.h>
 
+#include <drm/drm_atomic_helper.h>
+#include <drm/drm_drv.h>
+#include <drm/drm_gem_framebuffer_helper.h>
+#include <drm/drm_probe_helper.h>
+#include <drm/drm_vblank.h>
+
 #include "dummygfx_drv.h"
 
+#define	DRIVER_NAME	"dummygfx"
+#define	DRIVER_DESC	"Virtual KMS/GEM device for testing"
+#define	DRIVER_DATE	"20191001"
+#define	DRIVER_MAJOR	1
+#define	DRIVER_MINOR	0
+
+static bool dummygfx_enable = true;
+MODULE_PARM_DESC(enable, "Create the virtual DRM device (default true)");
+module_param_named(enable, dummygfx_enable, bool, 0444);
+
+static struct class *dummygfx_class;
+static struct dummygfx_device *dummygfx_device;
+
+static const struct drm_mode_config_funcs dummygfx_mode_funcs = {
+	.fb_create	= drm_gem_fb_create,
+	.atomic_check	= drm_atomic_helper_check,
+	.atomic_commit	= drm_atomic_helper_commit,
+};
+
+DEFINE_DRM_GEM_FOPS(dummygfx_fops);
+
+static struct drm_driver dummygfx_driver = {
+	.driver_features	= DRIVER_MODESET | DRIVER_ATOMIC | DRIVER_GEM |
+	    DRIVER_SYNCOBJ | DRIVER_SYNCOBJ_TIMELINE,
+	.fops			= &dummygfx_fops,
+	.gem_free_object_unlocked = dummygfx_gem_free_object,
+	.gem_vm_ops		= &dummygfx_gem_vm_ops,
+	.dumb_create		= dummygfx_dumb_create,
+	.dumb_map_offset	= drm_gem_dumb_map_offset,
+	.prime_handle_to_fd	= drm_gem_prime_handle_to_fd,
+	.prime_fd_to_handle	= drm_gem_prime_fd_to_handle,
+	.gem_prime_get_sg_table	= dummygfx_gem_prime_get_sg_table,
+	.get_vblank_timestamp	= dummygfx_get_vblank_timestamp,
+	.debugfs_init		= dummygfx_debugfs_stats_init,
+
+	.name			= DRIVER_NAME,
+	.desc			= DRIVER_DESC,
+	.date			= DRIVER_DATE,
+	.major			= DRIVER_MAJOR,
+	.minor			= DRIVER_MINOR,
+};
+
+static int
+dummygfx_modeset_init(struct dummygfx_device *dgfx)
+{
+	struct drm_device *dev = &dgfx->drm;
+	int ret;
+
+	drm_mode_config_init(dev);
+	dev->mode_config.funcs = &dummygfx_mode_funcs;
+	dev->mode_config.min_width = DUMMYGFX_XRES_MIN;
+	dev->mode_config.min_height = DUMMYGFX_YRES_MIN;
+	dev->mode_config.max_width = DUMMYGFX_XRES_MAX;
+	dev->mode_config.max_height = DUMMYGFX_YRES_MAX;
+	dev->mode_config.preferred_depth = 24;
+
+	ret = dummygfx_output_init(dgfx);
+	if (ret != 0)
+		return (ret);
+
+	drm_mode_config_reset(dev);
+	return (0);
+}
+
+static int
+dummygfx_device_create(void)
+{
+	struct dummygfx_device *dgfx;
+	struct device *parent;
+	int ret;
+
+	/*
+	 * There is no bus to attach to, hang a device off the root so the
+	 * DRM core has a parent with a newbus device behind it.
+	 */
+	dummygfx_class = class_create(THIS_MODULE, DRIVER_NAME);
+	if (IS_ERR(dummygfx_class))
+		return (PTR_ERR(dummygfx_class));
+	parent = device_create(dummygfx_class, &linux_root_device, 0, NULL,
+	    DRIVER_NAME);
+	if (IS_ERR(parent)) {
+		ret = PTR_ERR(parent);
+		goto err_class;
+	}
+
+	dgfx = kzalloc(sizeof(*dgfx), GFP_KERNEL);
+	if (dgfx == NULL) {
+		ret = -ENOMEM;
+		goto err_parent;
+	}
+	dgfx->parent = parent;
+
+	ret = drm_dev_init(&dgfx->drm, &dummygfx_driver, parent);
+	if (ret != 0) {
+		kfree(dgfx);
+		goto err_parent;
+	}
+	dgfx->drm.dev_private = dgfx;
+
+	ret = dummygfx_modeset_init(dgfx);
+	if (ret != 0)
+		goto err_dev;
+
+	ret = drm_vblank_init(&dgfx->drm, 1);
+	if (ret != 0)
+		goto err_dev;
+
+	ret = drm_dev_register(&dgfx->drm, 0);
+	if (ret != 0)
+		goto err_dev;
+
+	dummygfx_device = dgfx;
+	return (0);
+
+err_dev:
+	drm_mode_config_cleanup(&dgfx->drm);
+	drm_dev_put(&dgfx->drm);
+err_parent:
+	device_destroy(dummygfx_class, 0);
+err_class:
+	class_destroy(dummygfx_class);
+	dummygfx_class = NULL;
+	return (ret);
+}
+
+static void
+dummygfx_device_destroy(void)
+{
+	struct dummygfx_device *dgfx = dummygfx_device;
+
+	if (dgfx == NULL)
+		return;
+
+	drm_dev_unregister(&dgfx->drm);
+	drm_atomic_helper_shutdown(&dgfx->drm);
+	drm_mode_config_cleanup(&dgfx->drm);
+	kvfree(dgfx->output.compose_buf);
+	drm_dev_put(&dgfx->drm);
+	device_destroy(dummygfx_class, 0);
+	class_destroy(dummygfx_class);
+	dummygfx_class = NULL;
+	dummygfx_device = NULL;
+}
+
 static int __init dummygfx_init(void)
 {
 	int ret;
 
 	dummygfx_debugfs_init();
 	ret = 0;
+	if (dummygfx_enable)
+		ret = dummygfx_device_create();
 	return ret;
 }
 
 static void __exit dummygfx_exit(void)
 {
 
+	dummygfx_device_destroy();
 	dummygfx_debugfs_exit();
 }
 
@@ -24,7 +24,123 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifndef _DUMMYGFX_DRV_H_
+#define	_DUMMYGFX_DRV_H_
+
+#include <linux/hrtimer.h>
+
 #include <drm/drmP.h>
+#include <drm/drm_atomic.h>
+#include <drm/drm_gem.h>
+#include <drm/drm_writeback.h>
+
+#define	DUMMYGFX_XRES_MIN	32
+#define	DUMMYGFX_YRES_MIN	32
+#define	DUMMYGFX_XRES_MAX	8192
+#define	DUMMYGFX_YRES_MAX	8192
+#define	DUMMYGFX_XRES_DEF	1024
+#define	DUMMYGFX_YRES_DEF	768
+
+/*
+ * GEM object backed by individually allocated system pages.
+ */
+struct dummygfx_gem_object {
+	struct drm_gem_object	base;
+	struct page		**pages;
+	unsigned long		npages;
+};
+
+#define	to_dummygfx_bo(obj) \
+	container_of(obj, struct dummygfx_gem_object, base)
+
+/*
+ * Counters exported through debugfs, protected by the output lock.
+ */
+struct dummygfx_stats {
+	u64	commits;
+	u64	vblanks;
+	u64	events;
+	u64	event_latency_ns;
+	u64	event_latency_max_ns;
+	u64	composed;
+	u64	compose_ns;
+	u64	writebacks;
+};
+
+/*
+ * A single virtual output: one CRTC with a primary plane, a virtual
+ * encoder and an always connected virtual connector, plus a writeback
+ * connector on the same CRTC.  Vblanks are generated by an hrtimer
+ * running at the mode's refresh rate.
+ */
+struct dummygfx_output {
+	struct drm_crtc		crtc;
+	struct drm_plane	primary;
+	struct drm_encoder	encoder;
+	struct drm_connector	connector;
+	struct drm_writeback_connector wb_connector;
 
+	struct hrtimer		vblank_hrtimer;
+	ktime_t			period_ns;
+	spinlock_t		lock;	/* event and compose state, stats */
+
+	/*
+	 * Time of the last simulated vblank.  Vblanks stay on the grid
+	 * vblank_ns + n * period_ns while the interrupt is off, which gives
+	 * precise timestamps like a scanout position would.
+	 */
+	u64			vblank_ns;
+
+	/* time the currently armed flip event was queued, 0 if none */
+	u64			event_armed_ns;
+
+	/*
+	 * CPU composition: on every vblank the scanned out framebuffer is
+	 * copied into a crtc sized XRGB8888 buffer and checksummed, to model
+	 * the memory traffic of a real scanout.
+	 */
+	struct work_struct	compose_work;
+	struct drm_framebuffer	*compose_fb;
+	u32			*compose_buf;
+	size_t			compose_size;
+	unsigned int		compose_width;
+	unsigned int		compose_height;
+	u32			checksum;
+
+	/*
+	 * Writeback jobs queued on wb_connector and not completed yet.  The
+	 * compose work copies the composed frame into each of them in queue
+	 * order.
+	 */
+	unsigned int		wb_pending;
+};
+
+struct dummygfx_device {
+	struct drm_device	drm;
+	struct device		*parent;
+	struct dummygfx_output	output;
+	struct dummygfx_stats	stats;
+};
+
+#define	to_dummygfx(dev) container_of(dev, struct dummygfx_device, drm)
+
+/* dummygfx_gem.c */
+int dummygfx_dumb_create(struct drm_file *file, struct drm_device *dev,
+    struct drm_mode_create_dumb *args);
+extern const struct vm_operations_struct dummygfx_gem_vm_ops;
+void dummygfx_gem_free_object(struct drm_gem_object *obj);
+void *dummygfx_gem_vmap(struct dummygfx_gem_object *bo);
+void dummygfx_gem_vunmap(struct dummygfx_gem_object *bo, void *vaddr);
+struct sg_table *dummygfx_gem_prime_get_sg_table(struct drm_gem_object *obj);
+
+/* dummygfx_output.c */
+int dummygfx_output_init(struct dummygfx_device *dgfx);
+bool dummygfx_get_vblank_timestamp(struct drm_device *dev, unsigned int pipe,
+    int *max_error, ktime_t *vblank_time, bool in_vblank_irq);
+int dummygfx_debugfs_stats_init(struct drm_minor *minor);
+
+/* dummygfx_debugfs.c */
 int dummygfx_debugfs_init(void);
 void dummygfx_debugfs_exit(void);
+
+#endif /* _DUMMYGFX_DRV_H_ */
@@ -0,0 +1,203 @@
+/*-
+ * Copyright (c) 2019 Johannes Lundberg <johalun@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice unmodified, this list of conditions, and the following
+ *    disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+
+#include <drm/drm_prime.h>
+
+#include "dummygfx_drv.h"
+
+static void
+dummygfx_gem_free_pages(struct dummygfx_gem_object *bo)
+{
+	unsigned long i;
+
+	if (bo->pages == NULL)
+		return;
+	for (i = 0; i < bo->npages; i++) {
+		if (bo->pages[i] != NULL)
+			__free_page(bo->pages[i]);
+	}
+	kvfree(bo->pages);
+	bo->pages = NULL;
+}
+
+static struct dummygfx_gem_object *
+dummygfx_gem_create(struct drm_device *dev, size_t size)
+{
+	struct dummygfx_gem_object *bo;
+	unsigned long i;
+	int ret;
+
+	size = roundup(size, PAGE_SIZE);
+	if (size == 0)
+		return (ERR_PTR(-EINVAL));
+
+	bo = kzalloc(sizeof(*bo), GFP_KERNEL);
+	if (bo == NULL)
+		return (ERR_PTR(-ENOMEM));
+
+	drm_gem_private_object_init(dev, &bo->base, size);
+
+	bo->npages = size >> PAGE_SHIFT;
+	bo->pages = kvmalloc_array(bo->npages, sizeof(*bo->pages),
+	    GFP_KERNEL | __GFP_ZERO);
+	if (bo->pages == NULL) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+	for (i = 0; i < bo->npages; i++) {
+		bo->pages[i] = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (bo->pages[i] == NULL) {
+			ret = -ENOMEM;
+			goto fail;
+		}
+	}
+
+	return (bo);
+
+fail:
+	dummygfx_gem_free_pages(bo);
+	drm_gem_object_release(&bo->base);
+	kfree(bo);
+	return (ERR_PTR(ret));
+}
+
+void
+dummygfx_gem_free_object(struct drm_gem_object *obj)
+{
+	struct dummygfx_gem_object *bo = to_dummygfx_bo(obj);
+
+	drm_gem_free_mmap_offset(obj);
+	drm_gem_object_release(obj);
+	dummygfx_gem_free_pages(bo);
+	kfree(bo);
+}
+
+void *
+dummygfx_gem_vmap(struct dummygfx_gem_object *bo)
+{
+
+	return (vmap(bo->pages, bo->npages, VM_MAP, PAGE_KERNEL));
+}
+
+void
+dummygfx_gem_vunmap(struct dummygfx_gem_object *bo, void *vaddr)
+{
+
+	vunmap(vaddr);
+}
+
+struct sg_table *
+dummygfx_gem_prime_get_sg_table(struct drm_gem_object *obj)
+{
+	struct dummygfx_gem_object *bo = to_dummygfx_bo(obj);
+
+	return (drm_prime_pages_to_sg(bo->pages, bo->npages));
+}
+
+int
+dummygfx_dumb_create(struct drm_file *file, struct drm_device *dev,
+    struct drm_mode_create_dumb *args)
+{
+	struct dummygfx_gem_object *bo;
+	int ret;
+
+	args->pitch = DIV_ROUND_UP(args->width * args->bpp, 8);
+	args->size = (u64)args->pitch * args->height;
+
+	bo = dummygfx_gem_create(dev, args->size);
+	if (IS_ERR(bo))
+		return (PTR_ERR(bo));
+
+	ret = drm_gem_handle_create(file, &bo->base, &args->handle);
+	/* drop reference from allocate - handle holds it now */
+	drm_gem_object_put_unlocked(&bo->base);
+
+	return (ret);
+}
+
+#ifdef __linux__
+static vm_fault_t
+dummygfx_gem_fault(struct vm_fault *vmf)
+#elif defined(__FreeBSD__)
+static vm_fault_t
+dummygfx_gem_fault(struct vm_area_struct *dummy, struct vm_fault *vmf)
+#endif
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct dummygfx_gem_object *bo = to_dummygfx_bo(vma->vm_private_data);
+	unsigned long page_offset;
+#ifdef __linux__
+
+	page_offset = (vmf->address - vma->vm_start) >> PAGE_SHIFT;
+	if (page_offset >= bo->npages)
+		return (VM_FAULT_SIGBUS);
+
+	return (vmf_insert_page(vma, vmf->address, bo->pages[page_offset]));
+#elif defined(__FreeBSD__)
+	vm_object_t obj;
+	vm_pindex_t pidx;
+	vm_page_t page;
+	vm_fault_t ret;
+
+	page_offset = (vmf->address - vma->vm_start) >> PAGE_SHIFT;
+	if (page_offset >= bo->npages)
+		return (VM_FAULT_SIGBUS);
+
+	ret = VM_FAULT_NOPAGE;
+	obj = vma->vm_obj;
+	pidx = OFF_TO_IDX(vmf->address);
+	vma->vm_pfn_first = pidx;
+
+	VM_OBJECT_WLOCK(obj);
+retry:
+	page = vm_page_grab(obj, pidx, VM_ALLOC_NOCREAT);
+	if (page == NULL) {
+		page = bo->pages[page_offset];
+		page->oflags &= ~VPO_UNMANAGED;
+		if (!vm_page_busy_acquire(page, VM_ALLOC_WAITFAIL))
+			goto retry;
+		if (vm_page_insert(page, obj, pidx)) {
+			vm_page_xunbusy(page);
+			ret = VM_FAULT_OOM;
+			goto out;
+		}
+		vm_page_valid(page);
+	}
+	vma->vm_pfn_count++;
+out:
+	VM_OBJECT_WUNLOCK(obj);
+	return (ret);
+#endif
+}
+
+const struct vm_operations_struct dummygfx_gem_vm_ops = {
+	.fault = dummygfx_gem_fault,
+	.open = drm_gem_vm_open,
+	.close = drm_gem_vm_close,
+};
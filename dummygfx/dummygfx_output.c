@@ -0,0 +1,617 @@
+/*-
+ * Copyright (c) 2019 Johannes Lundberg <johalun@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice unmodified, this list of conditions, and the following
+ *    disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include <drm/drm_atomic_helper.h>
+#include <drm/drm_debugfs.h>
+#include <drm/drm_fourcc.h>
+#include <drm/drm_gem_framebuffer_helper.h>
+#include <drm/drm_plane_helper.h>
+#include <drm/drm_probe_helper.h>
+#include <drm/drm_vblank.h>
+#include <drm/drm_writeback.h>
+
+#include "dummygfx_drv.h"
+
+#define	to_dummygfx_output(c) container_of(c, struct dummygfx_output, crtc)
+#define	output_to_dummygfx(o) container_of(o, struct dummygfx_device, output)
+#define	wb_to_dummygfx_output(c) \
+	container_of(drm_connector_to_writeback(c), struct dummygfx_output, \
+	    wb_connector)
+
+static const u32 dummygfx_formats[] = {
+	DRM_FORMAT_XRGB8888,
+	DRM_FORMAT_ARGB8888,
+};
+
+static const u32 dummygfx_wb_formats[] = {
+	DRM_FORMAT_XRGB8888,
+};
+
+/*
+ * Composition
+ */
+static void
+dummygfx_compose(struct dummygfx_output *output, struct drm_framebuffer *fb)
+{
+	struct dummygfx_device *dgfx = output_to_dummygfx(output);
+	struct dummygfx_gem_object *bo;
+	unsigned int width, height, x, y;
+	u32 sum, *dst;
+	u8 *vaddr;
+	u64 start;
+
+	start = ktime_get_ns();
+	bo = to_dummygfx_bo(fb->obj[0]);
+	vaddr = dummygfx_gem_vmap(bo);
+	if (vaddr == NULL)
+		return;
+
+	width = min_t(unsigned int, fb->width, output->compose_width);
+	height = min_t(unsigned int, fb->height, output->compose_height);
+	sum = 0;
+	for (y = 0; y < height; y++) {
+		dst = output->compose_buf + y * output->compose_width;
+		memcpy(dst, vaddr + fb->offsets[0] + y * fb->pitches[0],
+		    width * sizeof(u32));
+		for (x = 0; x < width; x++)
+			sum = (sum << 1 | sum >> 31) ^ (dst[x] & 0x00ffffff);
+	}
+	dummygfx_gem_vunmap(bo, vaddr);
+
+	spin_lock_irq(&output->lock);
+	output->checksum = sum;
+	dgfx->stats.composed++;
+	dgfx->stats.compose_ns += ktime_get_ns() - start;
+	spin_unlock_irq(&output->lock);
+}
+
+/* Copy the composed frame into the framebuffer of the oldest writeback job. */
+static int
+dummygfx_writeback(struct dummygfx_output *output)
+{
+	struct drm_writeback_connector *wb = &output->wb_connector;
+	struct drm_writeback_job *job;
+	struct dummygfx_gem_object *bo;
+	struct drm_framebuffer *fb;
+	unsigned int width, height, y;
+	u8 *vaddr;
+
+	/* Jobs are only completed from here, the first one stays put */
+	spin_lock_irq(&wb->job_lock);
+	job = list_first_entry_or_null(&wb->job_queue,
+	    struct drm_writeback_job, list_entry);
+	fb = job != NULL ? job->fb : NULL;
+	spin_unlock_irq(&wb->job_lock);
+	if (fb == NULL)
+		return (-EINVAL);
+	if (output->compose_buf == NULL)
+		return (-ENOMEM);
+
+	bo = to_dummygfx_bo(fb->obj[0]);
+	vaddr = dummygfx_gem_vmap(bo);
+	if (vaddr == NULL)
+		return (-ENOMEM);
+
+	width = min_t(unsigned int, fb->width, output->compose_width);
+	height = min_t(unsigned int, fb->height, output->compose_height);
+	for (y = 0; y < height; y++)
+		memcpy(vaddr + fb->offsets[0] + y * fb->pitches[0],
+		    output->compose_buf + y * output->compose_width,
+		    width * sizeof(u32));
+	dummygfx_gem_vunmap(bo, vaddr);
+
+	return (0);
+}
+
+static void
+dummygfx_compose_work(struct work_struct *work)
+{
+	struct dummygfx_output *output =
+	    container_of(work, struct dummygfx_output, compose_work);
+	struct dummygfx_device *dgfx = output_to_dummygfx(output);
+	struct drm_framebuffer *fb;
+	unsigned int pending;
+
+	spin_lock_irq(&output->lock);
+	fb = output->compose_fb;
+	if (fb != NULL)
+		drm_framebuffer_get(fb);
+	pending = output->wb_pending;
+	output->wb_pending = 0;
+	spin_unlock_irq(&output->lock);
+
+	if (fb != NULL) {
+		if (output->compose_buf != NULL)
+			dummygfx_compose(output, fb);
+		drm_framebuffer_put(fb);
+	}
+
+	for (; pending > 0; pending--) {
+		drm_writeback_signal_completion(&output->wb_connector,
+		    dummygfx_writeback(output));
+		spin_lock_irq(&output->lock);
+		dgfx->stats.writebacks++;
+		spin_unlock_irq(&output->lock);
+	}
+}
+
+/*
+ * CRTC
+ */
+
+/* Latest vblank on the grid at or before @now, called with the lock held. */
+static u64
+dummygfx_vblank_last(struct dummygfx_output *output, u64 now)
+{
+	u64 period = ktime_to_ns(output->period_ns);
+
+	if (now <= output->vblank_ns || period == 0)
+		return (output->vblank_ns);
+	return (output->vblank_ns +
+	    div64_u64(now - output->vblank_ns, period) * period);
+}
+
+static enum hrtimer_restart
+dummygfx_vblank_simulate(struct hrtimer *timer)
+{
+	struct dummygfx_output *output =
+	    container_of(timer, struct dummygfx_output, vblank_hrtimer);
+	struct dummygfx_device *dgfx = output_to_dummygfx(output);
+	unsigned long flags;
+	u64 now, delta;
+	bool compose;
+
+	hrtimer_forward_now(timer, output->period_ns);
+
+	now = ktime_get_ns();
+	spin_lock_irqsave(&output->lock, flags);
+	/*
+	 * The timer was started on the grid and advances by whole periods,
+	 * so the nearest grid point is the vblank this expiry stands for.
+	 */
+	output->vblank_ns = dummygfx_vblank_last(output,
+	    now + ktime_to_ns(output->period_ns) / 2);
+	dgfx->stats.vblanks++;
+	if (output->event_armed_ns != 0) {
+		delta = now - output->event_armed_ns;
+		output->event_armed_ns = 0;
+		dgfx->stats.events++;
+		dgfx->stats.event_latency_ns += delta;
+		if (delta > dgfx->stats.event_latency_max_ns)
+			dgfx->stats.event_latency_max_ns = delta;
+	}
+	compose = output->compose_fb != NULL || output->wb_pending != 0;
+	spin_unlock_irqrestore(&output->lock, flags);
+
+	if (!drm_crtc_handle_vblank(&output->crtc))
+		DRM_DEBUG_DRIVER("dummygfx: failed to handle vblank\n");
+
+	if (compose)
+		schedule_work(&output->compose_work);
+
+	return (HRTIMER_RESTART);
+}
+
+static int
+dummygfx_enable_vblank(struct drm_crtc *crtc)
+{
+	struct dummygfx_output *output = to_dummygfx_output(crtc);
+	struct drm_vblank_crtc *vblank = &crtc->dev->vblank[drm_crtc_index(crtc)];
+	unsigned long flags;
+	u64 now, next;
+
+	drm_calc_timestamping_constants(crtc, &crtc->mode);
+
+	/* Resume on the grid the vblanks kept while the timer was off */
+	now = ktime_get_ns();
+	spin_lock_irqsave(&output->lock, flags);
+	output->period_ns = ktime_set(0, vblank->framedur_ns);
+	if (output->vblank_ns == 0)
+		output->vblank_ns = now;
+	next = dummygfx_vblank_last(output, now) +
+	    ktime_to_ns(output->period_ns);
+	spin_unlock_irqrestore(&output->lock, flags);
+
+	hrtimer_start(&output->vblank_hrtimer, ns_to_ktime(next - now),
+	    HRTIMER_MODE_REL);
+
+	return (0);
+}
+
+bool
+dummygfx_get_vblank_timestamp(struct drm_device *dev, unsigned int pipe,
+    int *max_error, ktime_t *vblank_time, bool in_vblank_irq)
+{
+	struct dummygfx_output *output = &to_dummygfx(dev)->output;
+	unsigned long flags;
+	u64 last;
+
+	spin_lock_irqsave(&output->lock, flags);
+	last = output->vblank_ns != 0 && ktime_to_ns(output->period_ns) != 0 ?
+	    dummygfx_vblank_last(output, ktime_get_ns()) : 0;
+	spin_unlock_irqrestore(&output->lock, flags);
+	if (last == 0)
+		return (false);
+
+	*vblank_time = ns_to_ktime(last);
+	*max_error = 0;
+	return (true);
+}
+
+static void
+dummygfx_disable_vblank(struct drm_crtc *crtc)
+{
+	struct dummygfx_output *output = to_dummygfx_output(crtc);
+
+	hrtimer_cancel(&output->vblank_hrtimer);
+}
+
+static const struct drm_crtc_funcs dummygfx_crtc_funcs = {
+	.set_config		= drm_atomic_helper_set_config,
+	.destroy		= drm_crtc_cleanup,
+	.page_flip		= drm_atomic_helper_page_flip,
+	.reset			= drm_atomic_helper_crtc_reset,
+	.atomic_duplicate_state	= drm_atomic_helper_crtc_duplicate_state,
+	.atomic_destroy_state	= drm_atomic_helper_crtc_destroy_state,
+	.enable_vblank		= dummygfx_enable_vblank,
+	.disable_vblank		= dummygfx_disable_vblank,
+};
+
+static void
+dummygfx_crtc_atomic_enable(struct drm_crtc *crtc,
+    struct drm_crtc_state *old_state)
+{
+	struct dummygfx_output *output = to_dummygfx_output(crtc);
+	const struct drm_display_mode *mode = &crtc->state->mode;
+	size_t size;
+
+	size = (size_t)mode->hdisplay * mode->vdisplay * sizeof(u32);
+	if (size != output->compose_size) {
+		kvfree(output->compose_buf);
+		output->compose_buf = kvzalloc(size, GFP_KERNEL);
+		output->compose_size = output->compose_buf != NULL ? size : 0;
+	}
+	output->compose_width = mode->hdisplay;
+	output->compose_height = mode->vdisplay;
+
+	/* New mode, new vblank grid */
+	spin_lock_irq(&output->lock);
+	output->vblank_ns = 0;
+	output->period_ns = 0;
+	spin_unlock_irq(&output->lock);
+
+	drm_crtc_vblank_on(crtc);
+}
+
+static void
+dummygfx_crtc_atomic_disable(struct drm_crtc *crtc,
+    struct drm_crtc_state *old_state)
+{
+	struct dummygfx_output *output = to_dummygfx_output(crtc);
+
+	drm_crtc_vblank_off(crtc);
+	cancel_work_sync(&output->compose_work);
+
+	/* No more vblanks, complete the writebacks still queued */
+	dummygfx_compose_work(&output->compose_work);
+}
+
+static void
+dummygfx_crtc_atomic_flush(struct drm_crtc *crtc,
+    struct drm_crtc_state *old_crtc_state)
+{
+	struct dummygfx_output *output = to_dummygfx_output(crtc);
+	struct dummygfx_device *dgfx = output_to_dummygfx(output);
+	unsigned long flags;
+
+	spin_lock_irqsave(&output->lock, flags);
+	dgfx->stats.commits++;
+	spin_unlock_irqrestore(&output->lock, flags);
+
+	if (crtc->state->event == NULL)
+		return;
+
+	spin_lock_irq(&crtc->dev->event_lock);
+	if (drm_crtc_vblank_get(crtc) == 0) {
+		spin_lock(&output->lock);
+		output->event_armed_ns = ktime_get_ns();
+		spin_unlock(&output->lock);
+		drm_crtc_arm_vblank_event(crtc, crtc->state->event);
+	} else {
+		drm_crtc_send_vblank_event(crtc, crtc->state->event);
+	}
+	spin_unlock_irq(&crtc->dev->event_lock);
+
+	crtc->state->event = NULL;
+}
+
+static const struct drm_crtc_helper_funcs dummygfx_crtc_helper_funcs = {
+	.atomic_flush	= dummygfx_crtc_atomic_flush,
+	.atomic_enable	= dummygfx_crtc_atomic_enable,
+	.atomic_disable	= dummygfx_crtc_atomic_disable,
+};
+
+/*
+ * Primary plane
+ */
+static int
+dummygfx_plane_atomic_check(struct drm_plane *plane,
+    struct drm_plane_state *state)
+{
+	struct drm_crtc_state *crtc_state;
+
+	if (state->fb == NULL || WARN_ON(state->crtc == NULL))
+		return (0);
+
+	crtc_state = drm_atomic_get_crtc_state(state->state, state->crtc);
+	if (IS_ERR(crtc_state))
+		return (PTR_ERR(crtc_state));
+
+	return (drm_atomic_helper_check_plane_state(state, crtc_state,
+	    DRM_PLANE_HELPER_NO_SCALING, DRM_PLANE_HELPER_NO_SCALING,
+	    false, true));
+}
+
+static void
+dummygfx_plane_atomic_update(struct drm_plane *plane,
+    struct drm_plane_state *old_state)
+{
+	struct dummygfx_device *dgfx = to_dummygfx(plane->dev);
+	struct dummygfx_output *output = &dgfx->output;
+	struct drm_framebuffer *fb, *old;
+
+	fb = plane->state->crtc != NULL && plane->state->visible ?
+	    plane->state->fb : NULL;
+	if (fb != NULL)
+		drm_framebuffer_get(fb);
+
+	spin_lock_irq(&output->lock);
+	old = output->compose_fb;
+	output->compose_fb = fb;
+	spin_unlock_irq(&output->lock);
+
+	if (old != NULL)
+		drm_framebuffer_put(old);
+}
+
+static const struct drm_plane_helper_funcs dummygfx_plane_helper_funcs = {
+	.atomic_check	= dummygfx_plane_atomic_check,
+	.atomic_update	= dummygfx_plane_atomic_update,
+};
+
+static const struct drm_plane_funcs dummygfx_plane_funcs = {
+	.update_plane		= drm_atomic_helper_update_plane,
+	.disable_plane		= drm_atomic_helper_disable_plane,
+	.destroy		= drm_plane_cleanup,
+	.reset			= drm_atomic_helper_plane_reset,
+	.atomic_duplicate_state	= drm_atomic_helper_plane_duplicate_state,
+	.atomic_destroy_state	= drm_atomic_helper_plane_destroy_state,
+};
+
+/*
+ * Encoder and connector
+ */
+static const struct drm_encoder_funcs dummygfx_encoder_funcs = {
+	.destroy	= drm_encoder_cleanup,
+};
+
+static int
+dummygfx_connector_get_modes(struct drm_connector *connector)
+{
+	int count;
+
+	count = drm_add_modes_noedid(connector, DUMMYGFX_XRES_MAX,
+	    DUMMYGFX_YRES_MAX);
+	drm_set_preferred_mode(connector, DUMMYGFX_XRES_DEF,
+	    DUMMYGFX_YRES_DEF);
+
+	return (count);
+}
+
+static const struct drm_connector_helper_funcs dummygfx_connector_helper_funcs = {
+	.get_modes	= dummygfx_connector_get_modes,
+};
+
+static const struct drm_connector_funcs dummygfx_connector_funcs = {
+	.fill_modes		= drm_helper_probe_single_connector_modes,
+	.destroy		= drm_connector_cleanup,
+	.reset			= drm_atomic_helper_connector_reset,
+	.atomic_duplicate_state	= drm_atomic_helper_connector_duplicate_state,
+	.atomic_destroy_state	= drm_atomic_helper_connector_destroy_state,
+};
+
+/*
+ * Writeback connector
+ */
+static int
+dummygfx_wb_encoder_atomic_check(struct drm_encoder *encoder,
+    struct drm_crtc_state *crtc_state, struct drm_connector_state *conn_state)
+{
+	const struct drm_display_mode *mode = &crtc_state->mode;
+	struct drm_framebuffer *fb;
+
+	if (conn_state->writeback_job == NULL ||
+	    conn_state->writeback_job->fb == NULL)
+		return (0);
+
+	fb = conn_state->writeback_job->fb;
+	if (fb->width != mode->hdisplay || fb->height != mode->vdisplay) {
+		DRM_DEBUG_KMS("dummygfx: invalid writeback size %ux%u\n",
+		    fb->width, fb->height);
+		return (-EINVAL);
+	}
+	if (fb->format->format != dummygfx_wb_formats[0]) {
+		DRM_DEBUG_KMS("dummygfx: invalid writeback format %08x\n",
+		    fb->format->format);
+		return (-EINVAL);
+	}
+
+	return (0);
+}
+
+static const struct drm_encoder_helper_funcs dummygfx_wb_encoder_helper_funcs = {
+	.atomic_check	= dummygfx_wb_encoder_atomic_check,
+};
+
+static int
+dummygfx_wb_connector_get_modes(struct drm_connector *connector)
+{
+
+	return (drm_add_modes_noedid(connector, DUMMYGFX_XRES_MAX,
+	    DUMMYGFX_YRES_MAX));
+}
+
+static void
+dummygfx_wb_atomic_commit(struct drm_connector *connector,
+    struct drm_connector_state *state)
+{
+	struct dummygfx_output *output = wb_to_dummygfx_output(connector);
+
+	/* Picked up by the compose work on the next vblank */
+	drm_writeback_queue_job(&output->wb_connector, state);
+	spin_lock_irq(&output->lock);
+	output->wb_pending++;
+	spin_unlock_irq(&output->lock);
+}
+
+static const struct drm_connector_helper_funcs dummygfx_wb_connector_helper_funcs = {
+	.get_modes	= dummygfx_wb_connector_get_modes,
+	.atomic_commit	= dummygfx_wb_atomic_commit,
+};
+
+static const struct drm_connector_funcs dummygfx_wb_connector_funcs = {
+	.fill_modes		= drm_helper_probe_single_connector_modes,
+	.destroy		= drm_connector_cleanup,
+	.reset			= drm_atomic_helper_connector_reset,
+	.atomic_duplicate_state	= drm_atomic_helper_connector_duplicate_state,
+	.atomic_destroy_state	= drm_atomic_helper_connector_destroy_state,
+};
+
+int
+dummygfx_output_init(struct dummygfx_device *dgfx)
+{
+	struct dummygfx_output *output = &dgfx->output;
+	struct drm_device *dev = &dgfx->drm;
+	int ret;
+
+	spin_lock_init(&output->lock);
+	INIT_WORK(&output->compose_work, dummygfx_compose_work);
+	hrtimer_init(&output->vblank_hrtimer, CLOCK_MONOTONIC,
+	    HRTIMER_MODE_REL);
+	output->vblank_hrtimer.function = dummygfx_vblank_simulate;
+
+	ret = drm_universal_plane_init(dev, &output->primary, 0,
+	    &dummygfx_plane_funcs, dummygfx_formats,
+	    ARRAY_SIZE(dummygfx_formats), NULL, DRM_PLANE_TYPE_PRIMARY, NULL);
+	if (ret != 0)
+		return (ret);
+	drm_plane_helper_add(&output->primary, &dummygfx_plane_helper_funcs);
+
+	ret = drm_crtc_init_with_planes(dev, &output->crtc, &output->primary,
+	    NULL, &dummygfx_crtc_funcs, NULL);
+	if (ret != 0)
+		return (ret);
+	drm_crtc_helper_add(&output->crtc, &dummygfx_crtc_helper_funcs);
+
+	ret = drm_encoder_init(dev, &output->encoder, &dummygfx_encoder_funcs,
+	    DRM_MODE_ENCODER_VIRTUAL, NULL);
+	if (ret != 0)
+		return (ret);
+	output->encoder.possible_crtcs = drm_crtc_mask(&output->crtc);
+
+	ret = drm_connector_init(dev, &output->connector,
+	    &dummygfx_connector_funcs, DRM_MODE_CONNECTOR_VIRTUAL);
+	if (ret != 0)
+		return (ret);
+	drm_connector_helper_add(&output->connector,
+	    &dummygfx_connector_helper_funcs);
+
+	ret = drm_connector_attach_encoder(&output->connector,
+	    &output->encoder);
+	if (ret != 0)
+		return (ret);
+
+	output->wb_connector.encoder.possible_crtcs =
+	    drm_crtc_mask(&output->crtc);
+	ret = drm_writeback_connector_init(dev, &output->wb_connector,
+	    &dummygfx_wb_connector_funcs, &dummygfx_wb_encoder_helper_funcs,
+	    dummygfx_wb_formats, ARRAY_SIZE(dummygfx_wb_formats));
+	if (ret != 0)
+		return (ret);
+	drm_connector_helper_add(&output->wb_connector.base,
+	    &dummygfx_wb_connector_helper_funcs);
+
+	return (0);
+}
+
+/*
+ * Statistics
+ */
+static int
+dummygfx_stats_show(struct seq_file *m, void *unused)
+{
+	struct drm_info_node *node = m->private;
+	struct dummygfx_device *dgfx = to_dummygfx(node->minor->dev);
+	struct dummygfx_output *output = &dgfx->output;
+	struct dummygfx_stats stats;
+	u32 checksum;
+
+	spin_lock_irq(&output->lock);
+	stats = dgfx->stats;
+	checksum = output->checksum;
+	spin_unlock_irq(&output->lock);
+
+	seq_printf(m, "commits: %llu\n", stats.commits);
+	seq_printf(m, "vblanks: %llu\n", stats.vblanks);
+	seq_printf(m, "flip events: %llu\n", stats.events);
+	seq_printf(m, "flip to event avg: %llu us\n", stats.events ?
+	    div64_u64(stats.event_latency_ns, stats.events * NSEC_PER_USEC) :
+	    0);
+	seq_printf(m, "flip to event max: %llu us\n",
+	    div_u64(stats.event_latency_max_ns, NSEC_PER_USEC));
+	seq_printf(m, "composed frames: %llu\n", stats.composed);
+	seq_printf(m, "compose avg: %llu us\n", stats.composed ?
+	    div64_u64(stats.compose_ns, stats.composed * NSEC_PER_USEC) : 0);
+	seq_printf(m, "writebacks: %llu\n", stats.writebacks);
+	seq_printf(m, "checksum: %08x\n", checksum);
+
+	return (0);
+}
+
+static const struct drm_info_list dummygfx_debugfs_list[] = {
+	{ "dummygfx_stats", dummygfx_stats_show, 0 },
+};
+
+int
+dummygfx_debugfs_stats_init(struct drm_minor *minor)
+{
+
+	return (drm_debugfs_create_files(dummygfx_debugfs_list,
+	    ARRAY_SIZE(dummygfx_debugfs_list), minor->debugfs_root, minor));
+}
@@ -308,6 +308,8 @@ struct drm_device {
 	void *sysctl_private;
 	char busid_str[128];
 	int modesetting;
+	/* Per-ioctl statistics, see hw.dri.N.ioctl_stats */
+	struct drm_ioctl_stats *ioctl_stats;
 #define	MAX_ORDER 11
 #endif
 	/**
@@ -33,6 +33,7 @@
 #include <linux/types.h>
 #include <linux/completion.h>
 #include <linux/idr.h>
+#include <linux/llist.h>
 #ifdef __FreeBSD__
 #include <linux/file.h>
 #endif
@@ -156,6 +157,14 @@ struct drm_pending_event {
 	 * userspace closes the file before the event is delivered.
 	 */
 	struct list_head pending_link;
+
+	/**
+	 * @node:
+	 *
+	 * Entry on &drm_file.event_llist between drm_send_event() and the
+	 * next drm_read().
+	 */
+	struct llist_node node;
 };
 
 /**
@@ -257,13 +266,20 @@ struct drm_file {
 	 * @object_idr:
 	 *
 	 * Mapping of mm object handles to object pointers. Used by the GEM
-	 * subsystem. Protected by @table_lock.
+	 * subsystem. Updates are protected by @table_lock, lookups only need
+	 * rcu_read_lock().
 	 */
 	struct idr object_idr;
 
-	/** @table_lock: Protects @object_idr. */
+	/** @table_lock: Serializes updates to @object_idr. */
 	spinlock_t table_lock;
 
+	/**
+	 * @gem_deferred_puts: Objects closed through drm_gem_handle_delete()
+	 * whose last reference drop still waits for an RCU grace period.
+	 */
+	atomic_t gem_deferred_puts;
+
 	/** @syncobj_idr: Mapping of sync object handles to object pointers. */
 	struct idr syncobj_idr;
 	/** @syncobj_table_lock: Protects @syncobj_idr. */
@@ -304,7 +320,7 @@ struct drm_file {
 	 */
 	struct list_head blobs;
 
-	/** @event_wait: Waitqueue for new events added to @event_list. */
+	/** @event_wait: Waitqueue for new events added to @event_llist. */
 	wait_queue_head_t event_wait;
 
 	/**
@@ -318,13 +334,24 @@ struct drm_file {
 	 */
 	struct list_head pending_event_list;
 
+	/**
+	 * @event_llist:
+	 *
+	 * Lock-free list of &struct drm_pending_event sent since drm_read()
+	 * last looked, newest first. Pushed by drm_send_event() from any
+	 * context, emptied in one go by drm_read(). Uses the
+	 * &drm_pending_event.node entry.
+	 */
+	struct llist_head event_llist;
+
 	/**
 	 * @event_list:
 	 *
 	 * List of &struct drm_pending_event, ready for delivery to userspace
-	 * through drm_read(). Uses the &drm_pending_event.link entry.
+	 * through drm_read() in the order they were sent. Refilled from
+	 * @event_llist and uses the &drm_pending_event.link entry.
 	 *
-	 * Protect by &drm_device.event_lock.
+	 * Protected by @event_read_lock.
 	 */
 	struct list_head event_list;
 
@@ -333,9 +360,10 @@ struct drm_file {
 	 *
 	 * Available event space to prevent userspace from
 	 * exhausting kernel memory. Currently limited to the fairly arbitrary
-	 * value of 4KB.
+	 * value of 4KB. Reserved under &drm_device.event_lock, given back
+	 * without it once drm_read() has consumed the event.
 	 */
-	int event_space;
+	atomic_t event_space;
 
 	/** @event_read_lock: Serializes drm_read(). */
 	struct mutex event_read_lock;
@@ -32,21 +32,22 @@
 #ifndef __DRM_PRIME_H__
 #define __DRM_PRIME_H__
 
+#include <linux/hashtable.h>
 #include <linux/mutex.h>
-#include <linux/rbtree.h>
 #include <linux/scatterlist.h>
 
 /**
  * struct drm_prime_file_private - per-file tracking for PRIME
  *
  * This just contains the internal &struct dma_buf and handle caches for each
- * &struct drm_file used by the PRIME core code.
+ * &struct drm_file used by the PRIME core code. The caches are updated under
+ * @lock and can be looked up under rcu_read_lock().
  */
 struct drm_prime_file_private {
 /* private: */
 	struct mutex lock;
-	struct rb_root dmabufs;
-	struct rb_root handles;
+	DECLARE_HASHTABLE(dmabufs, 6);
+	DECLARE_HASHTABLE(handles, 6);
 };
 
 struct device;
@@ -30,6 +30,7 @@
 #include <linux/dma-fence-chain.h>
 
 struct drm_file;
+struct drm_syncobj_index;
 
 /**
  * struct drm_syncobj - sync object.
@@ -61,6 +62,12 @@ struct drm_syncobj {
 	 * @file: A file backing for this syncobj.
 	 */
 	struct file *file;
+	/**
+	 * @index: Sparse index of the timeline points in &fence, used to
+	 * shorten point lookups. Allocated on the first timeline point and
+	 * protected by &lock.
+	 */
+	struct drm_syncobj_index *index;
 };
 
 void drm_syncobj_free(struct kref *kref);
@@ -192,6 +192,39 @@ struct drm_vblank_crtc {
 	 * disabling functions multiple times.
 	 */
 	bool enabled;
+
+	/**
+	 * @offdelay_ms: Off-delay learned from the reference pattern of this
+	 * CRTC, used instead of disabling immediately when clients keep
+	 * re-enabling the interrupt right after it went off. Zero while the
+	 * default behaviour applies. Protected by &drm_device.vbl_lock.
+	 */
+	unsigned int offdelay_ms;
+	/**
+	 * @disabled_at: Time the interrupt was last disabled. Protected by
+	 * &drm_device.vbl_lock.
+	 */
+	ktime_t disabled_at;
+	/**
+	 * @enable_count: Number of times the interrupt was enabled. Protected
+	 * by &drm_device.vbl_lock.
+	 */
+	unsigned long enable_count;
+	/**
+	 * @disable_count: Number of times the interrupt was disabled.
+	 * Protected by &drm_device.vbl_lock.
+	 */
+	unsigned long disable_count;
+	/**
+	 * @extrapolated_count: Number of counter queries answered from the
+	 * scanout position without enabling the interrupt.
+	 */
+	atomic_long_t extrapolated_count;
+	/**
+	 * @last_extrapolated: Highest count returned by an extrapolated
+	 * query, so that later ones never go backwards.
+	 */
+	atomic64_t last_extrapolated;
 };
 
 int drm_vblank_init(struct drm_device *dev, unsigned int num_crtcs);
@@ -1873,6 +1873,15 @@ enum drm_i915_perf_property_id {
 	 */
 	DRM_I915_PERF_PROP_OA_EXPONENT,
 
+	/**
+	 * A value of 1 requests that OA reports are consumed in place rather
+	 * than with read(): the OA buffer is mapped read-only into the process
+	 * with I915_PERF_IOCTL_OA_MMAP and released with I915_PERF_IOCTL_OA_ACK.
+	 * Only supported by streams that are not filtered for a single
+	 * context.
+	 */
+	DRM_I915_PERF_PROP_OA_MMAP,
+
 	DRM_I915_PERF_PROP_MAX /* non-ABI */
 };
 
@@ -1911,6 +1920,56 @@ struct drm_i915_perf_open_param {
  */
 #define I915_PERF_IOCTL_DISABLE	_IO('i', 0x1)
 
+/**
+ * Map the OA buffer of a stream opened with DRM_I915_PERF_PROP_OA_MMAP
+ * read-only into the calling process, returning its address.
+ *
+ * The mapping covers drm_i915_perf_oa_mmap.size bytes of OA buffer followed
+ * by one page holding a struct drm_i915_perf_oa_mmap. Reports lie between
+ * head and tail, wrapping at the end of the buffer. Reports are not checked
+ * by the kernel, so zeroed report-id fields still need skipping; the report
+ * ID of acknowledged reports is zeroed before they are reused. The
+ * mapping stays valid after the stream is closed, until munmap().
+ */
+#define I915_PERF_IOCTL_OA_MMAP	_IOR('i', 0x3, __u64)
+
+/**
+ * Release the reports of an mmapped stream up to the given byte offset in
+ * the OA buffer, which becomes the new head. Consumers are expected to
+ * acknowledge batches of reports rather than each report.
+ */
+#define I915_PERF_IOCTL_OA_ACK	_IOW('i', 0x4, __u32)
+
+/**
+ * Shared page following the OA buffer of a stream opened with
+ * DRM_I915_PERF_PROP_OA_MMAP. All fields are written by the kernel only.
+ */
+struct drm_i915_perf_oa_mmap {
+	/** Offset of the oldest report not yet acknowledged */
+	__u32 head;
+
+	/**
+	 * Offset just past the newest report that is safe to read. Read it
+	 * with acquire semantics before reading the reports it covers.
+	 */
+	__u32 tail;
+
+	/** Size of the OA buffer in bytes */
+	__u32 size;
+
+	/** Size of a single OA report in bytes */
+	__u32 report_size;
+
+	/**
+	 * Counts of DRM_I915_PERF_RECORD_OA_REPORT_LOST and
+	 * DRM_I915_PERF_RECORD_OA_BUFFER_LOST conditions seen while
+	 * acknowledging reports. After a buffer loss, head and tail restart
+	 * from zero.
+	 */
+	__u32 report_lost;
+	__u32 buffer_lost;
+};
+
 /**
  * Common to all i915 perf records
  */
@@ -39,6 +39,13 @@ struct sync_file {
 	 * entire array is 0).
 	 */
 	char			user_name[32];
+	/**
+	 * @name:
+	 *
+	 * Name generated through the driver callbacks after the fence
+	 * signaled, valid once NAME_CACHED is set in @flags.
+	 */
+	char			name[32];
 #ifdef CONFIG_DEBUG_FS
 	struct list_head	sync_file_list;
 #endif
@@ -51,6 +58,9 @@ struct sync_file {
 };
 
 #define POLL_ENABLED 0
+#define NAME_CACHING 1
+#define NAME_CACHED 2
+#define FENCES_ORDERED 3	/* built by sync_file_merge() */
 
 struct sync_file *sync_file_create(struct dma_fence *fence);
 struct dma_fence *sync_file_get_fence(int fd);
@@ -21,11 +21,14 @@
 #include <linux/poll.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <asm/uaccess.h>
 #include <linux/anon_inodes.h>
 #include <linux/sync_file.h>
 #include <uapi/linux/sync_file.h>
 
+#include "linux_sync_file_fences.h"
+
 static const struct file_operations sync_file_fops;
 
 static struct sync_file *sync_file_alloc(void)
@@ -135,20 +138,38 @@ EXPORT_SYMBOL(sync_file_get_fence);
  * case construction of the name is deferred until use, and so requires
  * sync_file_get_name().
  *
+ * The generated name is cached once the fence has signaled. Drivers may
+ * report a different name until then, i915 switches to "signaled".
+ *
  * Returns: a string representing the name.
  */
 char *sync_file_get_name(struct sync_file *sync_file, char *buf, int len)
 {
+	char name[sizeof(sync_file->name)];
+
 	if (sync_file->user_name[0]) {
 		strlcpy(buf, sync_file->user_name, len);
+	} else if (test_bit(NAME_CACHED, &sync_file->flags)) {
+		smp_rmb();
+		strlcpy(buf, sync_file->name, len);
 	} else {
 		struct dma_fence *fence = sync_file->fence;
+		bool signaled = dma_fence_is_signaled(fence);
 
-		snprintf(buf, len, "%s-%s%llu-%llu",
+		snprintf(name, sizeof(name), "%s-%s%llu-%llu",
 			 fence->ops->get_driver_name(fence),
 			 fence->ops->get_timeline_name(fence),
 			 (unsigned long long)fence->context,
 			 (unsigned long long)fence->seqno);
+		strlcpy(buf, name, len);
+
+		/* First caller fills the cache, the others just use theirs */
+		if (signaled &&
+		    !test_and_set_bit(NAME_CACHING, &sync_file->flags)) {
+			memcpy(sync_file->name, name, sizeof(name));
+			smp_mb__before_atomic();
+			set_bit(NAME_CACHED, &sync_file->flags);
+		}
 	}
 
 	return buf;
@@ -195,15 +216,32 @@ static struct dma_fence **get_fences(struct sync_file *sync_file,
 	return &sync_file->fence;
 }
 
-static void add_fence(struct dma_fence **fences,
-		      int *i, struct dma_fence *fence)
+/*
+ * Like get_fences(), but ordered by context with a single fence per context,
+ * as sync_file_merge() expects.  That already holds for anything it built
+ * itself, which FENCES_ORDERED marks; arrays other drivers wrapped with
+ * sync_file_create() are sorted into a copy returned in @sorted, which the
+ * caller must kfree().
+ */
+static struct dma_fence **get_ordered_fences(struct sync_file *sync_file,
+					     int *num_fences,
+					     struct dma_fence ***sorted)
 {
-	fences[*i] = fence;
+	struct dma_fence **fences;
 
-	if (!dma_fence_is_signaled(fence)) {
-		dma_fence_get(fence);
-		(*i)++;
-	}
+	*sorted = NULL;
+	fences = get_fences(sync_file, num_fences);
+	if (test_bit(FENCES_ORDERED, &sync_file->flags) ||
+	    sync_file_fences_ordered(fences, *num_fences))
+		return fences;
+
+	fences = kmemdup(fences, *num_fences * sizeof(*fences), GFP_KERNEL);
+	if (!fences)
+		return NULL;
+	*num_fences = sync_file_order_fences(fences, *num_fences);
+	*sorted = fences;
+
+	return fences;
 }
 
 /**
@@ -220,17 +258,20 @@ static struct sync_file *sync_file_merge(const char *name, struct sync_file *a,
 					 struct sync_file *b)
 {
 	struct sync_file *sync_file;
-	struct dma_fence **fences, **nfences, **a_fences, **b_fences;
-	int i, i_a, i_b, num_fences, a_num_fences, b_num_fences;
+	struct dma_fence **fences = NULL, **nfences, **a_fences, **b_fences;
+	struct dma_fence **a_sorted = NULL, **b_sorted = NULL;
+	int i, num_fences, a_num_fences, b_num_fences;
 
 	sync_file = sync_file_alloc();
 	if (!sync_file)
 		return NULL;
 
-	a_fences = get_fences(a, &a_num_fences);
-	b_fences = get_fences(b, &b_num_fences);
+	a_fences = get_ordered_fences(a, &a_num_fences, &a_sorted);
+	b_fences = get_ordered_fences(b, &b_num_fences, &b_sorted);
+	if (!a_fences || !b_fences)
+		goto err;
 	if (a_num_fences > INT_MAX - b_num_fences)
-		return NULL;
+		goto err;
 
 	num_fences = a_num_fences + b_num_fences;
 
@@ -238,63 +279,35 @@ static struct sync_file *sync_file_merge(const char *name, struct sync_file *a,
 	if (!fences)
 		goto err;
 
-	/*
-	 * Assume sync_file a and b are both ordered and have no
-	 * duplicates with the same context.
-	 *
-	 * If a sync_file can only be created with sync_file_merge
-	 * and sync_file_create, this is a reasonable assumption.
-	 */
-	for (i = i_a = i_b = 0; i_a < a_num_fences && i_b < b_num_fences; ) {
-		struct dma_fence *pt_a = a_fences[i_a];
-		struct dma_fence *pt_b = b_fences[i_b];
-
-		if (pt_a->context < pt_b->context) {
-			add_fence(fences, &i, pt_a);
-
-			i_a++;
-		} else if (pt_a->context > pt_b->context) {
-			add_fence(fences, &i, pt_b);
-
-			i_b++;
-		} else {
-			if (pt_a->seqno - pt_b->seqno <= INT_MAX)
-				add_fence(fences, &i, pt_a);
-			else
-				add_fence(fences, &i, pt_b);
-
-			i_a++;
-			i_b++;
-		}
-	}
-
-	for (; i_a < a_num_fences; i_a++)
-		add_fence(fences, &i, a_fences[i_a]);
-
-	for (; i_b < b_num_fences; i_b++)
-		add_fence(fences, &i, b_fences[i_b]);
+	i = sync_file_merge_fences(fences, a_fences, a_num_fences,
+				   b_fences, b_num_fences);
 
-	if (i == 0)
-		fences[i++] = dma_fence_get(a_fences[0]);
-
-	if (num_fences > i) {
+	/* The array lives as long as the fence, only trim real waste */
+	if (i > 1 && i <= num_fences / 2) {
 		nfences = krealloc(fences, i * sizeof(*fences),
 				  GFP_KERNEL);
-		if (!nfences)
-			goto err;
-
-		fences = nfences;
+		if (nfences)
+			fences = nfences;
 	}
 
 	if (sync_file_set_fence(sync_file, fences, i) < 0) {
+		while (i--)
+			dma_fence_put(fences[i]);
 		kfree(fences);
+		fences = NULL;
 		goto err;
 	}
 
+	set_bit(FENCES_ORDERED, &sync_file->flags);
 	strlcpy(sync_file->user_name, name, sizeof(sync_file->user_name));
+	kfree(a_sorted);
+	kfree(b_sorted);
 	return sync_file;
 
 err:
+	kfree(fences);
+	kfree(a_sorted);
+	kfree(b_sorted);
 	fput(sync_file->file);
 	return NULL;
 
@@ -384,26 +397,6 @@ err_put_fd:
 	return err;
 }
 
-static int sync_fill_fence_info(struct dma_fence *fence,
-				 struct sync_fence_info *info)
-{
-	strlcpy(info->obj_name, fence->ops->get_timeline_name(fence),
-		sizeof(info->obj_name));
-	strlcpy(info->driver_name, fence->ops->get_driver_name(fence),
-		sizeof(info->driver_name));
-
-	info->status = dma_fence_get_status(fence);
-	while (test_bit(DMA_FENCE_FLAG_SIGNALED_BIT, &fence->flags) &&
-	       !test_bit(DMA_FENCE_FLAG_TIMESTAMP_BIT, &fence->flags))
-		cpu_relax();
-	info->timestamp_ns =
-		test_bit(DMA_FENCE_FLAG_TIMESTAMP_BIT, &fence->flags) ?
-		ktime_to_ns(fence->timestamp) :
-		ktime_set(0, 0);
-
-	return info->status;
-}
-
 static long sync_file_ioctl_fence_info(struct sync_file *sync_file,
 				       unsigned long arg)
 {
@@ -411,7 +404,7 @@ static long sync_file_ioctl_fence_info(struct sync_file *sync_file,
 	struct sync_fence_info *fence_info = NULL;
 	struct dma_fence **fences;
 	__u32 size;
-	int num_fences, ret, i;
+	int num_fences, ret;
 
 	if (copy_from_user(&info, (void __user *)arg, sizeof(info)))
 		return -EFAULT;
@@ -430,8 +423,6 @@ static long sync_file_ioctl_fence_info(struct sync_file *sync_file,
 	if (!info.num_fences) {
 		info.status = dma_fence_is_signaled(sync_file->fence);
 		goto no_fences;
-	} else {
-		info.status = 1;
 	}
 
 	if (info.num_fences < num_fences)
@@ -442,10 +433,7 @@ static long sync_file_ioctl_fence_info(struct sync_file *sync_file,
 	if (!fence_info)
 		return -ENOMEM;
 
-	for (i = 0; i < num_fences; i++) {
-		int status = sync_fill_fence_info(fences[i], &fence_info[i]);
-		info.status = info.status <= 0 ? info.status : status;
-	}
+	info.status = sync_file_fill_info(fences, num_fences, fence_info);
 
 	if (copy_to_user(u64_to_user_ptr(info.sync_fence_info), fence_info,
 			 size)) {
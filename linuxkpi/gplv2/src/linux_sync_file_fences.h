@@ -0,0 +1,170 @@
+/*
+ * drivers/dma-buf/sync_file.c
+ *
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_SYNC_FILE_FENCES_H_
+#define _LINUX_SYNC_FILE_FENCES_H_
+
+/*
+ * Fence array handling of sync_file_merge() and SYNC_IOC_FILE_INFO. This is
+ * kept free of kernel includes so that scripts/syncfiletest.c can run it on
+ * the host. The includer provides the kernel types, INT_MAX, struct
+ * dma_fence, struct sync_fence_info, dma_fence_is_later(),
+ * dma_fence_is_signaled(), dma_fence_get(), dma_fence_get_status(),
+ * test_bit() with the DMA_FENCE_FLAG_* bits, cpu_relax(), ktime_to_ns(),
+ * ktime_set(), strlcpy() and sort().
+ */
+
+/*
+ * By context, and within a context oldest first.  Seqnos are compared like
+ * dma_fence_is_later() does, so 32-bit timelines that wrapped still sort in
+ * signaling order.
+ */
+static int fence_cmp(const void *a, const void *b)
+{
+	struct dma_fence *pt_a = *(struct dma_fence * const *)a;
+	struct dma_fence *pt_b = *(struct dma_fence * const *)b;
+
+	if (pt_a->context != pt_b->context)
+		return pt_a->context < pt_b->context ? -1 : 1;
+	if (pt_a->seqno == pt_b->seqno)
+		return 0;
+	return dma_fence_is_later(pt_a, pt_b) ? 1 : -1;
+}
+
+/* Whether @fences is ordered by context with a single fence per context */
+static bool sync_file_fences_ordered(struct dma_fence **fences,
+				     int num_fences)
+{
+	int i;
+
+	for (i = 1; i < num_fences; i++) {
+		if (fences[i - 1]->context >= fences[i]->context)
+			return false;
+	}
+	return true;
+}
+
+/* Sort @fences in place and keep the latest fence of each context */
+static int sync_file_order_fences(struct dma_fence **fences, int num_fences)
+{
+	int i, n;
+
+	sort(fences, num_fences, sizeof(*fences), fence_cmp, NULL);
+	for (i = n = 0; i < num_fences; i++) {
+		if (n && fences[n - 1]->context == fences[i]->context)
+			n--;
+		fences[n++] = fences[i];
+	}
+	return n;
+}
+
+static void add_fence(struct dma_fence **fences,
+		      int *i, struct dma_fence *fence)
+{
+	fences[*i] = fence;
+
+	if (!dma_fence_is_signaled(fence)) {
+		dma_fence_get(fence);
+		(*i)++;
+	}
+}
+
+/*
+ * Merge two ordered fence arrays into @fences, which has room for both, and
+ * return the number of fences stored.  Each of them holds a new reference.
+ *
+ * Both inputs are ordered by context with no duplicates, so a single pass
+ * merges them; fences that already signaled are dropped on the way, which
+ * keeps repeatedly merged sync_files from growing without bound.
+ */
+static int sync_file_merge_fences(struct dma_fence **fences,
+				  struct dma_fence **a_fences, int a_num_fences,
+				  struct dma_fence **b_fences, int b_num_fences)
+{
+	int i, i_a, i_b;
+
+	for (i = i_a = i_b = 0; i_a < a_num_fences && i_b < b_num_fences; ) {
+		struct dma_fence *pt_a = a_fences[i_a];
+		struct dma_fence *pt_b = b_fences[i_b];
+
+		if (pt_a->context < pt_b->context) {
+			add_fence(fences, &i, pt_a);
+
+			i_a++;
+		} else if (pt_a->context > pt_b->context) {
+			add_fence(fences, &i, pt_b);
+
+			i_b++;
+		} else {
+			if (dma_fence_is_later(pt_a, pt_b))
+				add_fence(fences, &i, pt_a);
+			else
+				add_fence(fences, &i, pt_b);
+
+			i_a++;
+			i_b++;
+		}
+	}
+
+	for (; i_a < a_num_fences; i_a++)
+		add_fence(fences, &i, a_fences[i_a]);
+
+	for (; i_b < b_num_fences; i_b++)
+		add_fence(fences, &i, b_fences[i_b]);
+
+	if (i == 0)
+		fences[i++] = dma_fence_get(a_fences[0]);
+
+	return i;
+}
+
+static int sync_fill_fence_info(struct dma_fence *fence,
+				 struct sync_fence_info *info)
+{
+	strlcpy(info->obj_name, fence->ops->get_timeline_name(fence),
+		sizeof(info->obj_name));
+	strlcpy(info->driver_name, fence->ops->get_driver_name(fence),
+		sizeof(info->driver_name));
+
+	info->status = dma_fence_get_status(fence);
+	while (test_bit(DMA_FENCE_FLAG_SIGNALED_BIT, &fence->flags) &&
+	       !test_bit(DMA_FENCE_FLAG_TIMESTAMP_BIT, &fence->flags))
+		cpu_relax();
+	info->timestamp_ns =
+		test_bit(DMA_FENCE_FLAG_TIMESTAMP_BIT, &fence->flags) ?
+		ktime_to_ns(fence->timestamp) :
+		ktime_set(0, 0);
+
+	return info->status;
+}
+
+/*
+ * Fill @fence_info for all of @fences and return the status of the whole
+ * set: the first error or active fence, 1 if all signaled.
+ */
+static int sync_file_fill_info(struct dma_fence **fences, int num_fences,
+			       struct sync_fence_info *fence_info)
+{
+	int i, status, ret = 1;
+
+	for (i = 0; i < num_fences; i++) {
+		status = sync_fill_fence_info(fences[i], &fence_info[i]);
+		ret = ret <= 0 ? ret : status;
+	}
+	return ret;
+}
+
+#endif /* _LINUX_SYNC_FILE_FENCES_H_ */
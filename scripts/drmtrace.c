@@ -0,0 +1,458 @@
+/*
+ * drmtrace - decode the DRM trace ring (hw.dri.trace).
+ *
+ * Build with "cc -o drmtrace drmtrace.c".  Without arguments it drains the
+ * rings of the running kernel.  A capture taken with
+ *
+ *	sysctl -n hw.dri.trace.events > events
+ *	sysctl -b hw.dri.trace.data > data
+ *
+ * can be decoded on any host with "drmtrace -e events -d data".  Events are
+ * enabled one by one, e.g. "sysctl hw.dri.trace.i915.i915_request_add=1".
+ *
+ * "drmtrace -t" runs the ring of drivers/gpu/drm/drm_trace_ringbuf_freebsd.h
+ * on the host instead.  It reports what a single writer appends per second,
+ * then runs 1, 2 and 4 writer threads, each with a ring of its own as each
+ * CPU has, against a reader draining them in hw.dri.trace.data's chunks.
+ * Every record the reader keeps must be whole and in order, and records
+ * appended must equal records read plus records counted lost.  Build with
+ * "-lpthread" for it.
+ */
+
+#include <sys/types.h>
+#ifdef __FreeBSD__
+#include <sys/sysctl.h>
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define	DRM_TRACE_MAX_ID	65536
+
+/* What drm_trace_ringbuf_freebsd.h expects from the kernel */
+#ifndef MIN
+#define	MIN(a, b)		(((a) < (b)) ? (a) : (b))
+#endif
+#define	atomic_load_acq_64(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define	atomic_store_rel_64(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define	atomic_thread_fence_acq() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+
+#include "../drivers/gpu/drm/drm_trace_ringbuf_freebsd.h"
+
+struct event {
+	char	*name;
+	char	*fmt;
+};
+
+static struct event *events;
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: drmtrace [-e events] [-d data]\n"
+	    "       drmtrace -t\n");
+	exit(1);
+}
+
+static char *
+slurp_file(const char *path, size_t *len)
+{
+	char *buf;
+	FILE *f;
+	long n;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		err(1, "%s", path);
+	if (fseek(f, 0, SEEK_END) != 0 || (n = ftell(f)) < 0)
+		err(1, "%s", path);
+	rewind(f);
+	buf = malloc(n + 1);
+	if (buf == NULL)
+		err(1, "malloc");
+	if (fread(buf, 1, n, f) != (size_t)n)
+		err(1, "%s", path);
+	buf[n] = '\0';
+	fclose(f);
+	*len = n;
+	return (buf);
+}
+
+static char *
+slurp_sysctl(const char *name, size_t *len)
+{
+#ifdef __FreeBSD__
+	char *buf;
+	size_t n;
+
+	if (sysctlbyname(name, NULL, &n, NULL, 0) != 0)
+		err(1, "%s", name);
+	buf = malloc(n + 1);
+	if (buf == NULL)
+		err(1, "malloc");
+	if (sysctlbyname(name, buf, &n, NULL, 0) != 0)
+		err(1, "%s", name);
+	buf[n] = '\0';
+	*len = n;
+	return (buf);
+#else
+	(void)len;
+	errx(1, "%s: live capture needs FreeBSD, use -e and -d", name);
+#endif
+}
+
+/* One "id provider event format" line per event */
+static void
+parse_events(char *buf)
+{
+	char *line, *name, *fmt;
+	unsigned int id;
+	int n;
+
+	events = calloc(DRM_TRACE_MAX_ID, sizeof(*events));
+	if (events == NULL)
+		err(1, "calloc");
+
+	while ((line = strsep(&buf, "\n")) != NULL) {
+		if (sscanf(line, "%u %*s %n", &id, &n) != 1 ||
+		    id >= DRM_TRACE_MAX_ID)
+			continue;
+		name = line + n;
+		fmt = strchr(name, ' ');
+		if (fmt != NULL)
+			*fmt++ = '\0';
+		events[id].name = name;
+		events[id].fmt = fmt != NULL ? fmt : "";
+	}
+}
+
+/*
+ * Print a record's arguments following its kernel format.  Every argument
+ * is a 64-bit word, so length modifiers are replaced by 'j'.
+ */
+static void
+print_args(const char *fmt, const uint64_t *arg)
+{
+	char spec[32];
+	size_t len;
+	int i;
+
+	for (i = 0; *fmt != '\0'; fmt++) {
+		if (*fmt != '%') {
+			putchar(*fmt);
+			continue;
+		}
+		if (fmt[1] == '%') {
+			putchar('%');
+			fmt++;
+			continue;
+		}
+
+		spec[0] = '%';
+		len = 1;
+		while (fmt[1] != '\0' && len < sizeof(spec) - 3 &&
+		    strchr("-+ #0123456789.", fmt[1]) != NULL)
+			spec[len++] = *++fmt;
+		while (fmt[1] != '\0' && strchr("hlLqjzt", fmt[1]) != NULL)
+			fmt++;
+		if (fmt[1] == '\0')
+			break;
+		fmt++;
+
+		if (i >= DRM_TRACE_NARGS) {
+			fputs("?", stdout);
+			continue;
+		}
+		switch (*fmt) {
+		case 'd':
+		case 'i':
+			spec[len++] = 'j';
+			spec[len++] = *fmt;
+			spec[len] = '\0';
+			printf(spec, (intmax_t)(int64_t)arg[i++]);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			spec[len++] = 'j';
+			spec[len++] = *fmt;
+			spec[len] = '\0';
+			printf(spec, (uintmax_t)arg[i++]);
+			break;
+		case 'p':
+			printf("0x%jx", (uintmax_t)arg[i++]);
+			break;
+		default:
+			fputs("?", stdout);
+			i++;
+			break;
+		}
+	}
+}
+
+static int
+record_cmp(const void *a, const void *b)
+{
+	const struct drm_trace_record *ra = a, *rb = b;
+
+	if (ra->ts != rb->ts)
+		return (ra->ts < rb->ts ? -1 : 1);
+	return (ra->cpu - rb->cpu);
+}
+
+/* As hw.dri.trace.ring_size and DRM_TRACE_CHUNK default to */
+#define	RING_SIZE		4096
+#define	READ_CHUNK		64
+#define	MAX_WRITERS		4
+
+struct ring_writer {
+	pthread_t		thread;
+	struct drm_trace_ring	*ring;
+	uint16_t		cpu;
+	uint64_t		appended;
+	uint64_t		next_seq;	/* reader side */
+};
+
+static volatile bool ring_stop;
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static struct drm_trace_ring *
+ring_alloc(void)
+{
+	struct drm_trace_ring *ring;
+
+	ring = calloc(1, sizeof(*ring) + RING_SIZE * sizeof(ring->rec[0]));
+	if (ring == NULL)
+		err(1, "calloc");
+	ring->mask = RING_SIZE - 1;
+	return (ring);
+}
+
+/* Arguments that let the reader tell a torn record from a whole one */
+static inline void
+ring_append(struct ring_writer *w, uint64_t seq)
+{
+	drm_trace_ring_put(w->ring, seq, 1, w->cpu, w->cpu, seq, ~seq,
+	    seq * 0x9e3779b97f4a7c15ull, w->cpu);
+}
+
+static void *
+ring_writer_main(void *arg)
+{
+	struct ring_writer *w = arg;
+	uint64_t seq;
+
+	for (seq = 0; !__atomic_load_n(&ring_stop, __ATOMIC_RELAXED); seq++)
+		ring_append(w, seq);
+	w->appended = seq;
+	return (NULL);
+}
+
+/*
+ * Drain one chunk of w's ring into *read and *lost and check what is kept.
+ * Returns the number of records taken off the ring, kept or not.
+ */
+static int
+ring_drain(struct ring_writer *w, struct drm_trace_record *buf,
+    uint64_t *read, uint64_t *lost, uint64_t *bad)
+{
+	const struct drm_trace_record *rec;
+	int i, n, skip;
+
+	n = drm_trace_ring_read(w->ring, buf, READ_CHUNK, &skip, lost);
+	*read += n;
+	for (i = 0; i < n; i++) {
+		rec = &buf[skip + i];
+		if (rec->arg[1] != ~rec->arg[0] ||
+		    rec->arg[2] != rec->arg[0] * 0x9e3779b97f4a7c15ull ||
+		    rec->arg[3] != w->cpu || rec->cpu != w->cpu ||
+		    rec->ts != rec->arg[0] || rec->arg[0] < w->next_seq) {
+			if ((*bad)++ < 10)
+				printf("FAIL ring %u: bad record seq %ju, "
+				    "expected at least %ju\n", w->cpu,
+				    (uintmax_t)rec->arg[0],
+				    (uintmax_t)w->next_seq);
+			continue;
+		}
+		w->next_seq = rec->arg[0] + 1;
+	}
+	return (n + skip);
+}
+
+static int
+ring_test(void)
+{
+	static const int nwriters[] = { 1, 2, 4 };
+	struct drm_trace_record buf[READ_CHUNK];
+	struct ring_writer w[MAX_WRITERS];
+	uint64_t start, elapsed, best, appended, read, lost, bad, seq;
+	unsigned int c;
+	int i, r, n;
+
+	/* Append cost alone, best of five */
+	memset(w, 0, sizeof(w));
+	w[0].ring = ring_alloc();
+	for (best = UINT64_MAX, r = 0; r < 5; r++) {
+		start = now_ns();
+		for (seq = 0; seq < 10000000; seq++)
+			ring_append(&w[0], seq);
+		elapsed = now_ns() - start;
+		if (elapsed < best)
+			best = elapsed;
+	}
+	printf("append: %.1f ns/record, %.1f Mrecords/s\n",
+	    (double)best / 10000000, 10000000 * 1000.0 / best);
+
+	/*
+	 * Drain cost alone, best of five.  The ring is filled up to one short
+	 * of full: in a full ring, the writer may be overwriting the oldest
+	 * record, so the reader drops it.
+	 */
+	lost = bad = 0;
+	for (best = UINT64_MAX, r = 0; r < 5; r++) {
+		elapsed = 0;
+		for (i = 0; i < 2500; i++) {
+			for (n = 0; n < RING_SIZE - 1; n++, seq++)
+				ring_append(&w[0], seq);
+			read = 0;
+			start = now_ns();
+			while (ring_drain(&w[0], buf, &read, &lost, &bad) != 0)
+				;
+			elapsed += now_ns() - start;
+			if (read != RING_SIZE - 1 && bad++ < 10)
+				printf("FAIL drain: %ju of %d records read\n",
+				    (uintmax_t)read, RING_SIZE - 1);
+		}
+		if (elapsed < best)
+			best = elapsed;
+	}
+	free(w[0].ring);
+	printf("drain:  %.1f ns/record, %.1f Mrecords/s\n",
+	    (double)best / (2500 * (RING_SIZE - 1)),
+	    2500.0 * (RING_SIZE - 1) * 1000 / best);
+
+	printf("%7s %14s %14s %14s\n", "writers", "appended/s", "read/s",
+	    "lost");
+	for (c = 0; c < sizeof(nwriters) / sizeof(nwriters[0]); c++) {
+		memset(w, 0, sizeof(w));
+		lost = read = 0;
+		ring_stop = false;
+		for (i = 0; i < nwriters[c]; i++) {
+			w[i].ring = ring_alloc();
+			w[i].cpu = i;
+			errno = pthread_create(&w[i].thread, NULL,
+			    ring_writer_main, &w[i]);
+			if (errno != 0)
+				err(1, "pthread_create");
+		}
+
+		start = now_ns();
+		while (now_ns() - start < 1000000000) {
+			for (i = 0; i < nwriters[c]; i++)
+				ring_drain(&w[i], buf, &read, &lost, &bad);
+		}
+		__atomic_store_n(&ring_stop, true, __ATOMIC_RELAXED);
+		elapsed = now_ns() - start;
+
+		appended = 0;
+		for (i = 0; i < nwriters[c]; i++) {
+			pthread_join(w[i].thread, NULL);
+			appended += w[i].appended;
+			do
+				n = ring_drain(&w[i], buf, &read, &lost, &bad);
+			while (n != 0);
+		}
+		if (appended != read + lost && bad++ < 10)
+			printf("FAIL %d writers: %ju appended, %ju read, "
+			    "%ju lost\n", nwriters[c], (uintmax_t)appended,
+			    (uintmax_t)read, (uintmax_t)lost);
+		printf("%7d %14.0f %14.0f %13.1f%%\n", nwriters[c],
+		    appended * 1e9 / elapsed, read * 1e9 / elapsed,
+		    appended ? lost * 100.0 / appended : 0);
+
+		for (i = 0; i < nwriters[c]; i++)
+			free(w[i].ring);
+	}
+
+	printf("ring test: %ju failed\n", (uintmax_t)bad);
+	return (bad != 0);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *events_path = NULL, *data_path = NULL;
+	struct drm_trace_record *rec;
+	struct event *ev;
+	size_t i, len, nrec;
+	uint64_t nsec;
+	char *buf;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "e:d:t")) != -1) {
+		switch (ch) {
+		case 't':
+			if (argc != 2)
+				usage();
+			return (ring_test());
+		case 'e':
+			events_path = optarg;
+			break;
+		case 'd':
+			data_path = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	buf = events_path != NULL ? slurp_file(events_path, &len) :
+	    slurp_sysctl("hw.dri.trace.events", &len);
+	parse_events(buf);
+
+	rec = (struct drm_trace_record *)(data_path != NULL ?
+	    slurp_file(data_path, &len) :
+	    slurp_sysctl("hw.dri.trace.data", &len));
+	if (len % sizeof(*rec) != 0)
+		errx(1, "trace data is not a whole number of records");
+	nrec = len / sizeof(*rec);
+
+	/* Each CPU's ring is drained in turn; merge them by time */
+	qsort(rec, nrec, sizeof(*rec), record_cmp);
+
+	for (i = 0; i < nrec; i++) {
+		ev = &events[rec[i].id];
+		nsec = ((rec[i].ts & 0xffffffff) * 1000000000) >> 32;
+		printf("%6ju.%09ju cpu%-3u %6u ",
+		    (uintmax_t)(rec[i].ts >> 32), (uintmax_t)nsec,
+		    rec[i].cpu, rec[i].tid);
+		if (ev->name == NULL) {
+			printf("event%u\n", rec[i].id);
+			continue;
+		}
+		printf("%s: ", ev->name);
+		print_args(ev->fmt, rec[i].arg);
+		putchar('\n');
+	}
+
+	return (0);
+}
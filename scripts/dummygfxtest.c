@@ -0,0 +1,1666 @@
+/*
+ * dummygfxtest - exercise DRM core paths on the dummygfx virtual device.
+ *
+ * Build with
+ *
+ *	cc -I/usr/local/include -I/usr/local/include/libdrm \
+ *	    -o dummygfxtest dummygfxtest.c -L/usr/local/lib -ldrm -lpthread
+ *
+ * and run it as root with dummygfx.ko loaded.  The preferred mode is set on
+ * the virtual output first, then one of the tests runs:
+ *
+ *	events	vblank event delivery latency and throughput while the
+ *		number of clients grows, each client queueing events and
+ *		reading them back from its own thread
+ *	prime	PRIME export/import between two files: handle and dma-buf
+ *		caching, contents, handle close and re-import, and the cost
+ *		of the cached lookups
+ *	vblank	vblank counter queries across interrupt enable/disable
+ *		cycles: counts never go backwards and never run ahead of
+ *		the interrupt driven count.  On FreeBSD the test turns on
+ *		hw.dri.vblank_extrapolate with a short off-delay for the run
+ *	commit	atomic commits per second: test-only, blocking, and
+ *		non-blocking page flips with commit to event latency
+ *	dumb	dumb buffer create/destroy and map/fault/unmap throughput
+ *		for a range of buffer sizes
+ *	handles	GEM handle lookups per second from 1, 4 and 16 threads
+ *		sharing one file, then again while another thread keeps
+ *		closing and recreating the handles they look up
+ *	syncobj	timeline syncobj wait latency against the number of points
+ *		waited on, for WAIT_ALL and WAIT_ANY, from signal to wake
+ *	timeline
+ *		a million timeline points, first all signaled, then fed
+ *		from the CRTC out-fence a frame at a time so thousands are
+ *		pending: queries stay in order, old points are found
+ *		signaled, and the cost of those lookups
+ *	writeback
+ *		writeback of the scanned out frame: out-fence signalling,
+ *		contents, and writebacks per second
+ *
+ * Tests print a FAIL line per failed check and exit non-zero.
+ */
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#ifdef __FreeBSD__
+#include <sys/sysctl.h>
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#define	MAX_CLIENTS	256
+#define	MAX_DEPTH	32
+
+/* A mode sized XRGB8888 framebuffer on a mapped dumb buffer */
+struct fb {
+	uint32_t	handle;
+	uint32_t	id;
+	uint32_t	pitch;
+	uint64_t	size;
+	uint32_t	*ptr;
+};
+
+static const char	*devpath;
+static int		master_fd;
+static uint32_t		crtc_id;
+static uint32_t		connector_id;
+static drmModeModeInfo	mode;
+static struct fb	scanout;
+static int		checks, failures;
+
+#define	CHECK(cond, ...) do {						\
+	checks++;							\
+	if (!(cond)) {							\
+		failures++;						\
+		printf("FAIL %s:%d: ", __func__, __LINE__);		\
+		printf(__VA_ARGS__);					\
+		printf("\n");						\
+	}								\
+} while (0)
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+	    "usage: dummygfxtest [-d device] events [-c clients] [-f frames] "
+	    "[-q depth]\n"
+	    "       dummygfxtest [-d device] prime [-n iterations]\n"
+	    "       dummygfxtest [-d device] vblank [-n iterations]\n"
+	    "       dummygfxtest [-d device] commit [-n iterations]\n"
+	    "       dummygfxtest [-d device] dumb [-n iterations]\n"
+	    "       dummygfxtest [-d device] handles [-n iterations]\n"
+	    "       dummygfxtest [-d device] syncobj [-n iterations]\n"
+	    "       dummygfxtest [-d device] timeline [-n points]\n"
+	    "       dummygfxtest [-d device] writeback [-n iterations]\n");
+	exit(1);
+}
+
+static uint64_t
+now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x < y ? -1 : x > y);
+}
+
+static int
+open_device(void)
+{
+	drmVersionPtr ver;
+	char path[64];
+	int fd, i;
+
+	if (devpath != NULL) {
+		fd = open(devpath, O_RDWR | O_CLOEXEC);
+		if (fd < 0)
+			err(1, "%s", devpath);
+		return (fd);
+	}
+
+	for (i = 0; i < DRM_MAX_MINOR; i++) {
+		snprintf(path, sizeof(path), DRM_DEV_NAME, DRM_DIR_NAME, i);
+		fd = open(path, O_RDWR | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+		ver = drmGetVersion(fd);
+		if (ver != NULL && strcmp(ver->name, "dummygfx") == 0) {
+			drmFreeVersion(ver);
+			if ((devpath = strdup(path)) == NULL)
+				err(1, "strdup");
+			return (fd);
+		}
+		drmFreeVersion(ver);
+		close(fd);
+	}
+	errx(1, "no dummygfx device found");
+}
+
+static void
+fb_create(struct fb *fb, uint32_t seed)
+{
+	struct drm_mode_create_dumb create;
+	struct drm_mode_map_dumb map;
+	uint32_t x, y;
+	void *ptr;
+
+	memset(&create, 0, sizeof(create));
+	create.width = mode.hdisplay;
+	create.height = mode.vdisplay;
+	create.bpp = 32;
+	if (drmIoctl(master_fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) != 0)
+		err(1, "DRM_IOCTL_MODE_CREATE_DUMB");
+	if (drmModeAddFB(master_fd, mode.hdisplay, mode.vdisplay, 24, 32,
+	    create.pitch, create.handle, &fb->id) != 0)
+		err(1, "drmModeAddFB");
+
+	memset(&map, 0, sizeof(map));
+	map.handle = create.handle;
+	if (drmIoctl(master_fd, DRM_IOCTL_MODE_MAP_DUMB, &map) != 0)
+		err(1, "DRM_IOCTL_MODE_MAP_DUMB");
+	ptr = mmap(NULL, create.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    master_fd, map.offset);
+	if (ptr == MAP_FAILED)
+		err(1, "mmap");
+
+	fb->handle = create.handle;
+	fb->pitch = create.pitch;
+	fb->size = create.size;
+	fb->ptr = ptr;
+	for (y = 0; y < mode.vdisplay; y++)
+		for (x = 0; x < mode.hdisplay; x++)
+			fb->ptr[y * fb->pitch / 4 + x] = seed ^ (y << 16 | x);
+}
+
+/* Light up the virtual output with a dumb buffer in its preferred mode. */
+static void
+setup_output(void)
+{
+	drmModeConnector *conn;
+	drmModeRes *res;
+	int i;
+
+	master_fd = open_device();
+
+	res = drmModeGetResources(master_fd);
+	if (res == NULL || res->count_crtcs < 1 || res->count_connectors < 1)
+		errx(1, "%s: no output", devpath);
+	conn = drmModeGetConnector(master_fd, res->connectors[0]);
+	if (conn == NULL || conn->count_modes < 1)
+		errx(1, "%s: no modes", devpath);
+	mode = conn->modes[0];
+	for (i = 0; i < conn->count_modes; i++) {
+		if (conn->modes[i].type & DRM_MODE_TYPE_PREFERRED) {
+			mode = conn->modes[i];
+			break;
+		}
+	}
+	crtc_id = res->crtcs[0];
+	connector_id = conn->connector_id;
+
+	fb_create(&scanout, 0x00a50000);
+	if (drmModeSetCrtc(master_fd, crtc_id, scanout.id, 0, 0,
+	    &connector_id, 1, &mode) != 0)
+		err(1, "drmModeSetCrtc");
+
+	drmModeFreeConnector(conn);
+	drmModeFreeResources(res);
+}
+
+/*
+ * Event delivery
+ */
+struct client {
+	pthread_t	thread;
+	int		fd;
+	int		frames;
+	int		depth;
+	uint64_t	*lat;		/* vblank to read(), us */
+	int		nlat;
+	int		reads;
+};
+
+static void *
+client_run(void *arg)
+{
+	struct client *c = arg;
+	uint64_t buf[512], now, t;
+	struct drm_event_vblank *vb;
+	struct drm_event *ev;
+	drmVBlank vbl;
+	ssize_t len, off;
+	int f, i, pending;
+
+	for (f = 0; f < c->frames; f++) {
+		for (i = 0; i < c->depth; i++) {
+			memset(&vbl, 0, sizeof(vbl));
+			vbl.request.type = DRM_VBLANK_RELATIVE |
+			    DRM_VBLANK_EVENT;
+			vbl.request.sequence = 1;
+			if (drmWaitVBlank(c->fd, &vbl) != 0)
+				err(1, "drmWaitVBlank");
+		}
+
+		for (pending = c->depth; pending > 0; ) {
+			len = read(c->fd, buf, sizeof(buf));
+			if (len < 0) {
+				if (errno == EINTR)
+					continue;
+				err(1, "read");
+			}
+			now = now_us();
+			c->reads++;
+			for (off = 0; off < len; off += ev->length) {
+				ev = (struct drm_event *)((char *)buf + off);
+				if (ev->type != DRM_EVENT_VBLANK)
+					continue;
+				vb = (struct drm_event_vblank *)ev;
+				t = (uint64_t)vb->tv_sec * 1000000 +
+				    vb->tv_usec;
+				c->lat[c->nlat++] = now > t ? now - t : 0;
+				pending--;
+			}
+		}
+	}
+
+	return (NULL);
+}
+
+static int
+run_events(int argc, char **argv)
+{
+	struct client *clients;
+	uint64_t *lat, start, elapsed, sum;
+	int ch, maxclients, frames, depth, n, i, nlat, reads;
+
+	maxclients = 64;
+	frames = 120;
+	depth = 1;
+	while ((ch = getopt(argc, argv, "c:f:q:")) != -1) {
+		switch (ch) {
+		case 'c':
+			maxclients = atoi(optarg);
+			break;
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (maxclients < 1 || maxclients > MAX_CLIENTS || frames < 1 ||
+	    depth < 1 || depth > MAX_DEPTH)
+		usage();
+
+	printf("%7s %8s %9s %7s %8s %8s %8s %8s\n", "clients", "events",
+	    "events/s", "ev/read", "avg_us", "p50_us", "p99_us", "max_us");
+	for (n = 1; n <= maxclients; n *= 2) {
+		clients = calloc(n, sizeof(*clients));
+		lat = calloc((size_t)n * frames * depth, sizeof(*lat));
+		if (clients == NULL || lat == NULL)
+			err(1, "calloc");
+
+		for (i = 0; i < n; i++) {
+			clients[i].fd = open(devpath, O_RDWR | O_CLOEXEC);
+			if (clients[i].fd < 0)
+				err(1, "%s", devpath);
+			clients[i].frames = frames;
+			clients[i].depth = depth;
+			clients[i].lat = lat + (size_t)i * frames * depth;
+		}
+
+		start = now_us();
+		for (i = 0; i < n; i++) {
+			errno = pthread_create(&clients[i].thread, NULL,
+			    client_run, &clients[i]);
+			if (errno != 0)
+				err(1, "pthread_create");
+		}
+		for (i = 0; i < n; i++)
+			pthread_join(clients[i].thread, NULL);
+		elapsed = now_us() - start;
+
+		/* Pack the samples, then report over all clients */
+		for (nlat = 0, reads = 0, i = 0; i < n; i++) {
+			memmove(lat + nlat, clients[i].lat,
+			    clients[i].nlat * sizeof(*lat));
+			nlat += clients[i].nlat;
+			reads += clients[i].reads;
+			close(clients[i].fd);
+		}
+		qsort(lat, nlat, sizeof(*lat), cmp_u64);
+		for (sum = 0, i = 0; i < nlat; i++)
+			sum += lat[i];
+
+		printf("%7d %8d %9ju %7.2f %8ju %8ju %8ju %8ju\n", n, nlat,
+		    (uintmax_t)(elapsed ? (uint64_t)nlat * 1000000 / elapsed :
+		    0), reads ? (double)nlat / reads : 0,
+		    (uintmax_t)(nlat ? sum / nlat : 0),
+		    (uintmax_t)lat[nlat / 2],
+		    (uintmax_t)lat[(uint64_t)nlat * 99 / 100],
+		    (uintmax_t)lat[nlat - 1]);
+
+		free(lat);
+		free(clients);
+	}
+
+	return (failures);
+}
+
+/*
+ * PRIME
+ */
+#define	BO_WIDTH	1024
+#define	BO_HEIGHT	64
+#define	BO_SIZE		(BO_WIDTH * BO_HEIGHT * 4)
+
+static uint32_t
+bo_create(int fd)
+{
+	struct drm_mode_create_dumb create;
+
+	memset(&create, 0, sizeof(create));
+	create.width = BO_WIDTH;
+	create.height = BO_HEIGHT;
+	create.bpp = 32;
+	if (drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) != 0)
+		err(1, "DRM_IOCTL_MODE_CREATE_DUMB");
+	return (create.handle);
+}
+
+static uint32_t *
+bo_map(int fd, uint32_t handle)
+{
+	struct drm_mode_map_dumb map;
+	void *ptr;
+
+	memset(&map, 0, sizeof(map));
+	map.handle = handle;
+	if (drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &map) != 0)
+		return (NULL);
+	ptr = mmap(NULL, BO_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+	    map.offset);
+	return (ptr == MAP_FAILED ? NULL : ptr);
+}
+
+static int
+bo_close(int fd, uint32_t handle)
+{
+	struct drm_gem_close close;
+
+	memset(&close, 0, sizeof(close));
+	close.handle = handle;
+	return (drmIoctl(fd, DRM_IOCTL_GEM_CLOSE, &close));
+}
+
+static void
+bo_fill(uint32_t *ptr, uint32_t seed)
+{
+	int i;
+
+	for (i = 0; i < BO_SIZE / 4; i++)
+		ptr[i] = seed ^ i;
+}
+
+/* Map @handle through @fd and check it holds the @seed pattern. */
+static int
+bo_check(int fd, uint32_t handle, uint32_t seed)
+{
+	uint32_t *ptr;
+	int i, ok;
+
+	ptr = bo_map(fd, handle);
+	if (ptr == NULL)
+		return (0);
+	for (ok = 1, i = 0; ok && i < BO_SIZE / 4; i++)
+		ok = ptr[i] == (seed ^ i);
+	munmap(ptr, BO_SIZE);
+	return (ok);
+}
+
+static int
+run_prime(int argc, char **argv)
+{
+	uint32_t handle, h = 0, hc = 0, *ptr;
+	int ch, churn, client, dmabuf, dmabuf2, fd, i, iterations;
+	uint64_t start;
+
+	iterations = 100000;
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (iterations < 1)
+		usage();
+	churn = iterations / 10 > 0 ? iterations / 10 : 1;
+
+	client = open(devpath, O_RDWR | O_CLOEXEC);
+	if (client < 0)
+		err(1, "%s", devpath);
+
+	handle = bo_create(master_fd);
+	ptr = bo_map(master_fd, handle);
+	if (ptr == NULL)
+		err(1, "bo_map");
+	bo_fill(ptr, 0x5a5a0000);
+	munmap(ptr, BO_SIZE);
+
+	/* The exporter gets its own handle back, twice */
+	CHECK(drmPrimeHandleToFD(master_fd, handle, DRM_CLOEXEC,
+	    &dmabuf) == 0, "export: %s", strerror(errno));
+	CHECK(drmPrimeFDToHandle(master_fd, dmabuf, &h) == 0 &&
+	    h == handle, "self import: handle %u, expected %u", h, handle);
+	CHECK(drmPrimeHandleToFD(master_fd, handle, DRM_CLOEXEC,
+	    &dmabuf2) == 0, "re-export: %s", strerror(errno));
+	CHECK(drmPrimeFDToHandle(master_fd, dmabuf2, &h) == 0 &&
+	    h == handle, "re-export import: handle %u, expected %u", h,
+	    handle);
+	close(dmabuf2);
+
+	/* Another file sees the same pages, and one handle per dma-buf */
+	CHECK(drmPrimeFDToHandle(client, dmabuf, &hc) == 0,
+	    "client import: %s", strerror(errno));
+	CHECK(bo_check(client, hc, 0x5a5a0000), "client contents");
+	CHECK(drmPrimeFDToHandle(client, dmabuf, &h) == 0 && h == hc,
+	    "client re-import: handle %u, expected %u", h, hc);
+	CHECK(drmPrimeHandleToFD(client, hc, DRM_CLOEXEC, &fd) == 0,
+	    "client re-export: %s", strerror(errno));
+	CHECK(drmPrimeFDToHandle(master_fd, fd, &h) == 0 && h == handle,
+	    "round trip: handle %u, expected %u", h, handle);
+	close(fd);
+
+	/* Closing the handle must drop it from the caches right away */
+	CHECK(bo_close(client, hc) == 0, "client close: %s",
+	    strerror(errno));
+	CHECK(drmPrimeFDToHandle(client, dmabuf, &hc) == 0,
+	    "import after close: %s", strerror(errno));
+	CHECK(bo_check(client, hc, 0x5a5a0000),
+	    "contents after close and re-import");
+	CHECK(bo_close(client, hc) == 0, "client close: %s",
+	    strerror(errno));
+
+	/* The dma-buf keeps the object alive without the exporter handle */
+	CHECK(bo_close(master_fd, handle) == 0, "exporter close: %s",
+	    strerror(errno));
+	CHECK(drmPrimeFDToHandle(client, dmabuf, &hc) == 0,
+	    "import after exporter close: %s", strerror(errno));
+	CHECK(bo_check(client, hc, 0x5a5a0000),
+	    "contents after exporter close");
+
+	/* Cached lookups, which must not take the per-file lock */
+	start = now_us();
+	for (i = 0; i < iterations; i++) {
+		if (drmPrimeHandleToFD(client, hc, DRM_CLOEXEC, &fd) != 0)
+			break;
+		close(fd);
+	}
+	CHECK(i == iterations, "cached export %d: %s", i, strerror(errno));
+	printf("cached export+close: %ju ns\n",
+	    (uintmax_t)((now_us() - start) * 1000 / iterations));
+
+	start = now_us();
+	for (i = 0; i < iterations; i++) {
+		if (drmPrimeFDToHandle(client, dmabuf, &h) != 0 || h != hc)
+			break;
+	}
+	CHECK(i == iterations, "cached import %d: handle %u, expected %u", i,
+	    h, hc);
+	printf("cached import: %ju ns\n",
+	    (uintmax_t)((now_us() - start) * 1000 / iterations));
+
+	/* Import and close churn, every import misses the cache */
+	start = now_us();
+	for (i = 0; i < churn; i++) {
+		if (bo_close(client, hc) != 0 ||
+		    drmPrimeFDToHandle(client, dmabuf, &hc) != 0)
+			break;
+	}
+	CHECK(i == churn, "import/close churn %d: %s", i,
+	    strerror(errno));
+	printf("uncached import+close: %ju ns\n",
+	    (uintmax_t)((now_us() - start) * 1000 / churn));
+	CHECK(bo_check(client, hc, 0x5a5a0000), "contents after churn");
+
+	bo_close(client, hc);
+	close(dmabuf);
+	close(client);
+
+	return (failures);
+}
+
+/*
+ * Vblank counter queries
+ */
+static int
+set_knob(const char *name, int val)
+{
+#ifdef __FreeBSD__
+	size_t len = sizeof(int);
+	int old;
+
+	if (sysctlbyname(name, &old, &len, &val, sizeof(val)) != 0)
+		err(1, "%s", name);
+	return (old);
+#else
+	(void)name;
+	return (val);
+#endif
+}
+
+static uint64_t
+vblank_query(uint64_t *time_us)
+{
+	drmVBlank vbl;
+
+	memset(&vbl, 0, sizeof(vbl));
+	vbl.request.type = DRM_VBLANK_RELATIVE;
+	vbl.request.sequence = 0;
+	if (drmWaitVBlank(master_fd, &vbl) != 0)
+		err(1, "drmWaitVBlank query");
+	*time_us = (uint64_t)vbl.reply.tval_sec * 1000000 +
+	    vbl.reply.tval_usec;
+	return (vbl.reply.sequence);
+}
+
+static uint64_t
+vblank_wait_next(void)
+{
+	drmVBlank vbl;
+
+	memset(&vbl, 0, sizeof(vbl));
+	vbl.request.type = DRM_VBLANK_RELATIVE;
+	vbl.request.sequence = 1;
+	if (drmWaitVBlank(master_fd, &vbl) != 0)
+		err(1, "drmWaitVBlank");
+	return (vbl.reply.sequence);
+}
+
+static int
+run_vblank(int argc, char **argv)
+{
+	uint64_t seq, last_seq, t, last_t, now, period_us, next, expect;
+	uint64_t gseq, gns;
+	int ch, i, iterations, lagged, old_extrapolate, old_offdelay;
+	uint32_t delay_us[6];
+
+	iterations = 200;
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (iterations < 1)
+		usage();
+
+	period_us = (uint64_t)mode.htotal * mode.vtotal * 1000 / mode.clock;
+	delay_us[0] = 0;
+	delay_us[1] = 1000;
+	delay_us[2] = period_us / 2;
+	delay_us[3] = period_us * 2;
+	delay_us[4] = 30000;	/* past the off-delay below */
+	delay_us[5] = 100000;
+
+	old_extrapolate = set_knob("hw.dri.vblank_extrapolate", 1);
+	old_offdelay = set_knob("hw.dri.vblank_offdelay", 20);
+
+	last_seq = vblank_query(&last_t);
+	for (lagged = 0, i = 0; i < iterations; i++) {
+		usleep(delay_us[i % 6]);
+
+		seq = vblank_query(&t);
+		now = now_us();
+		CHECK(seq >= last_seq, "query went backwards: %ju after %ju",
+		    (uintmax_t)seq, (uintmax_t)last_seq);
+		CHECK(t <= now, "timestamp %ju us in the future",
+		    (uintmax_t)(t - now));
+		/* Timestamps sit on the frame grid, count and time must agree */
+		expect = t >= last_t ? (t - last_t + period_us / 2) / period_us : 0;
+		CHECK(seq - last_seq <= expect + 1 && seq - last_seq + 1 >= expect,
+		    "count advanced %ju over %ju frames",
+		    (uintmax_t)(seq - last_seq), (uintmax_t)expect);
+
+		CHECK(drmCrtcGetSequence(master_fd, crtc_id, &gseq, &gns) == 0,
+		    "drmCrtcGetSequence: %s", strerror(errno));
+		CHECK(gseq >= seq, "get_sequence %ju behind query %ju",
+		    (uintmax_t)gseq, (uintmax_t)seq);
+		last_seq = seq;
+		last_t = t;
+		if (gseq > seq) {
+			last_seq = gseq;
+			last_t = gns / 1000;
+		}
+
+		if (i % 2 != 0)
+			continue;
+
+		/* The next real vblank must come after whatever was reported */
+		next = vblank_wait_next();
+		CHECK(next > last_seq, "query %ju ahead of next vblank %ju",
+		    (uintmax_t)last_seq, (uintmax_t)next);
+		CHECK(next - last_seq <= 2, "query %ju lags next vblank %ju",
+		    (uintmax_t)last_seq, (uintmax_t)next);
+		if (next - last_seq == 2)
+			lagged++;
+		last_seq = vblank_query(&last_t);
+		CHECK(last_seq >= next, "query %ju behind waited vblank %ju",
+		    (uintmax_t)last_seq, (uintmax_t)next);
+	}
+
+	set_knob("hw.dri.vblank_offdelay", old_offdelay);
+	set_knob("hw.dri.vblank_extrapolate", old_extrapolate);
+
+	printf("queries lagging one frame: %d of %d\n", lagged,
+	    (iterations + 1) / 2);
+	return (failures);
+}
+
+/*
+ * Atomic commits
+ */
+static uint32_t
+prop_id(uint32_t obj_id, uint32_t obj_type, const char *name)
+{
+	drmModeObjectProperties *props;
+	drmModePropertyRes *prop;
+	uint32_t i, id;
+
+	props = drmModeObjectGetProperties(master_fd, obj_id, obj_type);
+	if (props == NULL)
+		err(1, "drmModeObjectGetProperties %u", obj_id);
+	for (id = 0, i = 0; id == 0 && i < props->count_props; i++) {
+		prop = drmModeGetProperty(master_fd, props->props[i]);
+		if (prop != NULL && strcmp(prop->name, name) == 0)
+			id = prop->prop_id;
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+	if (id == 0)
+		errx(1, "object %u has no %s property", obj_id, name);
+	return (id);
+}
+
+static uint32_t
+primary_plane(void)
+{
+	drmModePlaneRes *res;
+	uint32_t plane_id;
+
+	res = drmModeGetPlaneResources(master_fd);
+	if (res == NULL || res->count_planes < 1)
+		errx(1, "%s: no planes", devpath);
+	plane_id = res->planes[0];
+	drmModeFreePlaneResources(res);
+	return (plane_id);
+}
+
+/* Commit @fb_id on the primary plane, returns 0 or an errno. */
+static int
+commit_fb(uint32_t plane_id, uint32_t fb_prop, uint32_t fb_id,
+    uint32_t flags)
+{
+	drmModeAtomicReq *req;
+	int ret;
+
+	req = drmModeAtomicAlloc();
+	if (req == NULL)
+		err(1, "drmModeAtomicAlloc");
+	drmModeAtomicAddProperty(req, plane_id, fb_prop, fb_id);
+	ret = drmModeAtomicCommit(master_fd, req, flags, NULL);
+	drmModeAtomicFree(req);
+	return (ret != 0 ? errno : 0);
+}
+
+/* Block until the next flip completion event, returns its read time. */
+static uint64_t
+wait_flip(void)
+{
+	char buf[1024];
+	struct drm_event *ev;
+	ssize_t len, off;
+
+	for (;;) {
+		len = read(master_fd, buf, sizeof(buf));
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			err(1, "read");
+		}
+		for (off = 0; off < len; off += ev->length) {
+			ev = (struct drm_event *)(buf + off);
+			if (ev->type == DRM_EVENT_FLIP_COMPLETE)
+				return (now_us());
+		}
+	}
+}
+
+static int
+run_commit(int argc, char **argv)
+{
+	uint64_t start, elapsed, t, lat, lat_sum, lat_max;
+	uint32_t plane_id, fb_prop, ids[2];
+	struct fb back;
+	int ch, i, iterations, frames, ret;
+
+	iterations = 10000;
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (iterations < 1)
+		usage();
+	/* Real commits are paced by vblank, keep those to a few seconds */
+	frames = iterations < 240 ? iterations : 240;
+
+	if (drmSetClientCap(master_fd, DRM_CLIENT_CAP_ATOMIC, 1) != 0)
+		err(1, "DRM_CLIENT_CAP_ATOMIC");
+	plane_id = primary_plane();
+	fb_prop = prop_id(plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID");
+	fb_create(&back, 0x005a0000);
+	ids[0] = scanout.id;
+	ids[1] = back.id;
+
+	/* Check only: the cost of the core's state duplication and checks */
+	start = now_us();
+	for (i = 0; i < iterations; i++) {
+		ret = commit_fb(plane_id, fb_prop, ids[i & 1],
+		    DRM_MODE_ATOMIC_TEST_ONLY);
+		if (ret != 0)
+			break;
+	}
+	elapsed = now_us() - start;
+	CHECK(i == iterations, "test-only commit %d: %s", i, strerror(ret));
+	printf("test-only: %ju commits/s\n",
+	    (uintmax_t)(elapsed ? (uint64_t)i * 1000000 / elapsed : 0));
+
+	/* Blocking flips each wait for the vblank that latches them */
+	start = now_us();
+	for (i = 0; i < frames; i++) {
+		ret = commit_fb(plane_id, fb_prop, ids[i & 1], 0);
+		if (ret != 0)
+			break;
+	}
+	elapsed = now_us() - start;
+	CHECK(i == frames, "blocking commit %d: %s", i, strerror(ret));
+	printf("blocking: %ju commits/s\n",
+	    (uintmax_t)(elapsed ? (uint64_t)i * 1000000 / elapsed : 0));
+
+	/* Non-blocking flips, the next one queued as the event arrives */
+	lat_sum = lat_max = 0;
+	start = now_us();
+	for (i = 0; i < frames; i++) {
+		t = now_us();
+		ret = commit_fb(plane_id, fb_prop, ids[i & 1],
+		    DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT);
+		if (ret != 0)
+			break;
+		lat = wait_flip() - t;
+		lat_sum += lat;
+		if (lat > lat_max)
+			lat_max = lat;
+	}
+	elapsed = now_us() - start;
+	CHECK(i == frames, "non-blocking commit %d: %s", i, strerror(ret));
+	printf("non-blocking: %ju commits/s, commit to event avg %ju us, "
+	    "max %ju us\n",
+	    (uintmax_t)(elapsed ? (uint64_t)i * 1000000 / elapsed : 0),
+	    (uintmax_t)(i ? lat_sum / i : 0), (uintmax_t)lat_max);
+
+	/* Leave the original framebuffer on screen */
+	CHECK(commit_fb(plane_id, fb_prop, scanout.id, 0) == 0,
+	    "restore: %s", strerror(errno));
+	munmap(back.ptr, back.size);
+	drmModeRmFB(master_fd, back.id);
+	bo_close(master_fd, back.handle);
+
+	return (failures);
+}
+
+/*
+ * Dumb buffers
+ */
+static const struct {
+	uint32_t	width;
+	uint32_t	height;
+} dumb_sizes[] = {
+	{ 64, 64 },
+	{ 256, 256 },
+	{ 1024, 768 },
+	{ 1920, 1080 },
+	{ 3840, 2160 },
+};
+
+/* Map @handle, touch every page, compare or write @seed and unmap. */
+static int
+dumb_touch(uint32_t handle, uint64_t size, uint32_t seed, int verify)
+{
+	struct drm_mode_map_dumb map;
+	uint32_t *ptr;
+	uint64_t off;
+	int ok;
+
+	memset(&map, 0, sizeof(map));
+	map.handle = handle;
+	if (drmIoctl(master_fd, DRM_IOCTL_MODE_MAP_DUMB, &map) != 0)
+		return (0);
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, master_fd,
+	    map.offset);
+	if (ptr == MAP_FAILED)
+		return (0);
+	for (ok = 1, off = 0; off < size / 4; off += 1024) {
+		if (verify)
+			ok &= ptr[off] == (seed ^ off);
+		else
+			ptr[off] = seed ^ off;
+	}
+	munmap(ptr, size);
+	return (ok);
+}
+
+static int
+run_dumb(int argc, char **argv)
+{
+	struct drm_mode_create_dumb create;
+	struct drm_mode_destroy_dumb destroy;
+	uint64_t start, create_us, map_us;
+	unsigned int s;
+	int ch, i, iterations, n;
+
+	iterations = 1000;
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (iterations < 1)
+		usage();
+
+	printf("%9s %9s %10s %10s %10s\n", "size", "KB", "create/s",
+	    "map/s", "map_MB/s");
+	for (s = 0; s < sizeof(dumb_sizes) / sizeof(dumb_sizes[0]); s++) {
+		memset(&create, 0, sizeof(create));
+		create.width = dumb_sizes[s].width;
+		create.height = dumb_sizes[s].height;
+		create.bpp = 32;
+
+		/* Fewer rounds for the big buffers, same amount of memory */
+		n = iterations / (1 + create.width * create.height / 65536);
+		if (n < 10)
+			n = 10;
+
+		start = now_us();
+		for (i = 0; i < n; i++) {
+			if (drmIoctl(master_fd, DRM_IOCTL_MODE_CREATE_DUMB,
+			    &create) != 0)
+				break;
+			destroy.handle = create.handle;
+			if (drmIoctl(master_fd, DRM_IOCTL_MODE_DESTROY_DUMB,
+			    &destroy) != 0)
+				break;
+		}
+		create_us = now_us() - start;
+		CHECK(i == n, "%ux%u create/destroy %d: %s", create.width,
+		    create.height, i, strerror(errno));
+
+		/* Map, fault in every page and unmap one buffer */
+		if (drmIoctl(master_fd, DRM_IOCTL_MODE_CREATE_DUMB,
+		    &create) != 0)
+			err(1, "DRM_IOCTL_MODE_CREATE_DUMB");
+		start = now_us();
+		for (i = 0; i < n; i++) {
+			if (!dumb_touch(create.handle, create.size, i, 0))
+				break;
+		}
+		map_us = now_us() - start;
+		CHECK(i == n, "%ux%u map %d: %s", create.width,
+		    create.height, i, strerror(errno));
+		CHECK(dumb_touch(create.handle, create.size, n - 1, 1),
+		    "%ux%u contents lost across unmap", create.width,
+		    create.height);
+		destroy.handle = create.handle;
+		drmIoctl(master_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+
+		printf("%4ux%-4u %9ju %10ju %10ju %10ju\n", create.width,
+		    create.height, (uintmax_t)(create.size / 1024),
+		    (uintmax_t)(create_us ? (uint64_t)n * 1000000 / create_us :
+		    0),
+		    (uintmax_t)(map_us ? (uint64_t)n * 1000000 / map_us : 0),
+		    (uintmax_t)(map_us ? create.size * n / map_us : 0));
+	}
+
+	return (failures);
+}
+
+/*
+ * GEM handle lookups
+ */
+#define	HANDLES_POOL	256
+#define	HANDLES_MAXTHR	16
+
+struct handles_thread {
+	pthread_t	thread;
+	int		fd;
+	int		index;
+	int		lookups;
+	int		found;
+	int		missed;		/* ENOENT, handle closed under us */
+	int		error;		/* first other errno, 0 if none */
+};
+
+static uint32_t		handles_pool[HANDLES_POOL];
+static volatile int	handles_done;
+
+static void *
+handles_run(void *arg)
+{
+	struct handles_thread *t = arg;
+	struct drm_mode_map_dumb map;
+	int i;
+
+	for (i = 0; i < t->lookups; i++) {
+		memset(&map, 0, sizeof(map));
+		map.handle = __atomic_load_n(
+		    &handles_pool[(i * 7 + t->index * 31) % HANDLES_POOL],
+		    __ATOMIC_RELAXED);
+		if (drmIoctl(t->fd, DRM_IOCTL_MODE_MAP_DUMB, &map) == 0)
+			t->found++;
+		else if (errno == ENOENT)
+			t->missed++;
+		else if (t->error == 0)
+			t->error = errno;
+	}
+
+	return (NULL);
+}
+
+/* Close and recreate pool handles until the lookup threads are done. */
+static void *
+handles_churn(void *arg)
+{
+	int fd = *(int *)arg;
+	uint32_t old;
+	int i;
+
+	for (i = 0; !handles_done; i = (i + 1) % HANDLES_POOL) {
+		old = handles_pool[i];
+		__atomic_store_n(&handles_pool[i], bo_create(fd),
+		    __ATOMIC_RELAXED);
+		if (bo_close(fd, old) != 0)
+			err(1, "DRM_IOCTL_GEM_CLOSE");
+	}
+
+	return (NULL);
+}
+
+static int
+run_handles(int argc, char **argv)
+{
+	static const int nthreads[] = { 1, 4, 16 };
+	struct handles_thread threads[HANDLES_MAXTHR];
+	pthread_t churner;
+	uint64_t start, elapsed, found, missed;
+	unsigned int c;
+	int ch, churn, fd, i, iterations, n;
+
+	iterations = 100000;
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (iterations < 1)
+		usage();
+
+	/* All threads share one file, as a driver's submit threads do */
+	fd = open_device();
+	for (i = 0; i < HANDLES_POOL; i++)
+		handles_pool[i] = bo_create(fd);
+
+	printf("%7s %5s %12s %12s %10s\n", "threads", "churn", "handles/s",
+	    "per_thread/s", "missed");
+	for (churn = 0; churn < 2; churn++) {
+		for (c = 0; c < sizeof(nthreads) / sizeof(nthreads[0]); c++) {
+			n = nthreads[c];
+			memset(threads, 0, sizeof(threads));
+			handles_done = 0;
+			if (churn) {
+				errno = pthread_create(&churner, NULL,
+				    handles_churn, &fd);
+				if (errno != 0)
+					err(1, "pthread_create");
+			}
+
+			start = now_us();
+			for (i = 0; i < n; i++) {
+				threads[i].fd = fd;
+				threads[i].index = i;
+				threads[i].lookups = iterations;
+				errno = pthread_create(&threads[i].thread,
+				    NULL, handles_run, &threads[i]);
+				if (errno != 0)
+					err(1, "pthread_create");
+			}
+			for (i = 0; i < n; i++)
+				pthread_join(threads[i].thread, NULL);
+			elapsed = now_us() - start;
+			handles_done = 1;
+			if (churn)
+				pthread_join(churner, NULL);
+
+			for (found = 0, missed = 0, i = 0; i < n; i++) {
+				found += threads[i].found;
+				missed += threads[i].missed;
+				CHECK(threads[i].error == 0,
+				    "%d threads, churn %d: MAP_DUMB: %s", n,
+				    churn, strerror(threads[i].error));
+			}
+			/* Only a concurrent close may make a lookup miss */
+			CHECK(churn || missed == 0,
+			    "%d threads: %ju lookups of open handles missed",
+			    n, (uintmax_t)missed);
+			CHECK(found + missed == (uint64_t)n * iterations,
+			    "%d threads, churn %d: %ju of %ju lookups done", n,
+			    churn, (uintmax_t)(found + missed),
+			    (uintmax_t)n * iterations);
+
+			printf("%7d %5s %12ju %12ju %10ju\n", n,
+			    churn ? "yes" : "no",
+			    (uintmax_t)(elapsed ? (found + missed) * 1000000 /
+			    elapsed : 0),
+			    (uintmax_t)(elapsed ? (found + missed) * 1000000 /
+			    elapsed / n : 0), (uintmax_t)missed);
+		}
+	}
+
+	for (i = 0; i < HANDLES_POOL; i++)
+		CHECK(bo_close(fd, handles_pool[i]) == 0,
+		    "close handle %u: %s", handles_pool[i], strerror(errno));
+	close(fd);
+
+	return (failures);
+}
+
+/*
+ * Syncobj waits
+ */
+#define	SYNCOBJ_MAX	1024
+
+static uint32_t
+syncobj_create(int fd)
+{
+	struct drm_syncobj_create create;
+
+	memset(&create, 0, sizeof(create));
+	if (drmIoctl(fd, DRM_IOCTL_SYNCOBJ_CREATE, &create) != 0)
+		err(1, "DRM_IOCTL_SYNCOBJ_CREATE");
+	return (create.handle);
+}
+
+static void
+syncobj_destroy(int fd, uint32_t handle)
+{
+	struct drm_syncobj_destroy destroy;
+
+	memset(&destroy, 0, sizeof(destroy));
+	destroy.handle = handle;
+	if (drmIoctl(fd, DRM_IOCTL_SYNCOBJ_DESTROY, &destroy) != 0)
+		err(1, "DRM_IOCTL_SYNCOBJ_DESTROY");
+}
+
+/* Add signaled points[i] to timeline handles[i] */
+static int
+syncobj_signal(int fd, uint32_t *handles, uint64_t *points, int count)
+{
+	struct drm_syncobj_timeline_array array;
+
+	memset(&array, 0, sizeof(array));
+	array.handles = (uintptr_t)handles;
+	array.points = (uintptr_t)points;
+	array.count_handles = count;
+	return (drmIoctl(fd, DRM_IOCTL_SYNCOBJ_TIMELINE_SIGNAL, &array));
+}
+
+/* Wait for the points with an absolute CLOCK_MONOTONIC timeout */
+static int
+syncobj_wait(int fd, uint32_t *handles, uint64_t *points, int count,
+    uint32_t flags, int64_t timeout_ns, uint32_t *first)
+{
+	struct drm_syncobj_timeline_wait wait;
+	int ret;
+
+	memset(&wait, 0, sizeof(wait));
+	wait.handles = (uintptr_t)handles;
+	wait.points = (uintptr_t)points;
+	wait.count_handles = count;
+	wait.flags = flags;
+	wait.timeout_nsec = timeout_ns;
+	ret = drmIoctl(fd, DRM_IOCTL_SYNCOBJ_TIMELINE_WAIT, &wait);
+	if (first != NULL)
+		*first = wait.first_signaled;
+	return (ret);
+}
+
+static void
+syncobj_check_cap(int fd)
+{
+	uint64_t cap;
+
+	if (drmGetCap(fd, DRM_CAP_SYNCOBJ_TIMELINE, &cap) != 0 || cap == 0)
+		errx(1, "%s: no timeline syncobj support", devpath);
+}
+
+/* Signals its points once the waiter is asleep and notes the time. */
+struct syncobj_signaler {
+	pthread_t		thread;
+	pthread_barrier_t	start;
+	pthread_barrier_t	done;
+	int			fd;
+	uint32_t		*handles;
+	uint64_t		*points;
+	int			count;		/* 0 to exit */
+	uint64_t		signal_us;
+	int			error;
+};
+
+static void *
+syncobj_signaler_run(void *arg)
+{
+	struct syncobj_signaler *s = arg;
+
+	for (;;) {
+		pthread_barrier_wait(&s->start);
+		if (s->count == 0)
+			break;
+		usleep(1000);
+		s->signal_us = now_us();
+		if (syncobj_signal(s->fd, s->handles, s->points,
+		    s->count) != 0 && s->error == 0)
+			s->error = errno;
+		pthread_barrier_wait(&s->done);
+	}
+
+	return (NULL);
+}
+
+static int
+run_syncobj(int argc, char **argv)
+{
+	static const int sizes[] = { 1, 4, 16, 64, 256, 1024 };
+	struct syncobj_signaler sig;
+	uint32_t handles[SYNCOBJ_MAX], first, flags;
+	uint64_t points[SYNCOBJ_MAX], *lat, sum, t;
+	unsigned int s;
+	int any, ch, i, iterations, n, r, ret;
+
+	iterations = 200;
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (iterations < 1)
+		usage();
+	syncobj_check_cap(master_fd);
+	if ((lat = calloc(iterations, sizeof(*lat))) == NULL)
+		err(1, "calloc");
+
+	memset(&sig, 0, sizeof(sig));
+	sig.fd = master_fd;
+	pthread_barrier_init(&sig.start, NULL, 2);
+	pthread_barrier_init(&sig.done, NULL, 2);
+	errno = pthread_create(&sig.thread, NULL, syncobj_signaler_run, &sig);
+	if (errno != 0)
+		err(1, "pthread_create");
+
+	/*
+	 * The waiter blocks on points that do not exist yet.  WAIT_ALL gets
+	 * all of them in one signal ioctl, so it wakes once per point; for
+	 * WAIT_ANY only the last entry of the array is signaled.
+	 */
+	printf("%6s %4s %8s %8s %8s %8s\n", "points", "mode", "avg_us",
+	    "p50_us", "p99_us", "max_us");
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		n = sizes[s];
+		for (any = 0; any < 2; any++) {
+			for (i = 0; i < n; i++)
+				handles[i] = syncobj_create(master_fd);
+			flags = DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT |
+			    (any ? 0 : DRM_SYNCOBJ_WAIT_FLAGS_WAIT_ALL);
+
+			for (r = 0; r < iterations; r++) {
+				for (i = 0; i < n; i++)
+					points[i] = r + 1;
+				sig.handles = any ? &handles[n - 1] : handles;
+				sig.points = any ? &points[n - 1] : points;
+				sig.count = any ? 1 : n;
+				pthread_barrier_wait(&sig.start);
+				ret = syncobj_wait(master_fd, handles, points,
+				    n, flags, (now_us() + 1000000) * 1000,
+				    &first);
+				t = now_us();
+				pthread_barrier_wait(&sig.done);
+				CHECK(ret == 0, "%d points, %s: wait: %s", n,
+				    any ? "any" : "all", strerror(errno));
+				CHECK(!any || first == (uint32_t)n - 1,
+				    "%d points: first signaled %u", n, first);
+				lat[r] = t > sig.signal_us ? t - sig.signal_us :
+				    0;
+			}
+			CHECK(sig.error == 0, "%d points: signal: %s", n,
+			    strerror(sig.error));
+
+			qsort(lat, iterations, sizeof(*lat), cmp_u64);
+			for (sum = 0, r = 0; r < iterations; r++)
+				sum += lat[r];
+			printf("%6d %4s %8ju %8ju %8ju %8ju\n", n,
+			    any ? "any" : "all", (uintmax_t)(sum / iterations),
+			    (uintmax_t)lat[iterations / 2],
+			    (uintmax_t)lat[(uint64_t)iterations * 99 / 100],
+			    (uintmax_t)lat[iterations - 1]);
+
+			for (i = 0; i < n; i++)
+				syncobj_destroy(master_fd, handles[i]);
+		}
+	}
+
+	sig.count = 0;
+	pthread_barrier_wait(&sig.start);
+	pthread_join(sig.thread, NULL);
+	pthread_barrier_destroy(&sig.start);
+	pthread_barrier_destroy(&sig.done);
+	free(lat);
+
+	return (failures);
+}
+
+/*
+ * Timeline stress
+ */
+#define	TIMELINE_BATCH		1024
+#define	TIMELINE_PER_FRAME	4096
+
+static uint64_t
+syncobj_query(int fd, uint32_t handle)
+{
+	struct drm_syncobj_timeline_array array;
+	uint64_t point;
+
+	memset(&array, 0, sizeof(array));
+	array.handles = (uintptr_t)&handle;
+	array.points = (uintptr_t)&point;
+	array.count_handles = 1;
+	if (drmIoctl(fd, DRM_IOCTL_SYNCOBJ_QUERY, &array) != 0)
+		err(1, "DRM_IOCTL_SYNCOBJ_QUERY");
+	return (point);
+}
+
+/* Poll @count random points at or below @done, they must have signaled. */
+static void
+timeline_lookup(uint32_t handle, uint64_t done, int count, uint64_t *us)
+{
+	uint64_t point, start;
+	int i, ret;
+
+	start = now_us();
+	for (i = 0; i < count; i++) {
+		point = 1 + (((uint64_t)random() << 31) | random()) % done;
+		ret = syncobj_wait(master_fd, &handle, &point, 1, 0, 0, NULL);
+		CHECK(ret == 0, "point %ju of %ju not signaled: %s",
+		    (uintmax_t)point, (uintmax_t)done, strerror(errno));
+	}
+	*us += now_us() - start;
+}
+
+static int
+run_timeline(int argc, char **argv)
+{
+	uint32_t handles[TIMELINE_BATCH], tl, bin, plane_id, fb_prop;
+	uint32_t fence_prop;
+	uint64_t points[TIMELINE_BATCH], p, q, last, done, start, elapsed;
+	uint64_t lookup_us;
+	struct drm_syncobj_transfer xfer;
+	struct drm_syncobj_handle import;
+	drmModeAtomicReq *req;
+	int ch, fence, frames, i, iterations, lookups;
+
+	iterations = 1000000;
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (iterations < TIMELINE_BATCH)
+		usage();
+	syncobj_check_cap(master_fd);
+
+	/*
+	 * Signaled points, added a batch per ioctl: every add retires the
+	 * collapsed prefix, lookups of old points go through the index.
+	 */
+	tl = syncobj_create(master_fd);
+	for (i = 0; i < TIMELINE_BATCH; i++)
+		handles[i] = tl;
+	lookup_us = 0;
+	lookups = 0;
+	start = now_us();
+	for (p = 0; p < (uint64_t)iterations; ) {
+		for (i = 0; i < TIMELINE_BATCH; i++)
+			points[i] = ++p;
+		if (syncobj_signal(master_fd, handles, points,
+		    TIMELINE_BATCH) != 0)
+			err(1, "DRM_IOCTL_SYNCOBJ_TIMELINE_SIGNAL");
+		q = syncobj_query(master_fd, tl);
+		CHECK(q == p, "signaled: query %ju, expected %ju",
+		    (uintmax_t)q, (uintmax_t)p);
+		if ((p / TIMELINE_BATCH) % 64 == 0) {
+			timeline_lookup(tl, p, 16, &lookup_us);
+			lookups += 16;
+		}
+	}
+	elapsed = now_us() - start - lookup_us;
+	p++;
+	CHECK(syncobj_wait(master_fd, &tl, &p, 1,
+	    DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT, 0, NULL) != 0 &&
+	    errno == ETIME, "signaled: point %ju past the end did not time out",
+	    (uintmax_t)p);
+	printf("signaled: %ju points, %ju points/s, %d lookups, %ju ns "
+	    "each\n", (uintmax_t)(p - 1),
+	    (uintmax_t)(elapsed ? (p - 1) * 1000000 / elapsed : 0), lookups,
+	    (uintmax_t)(lookups ? lookup_us * 1000 / lookups : 0));
+	syncobj_destroy(master_fd, tl);
+
+	/*
+	 * Pending points: each frame's CRTC out-fence is moved to the next
+	 * TIMELINE_PER_FRAME points one at a time, so up to a frame's worth
+	 * of unsignaled points hangs off the chain until the vblank.
+	 */
+	if (drmSetClientCap(master_fd, DRM_CLIENT_CAP_ATOMIC, 1) != 0)
+		err(1, "DRM_CLIENT_CAP_ATOMIC");
+	plane_id = primary_plane();
+	fb_prop = prop_id(plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID");
+	fence_prop = prop_id(crtc_id, DRM_MODE_OBJECT_CRTC, "OUT_FENCE_PTR");
+	tl = syncobj_create(master_fd);
+	bin = syncobj_create(master_fd);
+	frames = (iterations + TIMELINE_PER_FRAME - 1) / TIMELINE_PER_FRAME;
+	lookup_us = 0;
+	lookups = 0;
+	done = last = 0;
+	start = now_us();
+	for (p = 0; frames-- > 0; ) {
+		fence = -1;
+		req = drmModeAtomicAlloc();
+		if (req == NULL)
+			err(1, "drmModeAtomicAlloc");
+		drmModeAtomicAddProperty(req, plane_id, fb_prop, scanout.id);
+		drmModeAtomicAddProperty(req, crtc_id, fence_prop,
+		    (uint64_t)(uintptr_t)&fence);
+		if (drmModeAtomicCommit(master_fd, req,
+		    DRM_MODE_ATOMIC_NONBLOCK, NULL) != 0)
+			err(1, "drmModeAtomicCommit");
+		drmModeAtomicFree(req);
+		if (fence < 0)
+			errx(1, "no CRTC out-fence");
+
+		memset(&import, 0, sizeof(import));
+		import.handle = bin;
+		import.fd = fence;
+		import.flags = DRM_SYNCOBJ_FD_TO_HANDLE_FLAGS_IMPORT_SYNC_FILE;
+		if (drmIoctl(master_fd, DRM_IOCTL_SYNCOBJ_FD_TO_HANDLE,
+		    &import) != 0)
+			err(1, "DRM_IOCTL_SYNCOBJ_FD_TO_HANDLE");
+		close(fence);
+
+		for (i = 0; i < TIMELINE_PER_FRAME; i++) {
+			memset(&xfer, 0, sizeof(xfer));
+			xfer.src_handle = bin;
+			xfer.dst_handle = tl;
+			xfer.dst_point = ++p;
+			if (drmIoctl(master_fd, DRM_IOCTL_SYNCOBJ_TRANSFER,
+			    &xfer) != 0)
+				err(1, "DRM_IOCTL_SYNCOBJ_TRANSFER");
+			if (p % 256 != 0)
+				continue;
+			/* The fence may signal any time, but only once */
+			q = syncobj_query(master_fd, tl);
+			CHECK(q >= last && q >= done && q <= p,
+			    "pending: query %ju, previous %ju, done %ju, "
+			    "added %ju", (uintmax_t)q, (uintmax_t)last,
+			    (uintmax_t)done, (uintmax_t)p);
+			last = q;
+			if (done > 0) {
+				timeline_lookup(tl, done, 1, &lookup_us);
+				lookups++;
+			}
+		}
+
+		CHECK(syncobj_wait(master_fd, &tl, &p, 1,
+		    DRM_SYNCOBJ_WAIT_FLAGS_WAIT_ALL,
+		    (int64_t)(now_us() + 1000000) * 1000, NULL) == 0,
+		    "pending: point %ju: %s", (uintmax_t)p, strerror(errno));
+		done = p;
+	}
+	elapsed = now_us() - start - lookup_us;
+	q = syncobj_query(master_fd, tl);
+	CHECK(q == p, "pending: final query %ju, expected %ju", (uintmax_t)q,
+	    (uintmax_t)p);
+	printf("pending: %ju points, %ju points/s, %d lookups, %ju ns each\n",
+	    (uintmax_t)p, (uintmax_t)(elapsed ? p * 1000000 / elapsed : 0),
+	    lookups, (uintmax_t)(lookups ? lookup_us * 1000 / lookups : 0));
+	syncobj_destroy(master_fd, bin);
+	syncobj_destroy(master_fd, tl);
+
+	return (failures);
+}
+
+/*
+ * Writeback
+ */
+static int
+run_writeback(int argc, char **argv)
+{
+	uint32_t wb_id, crtc_prop, fb_prop, fence_prop, y;
+	drmModeAtomicReq *req;
+	drmModeConnector *conn;
+	drmModeRes *res;
+	struct pollfd pfd;
+	struct fb wb;
+	uint64_t start, elapsed;
+	int ch, fence, i, iterations, same;
+
+	iterations = 120;
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (iterations < 1)
+		usage();
+
+	if (drmSetClientCap(master_fd, DRM_CLIENT_CAP_ATOMIC, 1) != 0 ||
+	    drmSetClientCap(master_fd, DRM_CLIENT_CAP_WRITEBACK_CONNECTORS,
+	    1) != 0)
+		err(1, "drmSetClientCap");
+	res = drmModeGetResources(master_fd);
+	if (res == NULL)
+		err(1, "drmModeGetResources");
+	for (wb_id = 0, i = 0; wb_id == 0 && i < res->count_connectors; i++) {
+		conn = drmModeGetConnector(master_fd, res->connectors[i]);
+		if (conn != NULL &&
+		    conn->connector_type == DRM_MODE_CONNECTOR_WRITEBACK)
+			wb_id = conn->connector_id;
+		drmModeFreeConnector(conn);
+	}
+	drmModeFreeResources(res);
+	if (wb_id == 0)
+		errx(1, "%s: no writeback connector", devpath);
+	crtc_prop = prop_id(wb_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID");
+	fb_prop = prop_id(wb_id, DRM_MODE_OBJECT_CONNECTOR, "WRITEBACK_FB_ID");
+	fence_prop = prop_id(wb_id, DRM_MODE_OBJECT_CONNECTOR,
+	    "WRITEBACK_OUT_FENCE_PTR");
+	fb_create(&wb, 0);
+
+	start = now_us();
+	for (i = 0; i < iterations; i++) {
+		memset(wb.ptr, 0, wb.size);
+
+		fence = -1;
+		req = drmModeAtomicAlloc();
+		if (req == NULL)
+			err(1, "drmModeAtomicAlloc");
+		drmModeAtomicAddProperty(req, wb_id, crtc_prop, crtc_id);
+		drmModeAtomicAddProperty(req, wb_id, fb_prop, wb.id);
+		drmModeAtomicAddProperty(req, wb_id, fence_prop,
+		    (uint64_t)(uintptr_t)&fence);
+		CHECK(drmModeAtomicCommit(master_fd, req,
+		    DRM_MODE_ATOMIC_ALLOW_MODESET, NULL) == 0,
+		    "writeback commit %d: %s", i, strerror(errno));
+		drmModeAtomicFree(req);
+		if (fence < 0) {
+			CHECK(0, "writeback %d: no out-fence", i);
+			break;
+		}
+
+		pfd.fd = fence;
+		pfd.events = POLLIN;
+		CHECK(poll(&pfd, 1, 1000) == 1, "writeback %d: fence not "
+		    "signalled", i);
+		close(fence);
+
+		for (same = 1, y = 0; same && y < mode.vdisplay; y++)
+			same = memcmp(wb.ptr + y * wb.pitch / 4,
+			    scanout.ptr + y * scanout.pitch / 4,
+			    mode.hdisplay * 4) == 0;
+		CHECK(same, "writeback %d: line %u differs from scanout", i,
+		    y - 1);
+	}
+	elapsed = now_us() - start;
+	printf("writeback: %ju frames/s\n",
+	    (uintmax_t)(elapsed ? (uint64_t)i * 1000000 / elapsed : 0));
+
+	/* Detach the writeback connector again */
+	req = drmModeAtomicAlloc();
+	if (req == NULL)
+		err(1, "drmModeAtomicAlloc");
+	drmModeAtomicAddProperty(req, wb_id, crtc_prop, 0);
+	CHECK(drmModeAtomicCommit(master_fd, req,
+	    DRM_MODE_ATOMIC_ALLOW_MODESET, NULL) == 0, "writeback detach: %s",
+	    strerror(errno));
+	drmModeAtomicFree(req);
+
+	munmap(wb.ptr, wb.size);
+	drmModeRmFB(master_fd, wb.id);
+	bo_close(master_fd, wb.handle);
+
+	return (failures);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *test;
+	int ch, ret;
+
+	while ((ch = getopt(argc, argv, "d:")) != -1) {
+		switch (ch) {
+		case 'd':
+			devpath = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc < 1)
+		usage();
+	test = argv[0];
+	optind = 1;
+#ifdef __FreeBSD__
+	optreset = 1;
+#endif
+
+	setup_output();
+
+	if (strcmp(test, "events") == 0)
+		ret = run_events(argc, argv);
+	else if (strcmp(test, "prime") == 0)
+		ret = run_prime(argc, argv);
+	else if (strcmp(test, "vblank") == 0)
+		ret = run_vblank(argc, argv);
+	else if (strcmp(test, "commit") == 0)
+		ret = run_commit(argc, argv);
+	else if (strcmp(test, "dumb") == 0)
+		ret = run_dumb(argc, argv);
+	else if (strcmp(test, "handles") == 0)
+		ret = run_handles(argc, argv);
+	else if (strcmp(test, "syncobj") == 0)
+		ret = run_syncobj(argc, argv);
+	else if (strcmp(test, "timeline") == 0)
+		ret = run_timeline(argc, argv);
+	else if (strcmp(test, "writeback") == 0)
+		ret = run_writeback(argc, argv);
+	else
+		usage();
+
+	if (checks > 0)
+		printf("%s: %d checks, %d failed\n", test, checks, failures);
+	return (ret != 0);
+}
@@ -0,0 +1,656 @@
+/*
+ * i915cmdtest - replay batches through the i915 command parser lookup.
+ *
+ * Build with "cc -O2 -o i915cmdtest i915cmdtest.c" in this directory.  The
+ * kernel's drivers/gpu/drm/i915/i915_cmd_tables.h is compiled as is, so the
+ * engine command tables, the default length decoders and the slot lookup
+ * are the ones intel_engine_init_cmd_parser() sets up.  Next to it is a
+ * copy of the 512-bucket hash table the lookup replaced, hashed the way the
+ * LinuxKPI hash_32() does it.
+ *
+ * For every engine table, each header with any value in bits 31:16 and a
+ * few patterns in bits 15:0 is looked up in the slot lookup and compared
+ * against a linear search of the tables, which returns the last matching
+ * descriptor as the lookup and the hash do.  Descriptors the hash finds
+ * differently are counted, but are not failures.  Then random batches are
+ * replayed the way parse_cmds() walks them, with both lookups, and must end
+ * with the same verdict after the same number of commands.  Register
+ * whitelists and BB_START checks are not modelled: they are the same work
+ * with either lookup.
+ *
+ * The same batches are copied and parsed a chunk at a time the way
+ * copy_and_parse_batch() does, with chunks that cut through commands, and
+ * must give the verdict of parsing the whole batch at once.
+ *
+ * Then the commands per second both replay on each engine are reported,
+ * and the MB/s of copying and parsing batches up to 64 MiB, in two passes
+ * and page by page.  The source is plain memory here, where the kernel
+ * reads it through WC or after clflush, so only the cache effect of the
+ * second pass is measured.  "-b" only runs the benchmarks, "-t" only the
+ * test.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* What i915_cmd_tables.h expects from the kernel */
+typedef uint16_t	u16;
+typedef uint32_t	u32;
+typedef uint64_t	u64;
+
+#define	ARRAY_SIZE(x)		(sizeof(x) / sizeof((x)[0]))
+#define	GENMASK(h, l)		((~0u << (l)) & (~0u >> (31 - (h))))
+#define	U16_MAX			UINT16_MAX
+#define	DRM_DEBUG_DRIVER(...)	do { } while (0)
+
+#include "../drivers/gpu/drm/i915/i915_cmd_tables.h"
+
+#define	LENGTH_BIAS	2
+#define	HASH_ORDER	9
+
+struct engine {
+	const char *name;
+	const struct drm_i915_cmd_table *tables;
+	int count;
+	u32 (*get_cmd_length_mask)(u32 cmd_header);
+	/* The clients the engine's batches are made of */
+	u32 clients[3];
+	int nclients;
+	struct drm_i915_cmd_lookup *lookup;
+	struct cmd_node *hash[1 << HASH_ORDER];
+};
+
+static struct engine engines[] = {
+	{ "ivb rcs", gen7_render_cmd_table, ARRAY_SIZE(gen7_render_cmd_table),
+	  gen7_render_get_cmd_length_mask,
+	  { INSTR_MI_CLIENT, INSTR_RC_CLIENT }, 2 },
+	{ "hsw rcs", hsw_render_ring_cmd_table,
+	  ARRAY_SIZE(hsw_render_ring_cmd_table),
+	  gen7_render_get_cmd_length_mask,
+	  { INSTR_MI_CLIENT, INSTR_RC_CLIENT }, 2 },
+	{ "ivb vcs", gen7_video_cmd_table, ARRAY_SIZE(gen7_video_cmd_table),
+	  gen7_bsd_get_cmd_length_mask,
+	  { INSTR_MI_CLIENT, INSTR_RC_CLIENT }, 2 },
+	{ "hsw vecs", hsw_vebox_cmd_table, ARRAY_SIZE(hsw_vebox_cmd_table),
+	  gen7_bsd_get_cmd_length_mask,
+	  { INSTR_MI_CLIENT, INSTR_RC_CLIENT }, 2 },
+	{ "ivb bcs", gen7_blt_cmd_table, ARRAY_SIZE(gen7_blt_cmd_table),
+	  gen7_blt_get_cmd_length_mask,
+	  { INSTR_MI_CLIENT, INSTR_BC_CLIENT }, 2 },
+	{ "hsw bcs", hsw_blt_ring_cmd_table,
+	  ARRAY_SIZE(hsw_blt_ring_cmd_table),
+	  gen7_blt_get_cmd_length_mask,
+	  { INSTR_MI_CLIENT, INSTR_BC_CLIENT }, 2 },
+	{ "skl bcs", gen9_blt_cmd_table, ARRAY_SIZE(gen9_blt_cmd_table),
+	  gen9_blt_get_cmd_length_mask,
+	  { INSTR_MI_CLIENT, INSTR_BC_CLIENT }, 2 },
+};
+
+#define	NENGINES	ARRAY_SIZE(engines)
+
+static long checks, failures, hash_differs;
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static uint32_t
+rnd(void)
+{
+	static uint64_t state = 0x9e3779b97f4a7c15ull;
+
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return ((uint32_t)(state >> 16));
+}
+
+/*
+ * The lookup before the slot table: an hlist per bucket, each descriptor
+ * added at the head of the bucket of cmd_header_key(), and hash_min() of a
+ * u32 key is hash_32(), which in LinuxKPI is hash32_buf() from <sys/hash.h>.
+ */
+struct cmd_node {
+	const struct drm_i915_cmd_descriptor *desc;
+	struct cmd_node *next;
+};
+
+static u32
+cmd_header_key(u32 x)
+{
+	switch (x >> INSTR_CLIENT_SHIFT) {
+	default:
+	case INSTR_MI_CLIENT:
+		return (x >> STD_MI_OPCODE_SHIFT);
+	case INSTR_RC_CLIENT:
+		return (x >> STD_3D_OPCODE_SHIFT);
+	case INSTR_BC_CLIENT:
+		return (x >> STD_2D_OPCODE_SHIFT);
+	}
+}
+
+static u32
+hash_32(u32 val, unsigned int bits)
+{
+	const unsigned char *p = (const unsigned char *)&val;
+	u32 hash = bits;
+	size_t len = sizeof(val);
+
+	while (len--)
+		hash = ((hash << 5) + hash) + *p++;
+	return (hash >> (32 - bits));
+}
+
+static void
+init_hash(struct engine *e)
+{
+	struct cmd_node *node;
+	int i, j;
+
+	for (i = 0; i < e->count; i++) {
+		for (j = 0; j < e->tables[i].count; j++) {
+			const struct drm_i915_cmd_descriptor *desc =
+			    &e->tables[i].table[j];
+			u32 b = hash_32(cmd_header_key(desc->cmd.value),
+			    HASH_ORDER);
+
+			if ((node = malloc(sizeof(*node))) == NULL)
+				err(1, "malloc");
+			node->desc = desc;
+			node->next = e->hash[b];
+			e->hash[b] = node;
+		}
+	}
+}
+
+static const struct drm_i915_cmd_descriptor *
+hash_cmd(const struct engine *e, u32 cmd_header)
+{
+	const struct cmd_node *node;
+
+	for (node = e->hash[hash_32(cmd_header_key(cmd_header), HASH_ORDER)];
+	    node != NULL; node = node->next)
+		if (((cmd_header ^ node->desc->cmd.value) &
+		    node->desc->cmd.mask) == 0)
+			return (node->desc);
+	return (NULL);
+}
+
+/* As intel_engine_init_cmd_parser() does with kvzalloc() and kvmalloc() */
+static void
+init_lookup(struct engine *e)
+{
+	struct drm_i915_cmd_lookup *lookup;
+	int total;
+
+	if ((lookup = calloc(1, sizeof(*lookup))) == NULL)
+		err(1, "calloc");
+	total = count_cmd_lookup(lookup, e->tables, e->count);
+	if (total < 0)
+		errx(1, "%s: count_cmd_lookup: %s", e->name,
+		    strerror(-total));
+	e->lookup = malloc(sizeof(*lookup) +
+	    total * sizeof(lookup->descs[0]));
+	if (e->lookup == NULL)
+		err(1, "malloc");
+	memcpy(e->lookup->slot, lookup->slot, sizeof(lookup->slot));
+	free(lookup);
+	fill_cmd_lookup(e->lookup, e->tables, e->count);
+}
+
+static const struct drm_i915_cmd_descriptor *
+linear_cmd(const struct engine *e, u32 cmd_header)
+{
+	const struct drm_i915_cmd_descriptor *found = NULL;
+	int i, j;
+
+	for (i = 0; i < e->count; i++)
+		for (j = 0; j < e->tables[i].count; j++) {
+			const struct drm_i915_cmd_descriptor *desc =
+			    &e->tables[i].table[j];
+
+			if (((cmd_header ^ desc->cmd.value) &
+			    desc->cmd.mask) == 0)
+				found = desc;
+		}
+	return (found);
+}
+
+/* find_cmd(), with either lookup */
+static const struct drm_i915_cmd_descriptor *
+find_cmd(const struct engine *e, bool hash, u32 cmd_header,
+    const struct drm_i915_cmd_descriptor *desc,
+    struct drm_i915_cmd_descriptor *default_desc)
+{
+	u32 mask;
+
+	if (((cmd_header ^ desc->cmd.value) & desc->cmd.mask) == 0)
+		return (desc);
+
+	desc = hash ? hash_cmd(e, cmd_header) :
+	    lookup_cmd(e->lookup, cmd_header);
+	if (desc != NULL)
+		return (desc);
+
+	mask = e->get_cmd_length_mask(cmd_header);
+	if (mask == 0)
+		return (NULL);
+
+	default_desc->cmd.value = cmd_header;
+	default_desc->cmd.mask = ~0u << MIN_OPCODE_SHIFT;
+	default_desc->length.mask = mask;
+	default_desc->flags = CMD_DESC_SKIP;
+	return (default_desc);
+}
+
+/* What parse_cmds() keeps in struct cmd_parser, with the lookup to use */
+struct cmd_parser {
+	const struct engine *e;
+	bool hash;
+	struct drm_i915_cmd_descriptor default_desc;
+	const struct drm_i915_cmd_descriptor *desc;
+	const u32 *cmd;
+	const u32 *batch_end;
+	long ncmds;
+	bool done;
+};
+
+static void
+init_parser(struct cmd_parser *p, const struct engine *e, bool hash,
+    const u32 *batch, u32 len)
+{
+	p->e = e;
+	p->hash = hash;
+	p->default_desc = noop_desc;
+	p->desc = &p->default_desc;
+	p->cmd = batch;
+	p->batch_end = batch + len;
+	p->ncmds = 0;
+	p->done = false;
+}
+
+/*
+ * parse_cmds() up to @avail, the end of the part copied so far.  Returns
+ * -EACCES for a rejected command and -EINVAL for a malformed batch, and
+ * sets p->done at MI_BATCH_BUFFER_END.
+ */
+static int
+parse_cmds(struct cmd_parser *p, const u32 *avail)
+{
+	const struct drm_i915_cmd_descriptor *desc = p->desc;
+	const u32 *cmd = p->cmd;
+	u32 length;
+	int ret = 0;
+
+	while (cmd < avail) {
+		if (*cmd == MI_BATCH_BUFFER_END) {
+			p->done = true;
+			break;
+		}
+
+		desc = find_cmd(p->e, p->hash, *cmd, desc, &p->default_desc);
+		if (desc == NULL) {
+			ret = -EINVAL;
+			break;
+		}
+
+		if (desc->flags & CMD_DESC_FIXED)
+			length = desc->length.fixed;
+		else
+			length = (*cmd & desc->length.mask) + LENGTH_BIAS;
+		if (p->batch_end - cmd < length) {
+			ret = -EINVAL;
+			break;
+		}
+
+		/* The tail of this command has not been copied yet */
+		if (avail - cmd < length)
+			break;
+
+		if (desc->flags & CMD_DESC_REJECT) {
+			ret = -EACCES;
+			break;
+		}
+
+		p->ncmds++;
+		cmd += length;
+		if (cmd >= p->batch_end) {
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+	p->cmd = cmd;
+	p->desc = desc;
+	return (ret);
+}
+
+/*
+ * Copy @len dwords of @src to @dst and parse them, as copy_and_parse_batch()
+ * does: @chunk bytes at a time, parsing each chunk as it lands, or with
+ * @chunk 0, copying the whole batch first and parsing it afterwards, as
+ * i915_parse_cmds() did before.  Returns the verdict, with the number of
+ * commands walked in *ncmds.
+ */
+static int
+copy_and_parse(const struct engine *e, bool hash, u32 *dst, const u32 *src,
+    u32 len, u32 chunk, long *ncmds)
+{
+	struct cmd_parser p;
+	u32 pos, n;
+	int ret = 0;
+
+	init_parser(&p, e, hash, dst, len);
+	if (chunk == 0) {
+		memcpy(dst, src, len * sizeof(u32));
+		ret = parse_cmds(&p, dst + len);
+	} else {
+		for (pos = 0; pos < len && !p.done && !ret; pos += n) {
+			n = len - pos < chunk / sizeof(u32) ? len - pos :
+			    chunk / sizeof(u32);
+			memcpy(dst + pos, src + pos, n * sizeof(u32));
+			ret = parse_cmds(&p, dst + pos + n);
+		}
+	}
+	if (!ret && !p.done)
+		ret = -EINVAL;
+
+	*ncmds = p.ncmds;
+	return (ret);
+}
+
+static int
+replay(const struct engine *e, bool hash, const u32 *batch, u32 len,
+    long *ncmds)
+{
+	struct cmd_parser p;
+	int ret;
+
+	init_parser(&p, e, hash, batch, len);
+	ret = parse_cmds(&p, batch + len);
+	if (!ret && !p.done)
+		ret = -EINVAL;
+
+	*ncmds = p.ncmds;
+	return (ret);
+}
+
+/*
+ * A header for a command of one of the engine's clients: one of its
+ * table's descriptors, or a random opcode for the default length decoder.
+ * The length field is kept small, as real batches mostly have it.
+ */
+static u32
+random_header(const struct engine *e)
+{
+	const struct drm_i915_cmd_descriptor *desc;
+	const struct drm_i915_cmd_table *table;
+	u32 hdr, mask;
+
+	if (rnd() % 4 == 0) {
+		table = &e->tables[rnd() % e->count];
+		desc = &table->table[rnd() % table->count];
+		hdr = (desc->cmd.value & desc->cmd.mask) |
+		    (rnd() & ~desc->cmd.mask);
+	} else
+		hdr = e->clients[rnd() % e->nclients] << INSTR_CLIENT_SHIFT |
+		    (rnd() & ((1u << INSTR_CLIENT_SHIFT) - 1));
+
+	desc = linear_cmd(e, hdr);
+	mask = desc != NULL ? (desc->flags & CMD_DESC_FIXED ? 0 :
+	    desc->length.mask) : e->get_cmd_length_mask(hdr);
+	return ((hdr & ~mask) | (rnd() & 7 & mask));
+}
+
+/*
+ * A batch of ncmds commands that parses to the end: rejected and
+ * undecodable commands, BB_START and BBE are left out, then BBE.
+ */
+static u32
+make_batch(const struct engine *e, u32 *batch, u32 size, long ncmds)
+{
+	struct drm_i915_cmd_descriptor default_desc = noop_desc;
+	const struct drm_i915_cmd_descriptor *desc;
+	u32 hdr, len = 0, length;
+
+	while (ncmds > 0) {
+		hdr = random_header(e);
+		if (hdr == MI_BATCH_BUFFER_END)
+			continue;
+		desc = find_cmd(e, false, hdr, &noop_desc, &default_desc);
+		if (desc == NULL || desc->flags & CMD_DESC_REJECT ||
+		    desc->cmd.value == MI_BATCH_BUFFER_START)
+			continue;
+		length = desc->flags & CMD_DESC_FIXED ? desc->length.fixed :
+		    (hdr & desc->length.mask) + LENGTH_BIAS;
+		if (len + length + 1 > size)
+			break;
+		batch[len] = hdr;
+		memset(&batch[len + 1], 0, (length - 1) * sizeof(u32));
+		len += length;
+		ncmds--;
+	}
+	batch[len++] = MI_BATCH_BUFFER_END;
+	return (len);
+}
+
+static void
+check_lookup(struct engine *e, u32 hdr)
+{
+	const struct drm_i915_cmd_descriptor *ref, *desc;
+
+	ref = linear_cmd(e, hdr);
+	desc = lookup_cmd(e->lookup, hdr);
+	checks++;
+	if (desc != ref && failures++ < 20)
+		printf("FAIL %s: header 0x%08x: lookup %p, expected %p\n",
+		    e->name, hdr, (const void *)desc, (const void *)ref);
+	if (hash_cmd(e, hdr) != ref)
+		hash_differs++;
+}
+
+static void
+run_test(void)
+{
+	static const u32 chunks[] = { 4, 60, 4096 };
+	static u32 batch[1 << 16], shadow[1 << 16];
+	struct engine *e;
+	long n_hash, n_lookup, n_copy;
+	u32 hi, len, c;
+	int ret_hash, ret_lookup, ret_copy, i, k;
+
+	for (e = engines; e < engines + NENGINES; e++) {
+		for (hi = 0; hi < 1 << 16; hi++) {
+			check_lookup(e, hi << 16);
+			check_lookup(e, hi << 16 | 0xffff);
+			check_lookup(e, hi << 16 | (rnd() & 0xffff));
+		}
+
+		for (i = 0; i < 2000; i++) {
+			len = make_batch(e, batch, ARRAY_SIZE(batch),
+			    1 + rnd() % 512);
+			/* Damage some: a stray header, or a cut off batch */
+			if (i % 4 == 1)
+				batch[rnd() % len] = rnd();
+			else if (i % 4 == 2)
+				len = 1 + rnd() % len;
+			for (k = 0; k < 2; k++) {
+				ret_hash = replay(e, true, batch, len, &n_hash);
+				ret_lookup = replay(e, false, batch, len,
+				    &n_lookup);
+				checks++;
+				if ((ret_hash != ret_lookup ||
+				    n_hash != n_lookup) && failures++ < 20)
+					printf("FAIL %s: batch %d: hash %d "
+					    "after %ld, lookup %d after %ld\n",
+					    e->name, i, ret_hash, n_hash,
+					    ret_lookup, n_lookup);
+				/* Commands straddling a chunk end are parsed late */
+				for (c = 0; c < ARRAY_SIZE(chunks); c++) {
+					ret_copy = copy_and_parse(e, false,
+					    shadow, batch, len, chunks[c],
+					    &n_copy);
+					checks++;
+					if ((ret_copy != ret_lookup ||
+					    n_copy != n_lookup) &&
+					    failures++ < 20)
+						printf("FAIL %s: batch %d: "
+						    "%u byte chunks %d after "
+						    "%ld, expected %d after "
+						    "%ld\n", e->name, i,
+						    chunks[c], ret_copy, n_copy,
+						    ret_lookup, n_lookup);
+				}
+				/* And once more starting off a table command */
+				batch[0] = random_header(e);
+			}
+		}
+	}
+
+	printf("test: %ld checks, %ld failed, %ld hash lookups differ\n",
+	    checks, failures, hash_differs);
+}
+
+static void
+run_bench(void)
+{
+	static u32 batch[1 << 20];
+	volatile long sink;
+	struct engine *e;
+	uint64_t start, t, elapsed[2];
+	long ncmds, total;
+	u32 len;
+	int hash, r, i;
+
+	printf("%-9s %8s %12s %12s\n", "engine", "dw/cmd", "hash_Mcmd/s",
+	    "slot_Mcmd/s");
+	for (e = engines; e < engines + NENGINES; e++) {
+		len = make_batch(e, batch, ARRAY_SIZE(batch), 100000);
+		if (replay(e, false, batch, len, &total) != 0)
+			errx(1, "%s: benchmark batch does not parse", e->name);
+		for (hash = 0; hash < 2; hash++) {
+			/* Best of five, to keep other load out of it */
+			for (elapsed[hash] = UINT64_MAX, r = 0; r < 5; r++) {
+				start = now_ns();
+				for (i = 0; i < 20; i++) {
+					replay(e, hash, batch, len, &ncmds);
+					sink = ncmds;
+				}
+				t = now_ns() - start;
+				if (t < elapsed[hash])
+					elapsed[hash] = t;
+			}
+		}
+		(void)sink;
+		printf("%-9s %8.1f %12.1f %12.1f\n", e->name,
+		    (double)len / total,
+		    (double)total * 20 * 1000 / elapsed[1],
+		    (double)total * 20 * 1000 / elapsed[0]);
+	}
+}
+
+/*
+ * Copy and parse batches of increasing size, copying all of it before
+ * parsing and parsing each page as it is copied.  Big batches no longer
+ * fit the caches between the copy and a second pass over the shadow.
+ */
+static void
+run_copy_bench(void)
+{
+	static const u32 sizes[] = { 64 << 10, 1 << 20, 16 << 20, 64 << 20 };
+	const struct engine *e = &engines[1];
+	volatile long sink;
+	uint64_t start, t, elapsed[2];
+	u32 *src, *dst, len, s;
+	long ncmds;
+	int fused, r, i, n;
+
+	src = malloc(sizes[ARRAY_SIZE(sizes) - 1]);
+	dst = malloc(sizes[ARRAY_SIZE(sizes) - 1]);
+	if (src == NULL || dst == NULL)
+		err(1, "malloc");
+	memset(dst, 0, sizes[ARRAY_SIZE(sizes) - 1]);
+
+	printf("%-9s %10s %12s %12s\n", e->name, "batch_KiB", "2pass_MB/s",
+	    "fused_MB/s");
+	for (s = 0; s < ARRAY_SIZE(sizes); s++) {
+		len = make_batch(e, src, sizes[s] / sizeof(u32), LONG_MAX);
+		if (copy_and_parse(e, false, dst, src, len, 0, &ncmds) != 0)
+			errx(1, "%s: benchmark batch does not parse", e->name);
+		n = (256 << 20) / sizes[s];
+		for (fused = 0; fused < 2; fused++) {
+			/* Best of five, to keep other load out of it */
+			for (elapsed[fused] = UINT64_MAX, r = 0; r < 5; r++) {
+				start = now_ns();
+				for (i = 0; i < n; i++) {
+					copy_and_parse(e, false, dst, src, len,
+					    fused ? 4096 : 0, &ncmds);
+					sink = ncmds;
+				}
+				t = now_ns() - start;
+				if (t < elapsed[fused])
+					elapsed[fused] = t;
+			}
+		}
+		(void)sink;
+		printf("%-9s %10u %12ju %12ju\n", "", sizes[s] >> 10,
+		    (uintmax_t)((uint64_t)n * len * sizeof(u32) * 1000 /
+		    elapsed[0]),
+		    (uintmax_t)((uint64_t)n * len * sizeof(u32) * 1000 /
+		    elapsed[1]));
+	}
+
+	free(src);
+	free(dst);
+}
+
+int
+main(int argc, char **argv)
+{
+	bool bench, test;
+	struct engine *e;
+	int ch;
+
+	bench = test = true;
+	while ((ch = getopt(argc, argv, "bt")) != -1) {
+		switch (ch) {
+		case 'b':
+			test = false;
+			break;
+		case 't':
+			bench = false;
+			break;
+		default:
+			fprintf(stderr, "usage: i915cmdtest [-b | -t]\n");
+			return (1);
+		}
+	}
+
+	for (e = engines; e < engines + NENGINES; e++) {
+		init_lookup(e);
+		init_hash(e);
+	}
+	if (test)
+		run_test();
+	if (bench) {
+		run_bench();
+		run_copy_bench();
+	}
+
+	return (failures != 0);
+}
@@ -0,0 +1,515 @@
+/*
+ * radeonregtest - replay SET_CONFIG_REG / SET_CONTEXT_REG command streams
+ * through the radeon register checks.
+ *
+ * Build with "cc -O2 -o radeonregtest radeonregtest.c" in this directory.
+ * The kernel's drivers/gpu/drm/radeon/radeon_reg_range.h and the generated
+ * r600, evergreen and cayman reg_safe_bm tables are compiled as is.  Next
+ * to them are copies of the per register loops r600_packet3_check() and
+ * evergreen_packet3_check() ran before the bitmap word walk.
+ *
+ * Every stream is replayed through both, for each asic.  The register
+ * checker is a model: it logs each register and index it is called for,
+ * and rejects registers beyond the bitmap and a fixed quarter of the
+ * registers that have their bit set, the way the real handlers reject the
+ * ones they do not know.  The old and new code must return the same
+ * verdict after the same calls.  The streams are a few hand written good
+ * and bad ones, then random ones, which are known good or known bad by
+ * what the old code says about them.  Runs straight into the walk are
+ * checked as well, including runs beyond the bitmap.
+ *
+ * Then the registers per second both check on draw-like streams are
+ * reported.  "-b" only runs the benchmark, "-t" only the test.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* What the kernel headers expect */
+typedef uint32_t	u32;
+
+#define	__FBSDID(s)
+#define	GENMASK(h, l)	((~0U << (l)) & (~0U >> (31 - (h))))
+#define	__ffs(x)	((unsigned long)__builtin_ctz(x))
+#define	likely(x)	__builtin_expect(!!(x), 1)
+#define	unlikely(x)	__builtin_expect(!!(x), 0)
+#define	ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+struct radeon_cs_parser;
+
+#include "../drivers/gpu/drm/radeon/r600_reg_safe.h"
+#include "../drivers/gpu/drm/radeon/evergreen_reg_safe.h"
+#include "../drivers/gpu/drm/radeon/cayman_reg_safe.h"
+#include "../drivers/gpu/drm/radeon/radeon_reg_range.h"
+
+/* r600d.h, evergreend.h and nid.h agree on these */
+#define	PACKET3_NOP			0x10
+#define	PACKET3_SET_CONFIG_REG		0x68
+#define	PACKET3_SET_CONTEXT_REG		0x69
+#define	CONFIG_REG_START		0x00008000
+#define	CONFIG_REG_END			0x0000ac00
+#define	CONTEXT_REG_START		0x00028000
+#define	CONTEXT_REG_END			0x00029000
+
+#define	PACKET3(op, n)	((3U << 30) | (((n) & 0x3FFF) << 16) | ((op) << 8))
+#define	PACKET2		0x80000000U
+
+#define	MAX_CALLS	(1 << 16)
+#define	STREAM_MAX	(1 << 16)
+
+struct asic {
+	const char	*name;
+	const unsigned	*bm;
+	u32		 bm_size;
+	bool		 r600;		/* r600_cs_check_reg() tests the bit */
+};
+
+static const struct asic asics[] = {
+	{ "r600", r600_reg_safe_bm, ARRAY_SIZE(r600_reg_safe_bm), true },
+	{ "evergreen", evergreen_reg_safe_bm,
+	  ARRAY_SIZE(evergreen_reg_safe_bm), false },
+	{ "cayman", cayman_reg_safe_bm, ARRAY_SIZE(cayman_reg_safe_bm), false },
+};
+
+struct radeon_cs_parser {
+	const struct asic *asic;
+	const u32	*ib;
+	u32		 ndw;
+	u32		 calls[MAX_CALLS][2];
+	unsigned int	 ncalls;
+	bool		 log;
+};
+
+static struct radeon_cs_parser	old_p, new_p;
+static u32			stream[STREAM_MAX];
+static long			checks, failures;
+
+static bool
+bm_bit(const struct asic *a, u32 reg)
+{
+	return (a->bm[reg >> 7] & (1U << ((reg >> 2) & 31))) != 0;
+}
+
+static bool
+forbidden(u32 reg)
+{
+	return ((reg * 2654435761U) >> 30) == 0;
+}
+
+/*
+ * Model of r600_cs_check_reg() and evergreen_cs_handle_reg().  Only the
+ * calls for registers with their bit set or beyond the bitmap are logged,
+ * because the old r600 loop also called it for the safe ones.
+ */
+static int
+check_reg(struct radeon_cs_parser *p, u32 reg, u32 idx)
+{
+	const struct asic *a = p->asic;
+
+	if ((reg >> 7) < a->bm_size && !bm_bit(a, reg)) {
+		if (!a->r600)
+			errx(1, "%s: handler called for safe register %#x",
+			    a->name, reg);
+		return (0);
+	}
+	if (p->log) {
+		if (p->ncalls == MAX_CALLS)
+			errx(1, "too many checker calls");
+		p->calls[p->ncalls][0] = reg;
+		p->calls[p->ncalls][1] = idx;
+		p->ncalls++;
+	}
+	if ((reg >> 7) >= a->bm_size || forbidden(reg))
+		return (-EINVAL);
+	return (0);
+}
+
+/* The per register loops, as before the word walk */
+static int
+old_check_range(struct radeon_cs_parser *p, u32 start_reg, u32 end_reg,
+    u32 idx, u32 count)
+{
+	const struct asic *a = p->asic;
+	u32 reg, i;
+	int r;
+
+	if (a->r600) {
+		for (i = 0; i < count; i++) {
+			reg = start_reg + (4 * i);
+			r = check_reg(p, reg, idx + i);
+			if (r)
+				return (r);
+		}
+		return (0);
+	}
+	for (reg = start_reg; reg <= end_reg; reg += 4, idx++) {
+		/* evergreen_is_safe_reg() */
+		if ((reg >> 7) < a->bm_size && !bm_bit(a, reg))
+			continue;
+		r = check_reg(p, reg, idx);
+		if (r)
+			return (r);
+	}
+	return (0);
+}
+
+static int
+new_check_range(struct radeon_cs_parser *p, u32 start_reg, u32 end_reg,
+    u32 idx, u32 count)
+{
+	(void)count;
+	return (radeon_cs_check_reg_range(p, p->asic->bm, p->asic->bm_size,
+	    start_reg, end_reg, idx, check_reg));
+}
+
+/*
+ * The packet walk of radeon_cs_packet_parse() and the SET_*_REG cases of
+ * the packet3 checkers.  Returns the verdict, and the index of the failing
+ * packet in *fail.
+ */
+static int
+replay(struct radeon_cs_parser *p, bool old, int *fail)
+{
+	u32 idx, count, op, idx_value, start_reg, end_reg, base, end;
+	int r;
+
+	p->ncalls = 0;
+	for (idx = 0; idx < p->ndw; idx += count + 2) {
+		*fail = idx;
+		if (p->ib[idx] == PACKET2) {
+			count = (u32)-1;
+			continue;
+		}
+		if ((p->ib[idx] >> 30) != 3)
+			return (-EINVAL);
+		count = (p->ib[idx] >> 16) & 0x3FFF;
+		op = (p->ib[idx] >> 8) & 0xFF;
+		if (idx + count + 2 > p->ndw)
+			return (-EINVAL);
+		switch (op) {
+		case PACKET3_SET_CONFIG_REG:
+			base = CONFIG_REG_START;
+			end = CONFIG_REG_END;
+			break;
+		case PACKET3_SET_CONTEXT_REG:
+			base = CONTEXT_REG_START;
+			end = CONTEXT_REG_END;
+			break;
+		default:
+			continue;
+		}
+		idx_value = p->ib[idx + 1];
+		start_reg = (idx_value << 2) + base;
+		end_reg = 4 * count + start_reg - 4;
+		if (start_reg < base || start_reg >= end || end_reg >= end)
+			return (-EINVAL);
+		r = (old ? old_check_range : new_check_range)(p, start_reg,
+		    end_reg, idx + 2, count);
+		if (r)
+			return (r);
+	}
+	*fail = -1;
+	return (0);
+}
+
+static bool
+same_calls(void)
+{
+	return (old_p.ncalls == new_p.ncalls && memcmp(old_p.calls,
+	    new_p.calls, old_p.ncalls * sizeof(old_p.calls[0])) == 0);
+}
+
+/* Replays the stream on one asic, returns what the old code says */
+static int
+check_stream(const struct asic *a, u32 ndw, const char *what)
+{
+	int old_r, new_r, old_fail, new_fail;
+
+	old_p.asic = new_p.asic = a;
+	old_p.ib = new_p.ib = stream;
+	old_p.ndw = new_p.ndw = ndw;
+	old_p.log = new_p.log = true;
+	old_r = replay(&old_p, true, &old_fail);
+	new_r = replay(&new_p, false, &new_fail);
+	checks++;
+	if (old_r != new_r || old_fail != new_fail || !same_calls()) {
+		if (failures++ < 20)
+			printf("FAIL %s %s: old %d at %d after %u calls, "
+			    "new %d at %d after %u calls\n", a->name, what,
+			    old_r, old_fail, old_p.ncalls, new_r, new_fail,
+			    new_p.ncalls);
+	}
+	return (old_r);
+}
+
+static u32
+emit_regs(u32 ndw, u32 op, u32 offset, u32 count)
+{
+	u32 i;
+
+	stream[ndw++] = PACKET3(op, count);
+	stream[ndw++] = offset;
+	for (i = 0; i < count; i++)
+		stream[ndw++] = 0xdead0000 | i;
+	return (ndw);
+}
+
+/* A run of registers the model accepts, starting at or after @reg */
+static u32
+good_run(const struct asic *a, u32 start, u32 end, u32 *reg, u32 max)
+{
+	u32 r, n;
+
+	for (r = *reg; r < end && forbidden(r) && bm_bit(a, r); r += 4)
+		;
+	for (n = 0; n < max && r + 4 * n < end; n++) {
+		if (bm_bit(a, r + 4 * n) && forbidden(r + 4 * n))
+			break;
+	}
+	*reg = r;
+	(void)start;
+	return (n);
+}
+
+static void
+run_handwritten(const struct asic *a)
+{
+	u32 ndw, reg, n;
+	int r;
+
+	/* Good: the whole context space in the longest good runs */
+	ndw = 0;
+	for (reg = CONTEXT_REG_START; reg < CONTEXT_REG_END && ndw < 60000;) {
+		n = good_run(a, CONTEXT_REG_START, CONTEXT_REG_END, &reg, 256);
+		if (n == 0)
+			break;
+		ndw = emit_regs(ndw, PACKET3_SET_CONTEXT_REG,
+		    (reg - CONTEXT_REG_START) >> 2, n);
+		reg += 4 * n;
+		if (reg < CONTEXT_REG_END)
+			reg += 4;
+	}
+	stream[ndw++] = PACKET2;
+	ndw = emit_regs(ndw, PACKET3_NOP, 0, 3);
+	if ((r = check_stream(a, ndw, "good context sweep")) != 0)
+		printf("%s: good context sweep rejected: %d\n", a->name, r);
+
+	/* Good: nothing to write */
+	ndw = emit_regs(0, PACKET3_SET_CONTEXT_REG, 0, 0);
+	if ((r = check_stream(a, ndw, "empty run")) != 0)
+		printf("%s: empty run rejected: %d\n", a->name, r);
+
+	/* Bad: the whole config space, forbidden registers included */
+	ndw = emit_regs(0, PACKET3_SET_CONFIG_REG, 0,
+	    (CONFIG_REG_END - CONFIG_REG_START) >> 2);
+	check_stream(a, ndw, "config sweep");
+
+	/* Bad: runs past the end and below the start of the space */
+	ndw = emit_regs(0, PACKET3_SET_CONTEXT_REG,
+	    ((CONTEXT_REG_END - CONTEXT_REG_START) >> 2) - 2, 3);
+	if (check_stream(a, ndw, "run past the end") == 0)
+		printf("%s: run past the end accepted\n", a->name);
+	ndw = emit_regs(0, PACKET3_SET_CONTEXT_REG, 0xFFFFFFFF, 1);
+	if (check_stream(a, ndw, "wrapped offset") == 0)
+		printf("%s: wrapped offset accepted\n", a->name);
+
+	/* Bad: a forbidden register at the end of a word crossing run */
+	for (reg = CONTEXT_REG_START + 0x7c; reg < CONTEXT_REG_END; reg += 4) {
+		if (bm_bit(a, reg) && forbidden(reg) && (reg & 0x7c) < 0x10)
+			break;
+	}
+	if (reg < CONTEXT_REG_END && reg >= CONTEXT_REG_START + 0x40) {
+		ndw = emit_regs(0, PACKET3_SET_CONTEXT_REG,
+		    (reg - 0x40 - CONTEXT_REG_START) >> 2, 17);
+		if (check_stream(a, ndw, "forbidden at end") == 0)
+			printf("%s: forbidden register accepted\n", a->name);
+	}
+}
+
+static u32
+random_stream(const struct asic *a, bool mostly_good)
+{
+	u32 ndw, npkt, op, base, end, reg, n, i;
+
+	ndw = 0;
+	npkt = 1 + random() % 32;
+	for (i = 0; i < npkt && ndw < STREAM_MAX - 600; i++) {
+		switch (random() % 8) {
+		case 0:
+			stream[ndw++] = PACKET2;
+			continue;
+		case 1:
+			ndw = emit_regs(ndw, PACKET3_NOP, 0, random() % 4);
+			continue;
+		case 2:
+			op = PACKET3_SET_CONFIG_REG;
+			base = CONFIG_REG_START;
+			end = CONFIG_REG_END;
+			break;
+		default:
+			op = PACKET3_SET_CONTEXT_REG;
+			base = CONTEXT_REG_START;
+			end = CONTEXT_REG_END;
+			break;
+		}
+		reg = base + 4 * (random() % ((end - base) / 4));
+		n = random() % 4 ? 1 + random() % 48 : random() % 520;
+		if (mostly_good)
+			n = good_run(a, base, end, &reg, n);
+		if (random() % 64 == 0)
+			reg = base - 4 * (1 + random() % 8);
+		ndw = emit_regs(ndw, op, (reg - base) >> 2, n);
+	}
+	return (ndw);
+}
+
+static void
+run_test(void)
+{
+	long good, bad;
+	u32 start, end, idx, len;
+	unsigned int ai, s;
+	int old_r, new_r;
+
+	for (ai = 0; ai < ARRAY_SIZE(asics); ai++) {
+		const struct asic *a = &asics[ai];
+
+		run_handwritten(a);
+		srandom(ai + 1);
+		good = bad = 0;
+		for (s = 0; s < 20000; s++) {
+			if (check_stream(a, random_stream(a, s & 1), "random"))
+				bad++;
+			else
+				good++;
+		}
+		printf("%s: %ld known good and %ld known bad random streams\n",
+		    a->name, good, bad);
+
+		/* Straight into the walk, also beyond the bitmap */
+		old_p.asic = new_p.asic = a;
+		old_p.log = new_p.log = true;
+		for (s = 0; s < 200000; s++) {
+			start = 4 * (random() % (a->bm_size * 32 + 128));
+			len = random() % 3 ? random() % 80 : random() % 4000;
+			end = start + 4 * len - 4;
+			idx = random() % 1000;
+			old_p.ncalls = new_p.ncalls = 0;
+			old_r = old_check_range(&old_p, start, end, idx, len);
+			new_r = new_check_range(&new_p, start, end, idx, len);
+			checks++;
+			if (old_r != new_r || !same_calls()) {
+				if (failures++ < 20)
+					printf("FAIL %s walk %#x..%#x: old %d "
+					    "after %u calls, new %d after %u "
+					    "calls\n", a->name, start, end,
+					    old_r, old_p.ncalls, new_r,
+					    new_p.ncalls);
+			}
+		}
+	}
+	printf("test: %ld replays, %ld failed\n", checks, failures);
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static void
+run_bench(void)
+{
+	static const u32 runs[] = { 4, 16, 64 };
+	uint64_t start, t, best[2], nregs;
+	unsigned int ai, ri, i, k, n;
+	u32 ndw, reg;
+	int fail, which;
+
+	printf("%-10s %5s %14s %14s\n", "asic", "run", "old_regs/s",
+	    "new_regs/s");
+	for (ai = 0; ai < ARRAY_SIZE(asics); ai++) {
+		const struct asic *a = &asics[ai];
+
+		for (ri = 0; ri < ARRAY_SIZE(runs); ri++) {
+			/* Good runs of about this length all over the space */
+			srandom(ri);
+			ndw = 0;
+			nregs = 0;
+			while (ndw < STREAM_MAX - 600) {
+				reg = CONTEXT_REG_START + 4 * (random() %
+				    ((CONTEXT_REG_END - CONTEXT_REG_START) / 4));
+				n = good_run(a, CONTEXT_REG_START,
+				    CONTEXT_REG_END, &reg, runs[ri]);
+				ndw = emit_regs(ndw, PACKET3_SET_CONTEXT_REG,
+				    (reg - CONTEXT_REG_START) >> 2, n);
+				nregs += n;
+			}
+			old_p.asic = new_p.asic = a;
+			old_p.ib = new_p.ib = stream;
+			old_p.ndw = new_p.ndw = ndw;
+			old_p.log = new_p.log = false;
+			k = 200;
+			for (which = 0; which < 2; which++) {
+				/* Best of five, to keep other load out of it */
+				for (best[which] = UINT64_MAX, i = 0; i < 5;
+				    i++) {
+					start = now_ns();
+					for (n = 0; n < k; n++) {
+						if (replay(which ? &new_p :
+						    &old_p, !which, &fail))
+							errx(1, "bench stream "
+							    "rejected");
+					}
+					t = now_ns() - start;
+					if (t < best[which])
+						best[which] = t;
+				}
+			}
+			printf("%-10s %5u %14ju %14ju\n", a->name, runs[ri],
+			    (uintmax_t)(nregs * k * 1000000000 / best[0]),
+			    (uintmax_t)(nregs * k * 1000000000 / best[1]));
+		}
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	bool bench, test;
+	int ch;
+
+	bench = test = true;
+	while ((ch = getopt(argc, argv, "bt")) != -1) {
+		switch (ch) {
+		case 'b':
+			test = false;
+			break;
+		case 't':
+			bench = false;
+			break;
+		default:
+			fprintf(stderr, "usage: radeonregtest [-b | -t]\n");
+			return (1);
+		}
+	}
+
+	if (test)
+		run_test();
+	if (bench)
+		run_bench();
+
+	return (failures != 0);
+}
@@ -0,0 +1,638 @@
+/*
+ * syncfiletest - check and time the sync_file merge and fence info paths.
+ *
+ * Build with "cc -O2 -o syncfiletest syncfiletest.c" in this directory.
+ * The LinuxKPI's linuxkpi/gplv2/src/linux_sync_file_fences.h is compiled
+ * as is on top of a minimal struct dma_fence, so the test runs the ordering,
+ * merge walk and SYNC_IOC_FILE_INFO fill that sync_file_merge() and
+ * sync_file_ioctl_fence_info() run.
+ *
+ * Random pairs of sync_files are merged.  Each input is either one merge
+ * built (one fence per context, ordered by context) or a foreign array
+ * with several fences per context in any order.  Seqnos of 32-bit
+ * timelines are placed right below the wrap, 64-bit ones anywhere.  The
+ * result must hold, ordered by context, the latest unsignaled fence of
+ * every context that has one, each with one new reference, and the first
+ * fence of the first input when all signaled.  The fence info fill is
+ * checked for names, status, timestamps and the status of the whole set.
+ *
+ * Then merges per second are reported for both input kinds, next to a copy
+ * of the merge before the ordering and trimming changes, and the cost of
+ * the fence info fill per fence.  "-b" only runs the benchmark, "-t" only
+ * the test.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* What linux_sync_file_fences.h expects from the kernel */
+typedef uint32_t	u32;
+typedef uint64_t	u64;
+typedef int64_t		ktime_t;
+
+struct dma_fence;
+
+struct dma_fence_ops {
+	bool		use_64bit_seqno;
+	const char	*(*get_driver_name)(struct dma_fence *);
+	const char	*(*get_timeline_name)(struct dma_fence *);
+};
+
+struct dma_fence {
+	const struct dma_fence_ops *ops;
+	u64		context;
+	u64		seqno;
+	unsigned long	flags;
+	ktime_t		timestamp;
+	int		error;
+	/* test only */
+	long		refcount;
+	int		gen;		/* signaling order within the context */
+};
+
+enum {
+	DMA_FENCE_FLAG_SIGNALED_BIT,
+	DMA_FENCE_FLAG_TIMESTAMP_BIT,
+};
+
+/* As in uapi/linux/sync_file.h */
+struct sync_fence_info {
+	char		obj_name[32];
+	char		driver_name[32];
+	int32_t		status;
+	uint32_t	flags;
+	uint64_t	timestamp_ns;
+};
+
+#define	lower_32_bits(n)	((u32)(n))
+#define	test_bit(nr, addr)	((*(addr) >> (nr)) & 1)
+#define	cpu_relax()		do { } while (0)
+#define	ktime_to_ns(t)		(t)
+#define	ktime_set(s, ns)	((ktime_t)(s) * 1000000000 + (ns))
+#define	sort(base, num, size, cmp, swap) qsort(base, num, size, cmp)
+
+/* As in linux/dma-fence.h */
+static bool
+dma_fence_is_later(struct dma_fence *f1, struct dma_fence *f2)
+{
+
+	if (f1->ops->use_64bit_seqno)
+		return (f1->seqno > f2->seqno);
+	return ((int)(lower_32_bits(f1->seqno) -
+	    lower_32_bits(f2->seqno)) > 0);
+}
+
+static bool
+dma_fence_is_signaled(struct dma_fence *fence)
+{
+
+	return (test_bit(DMA_FENCE_FLAG_SIGNALED_BIT, &fence->flags));
+}
+
+static int
+dma_fence_get_status(struct dma_fence *fence)
+{
+
+	if (!dma_fence_is_signaled(fence))
+		return (0);
+	return (fence->error ? fence->error : 1);
+}
+
+static struct dma_fence *
+dma_fence_get(struct dma_fence *fence)
+{
+
+	fence->refcount++;
+	return (fence);
+}
+
+static size_t
+host_strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+
+	if (size > 0) {
+		if (len >= size)
+			size--;
+		else
+			size = len;
+		memcpy(dst, src, size);
+		dst[size] = '\0';
+	}
+	return (len);
+}
+#define	strlcpy		host_strlcpy
+
+#include "../linuxkpi/gplv2/src/linux_sync_file_fences.h"
+
+#define	MAX_CTX		16
+#define	MAX_GEN		8
+#define	MAX_FENCES	4096
+
+static long	checks, failures;
+
+static const char *
+driver_name(struct dma_fence *fence)
+{
+
+	return ("syncfiletest");
+}
+
+static const char *
+timeline_name(struct dma_fence *fence)
+{
+	static const char *names[] = {
+		"gfx", "sdma0", "a-timeline-name-longer-than-the-32-bytes-uapi",
+	};
+
+	return (names[fence->context % 3]);
+}
+
+static const struct dma_fence_ops ops32 = {
+	.use_64bit_seqno = false,
+	.get_driver_name = driver_name,
+	.get_timeline_name = timeline_name,
+};
+
+static const struct dma_fence_ops ops64 = {
+	.use_64bit_seqno = true,
+	.get_driver_name = driver_name,
+	.get_timeline_name = timeline_name,
+};
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static uint64_t
+rand64(void)
+{
+
+	return ((uint64_t)random() << 42 ^ (uint64_t)random() << 21 ^
+	    random());
+}
+
+/*
+ * MAX_GEN fences per context, gen k signaling after gen k - 1.  32-bit
+ * timelines start at most MAX_GEN below the wrap, and signaled fences are
+ * a prefix of each context.
+ */
+static struct dma_fence	pool[MAX_CTX][MAX_GEN];
+
+static void
+make_pool(int nctx)
+{
+	struct dma_fence *f;
+	const struct dma_fence_ops *ops;
+	uint64_t base;
+	int c, k, nsig;
+
+	for (c = 0; c < nctx; c++) {
+		ops = random() & 1 ? &ops64 : &ops32;
+		if (ops == &ops32)
+			base = (uint32_t)(0xffffffff - random() % (2 * MAX_GEN));
+		else
+			base = rand64() >> 1;
+		nsig = random() % (MAX_GEN + 1);
+		for (k = 0; k < MAX_GEN; k++) {
+			f = &pool[c][k];
+			memset(f, 0, sizeof(*f));
+			f->ops = ops;
+			f->context = 100 + 3 * c;
+			f->seqno = ops == &ops32 ? (uint32_t)(base + k) :
+			    base + k;
+			f->gen = k;
+			if (k < nsig)
+				f->flags = 1UL << DMA_FENCE_FLAG_SIGNALED_BIT;
+		}
+	}
+}
+
+/* One fence per context in context order, like merge builds them */
+static int
+make_ordered(struct dma_fence **fences, int nctx)
+{
+	int c, n;
+
+	for (n = 0, c = 0; c < nctx; c++)
+		if (random() % 3 != 0)
+			fences[n++] = &pool[c][random() % MAX_GEN];
+	if (n == 0)
+		fences[n++] = &pool[random() % nctx][random() % MAX_GEN];
+	return (n);
+}
+
+/* Any fences of any context in any order, duplicates included */
+static int
+make_foreign(struct dma_fence **fences, int nctx)
+{
+	int i, n;
+
+	n = 1 + random() % (2 * nctx * 2);
+	for (i = 0; i < n; i++)
+		fences[i] = &pool[random() % nctx][random() % MAX_GEN];
+	return (n);
+}
+
+/* get_ordered_fences(), @built as FENCES_ORDERED */
+static struct dma_fence **
+ordered(struct dma_fence **fences, int *num_fences, bool built,
+    struct dma_fence ***sorted)
+{
+
+	*sorted = NULL;
+	if (built || sync_file_fences_ordered(fences, *num_fences))
+		return (fences);
+	if ((*sorted = malloc(*num_fences * sizeof(*fences))) == NULL)
+		err(1, "malloc");
+	memcpy(*sorted, fences, *num_fences * sizeof(*fences));
+	*num_fences = sync_file_order_fences(*sorted, *num_fences);
+	return (*sorted);
+}
+
+static void
+check_merge(int nctx, bool a_foreign, bool b_foreign)
+{
+	struct dma_fence *a[4 * MAX_CTX], *b[4 * MAX_CTX], *expect[MAX_CTX];
+	struct dma_fence *latest[MAX_CTX], *out[8 * MAX_CTX];
+	struct dma_fence **a_fences, **b_fences, **a_sorted, **b_sorted;
+	struct dma_fence *f;
+	long refs;
+	int c, i, n, na, nb, nexpect;
+
+	make_pool(nctx);
+	na = a_foreign ? make_foreign(a, nctx) : make_ordered(a, nctx);
+	nb = b_foreign ? make_foreign(b, nctx) : make_ordered(b, nctx);
+
+	/* The latest fence of each context over both inputs */
+	memset(latest, 0, sizeof(latest));
+	for (i = 0; i < na + nb; i++) {
+		f = i < na ? a[i] : b[i - na];
+		c = (f->context - 100) / 3;
+		if (latest[c] == NULL || f->gen > latest[c]->gen)
+			latest[c] = f;
+	}
+	for (nexpect = 0, c = 0; c < nctx; c++)
+		if (latest[c] != NULL && !dma_fence_is_signaled(latest[c]))
+			expect[nexpect++] = latest[c];
+
+	a_fences = ordered(a, &na, !a_foreign, &a_sorted);
+	b_fences = ordered(b, &nb, !b_foreign, &b_sorted);
+	if (nexpect == 0)
+		expect[nexpect++] = a_fences[0];
+
+	n = sync_file_merge_fences(out, a_fences, na, b_fences, nb);
+
+	checks++;
+	for (refs = 0, c = 0; c < nctx; c++)
+		for (i = 0; i < MAX_GEN; i++)
+			refs += pool[c][i].refcount;
+	if (n != nexpect || memcmp(out, expect, n * sizeof(*out)) != 0 ||
+	    refs != n) {
+		if (failures++ < 20) {
+			printf("FAIL merge of %s and %s, %d contexts: got",
+			    a_foreign ? "foreign" : "ordered",
+			    b_foreign ? "foreign" : "ordered", nctx);
+			for (i = 0; i < n; i++)
+				printf(" %ju:%#jx", (uintmax_t)out[i]->context,
+				    (uintmax_t)out[i]->seqno);
+			printf(", expected");
+			for (i = 0; i < nexpect; i++)
+				printf(" %ju:%#jx",
+				    (uintmax_t)expect[i]->context,
+				    (uintmax_t)expect[i]->seqno);
+			printf(", %ld references for %d fences\n", refs, n);
+		}
+	}
+	free(a_sorted);
+	free(b_sorted);
+}
+
+static void
+check_info(int n)
+{
+	static struct dma_fence fences[64];
+	struct dma_fence *ptrs[64];
+	struct sync_fence_info info[64];
+	int expect, i, status, want;
+
+	expect = 1;
+	for (i = 0; i < n; i++) {
+		memset(&fences[i], 0, sizeof(fences[i]));
+		fences[i].ops = &ops64;
+		fences[i].context = random() % 8;
+		switch (random() % 4) {
+		case 0:
+			want = 0;
+			break;
+		case 1:
+			fences[i].error = -5;
+			want = -5;
+			break;
+		default:
+			want = 1;
+			break;
+		}
+		if (want != 0) {
+			fences[i].flags = 1UL << DMA_FENCE_FLAG_SIGNALED_BIT |
+			    1UL << DMA_FENCE_FLAG_TIMESTAMP_BIT;
+			fences[i].timestamp = 1000 + i;
+		}
+		fences[i].gen = want;
+		ptrs[i] = &fences[i];
+		if (expect > 0)
+			expect = want;
+	}
+	memset(info, 0xa5, sizeof(info));
+	status = sync_file_fill_info(ptrs, n, info);
+
+	checks++;
+	if (status != expect && failures++ < 20)
+		printf("FAIL fence info of %d fences: status %d, expected %d\n",
+		    n, status, expect);
+	for (i = 0; i < n; i++) {
+		checks++;
+		if (info[i].status == fences[i].gen &&
+		    info[i].timestamp_ns == (uint64_t)(fences[i].gen ?
+		    1000 + i : 0) &&
+		    strcmp(info[i].driver_name, "syncfiletest") == 0 &&
+		    strncmp(info[i].obj_name, timeline_name(&fences[i]),
+		    sizeof(info[i].obj_name) - 1) == 0 &&
+		    strlen(info[i].obj_name) < sizeof(info[i].obj_name))
+			continue;
+		if (failures++ < 20)
+			printf("FAIL fence info %d of %d: status %d ts %ju "
+			    "name %.32s/%.32s\n", i, n, info[i].status,
+			    (uintmax_t)info[i].timestamp_ns,
+			    info[i].driver_name, info[i].obj_name);
+	}
+}
+
+static void
+run_test(void)
+{
+	int i, nctx;
+
+	srandom(1);
+	for (i = 0; i < 200000; i++) {
+		nctx = 1 + random() % MAX_CTX;
+		check_merge(nctx, random() & 1, random() & 1);
+	}
+	for (i = 0; i < 20000; i++)
+		check_info(1 + random() % 64);
+
+	printf("test: %ld checks, %ld failed\n", checks, failures);
+}
+
+/*
+ * Benchmark
+ */
+static void
+old_add_fence(struct dma_fence **fences, int *i, struct dma_fence *fence)
+{
+
+	fences[*i] = fence;
+	if (!dma_fence_is_signaled(fence)) {
+		dma_fence_get(fence);
+		(*i)++;
+	}
+}
+
+/* sync_file_merge() before the ordering and trimming changes */
+static struct dma_fence **
+old_merge(struct dma_fence **a_fences, int a_num_fences,
+    struct dma_fence **b_fences, int b_num_fences, int *num)
+{
+	struct dma_fence **fences, **nfences;
+	int i, i_a, i_b, num_fences;
+
+	num_fences = a_num_fences + b_num_fences;
+	if ((fences = calloc(num_fences, sizeof(*fences))) == NULL)
+		err(1, "calloc");
+
+	for (i = i_a = i_b = 0; i_a < a_num_fences && i_b < b_num_fences; ) {
+		struct dma_fence *pt_a = a_fences[i_a];
+		struct dma_fence *pt_b = b_fences[i_b];
+
+		if (pt_a->context < pt_b->context) {
+			old_add_fence(fences, &i, pt_a);
+			i_a++;
+		} else if (pt_a->context > pt_b->context) {
+			old_add_fence(fences, &i, pt_b);
+			i_b++;
+		} else {
+			if (pt_a->seqno - pt_b->seqno <= INT_MAX)
+				old_add_fence(fences, &i, pt_a);
+			else
+				old_add_fence(fences, &i, pt_b);
+			i_a++;
+			i_b++;
+		}
+	}
+	for (; i_a < a_num_fences; i_a++)
+		old_add_fence(fences, &i, a_fences[i_a]);
+	for (; i_b < b_num_fences; i_b++)
+		old_add_fence(fences, &i, b_fences[i_b]);
+	if (i == 0)
+		fences[i++] = dma_fence_get(a_fences[0]);
+
+	if (num_fences > i) {
+		nfences = realloc(fences, i * sizeof(*fences));
+		if (nfences == NULL)
+			err(1, "realloc");
+		fences = nfences;
+	}
+	*num = i;
+	return (fences);
+}
+
+/* sync_file_merge() of a merged sync_file with @b */
+static struct dma_fence **
+merge(struct dma_fence **a, int a_num_fences, struct dma_fence **b,
+    int b_num_fences, bool b_built, int *num)
+{
+	struct dma_fence **fences, **nfences, **a_fences, **b_fences;
+	struct dma_fence **a_sorted, **b_sorted;
+	int i, num_fences;
+
+	a_fences = ordered(a, &a_num_fences, true, &a_sorted);
+	b_fences = ordered(b, &b_num_fences, b_built, &b_sorted);
+	num_fences = a_num_fences + b_num_fences;
+	if ((fences = calloc(num_fences, sizeof(*fences))) == NULL)
+		err(1, "calloc");
+	i = sync_file_merge_fences(fences, a_fences, a_num_fences,
+	    b_fences, b_num_fences);
+	if (i > 1 && i <= num_fences / 2) {
+		nfences = realloc(fences, i * sizeof(*fences));
+		if (nfences != NULL)
+			fences = nfences;
+	}
+	free(a_sorted);
+	free(b_sorted);
+	*num = i;
+	return (fences);
+}
+
+static struct dma_fence **
+new_merge(struct dma_fence **a, int a_num_fences, struct dma_fence **b,
+    int b_num_fences, int *num)
+{
+
+	return (merge(a, a_num_fences, b, b_num_fences, true, num));
+}
+
+static struct dma_fence **
+foreign_merge(struct dma_fence **a, int a_num_fences, struct dma_fence **b,
+    int b_num_fences, int *num)
+{
+
+	return (merge(a, a_num_fences, b, b_num_fences, false, num));
+}
+
+typedef struct dma_fence **(*merge_fn)(struct dma_fence **, int,
+    struct dma_fence **, int, int *);
+
+/* Best of five, in merges per second */
+static uint64_t
+time_merge(merge_fn merge, struct dma_fence **a, struct dma_fence **b,
+    int n)
+{
+	struct dma_fence **out;
+	uint64_t best, start, t;
+	int i, iters, num, r;
+
+	iters = 1 + (4 << 20) / n;
+	for (best = UINT64_MAX, r = 0; r < 5; r++) {
+		start = now_ns();
+		for (i = 0; i < iters; i++) {
+			out = merge(a, n, b, n, &num);
+			free(out);
+		}
+		t = now_ns() - start;
+		if (t < best)
+			best = t;
+	}
+	return (best ? (uint64_t)iters * 1000000000 / best : 0);
+}
+
+static void
+run_bench(void)
+{
+	static const int sizes[] = { 1, 8, 64, 512, 4096 };
+	static struct dma_fence fa[MAX_FENCES], fb[MAX_FENCES];
+	static struct dma_fence *a[MAX_FENCES], *b[MAX_FENCES];
+	static struct sync_fence_info info[MAX_FENCES];
+	struct dma_fence *tmp;
+	uint64_t best, start, t;
+	unsigned int s;
+	int i, iters, j, n, r, sig;
+
+	/*
+	 * Two sync_files with the same contexts, b one frame later, as a
+	 * pipeline merging per frame sees them.
+	 */
+	printf("%6s %4s %12s %12s %12s\n", "fences", "sig%", "old_merge/s",
+	    "new_merge/s", "foreign/s");
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		n = sizes[s];
+		for (sig = 0; sig <= 50; sig += 50) {
+			for (i = 0; i < n; i++) {
+				memset(&fa[i], 0, sizeof(fa[i]));
+				fa[i].ops = &ops64;
+				fa[i].context = 1000 + i;
+				fa[i].seqno = 7;
+				if (i * 100 < sig * n)
+					fa[i].flags = 1UL <<
+					    DMA_FENCE_FLAG_SIGNALED_BIT;
+				fb[i] = fa[i];
+				fb[i].seqno = 8;
+				fb[i].flags = 0;
+				a[i] = &fa[i];
+				b[i] = &fb[i];
+			}
+			printf("%6d %4d %12ju %12ju", n, sig,
+			    (uintmax_t)time_merge(old_merge, a, b, n),
+			    (uintmax_t)time_merge(new_merge, a, b, n));
+
+			/* b wrapped by another driver, in reverse order */
+			for (i = 0, j = n - 1; i < j; i++, j--) {
+				tmp = b[i];
+				b[i] = b[j];
+				b[j] = tmp;
+			}
+			printf(" %12ju\n",
+			    (uintmax_t)(n > 1 ? time_merge(foreign_merge, a, b, n) :
+			    0));
+		}
+	}
+
+	printf("%6s %12s\n", "fences", "info_ns/fence");
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		n = sizes[s];
+		for (i = 0; i < n; i++) {
+			memset(&fa[i], 0, sizeof(fa[i]));
+			fa[i].ops = &ops64;
+			fa[i].context = i;
+			if (i & 1) {
+				fa[i].flags = 1UL <<
+				    DMA_FENCE_FLAG_SIGNALED_BIT |
+				    1UL << DMA_FENCE_FLAG_TIMESTAMP_BIT;
+				fa[i].timestamp = i;
+			}
+			a[i] = &fa[i];
+		}
+		iters = 1 + (4 << 20) / n;
+		for (best = UINT64_MAX, r = 0; r < 5; r++) {
+			start = now_ns();
+			for (i = 0; i < iters; i++)
+				sync_file_fill_info(a, n, info);
+			t = now_ns() - start;
+			if (t < best)
+				best = t;
+		}
+		printf("%6d %12.1f\n", n, (double)best / iters / n);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	bool bench, test;
+	int ch;
+
+	bench = test = true;
+	while ((ch = getopt(argc, argv, "bt")) != -1) {
+		switch (ch) {
+		case 'b':
+			test = false;
+			break;
+		case 't':
+			bench = false;
+			break;
+		default:
+			fprintf(stderr, "usage: syncfiletest [-b | -t]\n");
+			return (1);
+		}
+	}
+
+	if (test)
+		run_test();
+	if (bench)
+		run_bench();
+
+	return (failures != 0);
+}
@@ -0,0 +1,251 @@
+/*
+ * vmwblittest - check and time the vmwgfx dirty-rect difference finders.
+ *
+ * Build with "cc -O2 -mgeneral-regs-only -o vmwblittest vmwblittest.c" in
+ * this directory.  The kernel's drivers/gpu/drm/vmwgfx/vmwgfx_blit_diff.h
+ * is compiled as is, so the test runs the code vmw_diff_memcpy() runs.
+ * Like the kernel, the compiler must not use vector registers itself: the
+ * SSE2 kernels clobber them without telling it.
+ *
+ * Every pixel aligned dst/src offset within 16 bytes, every tail length
+ * around the SSE2 threshold and around a page, granularities 1, 2 and 4
+ * and a set of difference patterns are run through the integer loops and
+ * through the SSE2 kernels.  Both must report the same first and last pixel
+ * as a byte by byte reference.  Then the throughput of both paths is
+ * reported for the span sizes a screen update sees.  "-b" only runs the
+ * benchmark, "-t" only the test.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* What vmwgfx_blit_diff.h expects from the kernel */
+typedef uint8_t		u8;
+typedef uint16_t	u16;
+typedef uint32_t	u32;
+typedef uint64_t	u64;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define	CONFIG_X86
+#endif
+#ifdef __LP64__
+#define	CONFIG_64BIT
+#endif
+
+#define	__round_mask(x, y)	((__typeof__(x))((y) - 1))
+#define	round_down(x, y)	((x) & ~__round_mask(x, y))
+#define	__ffs(x)		((unsigned long)__builtin_ctzl(x))
+#define	fls(x)			((x) ? 32 - __builtin_clz(x) : 0)
+#define	kernel_fpu_begin()	do { } while (0)
+#define	kernel_fpu_end()	do { } while (0)
+
+static bool	host_sse2;
+#define	VMW_HAS_SSE2()		(host_sse2)
+
+#include "../drivers/gpu/drm/vmwgfx/vmwgfx_blit_diff.h"
+
+#ifndef VMW_SIMD_DIFF_MIN
+#define	VMW_SIMD_DIFF_MIN	256
+#endif
+
+#define	SPAN_MAX	(4096 + 16)
+#define	ALIGN_MAX	16
+
+static u8	dst_buf[SPAN_MAX + ALIGN_MAX], src_buf[SPAN_MAX + ALIGN_MAX];
+static long	checks, failures;
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/* Pixel index of the first and last difference, as vmw_adjust_rect() sees */
+static void
+find_pixels(const u8 *dst, const u8 *src, size_t size, size_t gran,
+    bool sse2, long *first, long *last)
+{
+	size_t offs;
+	ssize_t loc;
+
+	host_sse2 = sse2;
+	offs = vmw_find_first_diff(dst, src, size, gran);
+	*first = offs < size ? (long)(offs / gran) : -1;
+	if (*first < 0) {
+		*last = -1;
+		return;
+	}
+	/* vmw_diff_memcpy() searches backwards from the first difference */
+	offs = round_down(offs, gran);
+	loc = vmw_find_last_diff(dst + offs, src + offs, size - offs, gran);
+	*last = loc < 0 ? *first : (long)((offs + loc) / gran);
+}
+
+static void
+check_case(size_t dalign, size_t salign, size_t size, size_t gran,
+    const size_t *pos, int npos)
+{
+	const u8 *dst = dst_buf + dalign, *src = src_buf + salign;
+	long ref_first, ref_last, first, last;
+	int i, sse2;
+
+	ref_first = ref_last = -1;
+	for (i = 0; i < npos; i++) {
+		src_buf[salign + pos[i]] ^= 0x81;
+		if (ref_first < 0 || (long)(pos[i] / gran) < ref_first)
+			ref_first = pos[i] / gran;
+		if ((long)(pos[i] / gran) > ref_last)
+			ref_last = pos[i] / gran;
+	}
+	/* Garbage just outside the span must not be seen */
+	if (salign > 0)
+		src_buf[salign - 1] ^= 0xff;
+	src_buf[salign + size] ^= 0xff;
+
+	for (sse2 = 0; sse2 < 2; sse2++) {
+		find_pixels(dst, src, size, gran, sse2, &first, &last);
+		checks++;
+		if (first != ref_first || last != ref_last) {
+			if (failures++ < 20)
+				printf("FAIL %s: dst+%zu src+%zu size %zu "
+				    "gran %zu: pixels %ld..%ld, expected "
+				    "%ld..%ld\n", sse2 ? "sse2" : "int",
+				    dalign, salign, size, gran, first, last,
+				    ref_first, ref_last);
+		}
+	}
+
+	for (i = 0; i < npos; i++)
+		src_buf[salign + pos[i]] ^= 0x81;
+	if (salign > 0)
+		src_buf[salign - 1] ^= 0xff;
+	src_buf[salign + size] ^= 0xff;
+}
+
+static void
+run_test(void)
+{
+	static const size_t grans[] = { 1, 2, 4 };
+	size_t dalign, salign, size, gran, pos[2], p;
+	unsigned int g;
+
+	memset(dst_buf, 0x5a, sizeof(dst_buf));
+	memset(src_buf, 0x5a, sizeof(src_buf));
+	for (g = 0; g < sizeof(grans) / sizeof(grans[0]); g++) {
+		gran = grans[g];
+		for (size = 0; size < SPAN_MAX; size += gran) {
+			/* Up to past the SSE2 threshold, then around a page */
+			if (size == VMW_SIMD_DIFF_MIN + 32)
+				size = 4096 - 16;
+			/* Pixels never straddle the start of a span */
+			for (dalign = 0; dalign < ALIGN_MAX; dalign += gran) {
+				for (salign = 0; salign < ALIGN_MAX;
+				    salign += gran) {
+					check_case(dalign, salign, size, gran,
+					    NULL, 0);
+					if (size == 0)
+						continue;
+					/* Single differences near both ends */
+					for (p = 0; p < 32 && p < size; p++) {
+						pos[0] = p;
+						check_case(dalign, salign,
+						    size, gran, pos, 1);
+						pos[0] = size - 1 - p;
+						check_case(dalign, salign,
+						    size, gran, pos, 1);
+					}
+					if (size < 4)
+						continue;
+					pos[0] = size / 2;
+					pos[1] = size / 2 + size / 4;
+					check_case(dalign, salign, size, gran,
+					    pos, 2);
+				}
+			}
+		}
+	}
+
+	printf("test: %ld checks, %ld failed\n", checks, failures);
+}
+
+static void
+run_bench(void)
+{
+	static const size_t sizes[] = { 256, 1024, 4096 };
+	volatile long sink;
+	long first, last;
+	uint64_t start, t, elapsed[2];
+	unsigned int s, n, i, r;
+	int sse2;
+
+	memset(dst_buf, 0x5a, sizeof(dst_buf));
+	memset(src_buf, 0x5a, sizeof(src_buf));
+
+	/* Unchanged spans are the common case and need a full scan */
+	printf("%6s %12s %12s\n", "bytes", "int_MB/s", "sse2_MB/s");
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		n = (64 << 20) / sizes[s];
+		for (sse2 = 0; sse2 < 2; sse2++) {
+			/* Best of five, to keep other load out of it */
+			for (elapsed[sse2] = UINT64_MAX, r = 0; r < 5; r++) {
+				start = now_ns();
+				for (i = 0; i < n; i++) {
+					find_pixels(dst_buf, src_buf, sizes[s],
+					    4, sse2, &first, &last);
+					sink = first;
+				}
+				t = now_ns() - start;
+				if (t < elapsed[sse2])
+					elapsed[sse2] = t;
+			}
+		}
+		(void)sink;
+		printf("%6zu %12ju %12ju\n", sizes[s],
+		    (uintmax_t)((uint64_t)n * sizes[s] * 1000 / elapsed[0]),
+		    (uintmax_t)((uint64_t)n * sizes[s] * 1000 / elapsed[1]));
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	bool bench, test;
+	int ch;
+
+	bench = test = true;
+	while ((ch = getopt(argc, argv, "bt")) != -1) {
+		switch (ch) {
+		case 'b':
+			test = false;
+			break;
+		case 't':
+			bench = false;
+			break;
+		default:
+			fprintf(stderr, "usage: vmwblittest [-b | -t]\n");
+			return (1);
+		}
+	}
+
+#ifndef CONFIG_X86
+	printf("no SSE2 kernels on this architecture, "
+	    "checking the integer loops only\n");
+#endif
+	if (test)
+		run_test();
+	if (bench)
+		run_bench();
+
+	return (failures != 0);
+}
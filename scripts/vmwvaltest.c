@@ -0,0 +1,390 @@
+/*
+ * vmwvaltest - check and time the vmwgfx validation duplicate table.
+ *
+ * Build with "cc -O2 -o vmwvaltest vmwvaltest.c" in this directory.  The
+ * kernel's drivers/gpu/drm/vmwgfx/vmwgfx_validation_dup.h is compiled as
+ * is.  It is run against a copy of what the validation code used before:
+ * a 4096 bucket drm_open_hash with the hash item embedded in each node and
+ * every item removed again at the end of the submission.
+ *
+ * A submission registers each of a number of buffer objects several times
+ * in random order, the way execbuf sees relocations and resource
+ * references: a lookup, and on a miss a node from the submission's pages
+ * and an insert.  Both tables must agree on every lookup.  The old path
+ * also gets a zeroed page from the allocator for every page of nodes and
+ * frees it afterwards; the new one takes the pages from the arena and
+ * clears the used bytes.  malloc() is not the page allocator, so that part
+ * only shows the order of the cost.
+ *
+ * "-l" hashes the old table with the LinuxKPI hash_long() of this tree
+ * instead of Linux' one, which puts every key in bucket 0 on 64-bit hosts.
+ * "-b" only runs the benchmark, "-t" only the test.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* What vmwgfx_validation_dup.h expects from the kernel */
+typedef uint32_t	u32;
+typedef uint64_t	u64;
+
+#ifdef __LP64__
+#define	BITS_PER_LONG	64
+#else
+#define	BITS_PER_LONG	32
+#endif
+#define	GFP_KERNEL	0
+#define	kvcalloc(n, size, gfp)	calloc(n, size)
+#define	kvfree(p)		free(p)
+
+#include "../drivers/gpu/drm/vmwgfx/vmwgfx_validation_dup.h"
+
+#define	PAGE_SIZE	4096
+#define	OLD_HT_ORDER	12	/* VMW_RES_HT_ORDER */
+#define	ARENA_PAGES	16	/* VMWGFX_VALIDATION_ARENA_PAGES */
+#define	REFS_PER_OBJ	4
+#define	OBJ_SIZE	640	/* about a vmw_buffer_object */
+
+/* drm_open_hash as drm_hashtab.c implements it, without the RCU */
+struct hlist_node {
+	struct hlist_node *next, **pprev;
+};
+
+struct ht_item {
+	struct hlist_node head;
+	unsigned long key;
+};
+
+struct old_node {
+	char base[48];		/* struct ttm_validate_buffer */
+	struct ht_item hash;
+	u32 flags;
+};
+
+struct new_node {
+	char base[48];
+	u32 flags;
+};
+
+static struct hlist_node	*old_table[1 << OLD_HT_ORDER];
+static bool			linuxkpi_hash;
+
+static unsigned int
+old_hash(unsigned long key)
+{
+	const unsigned char *p = (const unsigned char *)&key;
+	uint32_t h = OLD_HT_ORDER;
+	size_t i;
+
+	if (!linuxkpi_hash)
+		return (vmw_validation_dup_hash(key, OLD_HT_ORDER));
+	/* hash32_buf() followed by the shift of LinuxKPI hash_64() */
+	for (i = 0; i < sizeof(key); i++)
+		h = (h << 5) + h + p[i];
+	return ((uint64_t)h >> (BITS_PER_LONG - OLD_HT_ORDER));
+}
+
+static struct ht_item *
+old_find(unsigned long key)
+{
+	struct hlist_node *n;
+	struct ht_item *e;
+
+	for (n = old_table[old_hash(key)]; n != NULL; n = n->next) {
+		e = (struct ht_item *)n;
+		if (e->key == key)
+			return (e);
+		if (e->key > key)
+			break;
+	}
+	return (NULL);
+}
+
+static int
+old_insert(struct ht_item *item)
+{
+	struct hlist_node **link, *n;
+	struct ht_item *e;
+
+	link = &old_table[old_hash(item->key)];
+	for (n = *link; n != NULL; link = &n->next, n = n->next) {
+		e = (struct ht_item *)n;
+		if (e->key == item->key)
+			return (-EINVAL);
+		if (e->key > item->key)
+			break;
+	}
+	item->head.next = n;
+	item->head.pprev = link;
+	if (n != NULL)
+		n->pprev = &item->head.next;
+	*link = &item->head;
+	return (0);
+}
+
+static void
+old_remove(struct ht_item *item)
+{
+	*item->head.pprev = item->head.next;
+	if (item->head.next != NULL)
+		item->head.next->pprev = item->head.pprev;
+}
+
+/* Page backed bump allocator, as vmw_validation_mem_alloc() */
+struct submission {
+	void	*pages[256];
+	int	 npages;
+	size_t	 left;
+	char	*cur;
+	void	*cache[ARENA_PAGES];
+	int	 ncache;
+};
+
+static void *
+sub_alloc(struct submission *s, size_t size, bool arena)
+{
+	void *p;
+
+	if (s->left < size) {
+		if (s->npages == 256)
+			errx(1, "submission too large");
+		if (arena && s->ncache > 0)
+			p = s->cache[--s->ncache];
+		else if ((p = aligned_alloc(PAGE_SIZE, PAGE_SIZE)) == NULL)
+			err(1, "aligned_alloc");
+		else
+			memset(p, 0, PAGE_SIZE);
+		s->pages[s->npages++] = p;
+		s->cur = p;
+		s->left = PAGE_SIZE;
+	}
+	p = s->cur;
+	s->cur += size;
+	s->left -= size;
+	return (p);
+}
+
+static void
+sub_free(struct submission *s, bool arena)
+{
+	int i;
+
+	for (i = 0; i < s->npages; i++) {
+		if (arena && s->ncache < ARENA_PAGES) {
+			/* vmw_validation_put_page() */
+			memset(s->pages[i], 0, i == s->npages - 1 ?
+			    PAGE_SIZE - s->left : PAGE_SIZE);
+			s->cache[s->ncache++] = s->pages[i];
+		} else
+			free(s->pages[i]);
+	}
+	s->npages = 0;
+	s->left = 0;
+}
+
+static u64
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((u64)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static unsigned long	*objs;
+static unsigned int	*refs;
+static struct old_node	**old_nodes;
+static struct submission old_sub, new_sub;
+static struct vmw_validation_dup_table dups;
+static long		checks, failures;
+
+static void
+setup(unsigned int nobjs, unsigned int seed)
+{
+	unsigned int i, j, t, nrefs;
+
+	nrefs = nobjs * REFS_PER_OBJ;
+	objs = realloc(objs, nobjs * sizeof(*objs));
+	refs = realloc(refs, nrefs * sizeof(*refs));
+	old_nodes = realloc(old_nodes, nobjs * sizeof(*old_nodes));
+	if (objs == NULL || refs == NULL || old_nodes == NULL)
+		err(1, "realloc");
+	/* Object addresses as the slab hands them out: spaced, in one run */
+	for (i = 0; i < nobjs; i++)
+		objs[i] = 0xfffff80012340000UL + (unsigned long)i * OBJ_SIZE;
+	srandom(seed);
+	for (i = 0; i < nrefs; i++)
+		refs[i] = i % nobjs;
+	for (i = nrefs - 1; i > 0; i--) {
+		j = random() % (i + 1);
+		t = refs[i];
+		refs[i] = refs[j];
+		refs[j] = t;
+	}
+}
+
+static void
+run_old(unsigned int nobjs, bool check)
+{
+	struct old_node *node;
+	struct ht_item *hash;
+	unsigned int i, n, nrefs;
+
+	nrefs = nobjs * REFS_PER_OBJ;
+	for (i = 0, n = 0; i < nrefs; i++) {
+		hash = old_find(objs[refs[i]]);
+		if (check && (hash != NULL) != (vmw_validation_dup_find(&dups,
+		    objs[refs[i]]) != NULL)) {
+			if (failures++ < 20)
+				printf("FAIL %u objects: lookup %u of %#lx "
+				    "disagrees\n", nobjs, i, objs[refs[i]]);
+		}
+		if (check)
+			checks++;
+		if (hash != NULL)
+			continue;
+		node = sub_alloc(&old_sub, sizeof(*node), false);
+		node->hash.key = objs[refs[i]];
+		if (old_insert(&node->hash) != 0)
+			errx(1, "old insert failed");
+		old_nodes[n++] = node;
+		if (check &&
+		    vmw_validation_dup_insert(&dups, node->hash.key, node) != 0)
+			errx(1, "dup insert failed");
+	}
+	if (n != nobjs)
+		errx(1, "%u nodes for %u objects", n, nobjs);
+	/* vmw_validation_drop_ht() walked the lists removing each item */
+	for (i = 0; i < n; i++)
+		old_remove(&old_nodes[i]->hash);
+	sub_free(&old_sub, false);
+	if (check)
+		vmw_validation_dup_reset(&dups);
+}
+
+static void
+run_new(unsigned int nobjs)
+{
+	struct new_node *node;
+	unsigned int i, nrefs;
+
+	nrefs = nobjs * REFS_PER_OBJ;
+	for (i = 0; i < nrefs; i++) {
+		if (vmw_validation_dup_find(&dups, objs[refs[i]]) != NULL)
+			continue;
+		node = sub_alloc(&new_sub, sizeof(*node), true);
+		if (vmw_validation_dup_insert(&dups, objs[refs[i]], node) != 0)
+			errx(1, "dup insert failed");
+	}
+	if (dups.count != nobjs)
+		errx(1, "%u entries for %u objects", dups.count, nobjs);
+	vmw_validation_dup_reset(&dups);
+	sub_free(&new_sub, true);
+}
+
+static void
+run_test(void)
+{
+	unsigned int nobjs, round;
+
+	for (nobjs = 1; nobjs <= 5000; nobjs += nobjs < 80 ? 1 : nobjs / 7) {
+		for (round = 0; round < 3; round++) {
+			setup(nobjs, nobjs * 3 + round);
+			run_old(nobjs, true);
+			/* Emptied for the next submission, and sized to it */
+			if (dups.count != 0 || (dups.entries != NULL &&
+			    dups.order > VMW_VALIDATION_DUP_MIN_ORDER &&
+			    (1U << dups.order) > 32 * nobjs + 64)) {
+				if (failures++ < 20)
+					printf("FAIL %u objects: %u entries "
+					    "left, order %u after reset\n",
+					    nobjs, dups.count, dups.order);
+			}
+		}
+	}
+	printf("test: %ld lookups, %ld failed\n", checks, failures);
+}
+
+static void
+run_bench(void)
+{
+	static const unsigned int sizes[] = { 4, 16, 64, 256, 1024, 4096 };
+	u64 start, t, best[2];
+	unsigned int s, i, n, r;
+	int which;
+
+	printf("%7s %12s %12s %12s %12s\n", "objects", "old_ns/sub",
+	    "new_ns/sub", "old_ns/ref", "new_ns/ref");
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		setup(sizes[s], sizes[s]);
+		n = (4 << 20) / (sizes[s] * REFS_PER_OBJ);
+		if (linuxkpi_hash && sizes[s] > 64)
+			n = n / (sizes[s] / 64) + 1;
+		/* Warm the arena and the table like a running client */
+		run_new(sizes[s]);
+		for (which = 0; which < 2; which++) {
+			/* Best of five, to keep other load out of it */
+			for (best[which] = UINT64_MAX, r = 0; r < 5; r++) {
+				start = now_ns();
+				for (i = 0; i < n; i++) {
+					if (which == 0)
+						run_old(sizes[s], false);
+					else
+						run_new(sizes[s]);
+				}
+				t = (now_ns() - start) / n;
+				if (t < best[which])
+					best[which] = t;
+			}
+		}
+		printf("%7u %12ju %12ju %12.1f %12.1f\n", sizes[s],
+		    (uintmax_t)best[0], (uintmax_t)best[1],
+		    (double)best[0] / (sizes[s] * REFS_PER_OBJ),
+		    (double)best[1] / (sizes[s] * REFS_PER_OBJ));
+	}
+	printf("dup table: %ju lookups, %ju hits, %ju resizes\n",
+	    (uintmax_t)dups.num_lookups, (uintmax_t)dups.num_hits,
+	    (uintmax_t)dups.num_resizes);
+}
+
+int
+main(int argc, char **argv)
+{
+	bool bench, test;
+	int ch;
+
+	bench = test = true;
+	while ((ch = getopt(argc, argv, "blt")) != -1) {
+		switch (ch) {
+		case 'b':
+			test = false;
+			break;
+		case 'l':
+			linuxkpi_hash = true;
+			break;
+		case 't':
+			bench = false;
+			break;
+		default:
+			fprintf(stderr, "usage: vmwvaltest [-l] [-b | -t]\n");
+			return (1);
+		}
+	}
+
+	if (test)
+		run_test();
+	if (bench)
+		run_bench();
+	vmw_validation_dup_fini(&dups);
+
+	return (failures != 0);
+}